@@ -21,14 +21,16 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokani.h"
+#include "dokan_readahead.h"
+#include "dokan_writebehind.h"
 
 VOID DispatchCleanup(PDOKAN_IO_EVENT IoEvent) {
   CheckFileName(IoEvent->EventContext->Operation.Cleanup.FileName);
 
-  CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+  CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/TRUE);
 
-  IoEvent->EventResult->Status = STATUS_SUCCESS; // return success at any case
+  // Success unless the buffered writes of the open failed.
+  IoEvent->EventResult->Status = STATUS_SUCCESS;
 
   DbgPrint("###Cleanup file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
            IoEvent->DokanOpenInfo,
@@ -36,6 +38,15 @@ VOID DispatchCleanup(PDOKAN_IO_EVENT IoEvent) {
                                           : -1,
            IoEvent);
 
+  if (IoEvent->DokanOpenInfo) {
+    // Reads after cleanup, like paging reads, are not sequential reads.
+    DokanReadAhead_Stop(IoEvent->DokanOpenInfo);
+    // The backend usually closes its handle in Cleanup. A write error no
+    // later event of the open can return is returned by the cleanup.
+    IoEvent->EventResult->Status =
+        DokanWriteBehind_Cleanup(IoEvent->DokanOpenInfo);
+  }
+
   if (IoEvent->DokanInstance->DokanOperations->Cleanup) {
     // ignore return value
     IoEvent->DokanInstance->DokanOperations->Cleanup(
@@ -43,5 +54,14 @@ VOID DispatchCleanup(PDOKAN_IO_EVENT IoEvent) {
         &IoEvent->DokanFileInfo);
   }
 
+  if (IoEvent->DokanFileInfo.DeleteOnClose) {
+    // The backend deletes the file in Cleanup.
+    InvalidateFileInfoCache(IoEvent->DokanInstance,
+                            IoEvent->EventContext->Operation.Cleanup.FileName);
+    InvalidateDirectoryListCache(
+        IoEvent->DokanInstance,
+        IoEvent->EventContext->Operation.Cleanup.FileName);
+  }
+
   EventCompletion(IoEvent);
 }
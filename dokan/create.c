@@ -22,6 +22,8 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 #include "dokan_pool.h"
+#include "dokan_readahead.h"
+#include "dokan_writebehind.h"
 
 #include <assert.h>
 
@@ -90,6 +92,55 @@ VOID SetIOSecurityContext(PEVENT_CONTEXT EventContext,
       EventContext->Operation.Create.SecurityContext.DesiredAccess;
 }
 
+VOID InitializeNegativeLookupCache(PDOKAN_INSTANCE DokanInstance) {
+  if (!DokanNameCache_Initialize(
+          &DokanInstance->NegativeLookupCache,
+          DOKAN_NEGATIVE_LOOKUP_CACHE_SIZE, /*PayloadSize=*/0,
+          DokanInstance->DokanOptions->NegativeLookupCacheTtlMs,
+          /*MaxMemory=*/0,
+          DokanInstance->DokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE,
+          /*CopyPayload=*/NULL, /*FreePayload=*/NULL)) {
+    DbgPrintW(L"Dokan Warning: Failed to allocate the negative lookup "
+              L"cache.\n");
+  }
+}
+
+VOID FreeNegativeLookupCache(PDOKAN_INSTANCE DokanInstance) {
+  DokanNameCache_Free(&DokanInstance->NegativeLookupCache);
+}
+
+// Returns whether FileName was recently not found. Otherwise Generation
+// receives the generation of its entry to give to InsertNegativeLookupCache.
+static BOOL LookupNegativeLookupCache(PDOKAN_INSTANCE DokanInstance,
+                                      LPCWSTR FileName, PLONG64 Generation) {
+  BOOL found = DokanNameCache_Lookup(&DokanInstance->NegativeLookupCache,
+                                     FileName, (ULONG)wcslen(FileName),
+                                     /*Destination=*/NULL, Generation);
+  if (found) {
+    RecordNegativeLookupCacheHit(DokanInstance);
+  }
+  return found;
+}
+
+// Records that FileName was not found, unless its entry was invalidated
+// since Generation was read before calling the backend.
+static VOID InsertNegativeLookupCache(PDOKAN_INSTANCE DokanInstance,
+                                      LPCWSTR FileName, LONG64 Generation) {
+  DokanNameCache_Insert(&DokanInstance->NegativeLookupCache, FileName,
+                        (ULONG)wcslen(FileName), /*Payload=*/NULL,
+                        /*Memory=*/0, Generation);
+}
+
+VOID InvalidateNegativeLookupCache(PDOKAN_INSTANCE DokanInstance,
+                                   LPCWSTR FileName) {
+  DokanNameCache_Invalidate(&DokanInstance->NegativeLookupCache, FileName,
+                            (ULONG)wcslen(FileName));
+}
+
+VOID ClearNegativeLookupCache(PDOKAN_INSTANCE DokanInstance) {
+  DokanNameCache_Clear(&DokanInstance->NegativeLookupCache);
+}
+
 BOOL CreateSuccesStatusCheck(NTSTATUS status, ULONG disposition) {
   if (NT_SUCCESS(status))
     return TRUE;
@@ -121,8 +172,10 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
 
   CheckFileName(fileName);
 
-  CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+  CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/TRUE);
+
+  // The open can overwrite or check the size of the file.
+  DokanWriteBehind_FlushFile(IoEvent->DokanInstance, fileName);
 
   assert(IoEvent->DokanOpenInfo == NULL);
 
@@ -215,14 +268,31 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
       IoEvent->DokanFileInfo.IsDirectory = TRUE;
     }
 
+    // Only opens failing when the file does not exist can be answered from
+    // the negative lookup cache.
+    BOOL useNegativeLookupCache =
+        IoEvent->DokanInstance->NegativeLookupCache.Entries &&
+        !(IoEvent->EventContext->Flags & SL_OPEN_TARGET_DIRECTORY) &&
+        (disposition == FILE_OPEN || disposition == FILE_OVERWRITE);
+    LONG64 negativeLookupGeneration = 0;
+
     if (options & FILE_NON_DIRECTORY_FILE && options & FILE_DIRECTORY_FILE)
       status = STATUS_INVALID_PARAMETER;
-    else
+    else if (useNegativeLookupCache &&
+             LookupNegativeLookupCache(IoEvent->DokanInstance, fileName,
+                                       &negativeLookupGeneration))
+      status = STATUS_OBJECT_NAME_NOT_FOUND;
+    else {
       status = IoEvent->DokanInstance->DokanOperations->ZwCreateFile(
           fileName, &ioSecurityContext, ioSecurityContext.DesiredAccess,
           IoEvent->EventContext->Operation.Create.FileAttributes,
           IoEvent->EventContext->Operation.Create.ShareAccess, disposition,
           options, &IoEvent->DokanFileInfo);
+      if (useNegativeLookupCache && status == STATUS_OBJECT_NAME_NOT_FOUND) {
+        InsertNegativeLookupCache(IoEvent->DokanInstance, fileName,
+                                  negativeLookupGeneration);
+      }
+    }
 
     if (CreateSuccesStatusCheck(status, disposition)
       && !childExisted) {
@@ -319,6 +389,21 @@ VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent) {
     if (disposition == FILE_OVERWRITE)
       IoEvent->EventResult->Operation.Create.Information = FILE_OVERWRITTEN;
 
+    if (IoEvent->EventResult->Operation.Create.Information ==
+            FILE_OVERWRITTEN ||
+        IoEvent->EventResult->Operation.Create.Information == FILE_SUPERSEDED) {
+      // The previous data of the file is gone.
+      DokanReadAhead_Invalidate(IoEvent->DokanInstance, fileName,
+                                (ULONG)wcslen(fileName));
+      InvalidateFileInfoCache(IoEvent->DokanInstance, fileName);
+      InvalidateDirectoryListCache(IoEvent->DokanInstance, fileName);
+    }
+
+    if (IoEvent->EventResult->Operation.Create.Information == FILE_CREATED) {
+      InvalidateNegativeLookupCache(IoEvent->DokanInstance, fileName);
+      InvalidateDirectoryListCache(IoEvent->DokanInstance, fileName);
+    }
+
     if (IoEvent->DokanFileInfo.IsDirectory)
       IoEvent->EventResult->Operation.Create.Flags |= DOKAN_FILE_DIRECTORY;
   }
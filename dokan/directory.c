@@ -24,276 +24,247 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "fileinfo.h"
 #include "list.h"
 #include "dokan_pool.h"
+#include "dokan_pattern.h"
+#include "dokan_writebehind.h"
 
 #include <assert.h>
 
-/**
-* \struct DOKAN_FIND_DATA
-* \brief Dokan find file list
-*
-* Used by FindFiles
-*/
-typedef struct _DOKAN_FIND_DATA {
-  /**
-  * File data information link
-  */
-  WIN32_FIND_DATAW FindData;
-  /**
-  * Current list entry informations
-  */
-  LIST_ENTRY ListEntry;
-} DOKAN_FIND_DATA, *PDOKAN_FIND_DATA;
-
 VOID DokanFillDirInfo(PFILE_DIRECTORY_INFORMATION Buffer,
-                      PWIN32_FIND_DATAW FindData, ULONG Index,
+                      PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                       PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = Entry->FileAttributes;
   Buffer->FileNameLength = nameBytes;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.QuadPart = Entry->FileSize;
+  Buffer->AllocationSize.QuadPart = Entry->FileSize;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = Entry->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = Entry->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = Entry->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = Entry->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 VOID DokanFillFullDirInfo(PFILE_FULL_DIR_INFORMATION Buffer,
-                          PWIN32_FIND_DATAW FindData, ULONG Index,
+                          PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                           PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = Entry->FileAttributes;
   Buffer->FileNameLength = nameBytes;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.QuadPart = Entry->FileSize;
+  Buffer->AllocationSize.QuadPart = Entry->FileSize;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = Entry->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = Entry->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = Entry->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = Entry->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 VOID DokanFillIdFullDirInfo(PFILE_ID_FULL_DIR_INFORMATION Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
+                            PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                             PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = Entry->FileAttributes;
   Buffer->FileNameLength = nameBytes;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.QuadPart = Entry->FileSize;
+  Buffer->AllocationSize.QuadPart = Entry->FileSize;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = Entry->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = Entry->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = Entry->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = Entry->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
   Buffer->FileId.QuadPart = 0;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 VOID DokanFillIdBothDirInfo(PFILE_ID_BOTH_DIR_INFORMATION Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
+                            PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                             PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = Entry->FileAttributes;
   Buffer->FileNameLength = nameBytes;
   Buffer->ShortNameLength = 0;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.QuadPart = Entry->FileSize;
+  Buffer->AllocationSize.QuadPart = Entry->FileSize;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = Entry->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = Entry->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = Entry->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = Entry->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
   Buffer->FileId.QuadPart = 0;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 VOID DokanFillIdExtdDirInfo(PFILE_ID_EXTD_DIR_INFO Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
+                            PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                             PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = Entry->FileAttributes;
   Buffer->FileNameLength = nameBytes;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.QuadPart = Entry->FileSize;
+  Buffer->AllocationSize.QuadPart = Entry->FileSize;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = Entry->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = Entry->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = Entry->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = Entry->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
   Buffer->ReparsePointTag = 0;
   RtlFillMemory(&Buffer->FileId.Identifier, sizeof Buffer->FileId.Identifier, 0);
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 VOID DokanFillIdExtdBothDirInfo(PFILE_ID_EXTD_BOTH_DIR_INFORMATION Buffer,
-                            PWIN32_FIND_DATAW FindData, ULONG Index,
+                            PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                             PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = Entry->FileAttributes;
   Buffer->FileNameLength = nameBytes;
   Buffer->ShortNameLength = 0;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.QuadPart = Entry->FileSize;
+  Buffer->AllocationSize.QuadPart = Entry->FileSize;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = Entry->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = Entry->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = Entry->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = Entry->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
   Buffer->ReparsePointTag = 0;
   RtlFillMemory(&Buffer->FileId.Identifier, sizeof Buffer->FileId.Identifier, 0);
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 VOID DokanFillBothDirInfo(PFILE_BOTH_DIR_INFORMATION Buffer,
-                          PWIN32_FIND_DATAW FindData, ULONG Index,
+                          PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                           PDOKAN_INSTANCE DokanInstance) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
-  Buffer->FileAttributes = FindData->dwFileAttributes;
+  Buffer->FileAttributes = Entry->FileAttributes;
   Buffer->FileNameLength = nameBytes;
   Buffer->ShortNameLength = 0;
 
-  Buffer->EndOfFile.HighPart = FindData->nFileSizeHigh;
-  Buffer->EndOfFile.LowPart = FindData->nFileSizeLow;
-  Buffer->AllocationSize.HighPart = FindData->nFileSizeHigh;
-  Buffer->AllocationSize.LowPart = FindData->nFileSizeLow;
+  Buffer->EndOfFile.QuadPart = Entry->FileSize;
+  Buffer->AllocationSize.QuadPart = Entry->FileSize;
   ALIGN_ALLOCATION_SIZE(&Buffer->AllocationSize, DokanInstance->DokanOptions);
 
-  Buffer->CreationTime.HighPart = FindData->ftCreationTime.dwHighDateTime;
-  Buffer->CreationTime.LowPart = FindData->ftCreationTime.dwLowDateTime;
+  Buffer->CreationTime.HighPart = Entry->CreationTime.dwHighDateTime;
+  Buffer->CreationTime.LowPart = Entry->CreationTime.dwLowDateTime;
 
-  Buffer->LastAccessTime.HighPart = FindData->ftLastAccessTime.dwHighDateTime;
-  Buffer->LastAccessTime.LowPart = FindData->ftLastAccessTime.dwLowDateTime;
+  Buffer->LastAccessTime.HighPart = Entry->LastAccessTime.dwHighDateTime;
+  Buffer->LastAccessTime.LowPart = Entry->LastAccessTime.dwLowDateTime;
 
-  Buffer->LastWriteTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->LastWriteTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->LastWriteTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->LastWriteTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
-  Buffer->ChangeTime.HighPart = FindData->ftLastWriteTime.dwHighDateTime;
-  Buffer->ChangeTime.LowPart = FindData->ftLastWriteTime.dwLowDateTime;
+  Buffer->ChangeTime.HighPart = Entry->LastWriteTime.dwHighDateTime;
+  Buffer->ChangeTime.LowPart = Entry->LastWriteTime.dwLowDateTime;
 
   Buffer->EaSize = 0;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 VOID DokanFillNamesInfo(PFILE_NAMES_INFORMATION Buffer,
-                        PWIN32_FIND_DATAW FindData, ULONG Index) {
-  ULONG nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+                        PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index) {
+  ULONG nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   Buffer->FileIndex = Index;
   Buffer->FileNameLength = nameBytes;
 
-  RtlCopyMemory(Buffer->FileName, FindData->cFileName, nameBytes);
+  RtlCopyMemory(Buffer->FileName, Entry->FileName, nameBytes);
 }
 
 ULONG
 DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
                               PVOID Buffer, PULONG LengthRemaining,
-                              PWIN32_FIND_DATAW FindData, ULONG Index,
+                              PDOKAN_DIRECTORY_ENTRY Entry, ULONG Index,
                               PDOKAN_INSTANCE DokanInstance) {
   ULONG nameBytes;
   ULONG thisEntrySize;
 
-  nameBytes = (ULONG)wcslen(FindData->cFileName) * sizeof(WCHAR);
+  nameBytes = Entry->FileNameLength * sizeof(WCHAR);
 
   thisEntrySize = nameBytes;
 
@@ -339,28 +310,28 @@ DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
 
   switch (DirectoryInfo) {
   case FileDirectoryInformation:
-    DokanFillDirInfo(Buffer, FindData, Index, DokanInstance);
+    DokanFillDirInfo(Buffer, Entry, Index, DokanInstance);
     break;
   case FileFullDirectoryInformation:
-    DokanFillFullDirInfo(Buffer, FindData, Index, DokanInstance);
+    DokanFillFullDirInfo(Buffer, Entry, Index, DokanInstance);
     break;
   case FileIdFullDirectoryInformation:
-    DokanFillIdFullDirInfo(Buffer, FindData, Index, DokanInstance);
+    DokanFillIdFullDirInfo(Buffer, Entry, Index, DokanInstance);
     break;
   case FileNamesInformation:
-    DokanFillNamesInfo(Buffer, FindData, Index);
+    DokanFillNamesInfo(Buffer, Entry, Index);
     break;
   case FileBothDirectoryInformation:
-    DokanFillBothDirInfo(Buffer, FindData, Index, DokanInstance);
+    DokanFillBothDirInfo(Buffer, Entry, Index, DokanInstance);
     break;
   case FileIdBothDirectoryInformation:
-    DokanFillIdBothDirInfo(Buffer, FindData, Index, DokanInstance);
+    DokanFillIdBothDirInfo(Buffer, Entry, Index, DokanInstance);
     break;
   case FileIdExtdDirectoryInformation:
-    DokanFillIdExtdDirInfo(Buffer, FindData, Index, DokanInstance);
+    DokanFillIdExtdDirInfo(Buffer, Entry, Index, DokanInstance);
     break;
   case FileIdExtdBothDirectoryInformation:
-    DokanFillIdExtdBothDirInfo(Buffer, FindData, Index, DokanInstance);
+    DokanFillIdExtdBothDirInfo(Buffer, Entry, Index, DokanInstance);
     break;    
   default:
     break;
@@ -374,22 +345,28 @@ DokanFillDirectoryInformation(FILE_INFORMATION_CLASS DirectoryInfo,
 int WINAPI DokanFillFileData(PWIN32_FIND_DATAW FindData,
                              PDOKAN_FILE_INFO FileInfo) {
   assert(FileInfo->ProcessingContext);
-  PDOKAN_VECTOR dirList = (PDOKAN_VECTOR )FileInfo->ProcessingContext;
-  DokanVector_PushBack(dirList, FindData);
+  PDOKAN_DIRECTORY_LIST dirList =
+      (PDOKAN_DIRECTORY_LIST)FileInfo->ProcessingContext;
+  DokanDirectoryList_PushBack(dirList, FindData);
   return 0;
 }
 
 // add entry which matches the pattern specifed in EventContext
 // to the buffer specifed in EventInfo
+// Cursor is where the previous query of the list stopped and is moved to
+// where this one stops.
 //
-LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
+LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_DIRECTORY_LIST DirList,
+                PDOKAN_DIRECTORY_CURSOR Cursor) {
   ULONG lengthRemaining =
       IoEvent->EventContext->Operation.Directory.BufferLength;
   PVOID currentBuffer = IoEvent->EventResult->Buffer;
   PVOID lastBuffer = currentBuffer;
   ULONG index = 0;
+  ULONG i = 0;
   BOOL patternCheck = FALSE;
   PWCHAR pattern = NULL;
+  DOKAN_PATTERN compiledPattern;
   BOOL bufferOverFlow = FALSE;
   BOOL caseSensitive = IoEvent->DokanInstance->DokanOptions->Options &
                        DOKAN_OPTION_CASE_SENSITIVE;
@@ -405,23 +382,32 @@ LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
       (!IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern ||
        IoEvent->DokanOpenInfo->UnimplementedFindFilesWithPattern)) {
     patternCheck = TRUE;
+    DokanPattern_Compile(&compiledPattern, pattern, !caseSensitive);
+  }
+
+  // Resume from the cursor rather than matching again the entries before
+  // FileIndex, so that paging through a listing is linear.
+  if (Cursor->Index <= IoEvent->EventContext->Operation.Directory.FileIndex &&
+      Cursor->Position <= DokanDirectoryList_GetCount(DirList)) {
+    index = Cursor->Index;
+    i = Cursor->Position;
   }
 
-  for (size_t i = 0; i < DokanVector_GetCount(DirList); ++i) {
-    PDOKAN_FIND_DATA find = (PDOKAN_FIND_DATA)DokanVector_GetItem(DirList, i);
-    DbgPrintW(L"FileMatch? : %s (%s,%d,%d)\n", find->FindData.cFileName,
+  for (; i < DokanDirectoryList_GetCount(DirList); ++i) {
+    PDOKAN_DIRECTORY_ENTRY entry = DokanDirectoryList_GetEntry(DirList, i);
+    DbgPrintW(L"FileMatch? : %s (%s,%d,%d)\n", entry->FileName,
               (pattern ? pattern : L"null"),
               IoEvent->EventContext->Operation.Directory.FileIndex, index);
 
     // pattern is not specified or pattern match is ignore cases
     if (!patternCheck ||
-        DokanIsNameInExpression(pattern, find->FindData.cFileName,
-                                !caseSensitive)) {
+        DokanPattern_Match(&compiledPattern, entry->FileName,
+                           entry->FileNameLength)) {
       if (IoEvent->EventContext->Operation.Directory.FileIndex <= index) {
         // index+1 is very important, should use next entry index
         ULONG entrySize = DokanFillDirectoryInformation(
             IoEvent->EventContext->Operation.Directory.FileInformationClass,
-            currentBuffer, &lengthRemaining, &find->FindData, index + 1,
+            currentBuffer, &lengthRemaining, entry, index + 1,
             IoEvent->DokanInstance);
         // buffer is full
         if (entrySize == 0) {
@@ -435,6 +421,7 @@ LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
 
           DbgPrint("  =>return single entry\n");
           index++;
+          i++;
           break;
         }
         DbgPrint("  =>return\n");
@@ -448,6 +435,9 @@ LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
     }
   }
 
+  Cursor->Index = index;
+  Cursor->Position = i;
+
   // Since next of the last entry doesn't exist, clear next offset
   ((PFILE_BOTH_DIR_INFORMATION)lastBuffer)->NextEntryOffset = 0;
   // acctualy used length of buffer
@@ -462,36 +452,42 @@ LONG MatchFiles(PDOKAN_IO_EVENT IoEvent, PDOKAN_VECTOR DirList) {
   return index;
 }
 
-VOID AddMissingCurrentAndParentFolder(PDOKAN_IO_EVENT IoEvent) {
+// Whether the listing has to include the current and parent folders: every
+// entry is listed and the directory is not the root.
+static BOOL NeedsCurrentAndParentFolder(PDOKAN_IO_EVENT IoEvent) {
   PWCHAR pattern = NULL;
-  BOOLEAN currentFolder = FALSE, parentFolder = FALSE;
-  WIN32_FIND_DATAW findData;
-  FILETIME systime;
-  PDOKAN_VECTOR dirList = (PDOKAN_VECTOR)IoEvent->DokanFileInfo.ProcessingContext;
-
-  assert(dirList);
   if (IoEvent->EventContext->Operation.Directory.SearchPatternLength != 0) {
     pattern = (PWCHAR)((SIZE_T)&IoEvent->EventContext->Operation.Directory
                            .SearchPatternBase[0] +
                        (SIZE_T)IoEvent->EventContext->Operation.Directory
                            .SearchPatternOffset);
   }
+  return wcscmp(IoEvent->EventContext->Operation.Directory.DirectoryName,
+                L"\\") != 0 &&
+         (pattern == NULL || wcscmp(pattern, L"*") == 0);
+}
 
-  if (wcscmp(IoEvent->EventContext->Operation.Directory.DirectoryName,
-             L"\\") == 0 ||
-      (pattern != NULL && wcscmp(pattern, L"*") != 0)) {
+VOID AddMissingCurrentAndParentFolder(PDOKAN_IO_EVENT IoEvent) {
+  BOOLEAN currentFolder = FALSE, parentFolder = FALSE;
+  WIN32_FIND_DATAW findData;
+  FILETIME systime;
+  PDOKAN_DIRECTORY_LIST dirList =
+      (PDOKAN_DIRECTORY_LIST)IoEvent->DokanFileInfo.ProcessingContext;
+
+  assert(dirList);
+  if (!NeedsCurrentAndParentFolder(IoEvent)) {
     return;
   }
 
-  for (size_t i = 0;
-       (!currentFolder || !parentFolder) && i < DokanVector_GetCount(dirList);
+  for (ULONG i = 0; (!currentFolder || !parentFolder) &&
+                    i < DokanDirectoryList_GetCount(dirList);
        ++i) {
-    PDOKAN_FIND_DATA find = (PDOKAN_FIND_DATA)DokanVector_GetItem(dirList, i);
-    if (wcscmp(find->FindData.cFileName, L".") == 0) {
+    PDOKAN_DIRECTORY_ENTRY entry = DokanDirectoryList_GetEntry(dirList, i);
+    if (wcscmp(entry->FileName, L".") == 0) {
       currentFolder = TRUE;
     }
 
-    if (wcscmp(find->FindData.cFileName, L"..") == 0) {
+    if (wcscmp(entry->FileName, L"..") == 0) {
       parentFolder = TRUE;
     }
   }
@@ -508,22 +504,23 @@ VOID AddMissingCurrentAndParentFolder(PDOKAN_IO_EVENT IoEvent) {
       findData.cFileName[0] = '.';
       findData.cFileName[1] = '.';
       // NULL written during ZeroMemory()
-      DokanVector_PushFront(dirList, &findData);
+      DokanDirectoryList_PushFront(dirList, &findData);
     }
     if (!currentFolder) {
       findData.cFileName[0] = '.';
       findData.cFileName[1] = '\0';
-      DokanVector_PushFront(dirList, &findData);
+      DokanDirectoryList_PushFront(dirList, &findData);
     }
   }
 }
 
 NTSTATUS WriteDirectoryResults(PDOKAN_IO_EVENT EventInfo,
-                               PDOKAN_VECTOR dirList) {
+                               PDOKAN_DIRECTORY_LIST dirList,
+                               PDOKAN_DIRECTORY_CURSOR Cursor) {
   // If this function is called then so far everything should be good
   assert(EventInfo->EventResult->Status == STATUS_SUCCESS);
   // Write the file info to the output buffer
-  int index = MatchFiles(EventInfo, dirList);
+  int index = MatchFiles(EventInfo, dirList, Cursor);
   DbgPrint("WriteDirectoryResults() New directory index is %d.\n", index);
   // there is no matched file
   if (index < 0) {
@@ -550,9 +547,10 @@ NTSTATUS WriteDirectoryResults(PDOKAN_IO_EVENT EventInfo,
 }
 
 VOID EndFindFilesCommon(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status) {
-  PDOKAN_VECTOR dirList =
-      (PDOKAN_VECTOR)IoEvent->DokanFileInfo.ProcessingContext;
-  PDOKAN_VECTOR oldDirList = NULL;
+  PDOKAN_DIRECTORY_LIST dirList =
+      (PDOKAN_DIRECTORY_LIST)IoEvent->DokanFileInfo.ProcessingContext;
+  PDOKAN_DIRECTORY_LIST oldDirList = NULL;
+  DOKAN_DIRECTORY_CURSOR cursor = {0, 0};
 
   assert(IoEvent->EventResult->BufferLength == 0);
   assert(IoEvent->DokanFileInfo.ProcessingContext);
@@ -566,12 +564,13 @@ VOID EndFindFilesCommon(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status) {
 
   if (Status == STATUS_SUCCESS) {
     AddMissingCurrentAndParentFolder(IoEvent);
-    Status = WriteDirectoryResults(IoEvent, dirList);
+    Status = WriteDirectoryResults(IoEvent, dirList, &cursor);
     EnterCriticalSection(&IoEvent->DokanOpenInfo->CriticalSection);
     {
       if (IoEvent->DokanOpenInfo->DirList != dirList) {
         oldDirList = IoEvent->DokanOpenInfo->DirList;
         IoEvent->DokanOpenInfo->DirList = dirList;
+        IoEvent->DokanOpenInfo->DirListCursor = cursor;
       } else {
         // They should never point to the same object
         DbgPrint("Dokan Warning: EndFindFilesCommon() "
@@ -603,12 +602,295 @@ VOID EndFindFilesCommon(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status) {
   EventCompletion(IoEvent);
 }
 
+// State of a query answered with FindFilesStream, the ProcessingContext of
+// DokanFillFileDataWithCookie.
+typedef struct _DOKAN_FIND_STREAM_CONTEXT {
+  PDOKAN_IO_EVENT IoEvent;
+  // Pattern checked by the library when PatternCheck is set.
+  BOOL PatternCheck;
+  DOKAN_PATTERN Pattern;
+  // Whether "." and ".." are added by the library and skipped when listed.
+  BOOL AddDotEntries;
+  // Index of the next matching entry and the cookie listing it.
+  ULONG Index;
+  ULONG64 Cookie;
+  // Index of the first entry to return, the previous ones are skipped.
+  ULONG FileIndex;
+  ULONG ReturnedCount;
+  ULONG LengthRemaining;
+  PVOID CurrentBuffer;
+  PVOID LastBuffer;
+  // Set once no more entry can be returned by the query.
+  BOOL Stopped;
+  BOOL BufferOverflow;
+} DOKAN_FIND_STREAM_CONTEXT, *PDOKAN_FIND_STREAM_CONTEXT;
+
+// Returns the entry at the next index of the enumeration if it is not before
+// FileIndex. Returns FALSE when the entry was not consumed because the buffer
+// is full.
+static BOOL StreamEntry(PDOKAN_FIND_STREAM_CONTEXT Context,
+                        PDOKAN_DIRECTORY_ENTRY Entry) {
+  PDOKAN_IO_EVENT ioEvent = Context->IoEvent;
+  if (Context->Index < Context->FileIndex) {
+    ++Context->Index;
+    return TRUE;
+  }
+  // index+1 is very important, should use next entry index
+  ULONG entrySize = DokanFillDirectoryInformation(
+      ioEvent->EventContext->Operation.Directory.FileInformationClass,
+      Context->CurrentBuffer, &Context->LengthRemaining, Entry,
+      Context->Index + 1, ioEvent->DokanInstance);
+  if (entrySize == 0) {
+    Context->BufferOverflow = TRUE;
+    Context->Stopped = TRUE;
+    return FALSE;
+  }
+  ++Context->Index;
+  ++Context->ReturnedCount;
+  Context->LastBuffer = Context->CurrentBuffer;
+  if (ioEvent->EventContext->Flags & SL_RETURN_SINGLE_ENTRY) {
+    Context->Stopped = TRUE;
+    return TRUE;
+  }
+  ((PFILE_BOTH_DIR_INFORMATION)Context->CurrentBuffer)->NextEntryOffset =
+      entrySize;
+  Context->CurrentBuffer = (PCHAR)Context->CurrentBuffer + entrySize;
+  return TRUE;
+}
+
+static BOOL IsDotEntry(LPCWSTR FileName) {
+  return wcscmp(FileName, L".") == 0 || wcscmp(FileName, L"..") == 0;
+}
+
+int WINAPI DokanFillFileDataWithCookie(PWIN32_FIND_DATAW FindData,
+                                       ULONG64 NextCookie,
+                                       PDOKAN_FILE_INFO FileInfo) {
+  assert(FileInfo->ProcessingContext);
+  PDOKAN_FIND_STREAM_CONTEXT context =
+      (PDOKAN_FIND_STREAM_CONTEXT)FileInfo->ProcessingContext;
+  if (context->Stopped) {
+    return 1;
+  }
+  DOKAN_DIRECTORY_ENTRY_BUFFER entryBuffer;
+  DokanDirectoryEntry_Initialize(
+      &entryBuffer.Entry, FindData,
+      (ULONG)wcsnlen(FindData->cFileName, MAX_PATH));
+  if ((!context->AddDotEntries || !IsDotEntry(entryBuffer.Entry.FileName)) &&
+      (!context->PatternCheck ||
+       DokanPattern_Match(&context->Pattern, entryBuffer.Entry.FileName,
+                          entryBuffer.Entry.FileNameLength))) {
+    if (!StreamEntry(context, &entryBuffer.Entry)) {
+      return 1;
+    }
+  }
+  context->Cookie = NextCookie;
+  return context->Stopped ? 1 : 0;
+}
+
+// Answers a query with FindFilesStream, resuming the enumeration of the open
+// where the previous query stopped unless the query starts at another index.
+static NTSTATUS StreamDirectoryResults(PDOKAN_IO_EVENT IoEvent,
+                                       PDOKAN_OPEN_INFO OpenInfo,
+                                       PWCHAR SearchPattern) {
+  DOKAN_FIND_STREAM_CONTEXT context;
+  NTSTATUS status;
+  ULONG bufferLength = IoEvent->EventContext->Operation.Directory.BufferLength;
+
+  ZeroMemory(&context, sizeof(DOKAN_FIND_STREAM_CONTEXT));
+  context.IoEvent = IoEvent;
+  if (SearchPattern && wcscmp(SearchPattern, L"*") != 0) {
+    context.PatternCheck = TRUE;
+    DokanPattern_Compile(&context.Pattern, SearchPattern,
+                         !(IoEvent->DokanInstance->DokanOptions->Options &
+                           DOKAN_OPTION_CASE_SENSITIVE));
+  }
+  context.AddDotEntries = NeedsCurrentAndParentFolder(IoEvent);
+  context.FileIndex = IoEvent->EventContext->Operation.Directory.FileIndex;
+  context.LengthRemaining = bufferLength;
+  context.CurrentBuffer = IoEvent->EventResult->Buffer;
+  context.LastBuffer = context.CurrentBuffer;
+
+  EnterCriticalSection(&OpenInfo->CriticalSection);
+  if (OpenInfo->StreamIndex == context.FileIndex) {
+    context.Index = OpenInfo->StreamIndex;
+    context.Cookie = OpenInfo->StreamCookie;
+  }
+  LeaveCriticalSection(&OpenInfo->CriticalSection);
+
+  if (context.AddDotEntries) {
+    // Folders times should ideally be the real current and parent folder times.
+    WIN32_FIND_DATAW findData;
+    ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+    findData.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+    GetSystemTimeAsFileTime(&findData.ftCreationTime);
+    findData.ftLastAccessTime = findData.ftCreationTime;
+    findData.ftLastWriteTime = findData.ftCreationTime;
+    findData.cFileName[0] = L'.';
+    while (context.Index < 2 && !context.Stopped) {
+      DOKAN_DIRECTORY_ENTRY_BUFFER entryBuffer;
+      // "." is at index 0 and ".." at index 1.
+      findData.cFileName[context.Index] = L'.';
+      DokanDirectoryEntry_Initialize(&entryBuffer.Entry, &findData,
+                                     context.Index + 1);
+      if (!StreamEntry(&context, &entryBuffer.Entry)) {
+        break;
+      }
+    }
+  }
+
+  if (!context.Stopped) {
+    IoEvent->DokanFileInfo.ProcessingContext = &context;
+    status = IoEvent->DokanInstance->DokanOperations->FindFilesStream(
+        IoEvent->EventContext->Operation.Directory.DirectoryName,
+        SearchPattern ? SearchPattern : L"*", context.Cookie,
+        DokanFillFileDataWithCookie, &IoEvent->DokanFileInfo);
+    IoEvent->DokanFileInfo.ProcessingContext = NULL;
+    if (status == STATUS_BUFFER_OVERFLOW && context.Stopped) {
+      status = STATUS_SUCCESS;
+    }
+    if (status != STATUS_SUCCESS) {
+      // The entries of the buffer are not returned, the position of the open
+      // stays before them.
+      ZeroMemory(IoEvent->EventResult->Buffer,
+                 bufferLength - context.LengthRemaining);
+      IoEvent->EventResult->BufferLength = 0;
+      return status;
+    }
+  }
+
+  EnterCriticalSection(&OpenInfo->CriticalSection);
+  OpenInfo->StreamIndex = context.Index;
+  OpenInfo->StreamCookie = context.Cookie;
+  LeaveCriticalSection(&OpenInfo->CriticalSection);
+
+  // Since next of the last entry doesn't exist, clear next offset
+  ((PFILE_BOTH_DIR_INFORMATION)context.LastBuffer)->NextEntryOffset = 0;
+  IoEvent->EventResult->BufferLength = bufferLength - context.LengthRemaining;
+  if (context.ReturnedCount == 0) {
+    if (context.BufferOverflow) {
+      DbgPrint("  STATUS_BUFFER_OVERFLOW\n");
+      return STATUS_BUFFER_OVERFLOW;
+    }
+    if (context.FileIndex == 0) {
+      DbgPrint("  STATUS_NO_SUCH_FILE\n");
+      return STATUS_NO_SUCH_FILE;
+    }
+    DbgPrint("  STATUS_NO_MORE_FILES\n");
+    return STATUS_NO_MORE_FILES;
+  }
+  DbgPrint("index to %d\n", context.Index);
+  IoEvent->EventResult->Operation.Directory.Index = context.Index;
+  return STATUS_SUCCESS;
+}
+
+// Payload callbacks of the directory list cache, whose payloads are a
+// PDOKAN_DIRECTORY_LIST.
+static BOOL CopyCachedDirectoryList(PVOID Destination, const VOID *Payload) {
+  return DokanDirectoryList_Copy((PDOKAN_DIRECTORY_LIST)Destination,
+                                 *(const PDOKAN_DIRECTORY_LIST *)Payload);
+}
+
+static VOID FreeCachedDirectoryList(PVOID Payload) {
+  DokanDirectoryList_Free(*(PDOKAN_DIRECTORY_LIST *)Payload);
+}
+
+VOID InitializeDirectoryListCache(PDOKAN_INSTANCE DokanInstance) {
+  SIZE_T maxMemory = DokanInstance->DokanOptions->DirectoryListCacheMaxMemory;
+  if (!maxMemory) {
+    maxMemory = DOKAN_DIRECTORY_LIST_CACHE_DEFAULT_MAX_MEMORY;
+  }
+  if (!DokanNameCache_Initialize(
+          &DokanInstance->DirectoryListCache, DOKAN_DIRECTORY_LIST_CACHE_SIZE,
+          sizeof(PDOKAN_DIRECTORY_LIST),
+          DokanInstance->DokanOptions->DirectoryListCacheTtlMs, maxMemory,
+          DokanInstance->DokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE,
+          CopyCachedDirectoryList, FreeCachedDirectoryList)) {
+    DbgPrintW(
+        L"Dokan Warning: Failed to allocate the directory list cache.\n");
+  }
+}
+
+VOID FreeDirectoryListCache(PDOKAN_INSTANCE DokanInstance) {
+  DokanNameCache_Free(&DokanInstance->DirectoryListCache);
+}
+
+// Copies the listing of DirectoryName to List when it is cached and has not
+// expired. Otherwise Generation receives the generation of its entry to give
+// to InsertDirectoryListCache.
+static BOOL LookupDirectoryListCache(PDOKAN_INSTANCE DokanInstance,
+                                     LPCWSTR DirectoryName,
+                                     PDOKAN_DIRECTORY_LIST List,
+                                     PLONG64 Generation) {
+  BOOL found = DokanNameCache_Lookup(&DokanInstance->DirectoryListCache,
+                                     DirectoryName,
+                                     (ULONG)wcslen(DirectoryName), List,
+                                     Generation);
+  if (found) {
+    RecordDirectoryListCacheHit(DokanInstance);
+  } else {
+    RecordDirectoryListCacheMiss(DokanInstance);
+  }
+  return found;
+}
+
+// Caches a copy of the listing of DirectoryName read by the backend, unless
+// its entry was invalidated since Generation was read before calling it.
+// Other listings are evicted when the memory of the cache is exceeded.
+static VOID InsertDirectoryListCache(PDOKAN_INSTANCE DokanInstance,
+                                     LPCWSTR DirectoryName,
+                                     PDOKAN_DIRECTORY_LIST List,
+                                     LONG64 Generation) {
+  // The copy is sized to the listing, it is made before taking the lock.
+  PDOKAN_DIRECTORY_LIST copy = DokanDirectoryList_Alloc();
+  if (!copy || !DokanDirectoryList_Copy(copy, List)) {
+    DokanDirectoryList_Free(copy);
+    return;
+  }
+  if (!DokanNameCache_Insert(&DokanInstance->DirectoryListCache,
+                             DirectoryName, (ULONG)wcslen(DirectoryName),
+                             &copy, DokanDirectoryList_GetAllocatedSize(copy),
+                             Generation)) {
+    DokanDirectoryList_Free(copy);
+  }
+}
+
+VOID InvalidateDirectoryListCache(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR FileName) {
+  PDOKAN_NAME_CACHE cache = &DokanInstance->DirectoryListCache;
+  if (!cache->Entries) {
+    return;
+  }
+  ULONG length = (ULONG)wcslen(FileName);
+  // The parent directory name ends before the last backslash, except for the
+  // root directory "\".
+  ULONG parentLength = length;
+  while (parentLength > 0 && FileName[parentLength - 1] != L'\\') {
+    --parentLength;
+  }
+  if (parentLength > 1) {
+    --parentLength;
+  }
+  // The listing of FileName when it is a directory, and the one of its
+  // parent that lists it.
+  DokanNameCache_Invalidate(cache, FileName, length);
+  if (parentLength) {
+    DokanNameCache_Invalidate(cache, FileName, parentLength);
+  }
+}
+
+VOID ClearDirectoryListCache(PDOKAN_INSTANCE DokanInstance) {
+  DokanNameCache_Clear(&DokanInstance->DirectoryListCache);
+}
+
 VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
   PWCHAR searchPattern = NULL;
   NTSTATUS status = STATUS_SUCCESS;
   ULONG fileInfoClass =
       IoEvent->EventContext->Operation.Directory.FileInformationClass;
   BOOL forceScan = FALSE;
+  BOOL useListCache = FALSE;
+  BOOL fullListing = FALSE;
+  LONG64 listCacheGeneration = 0;
   PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
   BOOLEAN allocatedOpenInfo = FALSE;
 
@@ -640,8 +922,15 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
 
   CreateDispatchCommon(IoEvent,
                        IoEvent->EventContext->Operation.Directory.BufferLength,
-                       /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+                       /*ClearBuffer=*/TRUE);
+
+  // Listed sizes and times have to include the buffered writes of the
+  // entries, names alone do not.
+  if (fileInfoClass != FileNamesInformation) {
+    DokanWriteBehind_FlushDirectory(
+        IoEvent->DokanInstance,
+        IoEvent->EventContext->Operation.Directory.DirectoryName);
+  }
 
   IoEvent->EventResult->Operation.Directory.Index =
       IoEvent->EventContext->Operation.Directory.FileIndex;
@@ -658,6 +947,23 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
     allocatedOpenInfo = TRUE;
   }
 
+  if (IoEvent->DokanInstance->DokanOperations->FindFilesStream &&
+      !openInfo->UnimplementedFindFilesStream) {
+    status = StreamDirectoryResults(IoEvent, openInfo, searchPattern);
+    if (status != STATUS_NOT_IMPLEMENTED) {
+      IoEvent->EventResult->Status = status;
+      EventCompletion(IoEvent);
+      if (allocatedOpenInfo) {
+        PushFileOpenInfo(openInfo);
+      }
+      return;
+    }
+    EnterCriticalSection(&openInfo->CriticalSection);
+    openInfo->UnimplementedFindFilesStream = TRUE;
+    LeaveCriticalSection(&openInfo->CriticalSection);
+    status = STATUS_SUCCESS;
+  }
+
   EnterCriticalSection(&openInfo->CriticalSection);
   {
     if (openInfo->DirList == NULL) {
@@ -679,7 +985,8 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
             ? TRUE
             : FALSE;
     if (!forceScan) {
-      status = WriteDirectoryResults(IoEvent, openInfo->DirList);
+      status = WriteDirectoryResults(IoEvent, openInfo->DirList,
+                                     &openInfo->DirListCursor);
     }
   }
   LeaveCriticalSection(&openInfo->CriticalSection);
@@ -705,10 +1012,29 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
     return;
   }
 
+  // Full listings are shared by the opens of the directory. They answer the
+  // queries whose pattern is either "*" or checked by MatchFiles.
+  useListCache =
+      IoEvent->DokanInstance->DirectoryListCache.Entries != NULL &&
+      (!searchPattern || wcscmp(searchPattern, L"*") == 0 ||
+       !IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern ||
+       openInfo->UnimplementedFindFilesWithPattern);
+  if (useListCache &&
+      LookupDirectoryListCache(
+          IoEvent->DokanInstance,
+          IoEvent->EventContext->Operation.Directory.DirectoryName,
+          IoEvent->DokanFileInfo.ProcessingContext, &listCacheGeneration)) {
+    EndFindFilesCommon(IoEvent, STATUS_SUCCESS);
+    if (allocatedOpenInfo) {
+      PushFileOpenInfo(openInfo);
+    }
+    return;
+  }
   status = STATUS_NOT_IMPLEMENTED;
 
   // Reminder: FindFilesWithPattern may not be implemented by returning STATUS_NOT_IMPLEMENTED.
   if (IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern) {
+    fullListing = !searchPattern || wcscmp(searchPattern, L"*") == 0;
     status = IoEvent->DokanInstance->DokanOperations->FindFilesWithPattern(
         IoEvent->EventContext->Operation.Directory.DirectoryName,
         searchPattern ? searchPattern : L"*", DokanFillFileData,
@@ -723,11 +1049,19 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
   // And if not, try with FindFiles.
   if (status == STATUS_NOT_IMPLEMENTED &&
       IoEvent->DokanInstance->DokanOperations->FindFiles) {
+    fullListing = TRUE;
     status = IoEvent->DokanInstance->DokanOperations->FindFiles(
         IoEvent->EventContext->Operation.Directory.DirectoryName,
         DokanFillFileData, &IoEvent->DokanFileInfo);
   }
 
+  if (status == STATUS_SUCCESS && useListCache && fullListing) {
+    InsertDirectoryListCache(
+        IoEvent->DokanInstance,
+        IoEvent->EventContext->Operation.Directory.DirectoryName,
+        IoEvent->DokanFileInfo.ProcessingContext, listCacheGeneration);
+  }
+
   if (status != STATUS_NOT_IMPLEMENTED) {
     EndFindFilesCommon(IoEvent, status);
   } else {
@@ -741,13 +1075,9 @@ VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent) {
   }
 }
 
-#define DOS_STAR (L'<')
-#define DOS_QM (L'>')
-#define DOS_DOT (L'"')
-
-BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
-                                      LPCWSTR Name,       // file name
-                                      BOOL IgnoreCase) {
+static BOOL IsNameInExpression(LPCWSTR Expression, // matching pattern
+                               LPCWSTR Name,       // file name
+                               BOOL IgnoreCase) {
   ULONG ei = 0;
   ULONG ni = 0;
 
@@ -759,7 +1089,7 @@ BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
         return TRUE;
 
       while (Name[ni] != '\0') {
-        if (DokanIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
+        if (IsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
           return TRUE;
         ni++;
       }
@@ -782,7 +1112,7 @@ BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
         endReached = (Name[ni] == '\0' || ni == lastDot);
 
         if (!endReached) {
-          if (DokanIsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
+          if (IsNameInExpression(&Expression[ei], &Name[ni], IgnoreCase))
             return TRUE;
 
           ni++;
@@ -817,7 +1147,8 @@ BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
       if (Expression[ei] == L'?') {
         ei++;
         ni++;
-      } else if (IgnoreCase && towupper(Expression[ei]) == towupper(Name[ni])) {
+      } else if (IgnoreCase &&
+                 DokanUpcase(Expression[ei]) == DokanUpcase(Name[ni])) {
         ei++;
         ni++;
       } else if (!IgnoreCase && Expression[ei] == Name[ni]) {
@@ -834,3 +1165,10 @@ BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
 
   return FALSE;
 }
+
+BOOL DOKANAPI DokanIsNameInExpression(LPCWSTR Expression, // matching pattern
+                                      LPCWSTR Name,       // file name
+                                      BOOL IgnoreCase) {
+  DokanInitializeUpcaseTable();
+  return IsNameInExpression(Expression, Name, IgnoreCase);
+}
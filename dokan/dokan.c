@@ -24,6 +24,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "fileinfo.h"
 #include "list.h"
 #include "dokan_pool.h"
+#include "dokan_writebehind.h"
 
 #include <conio.h>
 #include <process.h>
@@ -31,11 +32,57 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <tchar.h>
 #include <strsafe.h>
 #include <assert.h>
+#include <wctype.h>
 
 #define DokanMapKernelBit(dest, src, userBit, kernelBit)                       \
   if (((src) & (kernelBit)) == (kernelBit))                                    \
   (dest) |= (userBit)
 
+// Number of events an instance can have queued to the thread pool before
+// falling back to one submission per event.
+#define DOKAN_DISPATCH_QUEUE_CAPACITY 4096
+
+// Number of deques of an instance scheduler. Main pull threads keep theirs
+// forever, the others are shared by pool threads pulling a batch.
+#define DOKAN_SCHEDULER_DEQUE_COUNT (DOKAN_MAIN_PULL_THREAD_COUNT_MAX * 2)
+
+// Number of events a puller can schedule in its deque before falling back to
+// QueueIoEvent.
+#define DOKAN_SCHEDULER_DEQUE_CAPACITY 256
+
+// Interval at which the number of pull threads is adjusted.
+#define DOKAN_PULLER_CONTROL_INTERVAL_MS 1000
+
+// Average number of events per pulled batch from which another pull thread
+// is started: events wait in the driver queue for a puller.
+#define DOKAN_PULLER_GROW_BATCH_FILL 4
+
+// First dispatch latency bucket of the events considered slow, 2^13
+// microseconds is about 8 milliseconds.
+#define DOKAN_PULLER_SLOW_EVENT_BUCKET 13
+
+// Maximum number of event results sent in a single ioctl.
+#define DOKAN_REPLY_BATCH_MAX_EVENTS 32
+
+// Larger event results are sent directly rather than copied in a batch.
+#define DOKAN_REPLY_BATCH_MAX_RESULT_SIZE DOKAN_EVENT_INFO_DEFAULT_SIZE
+
+// Delay after which batched event results are sent even if no thread pulls.
+#define DOKAN_REPLY_BATCH_MAX_DELAY_MS 1
+
+static VOID CALLBACK DispatchQueuedIoEvent(PTP_CALLBACK_INSTANCE Instance,
+                                           PVOID Parameter, PTP_WORK Work);
+
+static VOID CALLBACK DispatchStolenIoEvent(PTP_CALLBACK_INSTANCE Instance,
+                                           PVOID Parameter, PTP_WORK Work);
+
+VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance,
+                                      PVOID Parameter, PTP_WORK Work);
+
+static PDOKAN_IO_EVENT TakeBatchedEventResults(PDOKAN_INSTANCE DokanInstance);
+
+static VOID ReleaseEventResults(PDOKAN_IO_EVENT IoEvents);
+
 // DokanOptions->DebugMode is ON?
 BOOL g_DebugMode = TRUE;
 
@@ -89,6 +136,13 @@ NewDokanInstance() {
 
   (void)InitializeCriticalSectionAndSpinCount(&dokanInstance->CriticalSection,
                                               0x80000400);
+  (void)InitializeCriticalSectionAndSpinCount(
+      &dokanInstance->ReplyBatch.CriticalSection, 0x80000400);
+  (void)InitializeCriticalSectionAndSpinCount(
+      &dokanInstance->WriteBehind.CriticalSection, 0x80000400);
+  InitializeListHead(&dokanInstance->WriteBehind.DirtyList);
+  // Until the driver accepts another pull buffer length.
+  InitializeIoBatchPool(&dokanInstance->IoBatchPool, BATCH_EVENT_CONTEXT_SIZE);
 
   InitializeListHead(&dokanInstance->ListEntry);
 
@@ -132,22 +186,108 @@ NewDokanInstance() {
     SetThreadpoolCallbackCleanupGroup(
         &dokanInstance->ThreadInfo.CallbackEnvironment,
         dokanInstance->ThreadInfo.CleanupGroup, NULL);
+    // The dispatch work is a member of the cleanup group and is closed with
+    // it. Without it events are queued with one work object each.
+    dokanInstance->ThreadInfo.DispatchQueue =
+        DokanQueue_Alloc(DOKAN_DISPATCH_QUEUE_CAPACITY);
+    if (dokanInstance->ThreadInfo.DispatchQueue) {
+      dokanInstance->ThreadInfo.DispatchWork = CreateThreadpoolWork(
+          DispatchQueuedIoEvent, dokanInstance,
+          &dokanInstance->ThreadInfo.CallbackEnvironment);
+    }
+    // Without scheduler, batched events are all queued with QueueIoEvent.
+    dokanInstance->ThreadInfo.Scheduler = DokanScheduler_Alloc(
+        DOKAN_SCHEDULER_DEQUE_COUNT, DOKAN_SCHEDULER_DEQUE_CAPACITY);
+    if (dokanInstance->ThreadInfo.Scheduler) {
+      dokanInstance->ThreadInfo.StealWork = CreateThreadpoolWork(
+          DispatchStolenIoEvent, dokanInstance,
+          &dokanInstance->ThreadInfo.CallbackEnvironment);
+      if (!dokanInstance->ThreadInfo.StealWork) {
+        DokanScheduler_Free(dokanInstance->ThreadInfo.Scheduler);
+        dokanInstance->ThreadInfo.Scheduler = NULL;
+      }
+    }
     InsertTailList(&g_InstanceList, &dokanInstance->ListEntry);
   }
   LeaveCriticalSection(&g_InstanceCriticalSection);
+  // Statistics are optional, counters are not updated if allocation failed.
+  dokanInstance->Statistics = AllocateInstanceStatistics();
+  for (ULONG i = 0; i < DOKAN_STATISTICS_DISPATCH_CLASS_COUNT; ++i) {
+    (void)InitializeCriticalSectionAndSpinCount(
+        &dokanInstance->DispatchClasses[i].CriticalSection, 0x80000400);
+  }
   return dokanInstance;
 }
 
+// The pools are shared by the instances of the process: they get the largest
+// memory budget and the shortest idle trim interval the mounted instances
+// asked for. Options left to zero do not take part.
+static VOID ConfigureSharedPool() {
+  ULONG64 memoryBudget = 0;
+  ULONG idleTrimIntervalMs = 0;
+  EnterCriticalSection(&g_InstanceCriticalSection);
+  {
+    for (PLIST_ENTRY entry = g_InstanceList.Flink; entry != &g_InstanceList;
+         entry = entry->Flink) {
+      PDOKAN_INSTANCE dokanInstance =
+          CONTAINING_RECORD(entry, DOKAN_INSTANCE, ListEntry);
+      PDOKAN_OPTIONS dokanOptions = dokanInstance->DokanOptions;
+      if (!dokanOptions) {
+        continue;
+      }
+      memoryBudget = max(memoryBudget, dokanOptions->PoolMemoryBudget);
+      if (dokanOptions->PoolIdleTrimIntervalMs &&
+          (!idleTrimIntervalMs ||
+           dokanOptions->PoolIdleTrimIntervalMs < idleTrimIntervalMs)) {
+        idleTrimIntervalMs = dokanOptions->PoolIdleTrimIntervalMs;
+      }
+    }
+    ConfigurePool(memoryBudget, idleTrimIntervalMs);
+  }
+  LeaveCriticalSection(&g_InstanceCriticalSection);
+}
+
 VOID DeleteDokanInstance(PDOKAN_INSTANCE DokanInstance) {
   SetEvent(DokanInstance->DeviceClosedWaitHandle);
+  if (DokanInstance->PullerControl.Timer) {
+    // Stop starting pullers before the thread pool objects are closed.
+    SetThreadpoolTimer(DokanInstance->PullerControl.Timer, NULL, 0, 0);
+    WaitForThreadpoolTimerCallbacks(DokanInstance->PullerControl.Timer, TRUE);
+  }
+  if (DokanInstance->ReplyBatch.Timer) {
+    SetThreadpoolTimer(DokanInstance->ReplyBatch.Timer, NULL, 0, 0);
+    WaitForThreadpoolTimerCallbacks(DokanInstance->ReplyBatch.Timer, TRUE);
+  }
+  // Data still buffered was acknowledged, it is written before the timer is
+  // closed.
+  DokanWriteBehind_Stop(DokanInstance);
   if (DokanInstance->ThreadInfo.CleanupGroup) {
     CloseThreadpoolCleanupGroupMembers(DokanInstance->ThreadInfo.CleanupGroup,
                                        FALSE, DokanInstance);
     CloseThreadpoolCleanupGroup(DokanInstance->ThreadInfo.CleanupGroup);
     DokanInstance->ThreadInfo.CleanupGroup = NULL;
+    DokanInstance->ThreadInfo.DispatchWork = NULL;
+    DokanInstance->ThreadInfo.StealWork = NULL;
+    DokanInstance->PullerControl.Timer = NULL;
+    DokanInstance->ReplyBatch.Timer = NULL;
+    DokanInstance->WriteBehind.Timer = NULL;
     DestroyThreadpoolEnvironment(
         &DokanInstance->ThreadInfo.CallbackEnvironment);
   }
+  DokanQueue_Free(DokanInstance->ThreadInfo.DispatchQueue);
+  if (DokanInstance->ThreadInfo.Scheduler) {
+    // Events can only be left behind if a puller failed while dispatching.
+    PDOKAN_IO_EVENT ioEvent;
+    while ((ioEvent = (PDOKAN_IO_EVENT)DokanScheduler_Steal(
+                DokanInstance->ThreadInfo.Scheduler, 0))) {
+      PushIoBatchBuffer(ioEvent->IoBatch);
+      PushIoEventBuffer(ioEvent);
+    }
+    DokanScheduler_Free(DokanInstance->ThreadInfo.Scheduler);
+  }
+  // The device is closed, results left in the reply batch can be dropped.
+  ReleaseEventResults(TakeBatchedEventResults(DokanInstance));
+  CleanupIoBatchPool(&DokanInstance->IoBatchPool);
   if (DokanInstance->NotifyHandle &&
       DokanInstance->NotifyHandle != INVALID_HANDLE_VALUE) {
     CloseHandle(DokanInstance->NotifyHandle);
@@ -159,15 +299,26 @@ VOID DeleteDokanInstance(PDOKAN_INSTANCE DokanInstance) {
   if (DokanInstance->Device && DokanInstance->Device != INVALID_HANDLE_VALUE) {
     CloseHandle(DokanInstance->Device);
   }
+  FreeReadBuffer(DokanInstance);
   if (DokanInstance->GlobalDevice &&
       DokanInstance->GlobalDevice != INVALID_HANDLE_VALUE) {
     CloseHandle(DokanInstance->GlobalDevice);
   }
   DeleteCriticalSection(&DokanInstance->CriticalSection);
+  DeleteCriticalSection(&DokanInstance->ReplyBatch.CriticalSection);
+  DeleteCriticalSection(&DokanInstance->WriteBehind.CriticalSection);
+  FreeFileInfoCache(DokanInstance);
+  FreeNegativeLookupCache(DokanInstance);
+  FreeDirectoryListCache(DokanInstance);
+  for (ULONG i = 0; i < DOKAN_STATISTICS_DISPATCH_CLASS_COUNT; ++i) {
+    DeleteCriticalSection(&DokanInstance->DispatchClasses[i].CriticalSection);
+  }
   EnterCriticalSection(&g_InstanceCriticalSection);
   { RemoveEntryList(&DokanInstance->ListEntry); }
   LeaveCriticalSection(&g_InstanceCriticalSection);
+  ConfigureSharedPool();
   CloseHandle(DokanInstance->DeviceClosedWaitHandle);
+  FreeInstanceStatistics(DokanInstance->Statistics);
   free(DokanInstance);
 }
 
@@ -296,8 +447,13 @@ VOID SetupIOEventForProcessing(PDOKAN_IO_EVENT IoEvent) {
   }
 }
 
-VOID DispatchEvent(PDOKAN_IO_EVENT ioEvent) {
+// Returns FALSE if the event is completed asynchronously and must no longer be
+// accessed by the caller. Otherwise the caller sends its result, if any, and
+// releases it.
+BOOL DispatchEvent(PDOKAN_IO_EVENT ioEvent) {
   SetupIOEventForProcessing(ioEvent);
+  RecordDispatchedEvent(ioEvent->DokanInstance,
+                        ioEvent->EventContext->MajorFunction);
   switch (ioEvent->EventContext->MajorFunction) {
   case IRP_MJ_CREATE:
     DispatchCreate(ioEvent);
@@ -312,11 +468,9 @@ VOID DispatchEvent(PDOKAN_IO_EVENT ioEvent) {
     DispatchDirectoryInformation(ioEvent);
     break;
   case IRP_MJ_READ:
-    DispatchRead(ioEvent);
-    break;
+    return DispatchRead(ioEvent);
   case IRP_MJ_WRITE:
-    DispatchWrite(ioEvent);
-    break;
+    return DispatchWrite(ioEvent);
   case IRP_MJ_QUERY_INFORMATION:
     DispatchQueryInformation(ioEvent);
     break;
@@ -344,9 +498,10 @@ VOID DispatchEvent(PDOKAN_IO_EVENT ioEvent) {
   default:
     DokanDbgPrintW(L"Dokan Warning: Unsupported IRP 0x%x, event Info = 0x%p.\n",
                    ioEvent->EventContext->MajorFunction, ioEvent->EventContext);
-    PushIoEventBuffer(ioEvent);
+    // Released by the caller like events without result.
     break;
   }
+  return TRUE;
 }
 
 VOID OnDeviceIoCtlFailed(PDOKAN_INSTANCE DokanInstance, DWORD Result) {
@@ -373,41 +528,66 @@ VOID HandleProcessIoFatalError(PDOKAN_INSTANCE DokanInstance,
   OnDeviceIoCtlFailed(DokanInstance, Result);
 }
 
-VOID FreeIoEventResult(PEVENT_INFORMATION EventResult, ULONG EventResultSize,
+VOID FreeIoEventResult(PDOKAN_INSTANCE DokanInstance,
+                       PEVENT_INFORMATION EventResult, ULONG EventResultSize,
                        BOOL PoolAllocated) {
   if (!EventResult) {
     return;
   }
+  ReleaseReadBufferRange(DokanInstance, EventResult);
   if (!PoolAllocated) {
     FreeEventResult(EventResult);
-  } else if (EventResultSize <= DOKAN_EVENT_INFO_DEFAULT_SIZE) {
-    PushEventResult(EventResult);
-  } else if (EventResultSize <= DOKAN_EVENT_INFO_16K_SIZE) {
-    Push16KEventResult(EventResult);
-  } else if (EventResultSize <= DOKAN_EVENT_INFO_32K_SIZE) {
-    Push32KEventResult(EventResult);
-  } else if (EventResultSize <= DOKAN_EVENT_INFO_64K_SIZE) {
-    Push64KEventResult(EventResult);
-  } else if (EventResultSize <= DOKAN_EVENT_INFO_128K_SIZE) {
-    Push128KEventResult(EventResult);
   } else {
-    assert(FALSE);
+    PushEventResult(EventResult, EventResultSize);
+  }
+}
+
+// Work callback of the instance DispatchWork. Each submission matches one
+// pushed event but not necessarily the one it was submitted for.
+static VOID CALLBACK DispatchQueuedIoEvent(PTP_CALLBACK_INSTANCE Instance,
+                                           PVOID Parameter, PTP_WORK Work) {
+  PDOKAN_INSTANCE dokanInstance = (PDOKAN_INSTANCE)Parameter;
+  // An event whose producer claimed its cell but has not published it yet
+  // blocks the ones behind it. The producer submits the work again for this
+  // callback once it is published, so there is nothing to retry here.
+  PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)DokanQueue_PopOrWait(
+      dokanInstance->ThreadInfo.DispatchQueue);
+  if (ioEvent) {
+    ioEvent->QueuedCallback(Instance, ioEvent, Work);
   }
 }
 
+static VOID CALLBACK DispatchUnqueuedIoEvent(PTP_CALLBACK_INSTANCE Instance,
+                                             PVOID Parameter) {
+  PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)Parameter;
+  ioEvent->QueuedCallback(Instance, ioEvent, NULL);
+}
+
 VOID QueueIoEvent(PDOKAN_IO_EVENT IoEvent, PTP_WORK_CALLBACK Callback) {
-  PTP_WORK work = CreateThreadpoolWork(
-      Callback, IoEvent,
-      &IoEvent->DokanInstance->ThreadInfo.CallbackEnvironment);
-  if (!work) {
+  PDOKAN_INSTANCE_THREADINFO threadInfo = &IoEvent->DokanInstance->ThreadInfo;
+  IoEvent->QueuedCallback = Callback;
+  if (IoEvent->EventContext) {
+    RecordQueuedEvent(IoEvent->DokanInstance);
+  }
+  // Submitting an existing work object does not allocate, unlike creating a
+  // new one for each event that then lives until the instance is deleted.
+  LONG waiterCount = 0;
+  if (threadInfo->DispatchWork &&
+      DokanQueue_Push(threadInfo->DispatchQueue, IoEvent, &waiterCount)) {
+    // Also submit for the callbacks that found this event unpublished.
+    for (LONG i = 0; i <= waiterCount; ++i) {
+      SubmitThreadpoolWork(threadInfo->DispatchWork);
+    }
+    return;
+  }
+  if (!TrySubmitThreadpoolCallback(DispatchUnqueuedIoEvent, IoEvent,
+                                   &threadInfo->CallbackEnvironment)) {
     DWORD lastError = GetLastError();
-    DbgPrintW(L"Dokan Error: CreateThreadpoolWork() has returned error "
+    DbgPrintW(L"Dokan Error: TrySubmitThreadpoolCallback() has returned error "
               L"code %u.\n",
               lastError);
     OnDeviceIoCtlFailed(IoEvent->DokanInstance, lastError);
-    return;
   }
-  SubmitThreadpoolWork(work);
 }
 
 DWORD
@@ -417,11 +597,174 @@ GetEventInfoSize(__in ULONG MajorFunction, __in PEVENT_INFORMATION EventInfo) {
     // is the "bytes written" value as opposed to the reply size.
     return sizeof(EVENT_INFORMATION);
   }
+  if (EventInfo->Flags & DOKAN_EVENT_INFO_READ_BUFFER) {
+    // The read data is in the registered read buffer.
+    return sizeof(EVENT_INFORMATION);
+  }
   return (DWORD)max((ULONG)sizeof(EVENT_INFORMATION),
                     FIELD_OFFSET(EVENT_INFORMATION, Buffer[0]) +
                         EventInfo->BufferLength);
 }
 
+// Sends event results to the driver without pulling new events: without
+// output buffer the driver only completes the requests.
+static VOID SendEventInformation(PDOKAN_INSTANCE DokanInstance,
+                                 PVOID InputBuffer, DWORD InputBufferSize) {
+  DWORD returnedLength = 0;
+  if (!DeviceIoControl(DokanInstance->Device, FSCTL_EVENT_PROCESS_N_PULL,
+                       InputBuffer, InputBufferSize, NULL, 0, &returnedLength,
+                       NULL)) {
+    if (!DokanInstance->FileSystemStopped) {
+      DokanDbgPrintW(L"Dokan Error: Dokan device result ioctl failed with "
+                     L"code %d.\n",
+                     GetLastError());
+    }
+  }
+}
+
+// Whether the result of a dispatched event can wait in the reply batch of its
+// instance. Buffer overflow results cannot be batched by the driver.
+static BOOL IsBatchableEventResult(PDOKAN_IO_EVENT IoEvent) {
+  return IoEvent->DokanInstance->ReplyBatch.Timer &&
+         IoEvent->EventResult->Status != STATUS_BUFFER_OVERFLOW &&
+         GetEventInfoSize(IoEvent->EventContext->MajorFunction,
+                          IoEvent->EventResult) <=
+             DOKAN_REPLY_BATCH_MAX_RESULT_SIZE;
+}
+
+// Takes all the results waiting in the reply batch of an instance.
+static PDOKAN_IO_EVENT TakeBatchedEventResults(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_REPLY_BATCH replyBatch = &DokanInstance->ReplyBatch;
+  EnterCriticalSection(&replyBatch->CriticalSection);
+  PDOKAN_IO_EVENT ioEvents = replyBatch->Head;
+  replyBatch->Head = NULL;
+  replyBatch->EventCount = 0;
+  replyBatch->Size = 0;
+  LeaveCriticalSection(&replyBatch->CriticalSection);
+  return ioEvents;
+}
+
+// Sorts the results of IoEvents by serial number, as expected by the driver,
+// and copies them to Buffer. Returns their size.
+static DWORD SerializeEventResults(PDOKAN_IO_EVENT *IoEvents, PCHAR Buffer) {
+  PDOKAN_IO_EVENT sortedEvents = NULL;
+  while (*IoEvents) {
+    PDOKAN_IO_EVENT ioEvent = *IoEvents;
+    *IoEvents = ioEvent->NextWaitingEvent;
+    PDOKAN_IO_EVENT *position = &sortedEvents;
+    while (*position && (*position)->EventResult->SerialNumber <
+                            ioEvent->EventResult->SerialNumber) {
+      position = &(*position)->NextWaitingEvent;
+    }
+    ioEvent->NextWaitingEvent = *position;
+    *position = ioEvent;
+  }
+  *IoEvents = sortedEvents;
+  DWORD size = 0;
+  for (PDOKAN_IO_EVENT ioEvent = sortedEvents; ioEvent;
+       ioEvent = ioEvent->NextWaitingEvent) {
+    DWORD eventInfoSize = GetEventInfoSize(
+        ioEvent->EventContext->MajorFunction, ioEvent->EventResult);
+    PEVENT_INFORMATION eventInfo = (PEVENT_INFORMATION)(Buffer + size);
+    RtlCopyMemory(eventInfo, ioEvent->EventResult, eventInfoSize);
+    if (ioEvent->EventContext->MajorFunction == IRP_MJ_WRITE) {
+      eventInfo->Flags |= DOKAN_EVENT_INFO_FIXED_SIZE;
+    }
+    size += eventInfoSize;
+  }
+  return size;
+}
+
+static VOID ReleaseEventResults(PDOKAN_IO_EVENT IoEvents) {
+  while (IoEvents) {
+    PDOKAN_IO_EVENT ioEvent = IoEvents;
+    IoEvents = ioEvent->NextWaitingEvent;
+    FreeIoEventResult(ioEvent->DokanInstance, ioEvent->EventResult,
+                      ioEvent->EventResultSize, ioEvent->PoolAllocated);
+    PushIoBatchBuffer(ioEvent->IoBatch);
+    PushIoEventBuffer(ioEvent);
+  }
+}
+
+// Sends the results of IoEvents in a single ioctl when possible and releases
+// the events.
+static VOID SendEventResults(PDOKAN_INSTANCE DokanInstance,
+                             PDOKAN_IO_EVENT IoEvents) {
+  PDOKAN_IO_BATCH replyBuffer =
+      IoEvents->NextWaitingEvent ? PopIoBatchBuffer(DokanInstance) : NULL;
+  if (replyBuffer) {
+    DWORD size =
+        SerializeEventResults(&IoEvents, (PCHAR)replyBuffer->EventContext);
+    SendEventInformation(DokanInstance, replyBuffer->EventContext, size);
+    PushIoBatchBuffer(replyBuffer);
+  } else {
+    for (PDOKAN_IO_EVENT ioEvent = IoEvents; ioEvent;
+         ioEvent = ioEvent->NextWaitingEvent) {
+      SendEventInformation(DokanInstance, ioEvent->EventResult,
+                           GetEventInfoSize(ioEvent->EventContext->MajorFunction,
+                                            ioEvent->EventResult));
+    }
+  }
+  ReleaseEventResults(IoEvents);
+}
+
+// Adds a result accepted by IsBatchableEventResult to the reply batch of its
+// instance. It is sent with the next pull of any thread, or after
+// DOKAN_REPLY_BATCH_MAX_DELAY_MS.
+static VOID DeferEventResult(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_INSTANCE dokanInstance = IoEvent->DokanInstance;
+  PDOKAN_REPLY_BATCH replyBatch = &dokanInstance->ReplyBatch;
+  DWORD eventInfoSize = GetEventInfoSize(IoEvent->EventContext->MajorFunction,
+                                         IoEvent->EventResult);
+  PDOKAN_IO_EVENT fullBatch = NULL;
+  EnterCriticalSection(&replyBatch->CriticalSection);
+  // Leave room for the result of the thread taking the batch to pull.
+  if (replyBatch->Size + eventInfoSize >
+      dokanInstance->IoBatchPool.BufferLength -
+          DOKAN_REPLY_BATCH_MAX_RESULT_SIZE) {
+    fullBatch = replyBatch->Head;
+    replyBatch->Head = NULL;
+    replyBatch->EventCount = 0;
+    replyBatch->Size = 0;
+  }
+  IoEvent->NextWaitingEvent = replyBatch->Head;
+  replyBatch->Head = IoEvent;
+  replyBatch->Size += eventInfoSize;
+  if (++replyBatch->EventCount == DOKAN_REPLY_BATCH_MAX_EVENTS) {
+    fullBatch = replyBatch->Head;
+    replyBatch->Head = NULL;
+    replyBatch->EventCount = 0;
+    replyBatch->Size = 0;
+  } else if (replyBatch->EventCount == 1) {
+    // Negative due time is relative, in 100 nanoseconds units.
+    ULARGE_INTEGER dueTime;
+    dueTime.QuadPart =
+        (ULONGLONG)(-(LONGLONG)DOKAN_REPLY_BATCH_MAX_DELAY_MS * 10000);
+    FILETIME fileDueTime;
+    fileDueTime.dwHighDateTime = dueTime.HighPart;
+    fileDueTime.dwLowDateTime = dueTime.LowPart;
+    SetThreadpoolTimer(replyBatch->Timer, &fileDueTime, 0, 0);
+  }
+  LeaveCriticalSection(&replyBatch->CriticalSection);
+  if (fullBatch) {
+    SendEventResults(dokanInstance, fullBatch);
+  }
+}
+
+// Timer callback of the reply batch, sends the results no pull has sent in
+// time.
+static VOID CALLBACK SendBatchedEventResults(PTP_CALLBACK_INSTANCE Instance,
+                                             PVOID Context, PTP_TIMER Timer) {
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Timer);
+
+  PDOKAN_INSTANCE dokanInstance = (PDOKAN_INSTANCE)Context;
+  PDOKAN_IO_EVENT ioEvents = TakeBatchedEventResults(dokanInstance);
+  if (ioEvents) {
+    SendEventResults(dokanInstance, ioEvents);
+  }
+}
+
 DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
                                   PDOKAN_IO_BATCH IoBatch,
                                   BOOL ReleaseBatchBuffers) {
@@ -431,8 +774,39 @@ DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
   ULONG eventResultSize = 0;
   PEVENT_INFORMATION eventInfo = NULL;
   BOOL eventInfoPollAllocated = FALSE;
+  PDOKAN_IO_EVENT batchedEvents = NULL;
+  PDOKAN_IO_BATCH replyBuffer = NULL;
+
+  // Send the results waiting in the reply batch with ours.
+  if (ReleaseBatchBuffers && IoBatch->DokanInstance->ReplyBatch.Head &&
+      (replyBuffer = PopIoBatchBuffer(IoBatch->DokanInstance))) {
+    batchedEvents = TakeBatchedEventResults(IoBatch->DokanInstance);
+    if (batchedEvents && IoEvent && IoEvent->EventResult) {
+      if (IsBatchableEventResult(IoEvent)) {
+        IoEvent->NextWaitingEvent = batchedEvents;
+        batchedEvents = IoEvent;
+      } else {
+        // Our result cannot be batched, the others are sent separately.
+        SendEventResults(IoBatch->DokanInstance, batchedEvents);
+        batchedEvents = NULL;
+      }
+    }
+    if (!batchedEvents) {
+      PushIoBatchBuffer(replyBuffer);
+      replyBuffer = NULL;
+    }
+  }
 
-  if (IoEvent && IoEvent->EventResult) {
+  if (batchedEvents) {
+    inputBuffer = (PCHAR)replyBuffer->EventContext;
+    eventInfoSize = SerializeEventResults(&batchedEvents, inputBuffer);
+    // The driver reads the pull timeout from the first result.
+    ((PEVENT_INFORMATION)inputBuffer)->PullEventTimeoutMs =
+        IoBatch->MainPullThread ? /*infinite*/ 0 : DOKAN_PULL_EVENT_TIMEOUT_MS;
+    DbgPrint("Dokan Information: SendAndPullEventInformation() with a reply "
+             "batch of size %d\n",
+             eventInfoSize);
+  } else if (IoEvent && IoEvent->EventResult) {
     eventInfo = IoEvent->EventResult;
     eventResultSize = IoEvent->EventResultSize;
     eventInfoPollAllocated = IoEvent->PoolAllocated;
@@ -460,13 +834,18 @@ DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
           inputBuffer,                    // Input Buffer to driver.
           eventInfoSize,                  // Length of input buffer in bytes.
           &IoBatch->EventContext[0],      // Output Buffer from driver.
-          BATCH_EVENT_CONTEXT_SIZE,       // Length of output buffer in bytes.
+          IoBatch->DokanInstance->IoBatchPool.BufferLength, // Output length.
           &IoBatch->NumberOfBytesTransferred, // Bytes placed in buffer.
           NULL                                // asynchronous call
           )) {
     lastError = GetLastError();
     if (eventInfo) {
-      FreeIoEventResult(eventInfo, eventResultSize, eventInfoPollAllocated);
+      FreeIoEventResult(IoBatch->DokanInstance, eventInfo, eventResultSize,
+                        eventInfoPollAllocated);
+    }
+    if (replyBuffer) {
+      ReleaseEventResults(batchedEvents);
+      PushIoBatchBuffer(replyBuffer);
     }
     if (!IoBatch->DokanInstance->FileSystemStopped) {
       DokanDbgPrintW(
@@ -476,12 +855,234 @@ DWORD SendAndPullEventInformation(PDOKAN_IO_EVENT IoEvent,
     }
     return lastError;
   }
+  QueryPerformanceCounter(&IoBatch->PullTime);
   if (eventInfo) {
-    FreeIoEventResult(eventInfo, eventResultSize, eventInfoPollAllocated);
+    FreeIoEventResult(IoBatch->DokanInstance, eventInfo, eventResultSize,
+                      eventInfoPollAllocated);
+  }
+  if (replyBuffer) {
+    ReleaseEventResults(batchedEvents);
+    PushIoBatchBuffer(replyBuffer);
   }
   return 0;
 }
 
+// Returns whether the calling pull thread should stop waiting indefinitely
+// for events, in which case it is no longer counted as a puller.
+static BOOL TryRetirePuller(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_PULLER_CONTROL control = &DokanInstance->PullerControl;
+  LONG pullerCount = control->PullerCount;
+  while (pullerCount > control->TargetPullerCount) {
+    LONG previousCount = InterlockedCompareExchange(
+        &control->PullerCount, pullerCount - 1, pullerCount);
+    if (previousCount == pullerCount) {
+      return TRUE;
+    }
+    pullerCount = previousCount;
+  }
+  return FALSE;
+}
+
+// Returns the next scheduled event an idle thread should process: the most
+// recent event of its own deque first as it is likely still cached, then the
+// oldest event of another deque.
+static PDOKAN_IO_EVENT TakeScheduledIoEvent(PDOKAN_INSTANCE DokanInstance,
+                                            PDOKAN_WORK_DEQUE Deque) {
+  PDOKAN_WORK_SCHEDULER scheduler = DokanInstance->ThreadInfo.Scheduler;
+  if (!scheduler) {
+    return NULL;
+  }
+  if (Deque) {
+    PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)DokanScheduler_Pop(Deque);
+    if (ioEvent) {
+      return ioEvent;
+    }
+  }
+  return (PDOKAN_IO_EVENT)DokanScheduler_Steal(scheduler,
+                                               GetCurrentProcessorNumber());
+}
+
+// Schedules an event in the deque of the current thread, or queues it to the
+// thread pool. Returns whether a thief has to be woken up for it.
+static BOOL ScheduleIoEvent(PDOKAN_IO_EVENT IoEvent, PDOKAN_WORK_DEQUE Deque) {
+  if (Deque && DokanScheduler_Push(Deque, IoEvent)) {
+    RecordQueuedEvent(IoEvent->DokanInstance);
+    return TRUE;
+  }
+  QueueIoEvent(IoEvent, DispatchBatchIoCallback);
+  return FALSE;
+}
+
+static ULONG GetDispatchClass(ULONG MajorFunction) {
+  switch (MajorFunction) {
+  case IRP_MJ_READ:
+  case IRP_MJ_WRITE:
+  case IRP_MJ_FLUSH_BUFFERS:
+    return DOKAN_DISPATCH_CLASS_BULK;
+  default:
+    return DOKAN_DISPATCH_CLASS_METADATA;
+  }
+}
+
+// Returns whether the event can be dispatched now. Otherwise it is deferred
+// until an event of the same class completes. See
+// DOKAN_OPTIONS.MaxMetadataDispatchCount and MaxBulkDispatchCount.
+static BOOL EnterDispatchClass(PDOKAN_IO_EVENT IoEvent) {
+  if (IoEvent->DispatchClass) {
+    // The slot was handed over by LeaveDispatchClass.
+    return TRUE;
+  }
+  ULONG classIndex = GetDispatchClass(IoEvent->EventContext->MajorFunction);
+  PDOKAN_DISPATCH_CLASS dispatchClass =
+      &IoEvent->DokanInstance->DispatchClasses[classIndex];
+  if (!dispatchClass->MaxRunning) {
+    return TRUE;
+  }
+  BOOL enter;
+  EnterCriticalSection(&dispatchClass->CriticalSection);
+  enter = dispatchClass->Running < dispatchClass->MaxRunning;
+  if (enter) {
+    ++dispatchClass->Running;
+    IoEvent->DispatchClass = dispatchClass;
+  } else {
+    IoEvent->NextWaitingEvent = NULL;
+    if (dispatchClass->DeferredTail) {
+      dispatchClass->DeferredTail->NextWaitingEvent = IoEvent;
+    } else {
+      dispatchClass->DeferredHead = IoEvent;
+    }
+    dispatchClass->DeferredTail = IoEvent;
+  }
+  LeaveCriticalSection(&dispatchClass->CriticalSection);
+  if (!enter) {
+    RecordDeferredEvent(IoEvent->DokanInstance, classIndex);
+  }
+  return enter;
+}
+
+// Releases the slot held by a dispatched event. Returns the next deferred
+// event of the class, which then holds the slot, or NULL.
+static PDOKAN_IO_EVENT LeaveDispatchClass(PDOKAN_DISPATCH_CLASS DispatchClass) {
+  EnterCriticalSection(&DispatchClass->CriticalSection);
+  PDOKAN_IO_EVENT nextEvent = DispatchClass->DeferredHead;
+  if (nextEvent) {
+    DispatchClass->DeferredHead = nextEvent->NextWaitingEvent;
+    if (!DispatchClass->DeferredHead) {
+      DispatchClass->DeferredTail = NULL;
+    }
+    nextEvent->NextWaitingEvent = NULL;
+    nextEvent->DispatchClass = DispatchClass;
+  } else {
+    --DispatchClass->Running;
+  }
+  LeaveCriticalSection(&DispatchClass->CriticalSection);
+  return nextEvent;
+}
+
+// Returns whether the event can be dispatched now. Otherwise it is appended
+// to the lane of its open and is scheduled once the events pulled before it
+// are dispatched. See DOKAN_OPTION_ORDERED_FILE_DISPATCH.
+static BOOL EnterDispatchLane(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_OPEN_INFO openInfo =
+      (PDOKAN_OPEN_INFO)(UINT_PTR)IoEvent->EventContext->Context;
+  if (!openInfo ||
+      !(IoEvent->DokanInstance->DokanOptions->Options &
+        DOKAN_OPTION_ORDERED_FILE_DISPATCH) ||
+      IoEvent->EventContext->MajorFunction == IRP_MJ_CLOSE) {
+    return TRUE;
+  }
+  BOOL enter;
+  EnterCriticalSection(&openInfo->CriticalSection);
+  enter = !openInfo->LaneBusy;
+  if (enter) {
+    openInfo->LaneBusy = TRUE;
+    IoEvent->LaneOpenInfo = openInfo;
+  } else {
+    IoEvent->NextWaitingEvent = NULL;
+    if (openInfo->LaneTail) {
+      openInfo->LaneTail->NextWaitingEvent = IoEvent;
+    } else {
+      openInfo->LaneHead = IoEvent;
+    }
+    openInfo->LaneTail = IoEvent;
+  }
+  LeaveCriticalSection(&openInfo->CriticalSection);
+  return enter;
+}
+
+// Releases the lane held by a dispatched event. Returns the next event of the
+// lane, which then holds it, or NULL if the lane is now free.
+static PDOKAN_IO_EVENT LeaveDispatchLane(PDOKAN_OPEN_INFO OpenInfo) {
+  EnterCriticalSection(&OpenInfo->CriticalSection);
+  PDOKAN_IO_EVENT nextEvent = OpenInfo->LaneHead;
+  if (nextEvent) {
+    OpenInfo->LaneHead = nextEvent->NextWaitingEvent;
+    if (!OpenInfo->LaneHead) {
+      OpenInfo->LaneTail = NULL;
+    }
+    nextEvent->NextWaitingEvent = NULL;
+    nextEvent->LaneOpenInfo = OpenInfo;
+  } else {
+    OpenInfo->LaneBusy = FALSE;
+  }
+  LeaveCriticalSection(&OpenInfo->CriticalSection);
+  return nextEvent;
+}
+
+// Called by a dispatcher whose operation callback returned STATUS_PENDING.
+// Returns FALSE if the event is now owned by its completion, or TRUE if it
+// already completed and the caller sends its result as usual.
+BOOL SetIoEventPending(PDOKAN_IO_EVENT IoEvent) {
+  return InterlockedCompareExchange(&IoEvent->AsyncState,
+                                    DOKAN_IO_EVENT_ASYNC_PENDING,
+                                    DOKAN_IO_EVENT_ASYNC_DISPATCHING) ==
+         DOKAN_IO_EVENT_ASYNC_COMPLETED;
+}
+
+// Sends the result of an event completed after its dispatcher returned,
+// without pulling new events, and releases the event.
+static VOID SendAsyncEventResult(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_INSTANCE dokanInstance = IoEvent->DokanInstance;
+  PEVENT_INFORMATION eventInfo = IoEvent->EventResult;
+  DWORD eventInfoSize =
+      GetEventInfoSize(IoEvent->EventContext->MajorFunction, eventInfo);
+  PDOKAN_IO_EVENT nextLaneEvent = NULL;
+  if (IoEvent->LaneOpenInfo) {
+    nextLaneEvent = LeaveDispatchLane(IoEvent->LaneOpenInfo);
+  }
+  // The class slot was kept while the operation was pending, so that
+  // MaxBulkDispatchCount also bounds the operations in flight.
+  PDOKAN_IO_EVENT nextClassEvent = NULL;
+  if (IoEvent->DispatchClass) {
+    nextClassEvent = LeaveDispatchClass(IoEvent->DispatchClass);
+  }
+  SendEventInformation(dokanInstance, eventInfo, eventInfoSize);
+  FreeIoEventResult(dokanInstance, eventInfo, IoEvent->EventResultSize,
+                    IoEvent->PoolAllocated);
+  PushIoBatchBuffer(IoEvent->IoBatch);
+  PushIoEventBuffer(IoEvent);
+  if (nextLaneEvent) {
+    QueueIoEvent(nextLaneEvent, DispatchBatchIoCallback);
+  }
+  if (nextClassEvent) {
+    QueueIoEvent(nextClassEvent, DispatchBatchIoCallback);
+  }
+}
+
+// Called once the result of an operation that returned STATUS_PENDING is
+// filled, possibly before the operation callback returned.
+VOID CompleteIoEvent(PDOKAN_IO_EVENT IoEvent) {
+  EventCompletion(IoEvent);
+  if (InterlockedCompareExchange(&IoEvent->AsyncState,
+                                 DOKAN_IO_EVENT_ASYNC_COMPLETED,
+                                 DOKAN_IO_EVENT_ASYNC_DISPATCHING) ==
+      DOKAN_IO_EVENT_ASYNC_DISPATCHING) {
+    // The dispatcher has not returned yet and sends the result itself.
+    return;
+  }
+  SendAsyncEventResult(IoEvent);
+}
+
 VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Parameter,
                                PTP_WORK Work) {
   UNREFERENCED_PARAMETER(Instance);
@@ -492,45 +1093,111 @@ VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Para
   PDOKAN_INSTANCE dokanInstance = ioEvent->DokanInstance;
   PDOKAN_IO_BATCH ioBatch = NULL;
   BOOL mainPullThread = ioEvent->EventContext == NULL;
+  // Deque where this thread schedules the events it pulls, acquired with the
+  // first batch and kept until the thread terminates.
+  PDOKAN_WORK_DEQUE deque = NULL;
 
   while (TRUE) {
     // 6 - Process events coming from:
     // - Last event not dispatched to the pool (see bottom of this fct).
     // - New pool thread that just started with a dispatched event.
+    // - Scheduled event taken from a deque.
     // Note: Main pull thread does not have an EventContext when started.
     if (ioEvent && ioEvent->EventContext) {
-      DispatchEvent(ioEvent);
+      if (!EnterDispatchClass(ioEvent)) {
+        // Deferred until an event of its class completes: help with other
+        // scheduled events, otherwise pull or terminate.
+        ioEvent = TakeScheduledIoEvent(dokanInstance, deque);
+        if (ioEvent || mainPullThread) {
+          continue;
+        }
+        DokanScheduler_ReleaseDeque(deque);
+        return;
+      }
+      PDOKAN_OPEN_INFO laneOpenInfo = ioEvent->LaneOpenInfo;
+      PDOKAN_DISPATCH_CLASS dispatchClass = ioEvent->DispatchClass;
+      ULONG classIndex = GetDispatchClass(ioEvent->EventContext->MajorFunction);
+      LARGE_INTEGER pullTime = ioEvent->IoBatch->PullTime;
+      BOOL dispatched = DispatchEvent(ioEvent);
+      if (laneOpenInfo && dispatched) {
+        // The result is not sent yet so the open cannot be closed and
+        // released before we leave its lane.
+        PDOKAN_IO_EVENT nextLaneEvent = LeaveDispatchLane(laneOpenInfo);
+        if (nextLaneEvent && ScheduleIoEvent(nextLaneEvent, deque)) {
+          SubmitThreadpoolWork(dokanInstance->ThreadInfo.StealWork);
+        }
+      }
+      if (dispatchClass && dispatched) {
+        // A pending event keeps its slot until SendAsyncEventResult.
+        PDOKAN_IO_EVENT nextClassEvent = LeaveDispatchClass(dispatchClass);
+        if (nextClassEvent && ScheduleIoEvent(nextClassEvent, deque)) {
+          SubmitThreadpoolWork(dokanInstance->ThreadInfo.StealWork);
+        }
+      }
+      RecordDispatchLatency(dokanInstance, classIndex, &pullTime);
+      if (!dispatched) {
+        // Completed asynchronously with its lane: help with other scheduled
+        // events, otherwise pull or terminate.
+        ioEvent = TakeScheduledIoEvent(dokanInstance, deque);
+        if (ioEvent || mainPullThread) {
+          continue;
+        }
+        DokanScheduler_ReleaseDeque(deque);
+        return;
+      }
       if (!ioEvent->EventResult) {
         // Some events like Close() do not have event results.
-        // Release the resource and terminate here unless we are the main pulling thread.
+        // Release the resource and process another scheduled event if any.
+        // Otherwise terminate here unless we are the main pulling thread.
         PushIoBatchBuffer(ioEvent->IoBatch);
         PushIoEventBuffer(ioEvent);
-        if (mainPullThread) {
-          ioEvent = NULL;
+        ioEvent = TakeScheduledIoEvent(dokanInstance, deque);
+        if (ioEvent || mainPullThread) {
           continue;
         }
+        DokanScheduler_ReleaseDeque(deque);
         return;
       }
+      // Help with scheduled events before pulling, the result is sent in a
+      // reply batch with the next pull of any thread.
+      if (IsBatchableEventResult(ioEvent)) {
+        PDOKAN_IO_EVENT nextEvent = TakeScheduledIoEvent(dokanInstance, deque);
+        if (nextEvent) {
+          DeferEventResult(ioEvent);
+          ioEvent = nextEvent;
+          continue;
+        }
+      }
     }
 
-    ioBatch = PopIoBatchBuffer();
+    // Retire when there are more pullers than needed: the result is sent
+    // with a pull timeout and the thread terminates once idle.
+    if (mainPullThread && ioEvent && ioEvent->EventResult &&
+        TryRetirePuller(dokanInstance)) {
+      mainPullThread = FALSE;
+    }
+
+    ioBatch = PopIoBatchBuffer(dokanInstance);
     ioBatch->MainPullThread = mainPullThread;
     ioBatch->DokanInstance = dokanInstance;
 
     // 1 - Send event result and pull new events.
     DWORD error = SendAndPullEventInformation(ioEvent, ioBatch, /*ReleaseBatchBuffers=*/TRUE);
     if (error) {
+      DokanScheduler_ReleaseDeque(deque);
       HandleProcessIoFatalError(dokanInstance, ioBatch, error);
       return;
     }
 
-    // 2 - Terminate thread as nothing needs to be proceed unless we are the mainPullThread.
+    // 2 - Nothing was pulled: help with scheduled events, otherwise terminate
+    // thread unless we are the mainPullThread.
     if (!ioBatch->NumberOfBytesTransferred) {
       PushIoBatchBuffer(ioBatch);
-      if (mainPullThread) {
-        ioEvent = NULL;
+      ioEvent = TakeScheduledIoEvent(dokanInstance, deque);
+      if (ioEvent || mainPullThread) {
         continue;
       }
+      DokanScheduler_ReleaseDeque(deque);
       return;
     }
 
@@ -542,13 +1209,21 @@ VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Para
       currentNumberOfBytesTransferred -= context->Length;
       context = (PEVENT_CONTEXT)((PCHAR)(context) + context->Length);
     }
+    RecordPulledBatch(dokanInstance, ioBatch->EventContextBatchCount);
+    if (!deque && ioBatch->EventContextBatchCount > 1 &&
+        dokanInstance->ThreadInfo.Scheduler) {
+      deque = DokanScheduler_AcquireDeque(dokanInstance->ThreadInfo.Scheduler,
+                                          GetCurrentProcessorNumber());
+    }
     // 3 - Dispatch Events
     context = ioBatch->EventContext;
     LONG eventContextBatchCount = ioBatch->EventContextBatchCount;
+    BOOL scheduled = FALSE;
     while (eventContextBatchCount) {
       ioEvent = PopIoEventBuffer();
       if (!ioEvent) {
         DbgPrintW(L"Dokan Error: IoEvent allocation failed.\n");
+        DokanScheduler_ReleaseDeque(deque);
         OnDeviceIoCtlFailed(ioBatch->DokanInstance, ERROR_OUTOFMEMORY);
         return;
       }
@@ -558,13 +1233,47 @@ VOID CALLBACK DispatchBatchIoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Para
       --eventContextBatchCount;
       // It is unsafe to access the context from here after Queuing the event.
       context = (PEVENT_CONTEXT)((PCHAR)(context) + context->Length);
-      // 4 - All batched events are dispatched to the thread pool except the last event that is executed on the current thread.
+      // Events waiting on the lane of their open are scheduled when the lane
+      // is released.
+      if (!EnterDispatchLane(ioEvent)) {
+        ioEvent = NULL;
+        continue;
+      }
+      // 4 - All batched events are scheduled in our deque, or dispatched to the thread pool when it is full, except the last event that is executed on the current thread.
       // Note: Single thread mode has batching disabled and therefore only has one event which is executed on the main thread.
       if (eventContextBatchCount) {
-        QueueIoEvent(ioEvent, DispatchBatchIoCallback);
+        scheduled |= ScheduleIoEvent(ioEvent, deque);
       }
     }
+    // 5 - Wake up one thief. Each successful steal wakes up the next one so
+    // idle pullers taking events first avoid useless submissions.
+    if (scheduled) {
+      SubmitThreadpoolWork(dokanInstance->ThreadInfo.StealWork);
+    }
+    // The last event is waiting on its lane: help with scheduled events,
+    // otherwise terminate thread unless we are the mainPullThread.
+    if (!ioEvent) {
+      ioEvent = TakeScheduledIoEvent(dokanInstance, deque);
+      if (!ioEvent && !mainPullThread) {
+        DokanScheduler_ReleaseDeque(deque);
+        return;
+      }
+    }
+  }
+}
+
+// Work callback of the instance StealWork. The scheduled events may already
+// have been taken by their puller or idle threads, there is then nothing to do.
+static VOID CALLBACK DispatchStolenIoEvent(PTP_CALLBACK_INSTANCE Instance,
+                                           PVOID Parameter, PTP_WORK Work) {
+  PDOKAN_INSTANCE dokanInstance = (PDOKAN_INSTANCE)Parameter;
+  PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)DokanScheduler_Steal(
+      dokanInstance->ThreadInfo.Scheduler, GetCurrentProcessorNumber());
+  if (!ioEvent) {
+    return;
   }
+  SubmitThreadpoolWork(dokanInstance->ThreadInfo.StealWork);
+  DispatchBatchIoCallback(Instance, ioEvent, Work);
 }
 
 VOID CALLBACK DispatchDedicatedIoCallback(PTP_CALLBACK_INSTANCE Instance,
@@ -574,13 +1283,24 @@ VOID CALLBACK DispatchDedicatedIoCallback(PTP_CALLBACK_INSTANCE Instance,
 
   PDOKAN_IO_EVENT ioEvent = (PDOKAN_IO_EVENT)Parameter;
   assert(ioEvent);
-  PDOKAN_IO_BATCH ioBatch = PopIoBatchBuffer();
+  PDOKAN_IO_BATCH ioBatch = PopIoBatchBuffer(ioEvent->DokanInstance);
   ioBatch->MainPullThread = TRUE;
   ioBatch->DokanInstance = ioEvent->DokanInstance;
   ioEvent->EventContext = ioBatch->EventContext;
   ioEvent->IoBatch = ioBatch;
 
   while (TRUE) {
+    // Retire when there are more pullers than needed: the result is sent
+    // with a pull timeout and the thread terminates once idle.
+    if (ioBatch->MainPullThread && ioEvent->EventResult &&
+        TryRetirePuller(ioBatch->DokanInstance)) {
+      ioBatch->MainPullThread = FALSE;
+    }
+    if (!ioBatch->MainPullThread && !ioEvent->EventResult) {
+      PushIoEventBuffer(ioEvent);
+      PushIoBatchBuffer(ioBatch);
+      return;
+    }
     // 1 - Send possible event result and pull new events.
     DWORD error =
         SendAndPullEventInformation(ioEvent, ioBatch, /*ReleaseBatchBuffers=*/FALSE);
@@ -597,8 +1317,116 @@ VOID CALLBACK DispatchDedicatedIoCallback(PTP_CALLBACK_INSTANCE Instance,
     if (!ioBatch->NumberOfBytesTransferred) {
       continue;
     }
+    RecordPulledBatch(ioBatch->DokanInstance, 1);
     // 3 - Process event
-    DispatchEvent(ioEvent);
+    ULONG classIndex = GetDispatchClass(ioEvent->EventContext->MajorFunction);
+    LARGE_INTEGER pullTime = ioBatch->PullTime;
+    PDOKAN_INSTANCE dokanInstance = ioBatch->DokanInstance;
+    BOOL mainPullThread = ioBatch->MainPullThread;
+    if (!DispatchEvent(ioEvent)) {
+      // The event keeps its batch until it completes asynchronously, continue
+      // with new buffers.
+      ioEvent = PopIoEventBuffer();
+      ioBatch = PopIoBatchBuffer(dokanInstance);
+      if (!ioEvent || !ioBatch) {
+        DbgPrintW(L"Dokan Error: IoEvent allocation failed.\n");
+        if (ioEvent) {
+          PushIoEventBuffer(ioEvent);
+        }
+        if (ioBatch) {
+          PushIoBatchBuffer(ioBatch);
+        }
+        OnDeviceIoCtlFailed(dokanInstance, ERROR_OUTOFMEMORY);
+        return;
+      }
+      ioBatch->MainPullThread = mainPullThread;
+      ioBatch->DokanInstance = dokanInstance;
+      ioEvent->DokanInstance = dokanInstance;
+      ioEvent->EventContext = ioBatch->EventContext;
+      ioEvent->IoBatch = ioBatch;
+    }
+    RecordDispatchLatency(dokanInstance, classIndex, &pullTime);
+  }
+}
+
+// Starts a thread waiting indefinitely for events. The caller accounts for it
+// in the PullerControl.PullerCount.
+static BOOL StartPuller(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_IO_EVENT ioEvent = PopIoEventBuffer();
+  if (!ioEvent) {
+    DokanDbgPrintW(L"Dokan Error: IoEvent allocation failed.");
+    return FALSE;
+  }
+  ioEvent->DokanInstance = DokanInstance;
+  QueueIoEvent(ioEvent, (DokanInstance->DokanOptions->Options &
+                         DOKAN_OPTION_ALLOW_IPC_BATCHING)
+                            ? DispatchBatchIoCallback
+                            : DispatchDedicatedIoCallback);
+  return TRUE;
+}
+
+// Adds a puller when events wait in the driver: batches are full, or events
+// are slow and batches hold more than one event. Removes one when every pull
+// returns at most a single quick event.
+static VOID CALLBACK PullerControlCallback(PTP_CALLBACK_INSTANCE Instance,
+                                           PVOID Context, PTP_TIMER Timer) {
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Timer);
+
+  PDOKAN_INSTANCE dokanInstance = (PDOKAN_INSTANCE)Context;
+  PDOKAN_PULLER_CONTROL control = &dokanInstance->PullerControl;
+  DOKAN_RUNTIME_STATISTICS statistics;
+  if (dokanInstance->FileSystemStopped ||
+      !DokanGetRuntimeStatistics((DOKAN_HANDLE)dokanInstance, &statistics)) {
+    return;
+  }
+  ULONG64 dispatchedEvents = 0;
+  ULONG64 slowEvents = 0;
+  for (ULONG i = 0; i < DOKAN_STATISTICS_DISPATCH_CLASS_COUNT; ++i) {
+    for (ULONG j = 0; j < DOKAN_STATISTICS_LATENCY_BUCKET_COUNT; ++j) {
+      dispatchedEvents += statistics.DispatchLatencies[i][j];
+      if (j >= DOKAN_PULLER_SLOW_EVENT_BUCKET) {
+        slowEvents += statistics.DispatchLatencies[i][j];
+      }
+    }
+  }
+  ULONG64 batches = statistics.PulledBatches - control->PulledBatches;
+  ULONG64 events = statistics.PulledEvents - control->PulledEvents;
+  ULONG64 dispatched = dispatchedEvents - control->DispatchedEvents;
+  ULONG64 slow = slowEvents - control->SlowEvents;
+  control->PulledBatches = statistics.PulledBatches;
+  control->PulledEvents = statistics.PulledEvents;
+  control->DispatchedEvents = dispatchedEvents;
+  control->SlowEvents = slowEvents;
+
+  LONG targetPullerCount = control->TargetPullerCount;
+  if (events >= batches * DOKAN_PULLER_GROW_BATCH_FILL && batches) {
+    ++targetPullerCount;
+  } else if (events > batches && slow * 4 >= dispatched) {
+    ++targetPullerCount;
+  } else if (events <= batches && !slow) {
+    --targetPullerCount;
+  }
+  targetPullerCount = max(control->MinPullerCount,
+                          min(control->MaxPullerCount, targetPullerCount));
+  if (targetPullerCount != control->TargetPullerCount) {
+    DbgPrint("Dokan Information: Adjusting pull threads from %ld to %ld.\n",
+             control->TargetPullerCount, targetPullerCount);
+    InterlockedExchange(&control->TargetPullerCount, targetPullerCount);
+  }
+  LONG pullerCount = control->PullerCount;
+  while (pullerCount < targetPullerCount) {
+    LONG previousCount = InterlockedCompareExchange(
+        &control->PullerCount, pullerCount + 1, pullerCount);
+    if (previousCount != pullerCount) {
+      pullerCount = previousCount;
+      continue;
+    }
+    if (!StartPuller(dokanInstance)) {
+      InterlockedDecrement(&control->PullerCount);
+      break;
+    }
+    ++pullerCount;
   }
 }
 
@@ -667,6 +1495,29 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
   return returnCode;
 }
 
+// Applications built against an older header pass structures ending before
+// the members added since DOKAN_EXTENDED_API_VERSION. Only the part they know
+// about is read, the other members stay zero so the features they enable are
+// off.
+static VOID SetDokanInstanceParameters(PDOKAN_INSTANCE DokanInstance,
+                                       PDOKAN_OPTIONS DokanOptions,
+                                       PDOKAN_OPERATIONS DokanOperations) {
+  if (DokanOptions->Version >= DOKAN_EXTENDED_API_VERSION) {
+    DokanInstance->DokanOptions = DokanOptions;
+    DokanInstance->DokanOperations = DokanOperations;
+    return;
+  }
+  DbgPrintW(L"Dokan Info: Version %d ignores the options and operations "
+            L"added in %d.\n",
+            DokanOptions->Version, DOKAN_EXTENDED_API_VERSION);
+  memcpy(&DokanInstance->LegacyOptions, DokanOptions,
+         FIELD_OFFSET(DOKAN_OPTIONS, PoolMemoryBudget));
+  memcpy(&DokanInstance->LegacyOperations, DokanOperations,
+         FIELD_OFFSET(DOKAN_OPERATIONS, ReadFileScatter));
+  DokanInstance->DokanOptions = &DokanInstance->LegacyOptions;
+  DokanInstance->DokanOperations = &DokanInstance->LegacyOperations;
+}
+
 int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
                                    _In_ PDOKAN_OPERATIONS DokanOperations,
                                    _Out_ DOKAN_HANDLE *DokanInstance) {
@@ -723,8 +1574,17 @@ int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
     return DOKAN_DRIVER_INSTALL_ERROR;
   }
 
-  dokanInstance->DokanOptions = DokanOptions;
-  dokanInstance->DokanOperations = DokanOperations;
+  SetDokanInstanceParameters(dokanInstance, DokanOptions, DokanOperations);
+  DokanOptions = dokanInstance->DokanOptions;
+  if ((DokanOptions->Options & DOKAN_OPTION_ORDERED_FILE_DISPATCH) &&
+      (DokanOptions->ReadAheadSize || DokanOptions->WriteBehindSize)) {
+    // Prefetches and write-behind flushes call the file system from the
+    // thread pool, outside of the ordered events of the handle.
+    DokanDbgPrintW(L"Dokan Error: ReadAheadSize and WriteBehindSize cannot be "
+                   L"used with DOKAN_OPTION_ORDERED_FILE_DISPATCH.\n");
+    DeleteDokanInstance(dokanInstance);
+    return DOKAN_ERROR;
+  }
   dokanInstance->GlobalDevice =
       CreateFile(DOKAN_GLOBAL_DEVICE_NAME,           // lpFileName
                  0,                                  // dwDesiredAccess
@@ -785,6 +1645,9 @@ int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
     DeleteDokanInstance(dokanInstance);
     return DOKAN_DRIVER_INSTALL_ERROR;
   }
+  if (DokanOptions->ReadBufferSize) {
+    RegisterReadBuffer(dokanInstance, DokanOptions->ReadBufferSize);
+  }
 
   DWORD_PTR processAffinityMask;
   DWORD_PTR systemAffinityMask;
@@ -809,21 +1672,90 @@ int DOKANAPI DokanCreateFileSystem(_In_ PDOKAN_OPTIONS DokanOptions,
     DokanOptions->Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
     mainPullThreadCount = DOKAN_MAIN_PULL_THREAD_COUNT_MAX;
   }
+  if (!DokanOptions->SingleThread &&
+      (DokanOptions->Options & DOKAN_OPTION_ORDERED_FILE_DISPATCH)) {
+    // Events are ordered by the batch dispatcher.
+    DokanOptions->Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+  }
+  DWORD maxPullThreadCount =
+      DokanOptions->SingleThread ? 1 : DOKAN_MAIN_PULL_THREAD_COUNT_MAX;
+  if (DokanOptions->MaxThreads && !DokanOptions->SingleThread) {
+    // Leave at least as many threads to process the pulled events.
+    maxPullThreadCount =
+        max(1, min(maxPullThreadCount, DokanOptions->MaxThreads / 2));
+  }
+  mainPullThreadCount = min(mainPullThreadCount, maxPullThreadCount);
   BOOLEAN allowIpcBatching =
       (BOOLEAN)(DokanOptions->Options & DOKAN_OPTION_ALLOW_IPC_BATCHING);
   DbgPrintW(L"Dokan: Using %d main pull threads with ipc batching: %d\n",
             mainPullThreadCount, allowIpcBatching);
+  dokanInstance->DispatchClasses[DOKAN_DISPATCH_CLASS_METADATA].MaxRunning =
+      DokanOptions->MaxMetadataDispatchCount;
+  dokanInstance->DispatchClasses[DOKAN_DISPATCH_CLASS_BULK].MaxRunning =
+      DokanOptions->MaxBulkDispatchCount;
+  ConfigureSharedPool();
+  if (DokanOptions->PoolPrewarmEventCount) {
+    PrewarmPool(dokanInstance, DokanOptions->PoolPrewarmEventCount,
+                mainPullThreadCount);
+  }
+  ConfigureThreadPool(DokanOptions->MinThreads, DokanOptions->MaxThreads);
+  // Only the driver batching mode accepts several results per ioctl, and the
+  // pull buffers must hold a batch with the result of its puller.
+  if ((DokanOptions->Options & DOKAN_OPTION_ALLOW_IPC_BATCHING) &&
+      dokanInstance->IoBatchPool.BufferLength >=
+          2 * DOKAN_REPLY_BATCH_MAX_RESULT_SIZE) {
+    dokanInstance->ReplyBatch.Timer =
+        CreateThreadpoolTimer(SendBatchedEventResults, dokanInstance,
+                              &dokanInstance->ThreadInfo.CallbackEnvironment);
+    if (!dokanInstance->ReplyBatch.Timer) {
+      DbgPrintW(L"Dokan Warning: Failed to create the reply batch timer.\n");
+    }
+  }
+  if (DokanOptions->FileInfoCacheTtlMs) {
+    InitializeFileInfoCache(dokanInstance);
+  }
+  if (DokanOptions->NegativeLookupCacheTtlMs) {
+    InitializeNegativeLookupCache(dokanInstance);
+  }
+  if (DokanOptions->DirectoryListCacheTtlMs) {
+    InitializeDirectoryListCache(dokanInstance);
+  }
+  if (DokanOptions->WriteBehindSize && !DokanWriteBehind_Start(dokanInstance)) {
+    DbgPrintW(L"Dokan Warning: Failed to create the write-behind timer.\n");
+  }
+  PDOKAN_PULLER_CONTROL pullerControl = &dokanInstance->PullerControl;
+  pullerControl->MinPullerCount =
+      min(DOKAN_MAIN_PULL_THREAD_COUNT_MIN, maxPullThreadCount);
+  pullerControl->MaxPullerCount = maxPullThreadCount;
+  pullerControl->TargetPullerCount = mainPullThreadCount;
+  pullerControl->PullerCount = mainPullThreadCount;
   for (DWORD x = 0; x < mainPullThreadCount; ++x) {
-    PDOKAN_IO_EVENT ioEvent = PopIoEventBuffer();
-    if (!ioEvent) {
-      DokanDbgPrintW(L"Dokan Error: IoEvent allocation failed.");
+    if (!StartPuller(dokanInstance)) {
       DeleteDokanInstance(dokanInstance);
       return DOKAN_MOUNT_ERROR;
     }
-    ioEvent->DokanInstance = dokanInstance;
-    QueueIoEvent(ioEvent, allowIpcBatching
-                              ? DispatchBatchIoCallback
-                              : DispatchDedicatedIoCallback);
+  }
+  // The controller relies on the statistics to observe the activity.
+  if (dokanInstance->Statistics &&
+      pullerControl->MinPullerCount < pullerControl->MaxPullerCount) {
+    pullerControl->Timer =
+        CreateThreadpoolTimer(PullerControlCallback, dokanInstance,
+                              &dokanInstance->ThreadInfo.CallbackEnvironment);
+    if (pullerControl->Timer) {
+      // Negative due time is relative, in 100 nanoseconds units.
+      ULARGE_INTEGER dueTime;
+      dueTime.QuadPart =
+          (ULONGLONG)(-(LONGLONG)DOKAN_PULLER_CONTROL_INTERVAL_MS * 10000);
+      FILETIME fileDueTime;
+      fileDueTime.dwHighDateTime = dueTime.HighPart;
+      fileDueTime.dwLowDateTime = dueTime.LowPart;
+      SetThreadpoolTimer(pullerControl->Timer, &fileDueTime,
+                         DOKAN_PULLER_CONTROL_INTERVAL_MS,
+                         DOKAN_PULLER_CONTROL_INTERVAL_MS / 10);
+    } else {
+      DbgPrintW(L"Dokan Warning: Failed to create the pull threads "
+                L"controller timer.\n");
+    }
   }
 
   if (!DokanMount(dokanInstance, DokanOptions)) {
@@ -924,48 +1856,27 @@ ULONG DispatchGetEventInformationLength(ULONG bufferSize) {
              FIELD_OFFSET(EVENT_INFORMATION, Buffer[0]) + bufferSize);
 }
 
-VOID CreateDispatchCommon(PDOKAN_IO_EVENT IoEvent, ULONG SizeOfEventInfo, BOOL UseExtraMemoryPool, BOOL ClearNonPoolBuffer) {
+VOID CreateDispatchCommon(PDOKAN_IO_EVENT IoEvent, ULONG SizeOfEventInfo,
+                          BOOL ClearBuffer) {
   assert(IoEvent != NULL);
   assert(IoEvent->EventResult == NULL && IoEvent->EventResultSize == 0);
 
-  if (SizeOfEventInfo <= DOKAN_EVENT_INFO_DEFAULT_BUFFER_SIZE) {
-    IoEvent->EventResult = PopEventResult();
-    IoEvent->EventResultSize = DOKAN_EVENT_INFO_DEFAULT_SIZE;
+  ULONG eventInfoLength = DispatchGetEventInformationLength(SizeOfEventInfo);
+  IoEvent->EventResult =
+      PopEventResult(SizeOfEventInfo, &IoEvent->EventResultSize);
+  if (IoEvent->EventResult) {
     IoEvent->PoolAllocated = TRUE;
   } else {
-    if (UseExtraMemoryPool) {
-      if (SizeOfEventInfo <= (16 * 1024)) {
-        IoEvent->EventResult = Pop16KEventResult();
-        IoEvent->EventResultSize = DOKAN_EVENT_INFO_16K_SIZE;
-        IoEvent->PoolAllocated = TRUE;
-      } else if (SizeOfEventInfo <= (32 * 1024)) {
-        IoEvent->EventResult = Pop32KEventResult();
-        IoEvent->EventResultSize = DOKAN_EVENT_INFO_32K_SIZE;
-        IoEvent->PoolAllocated = TRUE;
-      } else if (SizeOfEventInfo <= (64 * 1024)) {
-        IoEvent->EventResult = Pop64KEventResult();
-        IoEvent->EventResultSize = DOKAN_EVENT_INFO_64K_SIZE;
-        IoEvent->PoolAllocated = TRUE;
-      } else if (SizeOfEventInfo <= (128 * 1024)) {
-        IoEvent->EventResult = Pop128KEventResult();
-        IoEvent->EventResultSize = DOKAN_EVENT_INFO_128K_SIZE;
-        IoEvent->PoolAllocated = TRUE;
-      }
-    }
-    if (IoEvent->EventResult == NULL) {
-      IoEvent->EventResultSize =
-          DispatchGetEventInformationLength(SizeOfEventInfo);
-      IoEvent->EventResult =
-          (PEVENT_INFORMATION)malloc(IoEvent->EventResultSize);
-      if (!IoEvent->EventResult) {
-        return;
-      }
-      ZeroMemory(IoEvent->EventResult,
-                 ClearNonPoolBuffer
-                     ? IoEvent->EventResultSize
-                     : FIELD_OFFSET(EVENT_INFORMATION, Buffer[0]));
+    // Larger than the largest size class of the pool.
+    IoEvent->EventResultSize = eventInfoLength;
+    IoEvent->EventResult = (PEVENT_INFORMATION)malloc(eventInfoLength);
+    if (!IoEvent->EventResult) {
+      return;
     }
   }
+  ZeroMemory(IoEvent->EventResult,
+             ClearBuffer ? eventInfoLength
+                         : FIELD_OFFSET(EVENT_INFORMATION, Buffer[0]));
   assert(IoEvent->EventResult &&
          IoEvent->EventResultSize >=
              DispatchGetEventInformationLength(SizeOfEventInfo));
@@ -974,6 +1885,46 @@ VOID CreateDispatchCommon(PDOKAN_IO_EVENT IoEvent, ULONG SizeOfEventInfo, BOOL U
   IoEvent->EventResult->Context = IoEvent->EventContext->Context;
 }
 
+PDOKAN_IO_SEGMENT SplitIoSegments(PDOKAN_IO_SEGMENT Segments,
+                                  ULONG SegmentCapacity, PVOID Buffer,
+                                  DWORD Length, LONGLONG Offset,
+                                  ULONG SegmentSize, PDWORD SegmentCount) {
+  ULONG count = 1;
+  // Writes at the end of the file have no offset to split at.
+  if (SegmentSize && Offset >= 0 && Length) {
+    ULONG firstLength =
+        SegmentSize - (ULONG)((ULONGLONG)Offset % SegmentSize);
+    if (Length > firstLength) {
+      count += (Length - firstLength + SegmentSize - 1) / SegmentSize;
+    }
+  }
+  PDOKAN_IO_SEGMENT segments = Segments;
+  if (count > SegmentCapacity) {
+    segments = malloc(count * sizeof(DOKAN_IO_SEGMENT));
+    if (!segments) {
+      return NULL;
+    }
+  }
+  PCHAR buffer = Buffer;
+  for (ULONG i = 0; i < count; ++i) {
+    DWORD segmentLength = Length;
+    if (count > 1) {
+      segmentLength = min(
+          Length, SegmentSize - (ULONG)((ULONGLONG)Offset % SegmentSize));
+    }
+    segments[i].Offset = Offset;
+    segments[i].Length = segmentLength;
+    segments[i].Buffer = buffer;
+    buffer += segmentLength;
+    Length -= segmentLength;
+    if (Offset >= 0) {
+      Offset += segmentLength;
+    }
+  }
+  *SegmentCount = count;
+  return segments;
+}
+
 VOID ReleaseDokanOpenInfo(PDOKAN_IO_EVENT IoEvent) {
   if (!IoEvent->DokanOpenInfo) {
     return;
@@ -1144,6 +2095,12 @@ int DokanStart(_In_ PDOKAN_INSTANCE DokanInstance) {
 
   eventStart.IrpTimeout = DokanInstance->DokanOptions->Timeout;
   eventStart.FcbGarbageCollectionIntervalMs = 2000;
+  eventStart.PullBufferLength =
+      DokanInstance->DokanOptions->PullBufferSize
+          ? DokanInstance->DokanOptions->PullBufferSize
+          : BATCH_EVENT_CONTEXT_SIZE;
+  eventStart.EventContextMaxLength =
+      DokanInstance->DokanOptions->MaxEventContextSize;
 
   SendToDevice(DOKAN_GLOBAL_DEVICE_NAME, FSCTL_EVENT_START, &eventStart,
                sizeof(EVENT_START), &driverInfo, sizeof(EVENT_DRIVER_INFO),
@@ -1164,6 +2121,11 @@ int DokanStart(_In_ PDOKAN_INSTANCE DokanInstance) {
   } else if (driverInfo.Status == DOKAN_MOUNTED) {
     DokanInstance->MountId = driverInfo.MountId;
     DokanInstance->DeviceNumber = driverInfo.DeviceNumber;
+    DbgPrint("Dokan Information: Pulling events with buffers of %lu bytes, "
+             "largest event %lu bytes\n",
+             driverInfo.PullBufferLength, driverInfo.EventContextMaxLength);
+    InitializeIoBatchPool(&DokanInstance->IoBatchPool,
+                          driverInfo.PullBufferLength);
     wcscpy_s(DokanInstance->DeviceName, sizeof(DokanInstance->DeviceName) / sizeof(WCHAR),
              driverInfo.DeviceName);
     if (driverLetter && mountManager) {
@@ -1454,6 +2416,9 @@ BOOL DOKANAPI DokanNotifyPath(_In_ DOKAN_HANDLE DokanInstance,
   }
   // remove the mount letter and colon from length, for example: "G:"
   length -= prefixSize;
+  InvalidateFileInfoCache(instance, FilePath + prefixSize);
+  InvalidateNegativeLookupCache(instance, FilePath + prefixSize);
+  InvalidateDirectoryListCache(instance, FilePath + prefixSize);
   ULONG returnedLength;
   ULONG inputLength = (ULONG)(sizeof(DOKAN_NOTIFY_PATH_INTERMEDIATE) +
                               (length * sizeof(WCHAR)));
@@ -1509,6 +2474,12 @@ BOOL DOKANAPI DokanNotifyRename(_In_ DOKAN_HANDLE DokanInstance,
                                 _In_ LPCWSTR OldPath, _In_ LPCWSTR NewPath,
                                 _In_ BOOL IsDirectory,
                                 _In_ BOOL IsInSameDirectory) {
+  if (IsDirectory && DokanInstance) {
+    // The files under the directory changed names too.
+    ClearFileInfoCache((PDOKAN_INSTANCE)DokanInstance);
+    ClearNegativeLookupCache((PDOKAN_INSTANCE)DokanInstance);
+    ClearDirectoryListCache((PDOKAN_INSTANCE)DokanInstance);
+  }
   BOOL success = DokanNotifyPath(
       DokanInstance, OldPath,
       IsDirectory ? FILE_NOTIFY_CHANGE_DIR_NAME : FILE_NOTIFY_CHANGE_FILE_NAME,
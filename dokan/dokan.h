@@ -56,9 +56,15 @@ extern "C" {
 /** @{ */
 
 /** The current Dokan version (200 means ver 2.0.0). \ref DOKAN_OPTIONS.Version */
-#define DOKAN_VERSION 221
+#define DOKAN_VERSION 230
 /** Minimum Dokan version (ver 2.0.0) accepted. */
 #define DOKAN_MINIMUM_COMPATIBLE_VERSION 200
+/**
+ * First Dokan version (ver 2.3.0) whose members of \ref DOKAN_OPTIONS from
+ * PoolMemoryBudget and of \ref DOKAN_OPERATIONS from ReadFileScatter are read.
+ * They are ignored when \ref DOKAN_OPTIONS.Version is lower.
+ */
+#define DOKAN_EXTENDED_API_VERSION 230
 /** Driver file name including the DOKAN_MAJOR_API_VERSION */
 #define DOKAN_DRIVER_NAME L"dokan" DOKAN_MAJOR_API_VERSION L".sys"
 /** Network provider name including the DOKAN_MAJOR_API_VERSION */
@@ -131,6 +137,18 @@ extern "C" {
  * and userland filesystem taking time to process requests (like remote storage).
  */
 #define DOKAN_OPTION_ALLOW_IPC_BATCHING (1 << 12)
+/**
+ * Dispatch the events of a same open handle one at a time, in the order they
+ * were pulled from the driver. Events of different handles still run in
+ * parallel, so the filesystem does not need to serialize them with its own
+ * per handle lock. Close events are not ordered.
+ * This enables \ref DOKAN_OPTION_ALLOW_IPC_BATCHING unless
+ * \ref DOKAN_OPTIONS.SingleThread is set, where events are already ordered.
+ * It cannot be combined with \ref DOKAN_OPTIONS.ReadAheadSize or
+ * \ref DOKAN_OPTIONS.WriteBehindSize, whose background reads and flushes are
+ * not ordered with the events of the handle.
+ */
+#define DOKAN_OPTION_ORDERED_FILE_DISPATCH (1 << 13)
 
 /** @} */
 
@@ -172,6 +190,163 @@ typedef struct _DOKAN_OPTIONS {
   ULONG VolumeSecurityDescriptorLength;
   /** Optional Volume Security descriptor. See <a href="https://docs.microsoft.com/en-us/windows/win32/api/securitybaseapi/nf-securitybaseapi-initializesecuritydescriptor">InitializeSecurityDescriptor</a> */
   CHAR VolumeSecurityDescriptor[VOLUME_SECURITY_DESCRIPTOR_MAX_SIZE];
+  /**
+   * High watermark in bytes of the memory the library keeps cached for reuse
+   * once requests are completed. Buffers released above it are given back to
+   * the heap. Pools are shared by all the file systems of the process and
+   * use the largest budget of the mounted ones.
+   * Each thread processing requests also keeps up to a few buffers of each
+   * size for itself outside of it, until it stays idle for a
+   * \ref PoolIdleTrimIntervalMs interval.
+   * Set 0 to only bound the pools by their default capacity.
+   * This member and the following ones are only read when \ref Version is at
+   * least \ref DOKAN_EXTENDED_API_VERSION.
+   */
+  ULONG64 PoolMemoryBudget;
+  /**
+   * Interval in milliseconds at which cached buffers that were not reused
+   * since the previous interval are progressively released to the system.
+   * The shortest interval of the mounted file systems is used.
+   * Set 0 to keep cached buffers until \ref DokanShutdown, unless another
+   * file system sets one.
+   */
+  ULONG PoolIdleTrimIntervalMs;
+  /**
+   * Number of requests the pools are filled for during \ref DokanCreateFileSystem
+   * so that the first burst after mount does not have to allocate memory.
+   * Set 0 to disable.
+   */
+  ULONG PoolPrewarmEventCount;
+  /**
+   * Maximum number of metadata events, all events but reads, writes and
+   * flushes, dispatched at the same time. Extra events wait for one of them
+   * to complete. Only applies when events are batched, see
+   * \ref DOKAN_OPTION_ALLOW_IPC_BATCHING. Set 0 for no limit.
+   */
+  ULONG MaxMetadataDispatchCount;
+  /**
+   * Maximum number of bulk data events, reads, writes and flushes, dispatched
+   * at the same time. Keeping it below the number of pool threads leaves
+   * threads to metadata events like CreateFile or GetFileInformation during
+   * large transfers. Only applies when events are batched, see
+   * \ref DOKAN_OPTION_ALLOW_IPC_BATCHING. Set 0 for no limit.
+   */
+  ULONG MaxBulkDispatchCount;
+  /**
+   * Minimum number of threads the thread pool processing events keeps alive.
+   * Set 0 for the system default.
+   * The thread pool is shared by all the file systems of the process.
+   */
+  ULONG MinThreads;
+  /**
+   * Maximum number of threads of the thread pool processing events.
+   * Set 0 for the system default.
+   * The number of threads waiting for events from the driver is adjusted
+   * while the file system runs, depending on how full the pulled batches are
+   * and how long events take, and is limited to half of this value.
+   * The thread pool is shared by all the file systems of the process.
+   */
+  ULONG MaxThreads;
+  /**
+   * Size in bytes of the buffers events are pulled from the driver with.
+   * Larger buffers carry more events and larger writes per pull, which favors
+   * throughput, smaller ones spread the events over more threads sooner.
+   * Set 0 for the default of 128KB. The driver raises it to
+   * \ref MaxEventContextSize and limits it to 8MB.
+   */
+  ULONG PullBufferSize;
+  /**
+   * Size in bytes of the largest event, except writes, the driver sends to the
+   * file system. Requests with a larger event, like a very long file name or
+   * security descriptor, fail.
+   * Set 0 for the default of 32KB. The driver keeps it between 4KB and 1MB.
+   */
+  ULONG MaxEventContextSize;
+  /**
+   * Size in bytes of a buffer registered with the driver that
+   * \ref DOKAN_OPERATIONS.ReadFile writes the data of large reads to. The
+   * driver copies it to the requester buffer directly instead of the data
+   * being copied with the result. Reads fall back to the result buffer while
+   * it is full.
+   * Set 0 to disable it. It is limited to 64MB.
+   */
+  ULONG ReadBufferSize;
+  /**
+   * Size in bytes at which the reads and writes passed to
+   * \ref DOKAN_OPERATIONS.ReadFileScatter and
+   * \ref DOKAN_OPERATIONS.WriteFileGather are split, usually the block size of
+   * the backend. Set 0 to pass them as a single segment.
+   */
+  ULONG IoSegmentSize;
+  /**
+   * Size in bytes of the data read ahead of an open reading sequentially.
+   * Following reads are served from memory while the next window is read in
+   * the background, within a limit of 64MB for the mount.
+   * The prefetched data is dropped when the file is written, resized,
+   * renamed or overwritten through the mount, so the backend data must not
+   * change by other means. \ref DOKAN_OPERATIONS.ReadFile must complete
+   * synchronously. The mount fails when it is combined with
+   * \ref DOKAN_OPTION_ORDERED_FILE_DISPATCH.
+   * Set 0 to disable it.
+   */
+  ULONG ReadAheadSize;
+  /**
+   * Size in bytes of a buffer per open merging its small contiguous writes
+   * into one \ref DOKAN_OPERATIONS.WriteFile call. Buffered writes complete
+   * without reaching the backend and are flushed when the open writes
+   * elsewhere, when the file is read, queried, flushed, locked, modified or
+   * opened again, when a directory is listed, at cleanup and at the latest one
+   * second after being buffered.
+   * The error of a failed flush is returned by the next read, write or flush
+   * of the open, or by its cleanup. \ref DOKAN_OPERATIONS.WriteFile
+   * must complete synchronously. The mount fails when it is combined with
+   * \ref DOKAN_OPTION_ORDERED_FILE_DISPATCH.
+   * Set 0 to disable it.
+   */
+  ULONG WriteBehindSize;
+  /**
+   * Time in milliseconds the \ref DOKAN_OPERATIONS.GetFileInformation result
+   * of a file is reused for the following queries of its information.
+   * Cached results are dropped when the file is written, overwritten, changed
+   * by SetFileAttributes, SetFileTime, SetEndOfFile or SetAllocationSize,
+   * deleted or given to one of the DokanNotify functions, and all of them are
+   * dropped by a rename. Other changes of the backend are only seen once the
+   * time has elapsed.
+   * Set 0 to disable it.
+   */
+  ULONG FileInfoCacheTtlMs;
+  /**
+   * Time in milliseconds a name for which \ref DOKAN_OPERATIONS.ZwCreateFile
+   * returned STATUS_OBJECT_NAME_NOT_FOUND is answered the same way, without
+   * calling it, for the following opens of existing files.
+   * Names are dropped when created, given to one of the DokanNotify
+   * functions, and all of them are dropped by a rename. Names compare
+   * case-insensitively unless \ref DOKAN_OPTION_CASE_SENSITIVE is set.
+   * Files created by other means than the mount are only seen once the time
+   * has elapsed.
+   * Set 0 to disable it.
+   */
+  ULONG NegativeLookupCacheTtlMs;
+  /**
+   * Time in milliseconds the full listing of a directory returned by
+   * \ref DOKAN_OPERATIONS.FindFiles, or by
+   * \ref DOKAN_OPERATIONS.FindFilesWithPattern with the "*" pattern, is
+   * reused by the following queries of any open of the directory.
+   * A listing is dropped when an entry of the directory is created, written,
+   * overwritten, changed by a set information request, deleted or given to
+   * one of the DokanNotify functions, and all of them are dropped by a
+   * rename. Other changes of the backend are only seen once the time has
+   * elapsed. Listings of \ref DOKAN_OPERATIONS.FindFilesStream are not
+   * cached.
+   * Set 0 to disable it.
+   */
+  ULONG DirectoryListCacheTtlMs;
+  /**
+   * Memory in bytes the listings cached for
+   * \ref DOKAN_OPTIONS.DirectoryListCacheTtlMs can use.
+   * Set 0 for the default of 64MB.
+   */
+  ULONG DirectoryListCacheMaxMemory;
 } DOKAN_OPTIONS, *PDOKAN_OPTIONS;
 
 /**
@@ -226,12 +401,36 @@ typedef struct _DOKAN_FILE_INFO {
  */
 typedef int(WINAPI *PFillFindData)(PWIN32_FIND_DATAW, PDOKAN_FILE_INFO);
 
+/**
+ * \brief FillFindDataWithCookie Used to add an entry in FindFilesStream
+ *
+ * The ULONG64 is the cookie resuming the enumeration after the entry.
+ * \return 1 if the entry was not added and the enumeration has to stop,
+ * otherwise 0
+ */
+typedef int(WINAPI *PFillFindDataWithCookie)(PWIN32_FIND_DATAW, ULONG64,
+                                             PDOKAN_FILE_INFO);
+
 /**
  * \brief FillFindStreamData Used to add an entry in FindStreams
  * \return FALSE if the buffer is full, otherwise TRUE
  */
 typedef BOOL(WINAPI *PFillFindStreamData)(PWIN32_FIND_STREAM_DATA, PVOID);
 
+/**
+ * \struct DOKAN_IO_SEGMENT
+ * \brief Part of a read or write passed to DOKAN_OPERATIONS.ReadFileScatter
+ * or DOKAN_OPERATIONS.WriteFileGather
+ */
+typedef struct _DOKAN_IO_SEGMENT {
+  /** Offset in the file of the segment. -1 for a write at the end of the file. */
+  LONGLONG Offset;
+  /** Length in bytes of the segment */
+  DWORD Length;
+  /** Data of the segment */
+  LPVOID Buffer;
+} DOKAN_IO_SEGMENT, *PDOKAN_IO_SEGMENT;
+
 // clang-format off
 
 /**
@@ -331,6 +530,10 @@ typedef struct _DOKAN_OPERATIONS {
   * functions may be invoked after DOKAN_OPERATIONS.Cleanup in order to complete the I/O operations.
   * The file system application should also properly work in this case.
   *
+  * The read can be completed asynchronously by returning \c STATUS_PENDING and calling
+  * \ref DokanEndDispatchRead later from any thread. ReadLength is then ignored. Buffer and
+  * DokanFileInfo remain valid until DokanEndDispatchRead is called.
+  *
   * \param FileName File path requested by the Kernel on the FileSystem.
   * \param Buffer Read buffer that has to be filled with the read result.
   * \param BufferLength Buffer length and read size to continue with.
@@ -358,6 +561,10 @@ typedef struct _DOKAN_OPERATIONS {
   * functions may be invoked after DOKAN_OPERATIONS.Cleanup in order to complete the I/O operations.
   * The file system application should also properly work in this case.
   * This type of request should follow Windows rules like not extending the current file size.
+  *
+  * The write can be completed asynchronously by returning \c STATUS_PENDING and calling
+  * \ref DokanEndDispatchWrite later from any thread. NumberOfBytesWritten is then ignored.
+  * Buffer and DokanFileInfo remain valid until DokanEndDispatchWrite is called.
   * 
   * \param FileName File path requested by the Kernel on the FileSystem.
   * \param Buffer Data that has to be written.
@@ -405,8 +612,9 @@ typedef struct _DOKAN_OPERATIONS {
   * \brief FindFiles Dokan API callback
   *
   * List all files in the requested path.
-  * \ref DOKAN_OPERATIONS.FindFilesWithPattern is checked first. If it is not implemented or
-  * returns \c STATUS_NOT_IMPLEMENTED, then FindFiles is called, if assigned.
+  * \ref DOKAN_OPERATIONS.FindFilesStream and then \ref DOKAN_OPERATIONS.FindFilesWithPattern
+  * are checked first. If they are not implemented or
+  * return \c STATUS_NOT_IMPLEMENTED, then FindFiles is called, if assigned.
   * It is recommended to have this implemented for performance reason.
   *
   * \param FileName File path requested by the Kernel on the FileSystem.
@@ -771,10 +979,187 @@ typedef struct _DOKAN_OPERATIONS {
     PVOID FindStreamContext,
     PDOKAN_FILE_INFO DokanFileInfo);
 
+  /**
+  * \brief ReadFileScatter Dokan API callback
+  *
+  * Optional replacement of \ref ReadFile that receives the read split in segments
+  * ending at file offsets multiple of \ref DOKAN_OPTIONS.IoSegmentSize, so that
+  * backends storing data in blocks of that size fill each segment from one block.
+  * ReadFile is called when it is \c NULL.
+  * This callback and the following ones are only used when \ref DOKAN_OPTIONS.Version
+  * is at least \ref DOKAN_EXTENDED_API_VERSION.
+  *
+  * Segments are contiguous in the file and in memory and have to be filled in order.
+  * The Segments array is only valid during the call, the buffers it points to
+  * follow the rules of \ref ReadFile, including asynchronous completion with
+  * \ref DokanEndDispatchRead.
+  *
+  * \param FileName File path requested by the Kernel on the FileSystem.
+  * \param Segments Parts of the read.
+  * \param SegmentCount Number of Segments.
+  * \param ReadLength Total data size that has been read.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see ReadFile
+  */
+  NTSTATUS(DOKAN_CALLBACK *ReadFileScatter)(LPCWSTR FileName,
+    PDOKAN_IO_SEGMENT Segments,
+    DWORD SegmentCount,
+    LPDWORD ReadLength,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief WriteFileGather Dokan API callback
+  *
+  * Optional replacement of \ref WriteFile that receives the write split like
+  * \ref ReadFileScatter. WriteFile is called when it is \c NULL.
+  *
+  * A write at the end of the file is a single segment with an Offset of -1.
+  * The Segments array is only valid during the call, the buffers it points to
+  * follow the rules of \ref WriteFile, including asynchronous completion with
+  * \ref DokanEndDispatchWrite.
+  *
+  * \param FileName File path requested by the Kernel on the FileSystem.
+  * \param Segments Parts of the write.
+  * \param SegmentCount Number of Segments.
+  * \param NumberOfBytesWritten Total number of bytes that have been written.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see WriteFile
+  */
+  NTSTATUS(DOKAN_CALLBACK *WriteFileGather)(LPCWSTR FileName,
+    PDOKAN_IO_SEGMENT Segments,
+    DWORD SegmentCount,
+    LPDWORD NumberOfBytesWritten,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
+  /**
+  * \brief FindFilesStream Dokan API callback
+  *
+  * Optional replacement of \ref FindFilesWithPattern listing a directory a part at a time,
+  * so that huge directories do not have to be listed entirely before the first results
+  * are returned.
+  *
+  * Entries are listed from the position given by Cookie, \c 0 being the start of the
+  * directory. Each entry is given to FillFindDataWithCookie with the cookie of the
+  * position following it. When FillFindDataWithCookie returns 1, the entry was not added
+  * because the query buffer is full: the enumeration has to stop and return \c STATUS_SUCCESS.
+  * It is then called again on the next query with the cookie of the last added entry,
+  * or with \c 0 when the query restarts the enumeration.
+  * Cookies are opaque to the library, they only need to stay valid while the directory is open.
+  *
+  * Entries not matching SearchPattern are skipped by the library, so it can be ignored.
+  * The "." and ".." entries are added by the library outside of the root directory
+  * when every entry is listed, the ones listed by the file system are then skipped.
+  *
+  * \param PathName Path requested by the Kernel on the FileSystem.
+  * \param SearchPattern Search pattern.
+  * \param Cookie Position from which to list the entries.
+  * \param FillFindDataWithCookie Callback that has to be called with PWIN32_FIND_DATAW that contains file information.
+  * \param DokanFileInfo Information about the file or directory.
+  * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * \see FindFilesWithPattern
+  */
+  NTSTATUS(DOKAN_CALLBACK *FindFilesStream)(LPCWSTR PathName,
+    LPCWSTR SearchPattern,
+    ULONG64 Cookie,
+    PFillFindDataWithCookie FillFindDataWithCookie,
+    PDOKAN_FILE_INFO DokanFileInfo);
+
 } DOKAN_OPERATIONS, *PDOKAN_OPERATIONS;
 
 // clang-format on
 
+/** Number of EVENT_INFORMATION pool size classes in \ref DOKAN_RUNTIME_STATISTICS. */
+#define DOKAN_STATISTICS_RESULT_POOL_COUNT 8
+/** Number of IRP major functions counted in \ref DOKAN_RUNTIME_STATISTICS. */
+#define DOKAN_STATISTICS_MAJOR_FUNCTION_COUNT 0x1c
+/**
+ * Number of pulled batch size buckets in \ref DOKAN_RUNTIME_STATISTICS.
+ * Bucket N counts the batches holding from 2^N to 2^(N+1)-1 events, the last
+ * bucket counts all the larger batches.
+ */
+#define DOKAN_STATISTICS_BATCH_SIZE_BUCKET_COUNT 8
+/** Index of the metadata events in the per dispatch class statistics. */
+#define DOKAN_DISPATCH_CLASS_METADATA 0
+/** Index of the bulk data events (read, write and flush) in the per dispatch class statistics. */
+#define DOKAN_DISPATCH_CLASS_BULK 1
+/** Number of dispatch classes in \ref DOKAN_RUNTIME_STATISTICS. */
+#define DOKAN_STATISTICS_DISPATCH_CLASS_COUNT 2
+/**
+ * Number of dispatch latency buckets in \ref DOKAN_RUNTIME_STATISTICS.
+ * Bucket N counts the events that took from 2^N to 2^(N+1)-1 microseconds,
+ * the last bucket counts all the slower events.
+ */
+#define DOKAN_STATISTICS_LATENCY_BUCKET_COUNT 24
+
+/**
+ * \struct DOKAN_POOL_STATISTICS
+ * \brief Usage of one of the object pools of the Dokan library.
+ *
+ * Pools are shared by all the file systems of the process.
+ * \see DOKAN_RUNTIME_STATISTICS
+ */
+typedef struct _DOKAN_POOL_STATISTICS {
+  /** Size in bytes of the pooled objects. */
+  ULONG64 ObjectSize;
+  /** Number of objects requested from the pool. */
+  ULONG64 Requests;
+  /** Number of requests the pool could not serve, that were allocated from the heap. */
+  ULONG64 Misses;
+  /** Number of objects allocated by the pool, either in use or cached. */
+  LONG ResidentObjects;
+  /** Number of objects cached in the pool shared depot. */
+  LONG CachedObjects;
+} DOKAN_POOL_STATISTICS, *PDOKAN_POOL_STATISTICS;
+
+/**
+ * \struct DOKAN_RUNTIME_STATISTICS
+ * \brief Event dispatching and memory pool counters returned by \ref DokanGetRuntimeStatistics.
+ *
+ * Event counters are cumulated since the file system was created.
+ */
+typedef struct _DOKAN_RUNTIME_STATISTICS {
+  /** Number of times events were pulled from the driver. */
+  ULONG64 PulledBatches;
+  /** Number of events pulled from the driver. */
+  ULONG64 PulledEvents;
+  /** Distribution of the number of events per pulled batch. See \ref DOKAN_STATISTICS_BATCH_SIZE_BUCKET_COUNT. */
+  ULONG64 PulledBatchSizes[DOKAN_STATISTICS_BATCH_SIZE_BUCKET_COUNT];
+  /** Number of events handed over to the thread pool instead of being processed by the pulling thread. */
+  ULONG64 QueuedEvents;
+  /** Number of dispatched events for each IRP major function. */
+  ULONG64 MajorFunctionEvents[DOKAN_STATISTICS_MAJOR_FUNCTION_COUNT];
+  /** Batch buffers pool. */
+  DOKAN_POOL_STATISTICS IoBatchPool;
+  /** Event buffers pool. */
+  DOKAN_POOL_STATISTICS IoEventPool;
+  /** Event result pools by increasing size class. */
+  DOKAN_POOL_STATISTICS EventResultPools[DOKAN_STATISTICS_RESULT_POOL_COUNT];
+  /** Number of events of each dispatch class that waited for the class concurrency limit. */
+  ULONG64 DeferredEvents[DOKAN_STATISTICS_DISPATCH_CLASS_COUNT];
+  /**
+   * Distribution of the time between the pull of an event and the end of its dispatch, for each dispatch class.
+   * See \ref DOKAN_STATISTICS_LATENCY_BUCKET_COUNT.
+   */
+  ULONG64 DispatchLatencies[DOKAN_STATISTICS_DISPATCH_CLASS_COUNT]
+                           [DOKAN_STATISTICS_LATENCY_BUCKET_COUNT];
+  /** Number of writes kept in a write-behind buffer instead of being sent to \ref DOKAN_OPERATIONS.WriteFile. See \ref DOKAN_OPTIONS.WriteBehindSize. */
+  ULONG64 BufferedWrites;
+  /** Number of write-behind buffers sent to \ref DOKAN_OPERATIONS.WriteFile. */
+  ULONG64 WriteBehindFlushes;
+  /** Number of file information queries answered from the cache. See \ref DOKAN_OPTIONS.FileInfoCacheTtlMs. */
+  ULONG64 FileInfoCacheHits;
+  /** Number of file information queries sent to \ref DOKAN_OPERATIONS.GetFileInformation while the cache is enabled. */
+  ULONG64 FileInfoCacheMisses;
+  /** Number of opens answered STATUS_OBJECT_NAME_NOT_FOUND without calling \ref DOKAN_OPERATIONS.ZwCreateFile. See \ref DOKAN_OPTIONS.NegativeLookupCacheTtlMs. */
+  ULONG64 NegativeLookupCacheHits;
+  /** Number of directory listings copied from the cache. See \ref DOKAN_OPTIONS.DirectoryListCacheTtlMs. */
+  ULONG64 DirectoryListCacheHits;
+  /** Number of cacheable directory listings requested from \ref DOKAN_OPERATIONS.FindFiles while the cache is enabled. */
+  ULONG64 DirectoryListCacheMisses;
+} DOKAN_RUNTIME_STATISTICS, *PDOKAN_RUNTIME_STATISTICS;
+
 /**
  * \defgroup DokanMainResult DokanMainResult
  * \brief \ref DokanMain \ref DokanCreateFileSystem returns error codes
@@ -917,6 +1302,20 @@ BOOL DOKANAPI DokanUnregisterWaitForFileSystemClosed(_In_ HANDLE WaitHandle,
  */
 VOID DOKANAPI DokanCloseHandle(_In_ DOKAN_HANDLE DokanInstance);
 
+/**
+ * \brief Get the event dispatching and memory pool counters of a Dokan instance.
+ *
+ * Counters are kept per processor and summed by this call, so they are cheap
+ * to maintain and can be queried at any time while the file system runs.
+ *
+ * \param DokanInstance The dokan mount context created by \ref DokanCreateFileSystem .
+ * \param Statistics Receives the counters.
+ * \return TRUE if successful, FALSE otherwise.
+ */
+BOOL DOKANAPI DokanGetRuntimeStatistics(
+    _In_ DOKAN_HANDLE DokanInstance,
+    _Out_ PDOKAN_RUNTIME_STATISTICS Statistics);
+
 /**
  * \brief Unmount a Dokan device from a driver letter.
  *
@@ -989,6 +1388,33 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO DokanFileInfo);
  */
 HANDLE DOKANAPI DokanOpenRequestorToken(PDOKAN_FILE_INFO DokanFileInfo);
 
+/**
+ * \brief Completes a \ref DOKAN_OPERATIONS.ReadFile that returned \c STATUS_PENDING.
+ *
+ * It can be called from any thread, including before ReadFile returns, and must be
+ * called exactly once for each pending read before \ref DokanCloseHandle.
+ *
+ * \param DokanFileInfo \ref DOKAN_FILE_INFO given to ReadFile.
+ * \param Status \c STATUS_SUCCESS on success or NTSTATUS appropriate to the read result.
+ * \param ReadLength Total data size that has been read in the ReadFile Buffer.
+ */
+VOID DOKANAPI DokanEndDispatchRead(PDOKAN_FILE_INFO DokanFileInfo,
+                                   NTSTATUS Status, DWORD ReadLength);
+
+/**
+ * \brief Completes a \ref DOKAN_OPERATIONS.WriteFile that returned \c STATUS_PENDING.
+ *
+ * It can be called from any thread, including before WriteFile returns, and must be
+ * called exactly once for each pending write before \ref DokanCloseHandle.
+ *
+ * \param DokanFileInfo \ref DOKAN_FILE_INFO given to WriteFile.
+ * \param Status \c STATUS_SUCCESS on success or NTSTATUS appropriate to the write result.
+ * \param NumberOfBytesWritten Total number of bytes that have been written.
+ */
+VOID DOKANAPI DokanEndDispatchWrite(PDOKAN_FILE_INFO DokanFileInfo,
+                                    NTSTATUS Status,
+                                    DWORD NumberOfBytesWritten);
+
 /**
  * \brief Get active Dokan mount points.
  *
@@ -0,0 +1,185 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokani.h"
+#include "dokan_dirlist.h"
+#include "fileinfo.h"
+
+#define DOKAN_DIRECTORY_LIST_INITIAL_ARENA_CAPACITY (16 * 1024)
+#define DOKAN_DIRECTORY_LIST_INITIAL_OFFSET_CAPACITY 128
+
+PDOKAN_DIRECTORY_LIST DokanDirectoryList_Alloc() {
+  PDOKAN_DIRECTORY_LIST list = calloc(1, sizeof(DOKAN_DIRECTORY_LIST));
+  if (!list) {
+    DbgPrintW(L"DOKAN_DIRECTORY_LIST allocation failed.\n");
+  }
+  return list;
+}
+
+VOID DokanDirectoryList_Free(PDOKAN_DIRECTORY_LIST List) {
+  if (!List) {
+    return;
+  }
+  free(List->Arena);
+  free(List->Offsets);
+  free(List);
+}
+
+VOID DokanDirectoryList_Clear(PDOKAN_DIRECTORY_LIST List) {
+  List->ArenaLength = 0;
+  List->Count = 0;
+}
+
+VOID DokanDirectoryEntry_Initialize(PDOKAN_DIRECTORY_ENTRY Entry,
+                                    PWIN32_FIND_DATAW FindData,
+                                    ULONG FileNameLength) {
+  Entry->FileSize =
+      ((ULONG64)FindData->nFileSizeHigh << 32) | FindData->nFileSizeLow;
+  Entry->CreationTime = FindData->ftCreationTime;
+  Entry->LastAccessTime = FindData->ftLastAccessTime;
+  Entry->LastWriteTime = FindData->ftLastWriteTime;
+  Entry->FileAttributes = FindData->dwFileAttributes;
+  Entry->FileNameLength = FileNameLength;
+  RtlCopyMemory(Entry->FileName, FindData->cFileName,
+                FileNameLength * sizeof(WCHAR));
+  // Names are matched against the search pattern as C strings.
+  Entry->FileName[FileNameLength] = L'\0';
+}
+
+// Doubles Capacity until it holds Length, within MAXULONG.
+static BOOL GetGrownCapacity(ULONG Capacity, ULONG InitialCapacity,
+                             ULONG64 Length, PULONG NewCapacity) {
+  ULONG64 capacity = Capacity ? Capacity : InitialCapacity;
+  while (capacity < Length) {
+    capacity *= 2;
+  }
+  if (capacity > MAXULONG) {
+    return FALSE;
+  }
+  *NewCapacity = (ULONG)capacity;
+  return TRUE;
+}
+
+// Copies FindData at the end of the arena and makes room for its offset.
+static BOOL AppendEntry(PDOKAN_DIRECTORY_LIST List, PWIN32_FIND_DATAW FindData,
+                        PULONG Offset) {
+  ULONG fileNameLength = (ULONG)wcsnlen(FindData->cFileName, MAX_PATH);
+  ULONG entrySize = QuadAlign(FIELD_OFFSET(DOKAN_DIRECTORY_ENTRY, FileName) +
+                              (fileNameLength + 1) * sizeof(WCHAR));
+  if (List->ArenaLength + (ULONG64)entrySize > List->ArenaCapacity) {
+    ULONG capacity;
+    if (!GetGrownCapacity(List->ArenaCapacity,
+                          DOKAN_DIRECTORY_LIST_INITIAL_ARENA_CAPACITY,
+                          List->ArenaLength + (ULONG64)entrySize,
+                          &capacity)) {
+      return FALSE;
+    }
+    PUCHAR arena = realloc(List->Arena, capacity);
+    if (!arena) {
+      DbgPrintW(L"DOKAN_DIRECTORY_LIST arena allocation failed.\n");
+      return FALSE;
+    }
+    List->Arena = arena;
+    List->ArenaCapacity = capacity;
+  }
+  if (List->Count == List->OffsetCapacity) {
+    ULONG capacity;
+    if (!GetGrownCapacity(List->OffsetCapacity,
+                          DOKAN_DIRECTORY_LIST_INITIAL_OFFSET_CAPACITY,
+                          List->Count + 1ULL, &capacity) ||
+        capacity > MAXULONG / sizeof(ULONG)) {
+      return FALSE;
+    }
+    PULONG offsets = realloc(List->Offsets, capacity * sizeof(ULONG));
+    if (!offsets) {
+      DbgPrintW(L"DOKAN_DIRECTORY_LIST index allocation failed.\n");
+      return FALSE;
+    }
+    List->Offsets = offsets;
+    List->OffsetCapacity = capacity;
+  }
+  DokanDirectoryEntry_Initialize(
+      (PDOKAN_DIRECTORY_ENTRY)(List->Arena + List->ArenaLength), FindData,
+      fileNameLength);
+  *Offset = List->ArenaLength;
+  List->ArenaLength += entrySize;
+  return TRUE;
+}
+
+BOOL DokanDirectoryList_PushBack(PDOKAN_DIRECTORY_LIST List,
+                                 PWIN32_FIND_DATAW FindData) {
+  ULONG offset;
+  if (!AppendEntry(List, FindData, &offset)) {
+    return FALSE;
+  }
+  List->Offsets[List->Count++] = offset;
+  return TRUE;
+}
+
+BOOL DokanDirectoryList_PushFront(PDOKAN_DIRECTORY_LIST List,
+                                  PWIN32_FIND_DATAW FindData) {
+  ULONG offset;
+  if (!AppendEntry(List, FindData, &offset)) {
+    return FALSE;
+  }
+  RtlMoveMemory(List->Offsets + 1, List->Offsets, List->Count * sizeof(ULONG));
+  List->Offsets[0] = offset;
+  ++List->Count;
+  return TRUE;
+}
+
+BOOL DokanDirectoryList_Copy(PDOKAN_DIRECTORY_LIST Destination,
+                             PDOKAN_DIRECTORY_LIST Source) {
+  if (Destination->ArenaCapacity < Source->ArenaLength) {
+    PUCHAR arena = realloc(Destination->Arena, Source->ArenaLength);
+    if (!arena) {
+      DbgPrintW(L"DOKAN_DIRECTORY_LIST arena allocation failed.\n");
+      return FALSE;
+    }
+    Destination->Arena = arena;
+    Destination->ArenaCapacity = Source->ArenaLength;
+  }
+  if (Destination->OffsetCapacity < Source->Count) {
+    PULONG offsets = realloc(Destination->Offsets,
+                             (SIZE_T)Source->Count * sizeof(ULONG));
+    if (!offsets) {
+      DbgPrintW(L"DOKAN_DIRECTORY_LIST index allocation failed.\n");
+      return FALSE;
+    }
+    Destination->Offsets = offsets;
+    Destination->OffsetCapacity = Source->Count;
+  }
+  if (Source->ArenaLength) {
+    RtlCopyMemory(Destination->Arena, Source->Arena, Source->ArenaLength);
+  }
+  if (Source->Count) {
+    RtlCopyMemory(Destination->Offsets, Source->Offsets,
+                  Source->Count * sizeof(ULONG));
+  }
+  Destination->ArenaLength = Source->ArenaLength;
+  Destination->Count = Source->Count;
+  return TRUE;
+}
+
+SIZE_T DokanDirectoryList_GetAllocatedSize(PDOKAN_DIRECTORY_LIST List) {
+  return sizeof(DOKAN_DIRECTORY_LIST) + List->ArenaCapacity +
+         List->OffsetCapacity * sizeof(ULONG);
+}
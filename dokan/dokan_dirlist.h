@@ -0,0 +1,106 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_DIRLIST_H_
+#define DOKAN_DIRLIST_H_
+
+// Entry of a DOKAN_DIRECTORY_LIST, the WIN32_FIND_DATAW fields used to
+// answer directory queries followed by the name.
+typedef struct _DOKAN_DIRECTORY_ENTRY {
+  ULONG64 FileSize;
+  FILETIME CreationTime;
+  FILETIME LastAccessTime;
+  FILETIME LastWriteTime;
+  DWORD FileAttributes;
+  // Length of FileName in characters, without the null terminator.
+  ULONG FileNameLength;
+  WCHAR FileName[ANYSIZE_ARRAY];
+} DOKAN_DIRECTORY_ENTRY, *PDOKAN_DIRECTORY_ENTRY;
+
+// Entry with room for a name of MAX_PATH characters, to hold a single entry
+// outside of a list.
+typedef struct _DOKAN_DIRECTORY_ENTRY_BUFFER {
+  DOKAN_DIRECTORY_ENTRY Entry;
+  WCHAR FileNameBuffer[MAX_PATH];
+} DOKAN_DIRECTORY_ENTRY_BUFFER, *PDOKAN_DIRECTORY_ENTRY_BUFFER;
+
+// Copies FindData to Entry, which has room for the FileNameLength characters
+// of its name and the null terminator.
+VOID DokanDirectoryEntry_Initialize(PDOKAN_DIRECTORY_ENTRY Entry,
+                                    PWIN32_FIND_DATAW FindData,
+                                    ULONG FileNameLength);
+
+// Listing of a directory. Entries are appended to an arena and only take the
+// size of their name, the index gives their offsets in listing order.
+typedef struct _DOKAN_DIRECTORY_LIST {
+  PUCHAR Arena;
+  ULONG ArenaLength;
+  ULONG ArenaCapacity;
+  PULONG Offsets;
+  ULONG Count;
+  ULONG OffsetCapacity;
+} DOKAN_DIRECTORY_LIST, *PDOKAN_DIRECTORY_LIST;
+
+// Position of the directory queries of an open in a list: the index of the
+// next entry matching the search pattern, as returned to the driver, and the
+// position in the list from which it is searched.
+typedef struct _DOKAN_DIRECTORY_CURSOR {
+  ULONG Index;
+  ULONG Position;
+} DOKAN_DIRECTORY_CURSOR, *PDOKAN_DIRECTORY_CURSOR;
+
+// Creates an empty list.
+PDOKAN_DIRECTORY_LIST DokanDirectoryList_Alloc();
+
+// Releases the memory of a list.
+VOID DokanDirectoryList_Free(PDOKAN_DIRECTORY_LIST List);
+
+// Removes the entries of a list and keeps its memory.
+VOID DokanDirectoryList_Clear(PDOKAN_DIRECTORY_LIST List);
+
+// Appends an entry with the content of FindData.
+BOOL DokanDirectoryList_PushBack(PDOKAN_DIRECTORY_LIST List,
+                                 PWIN32_FIND_DATAW FindData);
+
+// Inserts an entry with the content of FindData before the others. Only the
+// index is moved.
+BOOL DokanDirectoryList_PushFront(PDOKAN_DIRECTORY_LIST List,
+                                  PWIN32_FIND_DATAW FindData);
+
+// Replaces the entries of Destination with the ones of Source.
+BOOL DokanDirectoryList_Copy(PDOKAN_DIRECTORY_LIST Destination,
+                             PDOKAN_DIRECTORY_LIST Source);
+
+// Returns the number of entries of a list.
+FORCEINLINE ULONG DokanDirectoryList_GetCount(PDOKAN_DIRECTORY_LIST List) {
+  return List->Count;
+}
+
+// Returns the entry at Index in listing order.
+FORCEINLINE PDOKAN_DIRECTORY_ENTRY
+DokanDirectoryList_GetEntry(PDOKAN_DIRECTORY_LIST List, ULONG Index) {
+  return (PDOKAN_DIRECTORY_ENTRY)(List->Arena + List->Offsets[Index]);
+}
+
+// Returns the memory allocated by a list.
+SIZE_T DokanDirectoryList_GetAllocatedSize(PDOKAN_DIRECTORY_LIST List);
+
+#endif
@@ -0,0 +1,403 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <windows.h>
+#include <assert.h>
+#include <malloc.h>
+
+#include "dokan_magazine.h"
+
+VOID DokanObjectCache_Initialize(PDOKAN_OBJECT_CACHE Cache, SIZE_T ObjectSize,
+                                 LONG MagazineSize, LONG PoolSize,
+                                 PDOKAN_MAGAZINE_BUDGET Budget) {
+  InitializeSListHead(&Cache->FullMagazines);
+  InitializeSListHead(&Cache->EmptyMagazines);
+  Cache->FullMagazineCount = 0;
+  Cache->MaxFullMagazines = PoolSize / MagazineSize;
+  Cache->MagazineSize = MagazineSize;
+  Cache->ObjectSize = ObjectSize;
+  Cache->Budget = Budget;
+  Cache->ResidentObjects = 0;
+  Cache->DepotObjects = 0;
+  Cache->HeapAllocations = 0;
+  Cache->Requests = 0;
+  Cache->DepotPops = 0;
+  Cache->LastTrimDepotPops = 0;
+}
+
+static PVOID AllocObject(PDOKAN_OBJECT_CACHE Cache) {
+  PVOID object = malloc(Cache->ObjectSize);
+  if (object) {
+    InterlockedIncrement(&Cache->ResidentObjects);
+    InterlockedIncrement64(&Cache->HeapAllocations);
+  }
+  return object;
+}
+
+static VOID FreeObject(PDOKAN_OBJECT_CACHE Cache, PVOID Object) {
+  InterlockedDecrement(&Cache->ResidentObjects);
+  free(Object);
+}
+
+static VOID FreeMagazine(PDOKAN_OBJECT_CACHE Cache, PDOKAN_MAGAZINE Magazine) {
+  for (LONG i = 0; i < Magazine->Count; ++i) {
+    FreeObject(Cache, Magazine->Objects[i]);
+  }
+  _aligned_free(Magazine);
+}
+
+static VOID FreeMagazineList(PDOKAN_OBJECT_CACHE Cache, PSLIST_ENTRY Entry) {
+  while (Entry) {
+    PSLIST_ENTRY next = Entry->Next;
+    FreeMagazine(Cache, CONTAINING_RECORD(Entry, DOKAN_MAGAZINE, ListEntry));
+    Entry = next;
+  }
+}
+
+VOID DokanObjectCache_Cleanup(PDOKAN_OBJECT_CACHE Cache) {
+  FreeMagazineList(Cache, InterlockedFlushSList(&Cache->FullMagazines));
+  FreeMagazineList(Cache, InterlockedFlushSList(&Cache->EmptyMagazines));
+  Cache->FullMagazineCount = 0;
+  Cache->DepotObjects = 0;
+}
+
+static LONG64 GetMagazineBytes(PDOKAN_OBJECT_CACHE Cache,
+                               PDOKAN_MAGAZINE Magazine) {
+  return (LONG64)Magazine->Count * (LONG64)Cache->ObjectSize;
+}
+
+// Returns an empty magazine from the depot or allocates a new one.
+static PDOKAN_MAGAZINE PopEmptyMagazine(PDOKAN_OBJECT_CACHE Cache) {
+  PSLIST_ENTRY entry = InterlockedPopEntrySList(&Cache->EmptyMagazines);
+  if (entry) {
+    return CONTAINING_RECORD(entry, DOKAN_MAGAZINE, ListEntry);
+  }
+  PDOKAN_MAGAZINE magazine = (PDOKAN_MAGAZINE)_aligned_malloc(
+      FIELD_OFFSET(DOKAN_MAGAZINE, Objects) +
+          sizeof(PVOID) * Cache->MagazineSize,
+      MEMORY_ALLOCATION_ALIGNMENT);
+  if (magazine) {
+    magazine->Count = 0;
+  }
+  return magazine;
+}
+
+static VOID PushEmptyMagazine(PDOKAN_OBJECT_CACHE Cache,
+                              PDOKAN_MAGAZINE Magazine) {
+  assert(Magazine->Count == 0);
+  InterlockedPushEntrySList(&Cache->EmptyMagazines, &Magazine->ListEntry);
+}
+
+static PDOKAN_MAGAZINE PopFullMagazine(PDOKAN_OBJECT_CACHE Cache) {
+  PSLIST_ENTRY entry = InterlockedPopEntrySList(&Cache->FullMagazines);
+  if (!entry) {
+    return NULL;
+  }
+  InterlockedDecrement(&Cache->FullMagazineCount);
+  PDOKAN_MAGAZINE magazine =
+      CONTAINING_RECORD(entry, DOKAN_MAGAZINE, ListEntry);
+  InterlockedAdd(&Cache->DepotObjects, -magazine->Count);
+  InterlockedAdd64(&Cache->Budget->DepotBytes,
+                   -GetMagazineBytes(Cache, magazine));
+  return magazine;
+}
+
+// Parks a magazine holding objects in the depot. Fails when the depot already
+// holds as many objects as the pool size allows or when the depots would
+// exceed the memory budget.
+static BOOL PushFullMagazine(PDOKAN_OBJECT_CACHE Cache,
+                             PDOKAN_MAGAZINE Magazine) {
+  assert(Magazine->Count > 0);
+  if (InterlockedIncrement(&Cache->FullMagazineCount) >
+      Cache->MaxFullMagazines) {
+    InterlockedDecrement(&Cache->FullMagazineCount);
+    return FALSE;
+  }
+  LONG64 magazineBytes = GetMagazineBytes(Cache, Magazine);
+  LONG64 depotBytes =
+      InterlockedAdd64(&Cache->Budget->DepotBytes, magazineBytes);
+  LONG64 memoryBudget = ReadNoFence64(&Cache->Budget->MemoryBudget);
+  if (memoryBudget && depotBytes > memoryBudget) {
+    InterlockedAdd64(&Cache->Budget->DepotBytes, -magazineBytes);
+    InterlockedDecrement(&Cache->FullMagazineCount);
+    return FALSE;
+  }
+  InterlockedAdd(&Cache->DepotObjects, Magazine->Count);
+  InterlockedPushEntrySList(&Cache->FullMagazines, &Magazine->ListEntry);
+  return TRUE;
+}
+
+static VOID ReturnMagazine(PDOKAN_OBJECT_CACHE Cache,
+                           PDOKAN_MAGAZINE Magazine) {
+  if (!Magazine) {
+    return;
+  }
+  if (Magazine->Count == 0) {
+    PushEmptyMagazine(Cache, Magazine);
+  } else if (!PushFullMagazine(Cache, Magazine)) {
+    FreeMagazine(Cache, Magazine);
+  }
+}
+
+// Pops a single object from the depot, for a caller without magazines.
+static PVOID PopDepotObject(PDOKAN_OBJECT_CACHE Cache) {
+  PDOKAN_MAGAZINE magazine = PopFullMagazine(Cache);
+  if (!magazine) {
+    return NULL;
+  }
+  InterlockedIncrement(&Cache->DepotPops);
+  PVOID object = magazine->Objects[--magazine->Count];
+  ReturnMagazine(Cache, magazine);
+  return object;
+}
+
+// Pops an object from the magazines of the calling thread. The depot is only
+// reached once both are empty. Returns NULL when the depot is empty too.
+static PVOID PopThreadObject(PDOKAN_OBJECT_CACHE Cache,
+                             PDOKAN_THREAD_MAGAZINES Magazines) {
+  PDOKAN_MAGAZINE loaded = Magazines->Loaded;
+  PDOKAN_MAGAZINE previous = Magazines->Previous;
+  if (!loaded || loaded->Count == 0) {
+    if (previous && previous->Count > 0) {
+      Magazines->Loaded = previous;
+      Magazines->Previous = loaded;
+    } else {
+      PDOKAN_MAGAZINE full = PopFullMagazine(Cache);
+      if (!full) {
+        return NULL;
+      }
+      InterlockedIncrement(&Cache->DepotPops);
+      if (previous) {
+        PushEmptyMagazine(Cache, previous);
+      }
+      Magazines->Previous = loaded;
+      Magazines->Loaded = full;
+    }
+    loaded = Magazines->Loaded;
+  }
+  return loaded->Objects[--loaded->Count];
+}
+
+// Pushes an object into the magazines of the calling thread. When both are
+// full, the previous one is handed over to the depot. Fails when the depot is
+// already at capacity.
+static BOOL PushThreadObject(PDOKAN_OBJECT_CACHE Cache,
+                             PDOKAN_THREAD_MAGAZINES Magazines, PVOID Object) {
+  PDOKAN_MAGAZINE loaded = Magazines->Loaded;
+  PDOKAN_MAGAZINE previous = Magazines->Previous;
+  if (!loaded || loaded->Count == Cache->MagazineSize) {
+    if (previous && previous->Count < Cache->MagazineSize) {
+      Magazines->Loaded = previous;
+      Magazines->Previous = loaded;
+    } else {
+      PDOKAN_MAGAZINE empty = PopEmptyMagazine(Cache);
+      if (!empty) {
+        return FALSE;
+      }
+      if (previous && !PushFullMagazine(Cache, previous)) {
+        PushEmptyMagazine(Cache, empty);
+        return FALSE;
+      }
+      Magazines->Previous = loaded;
+      Magazines->Loaded = empty;
+    }
+    loaded = Magazines->Loaded;
+  }
+  loaded->Objects[loaded->Count++] = Object;
+  return TRUE;
+}
+
+// Marks the thread cache as used by its owner. Fails while
+// DokanThreadCache_ReclaimIdle may take its magazines.
+static BOOL EnterThreadCache(PDOKAN_THREAD_CACHE ThreadCache) {
+  WriteNoFence(&ThreadCache->Busy, TRUE);
+  // The store above can still be buffered when Reclaiming is read: the
+  // reclaim flushes the write buffers of every processor before it reads
+  // Busy, so that one of the two threads always sees the flag of the other.
+  if (ReadAcquire(&ThreadCache->Reclaiming)) {
+    WriteRelease(&ThreadCache->Busy, FALSE);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static VOID LeaveThreadCache(PDOKAN_THREAD_CACHE ThreadCache) {
+  WriteNoFence(&ThreadCache->Uses, ThreadCache->Uses + 1);
+  WriteRelease(&ThreadCache->Busy, FALSE);
+}
+
+PVOID DokanObjectCache_Pop(PDOKAN_OBJECT_CACHE Cache,
+                           PDOKAN_THREAD_CACHE ThreadCache, ULONG Index) {
+  PVOID object = NULL;
+  if (ThreadCache && EnterThreadCache(ThreadCache)) {
+    PDOKAN_THREAD_MAGAZINES magazines = &ThreadCache->Magazines[Index];
+    WriteNoFence64(&magazines->Requests, magazines->Requests + 1);
+    object = PopThreadObject(Cache, magazines);
+    LeaveThreadCache(ThreadCache);
+  } else {
+    InterlockedIncrement64(&Cache->Requests);
+    object = PopDepotObject(Cache);
+  }
+  return object ? object : AllocObject(Cache);
+}
+
+VOID DokanObjectCache_Push(PDOKAN_OBJECT_CACHE Cache,
+                           PDOKAN_THREAD_CACHE ThreadCache, ULONG Index,
+                           PVOID Object) {
+  BOOL pushed = FALSE;
+  if (ThreadCache && EnterThreadCache(ThreadCache)) {
+    pushed =
+        PushThreadObject(Cache, &ThreadCache->Magazines[Index], Object);
+    LeaveThreadCache(ThreadCache);
+  } else {
+    PDOKAN_MAGAZINE magazine = PopEmptyMagazine(Cache);
+    if (magazine) {
+      magazine->Objects[magazine->Count++] = Object;
+      pushed = PushFullMagazine(Cache, magazine);
+      if (!pushed) {
+        magazine->Count = 0;
+        PushEmptyMagazine(Cache, magazine);
+      }
+    }
+  }
+  if (!pushed) {
+    FreeObject(Cache, Object);
+  }
+}
+
+VOID DokanObjectCache_Prewarm(PDOKAN_OBJECT_CACHE Cache, ULONG ObjectCount) {
+  while (ObjectCount > 0) {
+    PDOKAN_MAGAZINE magazine = PopEmptyMagazine(Cache);
+    if (!magazine) {
+      return;
+    }
+    while (ObjectCount > 0 && magazine->Count < Cache->MagazineSize) {
+      PVOID object = AllocObject(Cache);
+      if (!object) {
+        break;
+      }
+      magazine->Objects[magazine->Count++] = object;
+      --ObjectCount;
+    }
+    if (magazine->Count == 0) {
+      PushEmptyMagazine(Cache, magazine);
+      return;
+    }
+    if (!PushFullMagazine(Cache, magazine)) {
+      FreeMagazine(Cache, magazine);
+      return;
+    }
+  }
+}
+
+LONG DokanObjectCache_TrimIdle(PDOKAN_OBJECT_CACHE Cache) {
+  LONG depotPops = ReadNoFence(&Cache->DepotPops);
+  if (depotPops != Cache->LastTrimDepotPops) {
+    Cache->LastTrimDepotPops = depotPops;
+    return 0;
+  }
+  LONG trimCount = (ReadNoFence(&Cache->FullMagazineCount) + 1) / 2;
+  LONG freedObjects = 0;
+  for (LONG i = 0; i < trimCount; ++i) {
+    PDOKAN_MAGAZINE magazine = PopFullMagazine(Cache);
+    if (!magazine) {
+      break;
+    }
+    freedObjects += magazine->Count;
+    FreeMagazine(Cache, magazine);
+  }
+  FreeMagazineList(Cache, InterlockedFlushSList(&Cache->EmptyMagazines));
+  return freedObjects;
+}
+
+PDOKAN_THREAD_CACHE DokanThreadCache_Alloc(ULONG CacheCount) {
+  PDOKAN_THREAD_CACHE threadCache = (PDOKAN_THREAD_CACHE)calloc(
+      1, FIELD_OFFSET(DOKAN_THREAD_CACHE, Magazines) +
+             sizeof(DOKAN_THREAD_MAGAZINES) * CacheCount);
+  if (threadCache) {
+    threadCache->CacheCount = CacheCount;
+  }
+  return threadCache;
+}
+
+// Hands the magazines of a thread cache that is not in use back to the
+// depots.
+static VOID ReturnThreadMagazines(PDOKAN_THREAD_CACHE ThreadCache,
+                                  PDOKAN_OBJECT_CACHE Caches) {
+  for (ULONG i = 0; i < ThreadCache->CacheCount; ++i) {
+    PDOKAN_THREAD_MAGAZINES magazines = &ThreadCache->Magazines[i];
+    ReturnMagazine(&Caches[i], magazines->Loaded);
+    ReturnMagazine(&Caches[i], magazines->Previous);
+    magazines->Loaded = NULL;
+    magazines->Previous = NULL;
+  }
+}
+
+VOID DokanThreadCache_Free(PDOKAN_THREAD_CACHE ThreadCache,
+                           PDOKAN_OBJECT_CACHE Caches) {
+  if (!ThreadCache) {
+    return;
+  }
+  ReturnThreadMagazines(ThreadCache, Caches);
+  for (ULONG i = 0; i < ThreadCache->CacheCount; ++i) {
+    InterlockedAdd64(&Caches[i].Requests,
+                     ThreadCache->Magazines[i].Requests);
+  }
+  free(ThreadCache);
+}
+
+ULONG DokanThreadCache_ReclaimIdle(PLIST_ENTRY ThreadCaches,
+                                   PDOKAN_OBJECT_CACHE Caches) {
+  BOOL reclaiming = FALSE;
+  for (PLIST_ENTRY entry = ThreadCaches->Flink; entry != ThreadCaches;
+       entry = entry->Flink) {
+    PDOKAN_THREAD_CACHE threadCache =
+        CONTAINING_RECORD(entry, DOKAN_THREAD_CACHE, ListEntry);
+    LONG uses = ReadNoFence(&threadCache->Uses);
+    if (uses == threadCache->LastReclaimUses) {
+      WriteNoFence(&threadCache->Reclaiming, TRUE);
+      reclaiming = TRUE;
+    }
+    threadCache->LastReclaimUses = uses;
+  }
+  if (!reclaiming) {
+    return 0;
+  }
+  // Makes the Reclaiming flags visible to the owners and their Busy flags
+  // visible here, without a fence on their side.
+  FlushProcessWriteBuffers();
+  ULONG reclaimedCount = 0;
+  for (PLIST_ENTRY entry = ThreadCaches->Flink; entry != ThreadCaches;
+       entry = entry->Flink) {
+    PDOKAN_THREAD_CACHE threadCache =
+        CONTAINING_RECORD(entry, DOKAN_THREAD_CACHE, ListEntry);
+    if (!ReadNoFence(&threadCache->Reclaiming)) {
+      continue;
+    }
+    // An owner seeing Reclaiming from now on leaves its magazines alone.
+    if (!ReadAcquire(&threadCache->Busy)) {
+      ReturnThreadMagazines(threadCache, Caches);
+      ++reclaimedCount;
+    }
+    WriteRelease(&threadCache->Reclaiming, FALSE);
+  }
+  return reclaimedCount;
+}
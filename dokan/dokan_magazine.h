@@ -0,0 +1,145 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_MAGAZINE_H_
+#define DOKAN_MAGAZINE_H_
+
+// Object caches following the Bonwick magazine allocator design. Threads keep
+// two magazines of free objects per cache and only exchange whole magazines
+// with the global depot of the cache, through lock-free SLISTs. It only
+// depends on the heap: the caller stores the thread caches and decides when
+// idle ones are reclaimed.
+
+// A fixed size stack of free objects owned by a single thread, or parked in
+// the depot of its object cache.
+typedef struct _DOKAN_MAGAZINE {
+  SLIST_ENTRY ListEntry;
+  LONG Count;
+  PVOID Objects[1];
+} DOKAN_MAGAZINE, *PDOKAN_MAGAZINE;
+
+// Memory budget shared by the depots of several object caches.
+typedef struct _DOKAN_MAGAZINE_BUDGET {
+  // Bytes held by the depots.
+  volatile LONG64 DepotBytes;
+  // High watermark of DepotBytes. 0 means the depots are only bounded by
+  // their pool size.
+  volatile LONG64 MemoryBudget;
+} DOKAN_MAGAZINE_BUDGET, *PDOKAN_MAGAZINE_BUDGET;
+
+// Global depot of an object cache.
+typedef struct _DOKAN_OBJECT_CACHE {
+  SLIST_HEADER FullMagazines;
+  SLIST_HEADER EmptyMagazines;
+  volatile LONG FullMagazineCount;
+  LONG MaxFullMagazines;
+  LONG MagazineSize;
+  SIZE_T ObjectSize;
+  PDOKAN_MAGAZINE_BUDGET Budget;
+  // Occupancy counters, only updated when reaching the depot or the heap.
+  volatile LONG ResidentObjects;
+  volatile LONG DepotObjects;
+  volatile LONG64 HeapAllocations;
+  // Requests served without a thread cache or by threads that exited. The
+  // ones of live threads are counted in their thread cache.
+  volatile LONG64 Requests;
+  // Number of magazines handed out by the depot, used to detect idle caches.
+  volatile LONG DepotPops;
+  // DepotPops value seen by the previous idle trim.
+  LONG LastTrimDepotPops;
+} DOKAN_OBJECT_CACHE, *PDOKAN_OBJECT_CACHE;
+
+// Magazines of a thread for one object cache.
+typedef struct _DOKAN_THREAD_MAGAZINES {
+  PDOKAN_MAGAZINE Loaded;
+  PDOKAN_MAGAZINE Previous;
+  // Objects requested by the thread, only written by it.
+  volatile LONG64 Requests;
+} DOKAN_THREAD_MAGAZINES, *PDOKAN_THREAD_MAGAZINES;
+
+// Magazines of a thread for an array of object caches, indexed like it.
+// Only the owner thread pops and pushes objects with them, without atomic
+// operations. DokanThreadCache_ReclaimIdle takes the magazines of an idle
+// owner through the Busy and Reclaiming flags.
+typedef struct _DOKAN_THREAD_CACHE {
+  // Set by the owner while it uses its magazines.
+  volatile LONG Busy;
+  // Set while DokanThreadCache_ReclaimIdle may take the magazines.
+  volatile LONG Reclaiming;
+  // Number of operations of the owner, and its value seen by the previous
+  // DokanThreadCache_ReclaimIdle.
+  volatile LONG Uses;
+  LONG LastReclaimUses;
+  // Entry in the list of thread caches of the caller.
+  LIST_ENTRY ListEntry;
+  ULONG CacheCount;
+  DOKAN_THREAD_MAGAZINES Magazines[ANYSIZE_ARRAY];
+} DOKAN_THREAD_CACHE, *PDOKAN_THREAD_CACHE;
+
+// Initializes an empty cache of ObjectSize objects. Its depot keeps up to
+// PoolSize objects in magazines of MagazineSize objects, within the memory
+// budget shared with other caches.
+VOID DokanObjectCache_Initialize(PDOKAN_OBJECT_CACHE Cache, SIZE_T ObjectSize,
+                                 LONG MagazineSize, LONG PoolSize,
+                                 PDOKAN_MAGAZINE_BUDGET Budget);
+
+// Releases the objects of the depot. The thread caches must have been freed.
+VOID DokanObjectCache_Cleanup(PDOKAN_OBJECT_CACHE Cache);
+
+// Returns a free object from the magazines of ThreadCache at Index, from the
+// depot or from the heap. ThreadCache can be NULL to skip the magazines, it
+// must be owned by the calling thread otherwise.
+PVOID DokanObjectCache_Pop(PDOKAN_OBJECT_CACHE Cache,
+                           PDOKAN_THREAD_CACHE ThreadCache, ULONG Index);
+
+// Gives back an object of the cache to the magazines of ThreadCache at Index,
+// to the depot, or to the heap when they are all at capacity.
+VOID DokanObjectCache_Push(PDOKAN_OBJECT_CACHE Cache,
+                           PDOKAN_THREAD_CACHE ThreadCache, ULONG Index,
+                           PVOID Object);
+
+// Fills the depot with up to ObjectCount newly allocated objects.
+VOID DokanObjectCache_Prewarm(PDOKAN_OBJECT_CACHE Cache, ULONG ObjectCount);
+
+// Releases half of the magazines of a depot that did not hand out any
+// magazine since the previous call. Returns the number of freed objects.
+LONG DokanObjectCache_TrimIdle(PDOKAN_OBJECT_CACHE Cache);
+
+// Allocates a thread cache with magazines for CacheCount caches.
+PDOKAN_THREAD_CACHE DokanThreadCache_Alloc(ULONG CacheCount);
+
+// Hands the magazines of a thread cache back to the depots of Caches and
+// frees it. The thread cache must no longer be visible to
+// DokanThreadCache_ReclaimIdle.
+VOID DokanThreadCache_Free(PDOKAN_THREAD_CACHE ThreadCache,
+                           PDOKAN_OBJECT_CACHE Caches);
+
+// Hands the magazines of the thread caches of the list that were not used
+// since the previous call back to the depots of Caches, where they count in
+// the memory budget and are trimmed like the others. The owners are never
+// blocked: a thread cache in use is skipped, and its owner bypasses its
+// magazines for the few operations started during the reclaim. Calls must be
+// serialized with each other and with the changes of the list. Returns the
+// number of reclaimed thread caches.
+ULONG DokanThreadCache_ReclaimIdle(PLIST_ENTRY ThreadCaches,
+                                   PDOKAN_OBJECT_CACHE Caches);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+#include "dokan_namecache.h"
+
+#include <malloc.h>
+
+ULONG HashFileName(LPCWSTR FileName, ULONG FileNameLength) {
+  ULONG hash = 2166136261;
+  for (ULONG i = 0; i < FileNameLength; ++i) {
+    hash = (hash ^ towupper(FileName[i])) * 16777619;
+  }
+  return hash;
+}
+
+static PDOKAN_NAME_CACHE_ENTRY GetEntry(PDOKAN_NAME_CACHE Cache,
+                                        ULONG Index) {
+  return (PDOKAN_NAME_CACHE_ENTRY)(Cache->Entries + Index * Cache->EntrySize);
+}
+
+static PVOID GetPayload(PDOKAN_NAME_CACHE_ENTRY Entry) {
+  return Entry + 1;
+}
+
+static BOOL IsEntryOf(PDOKAN_NAME_CACHE Cache, PDOKAN_NAME_CACHE_ENTRY Entry,
+                      LPCWSTR Name, ULONG NameLength, ULONG Hash) {
+  if (!Entry->Name || Entry->Hash != Hash || Entry->NameLength != NameLength) {
+    return FALSE;
+  }
+  if (Cache->CaseSensitive) {
+    return wcsncmp(Entry->Name, Name, NameLength) == 0;
+  }
+  return _wcsnicmp(Entry->Name, Name, NameLength) == 0;
+}
+
+// Releases the payload of Entry. The cache lock is held exclusively.
+static VOID DropPayload(PDOKAN_NAME_CACHE Cache,
+                        PDOKAN_NAME_CACHE_ENTRY Entry) {
+  if (!Entry->ExpirationTime) {
+    return;
+  }
+  if (Cache->FreePayload) {
+    Cache->FreePayload(GetPayload(Entry));
+  }
+  Cache->Memory -= Entry->Memory;
+  Entry->Memory = 0;
+  Entry->ExpirationTime = 0;
+}
+
+BOOL DokanNameCache_Initialize(PDOKAN_NAME_CACHE Cache, ULONG EntryCount,
+                               ULONG PayloadSize, ULONG TtlMs,
+                               SIZE_T MaxMemory, BOOL CaseSensitive,
+                               PDOKAN_NAME_CACHE_COPY CopyPayload,
+                               PDOKAN_NAME_CACHE_FREE FreePayload) {
+  ZeroMemory(Cache, sizeof(DOKAN_NAME_CACHE));
+  InitializeSRWLock(&Cache->Lock);
+  // The Generation of each entry must stay 8 byte aligned.
+  Cache->EntrySize = (sizeof(DOKAN_NAME_CACHE_ENTRY) + PayloadSize + 7) & ~7;
+  Cache->EntryCount = EntryCount;
+  Cache->PayloadSize = PayloadSize;
+  Cache->TtlMs = TtlMs;
+  Cache->CaseSensitive = CaseSensitive;
+  Cache->MaxMemory = MaxMemory;
+  Cache->CopyPayload = CopyPayload;
+  Cache->FreePayload = FreePayload;
+  Cache->Entries = calloc(EntryCount, Cache->EntrySize);
+  return Cache->Entries != NULL;
+}
+
+VOID DokanNameCache_Free(PDOKAN_NAME_CACHE Cache) {
+  if (!Cache->Entries) {
+    return;
+  }
+  for (ULONG i = 0; i < Cache->EntryCount; ++i) {
+    PDOKAN_NAME_CACHE_ENTRY entry = GetEntry(Cache, i);
+    DropPayload(Cache, entry);
+    free(entry->Name);
+  }
+  free(Cache->Entries);
+  Cache->Entries = NULL;
+}
+
+BOOL DokanNameCache_Lookup(PDOKAN_NAME_CACHE Cache, LPCWSTR Name,
+                           ULONG NameLength, PVOID Destination,
+                           PLONG64 Generation) {
+  *Generation = 0;
+  if (!Cache->Entries) {
+    return FALSE;
+  }
+  ULONG hash = HashFileName(Name, NameLength);
+  PDOKAN_NAME_CACHE_ENTRY entry = GetEntry(Cache, hash % Cache->EntryCount);
+  ULONGLONG now = GetTickCount64();
+  *Generation = ReadAcquire64(&entry->Generation);
+  AcquireSRWLockShared(&Cache->Lock);
+  BOOL found = IsEntryOf(Cache, entry, Name, NameLength, hash) &&
+               now < entry->ExpirationTime;
+  if (found && Cache->PayloadSize) {
+    if (Cache->CopyPayload) {
+      found = Cache->CopyPayload(Destination, GetPayload(entry));
+    } else {
+      memcpy(Destination, GetPayload(entry), Cache->PayloadSize);
+    }
+  }
+  ReleaseSRWLockShared(&Cache->Lock);
+  return found;
+}
+
+BOOL DokanNameCache_Insert(PDOKAN_NAME_CACHE Cache, LPCWSTR Name,
+                           ULONG NameLength, const VOID *Payload,
+                           SIZE_T Memory, LONG64 Generation) {
+  if (!Cache->Entries) {
+    return FALSE;
+  }
+  ULONG hash = HashFileName(Name, NameLength);
+  PDOKAN_NAME_CACHE_ENTRY entry = GetEntry(Cache, hash % Cache->EntryCount);
+  ULONGLONG expirationTime = GetTickCount64() + Cache->TtlMs;
+  BOOL inserted = FALSE;
+  AcquireSRWLockExclusive(&Cache->Lock);
+  if (entry->Generation == Generation &&
+      (!Cache->MaxMemory || Memory <= Cache->MaxMemory)) {
+    BOOL matching = IsEntryOf(Cache, entry, Name, NameLength, hash);
+    if (!matching) {
+      // The entry of another name is evicted.
+      LPWSTR name = malloc((NameLength + 1) * sizeof(WCHAR));
+      if (name) {
+        memcpy(name, Name, NameLength * sizeof(WCHAR));
+        name[NameLength] = L'\0';
+        DropPayload(Cache, entry);
+        free(entry->Name);
+        entry->Name = name;
+        entry->NameLength = NameLength;
+        entry->Hash = hash;
+        matching = TRUE;
+      }
+    }
+    if (matching) {
+      DropPayload(Cache, entry);
+      while (Cache->MaxMemory && Cache->Memory + Memory > Cache->MaxMemory) {
+        DropPayload(Cache, GetEntry(Cache, Cache->EvictionIndex));
+        Cache->EvictionIndex = (Cache->EvictionIndex + 1) % Cache->EntryCount;
+      }
+      if (Cache->PayloadSize) {
+        memcpy(GetPayload(entry), Payload, Cache->PayloadSize);
+      }
+      entry->Memory = Memory;
+      entry->ExpirationTime = expirationTime;
+      Cache->Memory += Memory;
+      inserted = TRUE;
+    }
+  }
+  ReleaseSRWLockExclusive(&Cache->Lock);
+  return inserted;
+}
+
+VOID DokanNameCache_Invalidate(PDOKAN_NAME_CACHE Cache, LPCWSTR Name,
+                               ULONG NameLength) {
+  if (!Cache->Entries) {
+    return;
+  }
+  ULONG hash = HashFileName(Name, NameLength);
+  PDOKAN_NAME_CACHE_ENTRY entry = GetEntry(Cache, hash % Cache->EntryCount);
+  // Lookups of the names of the entry already calling the backend must not
+  // cache what they read. Lookups of other names are not concerned.
+  InterlockedIncrement64(&entry->Generation);
+  // Inserts compare the generation with the lock held exclusively, one
+  // running after this check cannot cache the name anymore.
+  AcquireSRWLockShared(&Cache->Lock);
+  BOOL cached = entry->ExpirationTime &&
+                IsEntryOf(Cache, entry, Name, NameLength, hash);
+  ReleaseSRWLockShared(&Cache->Lock);
+  if (!cached) {
+    return;
+  }
+  AcquireSRWLockExclusive(&Cache->Lock);
+  if (IsEntryOf(Cache, entry, Name, NameLength, hash)) {
+    DropPayload(Cache, entry);
+  }
+  ReleaseSRWLockExclusive(&Cache->Lock);
+}
+
+VOID DokanNameCache_Clear(PDOKAN_NAME_CACHE Cache) {
+  if (!Cache->Entries) {
+    return;
+  }
+  AcquireSRWLockExclusive(&Cache->Lock);
+  for (ULONG i = 0; i < Cache->EntryCount; ++i) {
+    PDOKAN_NAME_CACHE_ENTRY entry = GetEntry(Cache, i);
+    InterlockedIncrement64(&entry->Generation);
+    DropPayload(Cache, entry);
+  }
+  ReleaseSRWLockExclusive(&Cache->Lock);
+}
@@ -0,0 +1,115 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_NAMECACHE_H_
+#define DOKAN_NAMECACHE_H_
+
+// Direct-mapped cache of payloads keyed by file name, with a time to live.
+// Each name has a single possible entry, a name evicts the one of another name
+// with the same entry. The payloads have a fixed size and are stored in their
+// entry. Payloads owning memory, like a pointer, are given to the cache and
+// released with its free callback.
+//
+// A payload read from the backend is only cached when its entry was not
+// invalidated during the call: DokanNameCache_Lookup returns the generation
+// of the entry to give to DokanNameCache_Insert, and every invalidation of a
+// name selecting the entry increments it.
+
+// Copies the Payload of an entry to the Destination of a lookup, with the
+// cache lock held shared. Returns FALSE when it fails, the lookup then misses.
+typedef BOOL (*PDOKAN_NAME_CACHE_COPY)(PVOID Destination, const VOID *Payload);
+
+// Releases what a payload owns when it is dropped from the cache.
+typedef VOID (*PDOKAN_NAME_CACHE_FREE)(PVOID Payload);
+
+typedef struct _DOKAN_NAME_CACHE_ENTRY {
+  // NULL when the entry was never used.
+  LPWSTR Name;
+  // Length of Name in characters.
+  ULONG NameLength;
+  // Hash of Name, which selects the entry.
+  ULONG Hash;
+  // GetTickCount64 time after which the payload is no longer used. 0 when
+  // the entry has no payload.
+  ULONGLONG ExpirationTime;
+  // Memory accounted for the payload.
+  SIZE_T Memory;
+  // Incremented by each invalidation of a name selecting the entry.
+  volatile LONG64 Generation;
+  // Followed by the payload, padded to keep the entries aligned.
+} DOKAN_NAME_CACHE_ENTRY, *PDOKAN_NAME_CACHE_ENTRY;
+
+typedef struct _DOKAN_NAME_CACHE {
+  SRWLOCK Lock;
+  // EntryCount entries of EntrySize bytes, NULL when the cache is disabled.
+  PUCHAR Entries;
+  ULONG EntryCount;
+  SIZE_T EntrySize;
+  ULONG PayloadSize;
+  ULONG TtlMs;
+  BOOL CaseSensitive;
+  // Memory of the payloads. Payloads are evicted in entry order to keep it
+  // under MaxMemory, unless MaxMemory is 0.
+  SIZE_T Memory;
+  SIZE_T MaxMemory;
+  // Next entry evicted when a payload needs memory.
+  ULONG EvictionIndex;
+  // NULL to copy the payload as is.
+  PDOKAN_NAME_CACHE_COPY CopyPayload;
+  // NULL when the payloads own nothing.
+  PDOKAN_NAME_CACHE_FREE FreePayload;
+} DOKAN_NAME_CACHE, *PDOKAN_NAME_CACHE;
+
+// Allocates the EntryCount entries of a cache of PayloadSize payloads kept
+// TtlMs milliseconds. Returns FALSE when they cannot be allocated, the cache
+// is then disabled and its other functions do nothing.
+BOOL DokanNameCache_Initialize(PDOKAN_NAME_CACHE Cache, ULONG EntryCount,
+                               ULONG PayloadSize, ULONG TtlMs,
+                               SIZE_T MaxMemory, BOOL CaseSensitive,
+                               PDOKAN_NAME_CACHE_COPY CopyPayload,
+                               PDOKAN_NAME_CACHE_FREE FreePayload);
+
+// Releases the entries and their payloads.
+VOID DokanNameCache_Free(PDOKAN_NAME_CACHE Cache);
+
+// Copies the payload of the NameLength characters of Name to Destination
+// when it is cached and has not expired. Otherwise Generation receives the
+// generation of its entry to give to DokanNameCache_Insert.
+BOOL DokanNameCache_Lookup(PDOKAN_NAME_CACHE Cache, LPCWSTR Name,
+                           ULONG NameLength, PVOID Destination,
+                           PLONG64 Generation);
+
+// Stores the PayloadSize bytes of Payload for Name, accounting Memory bytes
+// for it, unless its entry was invalidated since Generation was read. Returns
+// FALSE when the payload was not stored and still belongs to the caller.
+BOOL DokanNameCache_Insert(PDOKAN_NAME_CACHE Cache, LPCWSTR Name,
+                           ULONG NameLength, const VOID *Payload,
+                           SIZE_T Memory, LONG64 Generation);
+
+// Drops the payload of Name. Lookups of the names of its entry already
+// calling the backend do not cache what they read.
+VOID DokanNameCache_Invalidate(PDOKAN_NAME_CACHE Cache, LPCWSTR Name,
+                               ULONG NameLength);
+
+// Drops all the payloads, and prevents the lookups calling the backend from
+// caching what they read.
+VOID DokanNameCache_Clear(PDOKAN_NAME_CACHE Cache);
+
+#endif
@@ -0,0 +1,117 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_pattern.h"
+
+WCHAR g_DokanUpcaseTable[0x10000];
+
+static INIT_ONCE g_UpcaseTableInitOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK FillUpcaseTable(PINIT_ONCE InitOnce, PVOID Parameter,
+                                     PVOID *Context) {
+  UNREFERENCED_PARAMETER(InitOnce);
+  UNREFERENCED_PARAMETER(Parameter);
+  UNREFERENCED_PARAMETER(Context);
+  for (ULONG c = 0; c < 0x10000; ++c) {
+    g_DokanUpcaseTable[c] = (WCHAR)towupper((WCHAR)c);
+  }
+  return TRUE;
+}
+
+VOID DokanInitializeUpcaseTable() {
+  InitOnceExecuteOnce(&g_UpcaseTableInitOnce, FillUpcaseTable, NULL, NULL);
+}
+
+static BOOL IsWildcard(WCHAR Character) {
+  return Character == L'*' || Character == L'?' || Character == DOS_STAR ||
+         Character == DOS_QM || Character == DOS_DOT;
+}
+
+VOID DokanPattern_Compile(PDOKAN_PATTERN Pattern, LPCWSTR Expression,
+                          BOOL IgnoreCase) {
+  DokanInitializeUpcaseTable();
+  Pattern->Kind = DOKAN_PATTERN_EXPRESSION;
+  Pattern->IgnoreCase = IgnoreCase;
+  Pattern->Expression = Expression;
+  Pattern->Literal = NULL;
+  Pattern->LiteralLength = 0;
+
+  ULONG length = (ULONG)wcslen(Expression);
+  ULONG wildcardCount = 0;
+  for (ULONG i = 0; i < length; ++i) {
+    if (IsWildcard(Expression[i])) {
+      ++wildcardCount;
+    }
+  }
+  if (wildcardCount == 0) {
+    Pattern->Kind = DOKAN_PATTERN_LITERAL;
+    Pattern->Literal = Expression;
+    Pattern->LiteralLength = length;
+  } else if (wildcardCount == 1 && length == 1 && Expression[0] == L'*') {
+    Pattern->Kind = DOKAN_PATTERN_ALL;
+  } else if (wildcardCount == 1 && Expression[length - 1] == L'*') {
+    Pattern->Kind = DOKAN_PATTERN_PREFIX;
+    Pattern->Literal = Expression;
+    Pattern->LiteralLength = length - 1;
+  } else if (wildcardCount == 1 && Expression[0] == L'*') {
+    Pattern->Kind = DOKAN_PATTERN_SUFFIX;
+    Pattern->Literal = Expression + 1;
+    Pattern->LiteralLength = length - 1;
+  }
+}
+
+// Compares the Length first characters of Name and Literal.
+static BOOL MatchLiteral(PDOKAN_PATTERN Pattern, LPCWSTR Name,
+                         LPCWSTR Literal, ULONG Length) {
+  if (!Pattern->IgnoreCase) {
+    return wmemcmp(Name, Literal, Length) == 0;
+  }
+  for (ULONG i = 0; i < Length; ++i) {
+    if (Name[i] != Literal[i] &&
+        DokanUpcase(Name[i]) != DokanUpcase(Literal[i])) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+BOOL DokanPattern_Match(PDOKAN_PATTERN Pattern, LPCWSTR Name,
+                        ULONG NameLength) {
+  switch (Pattern->Kind) {
+  case DOKAN_PATTERN_ALL:
+    return TRUE;
+  case DOKAN_PATTERN_LITERAL:
+    return NameLength == Pattern->LiteralLength &&
+           MatchLiteral(Pattern, Name, Pattern->Literal,
+                        Pattern->LiteralLength);
+  case DOKAN_PATTERN_PREFIX:
+    return NameLength >= Pattern->LiteralLength &&
+           MatchLiteral(Pattern, Name, Pattern->Literal,
+                        Pattern->LiteralLength);
+  case DOKAN_PATTERN_SUFFIX:
+    return NameLength >= Pattern->LiteralLength &&
+           MatchLiteral(Pattern, Name + NameLength - Pattern->LiteralLength,
+                        Pattern->Literal, Pattern->LiteralLength);
+  default:
+    return DokanIsNameInExpression(Pattern->Expression, Name,
+                                   Pattern->IgnoreCase);
+  }
+}
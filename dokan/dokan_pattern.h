@@ -0,0 +1,75 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_PATTERN_H_
+#define DOKAN_PATTERN_H_
+
+#include "dokani.h"
+
+#define DOS_STAR (L'<')
+#define DOS_QM (L'>')
+#define DOS_DOT (L'"')
+
+// Upper case of each character, as returned by towupper.
+extern WCHAR g_DokanUpcaseTable[0x10000];
+
+// Fills g_DokanUpcaseTable the first time it is called.
+VOID DokanInitializeUpcaseTable();
+
+FORCEINLINE WCHAR DokanUpcase(WCHAR Character) {
+  return g_DokanUpcaseTable[(USHORT)Character];
+}
+
+typedef enum _DOKAN_PATTERN_KIND {
+  // "*", every name matches.
+  DOKAN_PATTERN_ALL,
+  // No wildcard, the name is the literal.
+  DOKAN_PATTERN_LITERAL,
+  // "literal*", the name starts with the literal.
+  DOKAN_PATTERN_PREFIX,
+  // "*literal" like "*.ext", the name ends with the literal.
+  DOKAN_PATTERN_SUFFIX,
+  // Any other expression, matched by DokanIsNameInExpression.
+  DOKAN_PATTERN_EXPRESSION,
+} DOKAN_PATTERN_KIND;
+
+// Search pattern analyzed once to match many names. It points into the
+// expression it was compiled from, which has to outlive it.
+typedef struct _DOKAN_PATTERN {
+  DOKAN_PATTERN_KIND Kind;
+  BOOL IgnoreCase;
+  LPCWSTR Expression;
+  // Part of the expression without wildcard for the literal, prefix and
+  // suffix kinds.
+  LPCWSTR Literal;
+  ULONG LiteralLength;
+} DOKAN_PATTERN, *PDOKAN_PATTERN;
+
+// Compiles Expression with the wildcards of DokanIsNameInExpression.
+VOID DokanPattern_Compile(PDOKAN_PATTERN Pattern, LPCWSTR Expression,
+                          BOOL IgnoreCase);
+
+// Returns whether the null terminated Name of NameLength characters matches
+// the pattern, with the same result as DokanIsNameInExpression.
+BOOL DokanPattern_Match(PDOKAN_PATTERN Pattern, LPCWSTR Name,
+                        ULONG NameLength);
+
+#endif
@@ -20,41 +20,81 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokan_pool.h"
+#include "dokan_magazine.h"
+#include "dokan_readahead.h"
 #include "dokan_vector.h"
+#include "dokan_writebehind.h"
 
 #include <assert.h>
+#include <malloc.h>
 #include <threadpoolapiset.h>
 
 #define DOKAN_IO_BATCH_POOL_SIZE 1024
 #define DOKAN_IO_EVENT_POOL_SIZE 1024
-#define DOKAN_IO_EXTRA_EVENT_POOL_SIZE 128
 #define DOKAN_DIRECTORY_LIST_POOL_SIZE 128
+#define DOKAN_DIRECTORY_LIST_POOL_MAX_KEPT_SIZE (1024 * 1024)
 
 // Global thread pool
 PTP_POOL g_ThreadPool = NULL;
 
-// Global vector of event buffers
-PDOKAN_VECTOR g_IoBatchBufferPool = NULL;
-CRITICAL_SECTION g_IoBatchBufferCriticalSection;
-
-PDOKAN_VECTOR g_IoEventBufferPool = NULL;
-CRITICAL_SECTION g_IoEventBufferCriticalSection;
-
-PDOKAN_VECTOR g_EventResultPool = NULL;
-CRITICAL_SECTION g_EventResultCriticalSection;
-
-PDOKAN_VECTOR g_16KEventResultPool = NULL;
-CRITICAL_SECTION g_16KEventResultCriticalSection;
-
-PDOKAN_VECTOR g_32KEventResultPool = NULL;
-CRITICAL_SECTION g_32KEventResultCriticalSection;
-
-PDOKAN_VECTOR g_64KEventResultPool = NULL;
-CRITICAL_SECTION g_64KEventResultCriticalSection;
-
-PDOKAN_VECTOR g_128KEventResultPool = NULL;
-CRITICAL_SECTION g_128KEventResultCriticalSection;
-
+// Magazine sizes of the per-thread object caches. Large objects use smaller
+// magazines to bound the memory a single thread can keep to itself.
+#define DOKAN_IO_BATCH_MAGAZINE_SIZE 4
+#define DOKAN_IO_EVENT_MAGAZINE_SIZE 32
+
+// Hot object pools served by the per-thread magazine caches.
+typedef enum _DOKAN_OBJECT_CACHE_ID {
+  DOKAN_OBJECT_CACHE_IO_BATCH = 0,
+  DOKAN_OBJECT_CACHE_IO_EVENT,
+  // First of the DOKAN_EVENT_RESULT_CLASS_COUNT EVENT_INFORMATION classes.
+  DOKAN_OBJECT_CACHE_EVENT_RESULT,
+  DOKAN_OBJECT_CACHE_COUNT =
+      DOKAN_OBJECT_CACHE_EVENT_RESULT + DOKAN_EVENT_RESULT_CLASS_COUNT
+} DOKAN_OBJECT_CACHE_ID;
+
+// A size class of the EVENT_INFORMATION slab allocator.
+typedef struct _DOKAN_EVENT_RESULT_CLASS {
+  // Size of the EVENT_INFORMATION Buffer the class objects can hold.
+  ULONG BufferSize;
+  // Maximum number of objects kept in the global depot.
+  LONG PoolSize;
+  LONG MagazineSize;
+} DOKAN_EVENT_RESULT_CLASS;
+
+// EVENT_INFORMATION size classes, sorted by buffer size. Most requests fit in
+// the default one page class, larger ones come from reads and directory
+// listings. Requests above the last class are served directly by the heap.
+static const DOKAN_EVENT_RESULT_CLASS
+    g_EventResultClasses[DOKAN_EVENT_RESULT_CLASS_COUNT] = {
+        {DOKAN_EVENT_INFO_DEFAULT_BUFFER_SIZE, 1024, 32},
+        {16 * 1024, 128, 4},
+        {32 * 1024, 128, 4},
+        {64 * 1024, 128, 4},
+        {128 * 1024, 128, 4},
+        {256 * 1024, 32, 2},
+        {512 * 1024, 16, 2},
+        {1024 * 1024, 8, 1},
+};
+
+DOKAN_OBJECT_CACHE g_ObjectCaches[DOKAN_OBJECT_CACHE_COUNT];
+DWORD g_PoolFlsIndex = FLS_OUT_OF_INDEXES;
+
+// Thread caches of the process, walked by the idle trim and the statistics.
+LIST_ENTRY g_PoolThreadCaches;
+CRITICAL_SECTION g_PoolThreadCachesCriticalSection;
+
+C_ASSERT(DOKAN_EVENT_RESULT_CLASS_COUNT == DOKAN_STATISTICS_RESULT_POOL_COUNT);
+
+// Bytes held by all the depots and their high watermark, shared with the
+// batch lists of the instances.
+DOKAN_MAGAZINE_BUDGET g_PoolBudget;
+
+// Timer releasing the objects of idle depots.
+PTP_TIMER g_PoolTrimTimer = NULL;
+ULONG g_PoolTrimIntervalMs = 0;
+CRITICAL_SECTION g_PoolConfigCriticalSection;
+
+// Global vector of less frequently used objects
 PDOKAN_VECTOR g_FileInfoPool = NULL;
 CRITICAL_SECTION g_FileInfoCriticalSection;
 
@@ -69,25 +109,188 @@ VOID FreeIoEventBuffer(PDOKAN_IO_EVENT IoEvent) {
   }
 }
 
+/////////////////// Per-thread object caches ///////////////////
+// FLS callback invoked when a thread exits or the FLS index is freed.
+static VOID NTAPI FlushPoolThreadCache(PVOID Data) {
+  PDOKAN_THREAD_CACHE threadCache = (PDOKAN_THREAD_CACHE)Data;
+  if (!threadCache) {
+    return;
+  }
+  EnterCriticalSection(&g_PoolThreadCachesCriticalSection);
+  RemoveEntryList(&threadCache->ListEntry);
+  LeaveCriticalSection(&g_PoolThreadCachesCriticalSection);
+  DokanThreadCache_Free(threadCache, g_ObjectCaches);
+}
+
+static PDOKAN_THREAD_CACHE GetPoolThreadCache() {
+  if (g_PoolFlsIndex == FLS_OUT_OF_INDEXES) {
+    return NULL;
+  }
+  PDOKAN_THREAD_CACHE threadCache =
+      (PDOKAN_THREAD_CACHE)FlsGetValue(g_PoolFlsIndex);
+  if (!threadCache) {
+    threadCache = DokanThreadCache_Alloc(DOKAN_OBJECT_CACHE_COUNT);
+    if (!threadCache) {
+      return NULL;
+    }
+    EnterCriticalSection(&g_PoolThreadCachesCriticalSection);
+    InsertTailList(&g_PoolThreadCaches, &threadCache->ListEntry);
+    LeaveCriticalSection(&g_PoolThreadCachesCriticalSection);
+    if (!FlsSetValue(g_PoolFlsIndex, threadCache)) {
+      FlushPoolThreadCache(threadCache);
+      return NULL;
+    }
+  }
+  return threadCache;
+}
+
+// Pops an object from the calling thread magazines. The heap is only reached
+// once they and the depot are empty.
+static PVOID PopCachedObject(DOKAN_OBJECT_CACHE_ID Id) {
+  return DokanObjectCache_Pop(&g_ObjectCaches[Id], GetPoolThreadCache(), Id);
+}
+
+// Pushes an object into the calling thread magazines, or frees it if they
+// and the depot are at capacity.
+static VOID PushCachedObject(DOKAN_OBJECT_CACHE_ID Id, PVOID Object) {
+  DokanObjectCache_Push(&g_ObjectCaches[Id], GetPoolThreadCache(), Id,
+                        Object);
+}
+
+static VOID CALLBACK PoolTrimTimerCallback(PTP_CALLBACK_INSTANCE Instance,
+                                           PVOID Context, PTP_TIMER Timer) {
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Context);
+  UNREFERENCED_PARAMETER(Timer);
+  EnterCriticalSection(&g_PoolThreadCachesCriticalSection);
+  DokanThreadCache_ReclaimIdle(&g_PoolThreadCaches, g_ObjectCaches);
+  LeaveCriticalSection(&g_PoolThreadCachesCriticalSection);
+  LONG freedObjects = 0;
+  for (int i = 0; i < DOKAN_OBJECT_CACHE_COUNT; ++i) {
+    freedObjects += DokanObjectCache_TrimIdle(&g_ObjectCaches[i]);
+  }
+  if (freedObjects) {
+    DbgPrint("Dokan Information: Pool trim released %ld idle objects.\n",
+             freedObjects);
+    // Give the released memory back to the OS.
+    _heapmin();
+  }
+}
+
+VOID ConfigurePool(ULONG64 MemoryBudget, ULONG IdleTrimIntervalMs) {
+  EnterCriticalSection(&g_PoolConfigCriticalSection);
+  {
+    g_PoolBudget.MemoryBudget = (LONG64)MemoryBudget;
+    if (IdleTrimIntervalMs != g_PoolTrimIntervalMs) {
+      if (IdleTrimIntervalMs && !g_PoolTrimTimer) {
+        g_PoolTrimTimer =
+            CreateThreadpoolTimer(PoolTrimTimerCallback, NULL, NULL);
+      }
+      if (!IdleTrimIntervalMs) {
+        if (g_PoolTrimTimer) {
+          SetThreadpoolTimer(g_PoolTrimTimer, NULL, 0, 0);
+        }
+        g_PoolTrimIntervalMs = 0;
+      } else if (g_PoolTrimTimer) {
+        // Negative due time is relative, in 100 nanoseconds units.
+        ULARGE_INTEGER dueTime;
+        dueTime.QuadPart = (ULONGLONG)(-(LONGLONG)IdleTrimIntervalMs * 10000);
+        FILETIME fileDueTime;
+        fileDueTime.dwHighDateTime = dueTime.HighPart;
+        fileDueTime.dwLowDateTime = dueTime.LowPart;
+        SetThreadpoolTimer(g_PoolTrimTimer, &fileDueTime, IdleTrimIntervalMs,
+                           IdleTrimIntervalMs / 10);
+        g_PoolTrimIntervalMs = IdleTrimIntervalMs;
+      } else {
+        DokanDbgPrint("Dokan Error: Failed to create pool trim timer.\n");
+      }
+    }
+  }
+  LeaveCriticalSection(&g_PoolConfigCriticalSection);
+}
+
+VOID ConfigureThreadPool(ULONG MinThreads, ULONG MaxThreads) {
+  if (!g_ThreadPool) {
+    return;
+  }
+  EnterCriticalSection(&g_PoolConfigCriticalSection);
+  {
+    if (MaxThreads) {
+      SetThreadpoolThreadMaximum(g_ThreadPool, MaxThreads);
+    }
+    if (MinThreads) {
+      if (MaxThreads && MinThreads > MaxThreads) {
+        MinThreads = MaxThreads;
+      }
+      if (!SetThreadpoolThreadMinimum(g_ThreadPool, MinThreads)) {
+        DokanDbgPrint("Dokan Error: SetThreadpoolThreadMinimum failed with "
+                      "error %d.\n",
+                      GetLastError());
+      }
+    }
+  }
+  LeaveCriticalSection(&g_PoolConfigCriticalSection);
+}
+
+static BOOL IsSharedIoBatchPool(PDOKAN_IO_BATCH_POOL IoBatchPool) {
+  return IoBatchPool->BufferLength == BATCH_EVENT_CONTEXT_SIZE;
+}
+
+// Parks a free batch in the list of its instance. Fails when the list is full
+// or when the depots would exceed the pool memory budget.
+static BOOL PushInstanceIoBatch(PDOKAN_IO_BATCH_POOL IoBatchPool,
+                                PDOKAN_IO_BATCH IoBatch) {
+  if (InterlockedIncrement(&IoBatchPool->FreeCount) >
+      IoBatchPool->MaxFreeCount) {
+    InterlockedDecrement(&IoBatchPool->FreeCount);
+    return FALSE;
+  }
+  LONG64 batchBytes = DOKAN_IO_BATCH_SIZE(IoBatchPool->BufferLength);
+  LONG64 depotBytes = InterlockedAdd64(&g_PoolBudget.DepotBytes, batchBytes);
+  if (g_PoolBudget.MemoryBudget && depotBytes > g_PoolBudget.MemoryBudget) {
+    InterlockedAdd64(&g_PoolBudget.DepotBytes, -batchBytes);
+    InterlockedDecrement(&IoBatchPool->FreeCount);
+    return FALSE;
+  }
+  InterlockedPushEntrySList(&IoBatchPool->FreeBatches, (PSLIST_ENTRY)IoBatch);
+  return TRUE;
+}
+
+VOID PrewarmPool(PDOKAN_INSTANCE DokanInstance, ULONG EventCount,
+                 ULONG BatchCount) {
+  PDOKAN_IO_BATCH_POOL ioBatchPool = &DokanInstance->IoBatchPool;
+  if (IsSharedIoBatchPool(ioBatchPool)) {
+    DokanObjectCache_Prewarm(&g_ObjectCaches[DOKAN_OBJECT_CACHE_IO_BATCH],
+                             BatchCount);
+  } else {
+    for (ULONG i = 0; i < BatchCount; ++i) {
+      PDOKAN_IO_BATCH ioBatch = (PDOKAN_IO_BATCH)malloc(
+          DOKAN_IO_BATCH_SIZE(ioBatchPool->BufferLength));
+      if (!ioBatch) {
+        break;
+      }
+      if (!PushInstanceIoBatch(ioBatchPool, ioBatch)) {
+        free(ioBatch);
+        break;
+      }
+    }
+  }
+  DokanObjectCache_Prewarm(&g_ObjectCaches[DOKAN_OBJECT_CACHE_IO_EVENT],
+                           EventCount);
+  DokanObjectCache_Prewarm(&g_ObjectCaches[DOKAN_OBJECT_CACHE_EVENT_RESULT],
+                           EventCount);
+}
+
 int InitializePool() {
-  (void)InitializeCriticalSectionAndSpinCount(&g_IoBatchBufferCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_IoEventBufferCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_EventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_16KEventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_32KEventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_64KEventResultCriticalSection,
-                                              0x80000400);
-  (void)InitializeCriticalSectionAndSpinCount(&g_128KEventResultCriticalSection,
+  (void)InitializeCriticalSectionAndSpinCount(&g_PoolConfigCriticalSection,
                                               0x80000400);
   (void)InitializeCriticalSectionAndSpinCount(&g_FileInfoCriticalSection,
                                               0x80000400);
   (void)InitializeCriticalSectionAndSpinCount(&g_DirectoryListCriticalSection,
                                               0x80000400);
+  (void)InitializeCriticalSectionAndSpinCount(
+      &g_PoolThreadCachesCriticalSection, 0x80000400);
+  InitializeListHead(&g_PoolThreadCaches);
 
   if (g_ThreadPool) {
     DokanDbgPrint("Dokan Error: Thread pool has already been created.\n");
@@ -102,20 +305,27 @@ int InitializePool() {
     return DOKAN_DRIVER_INSTALL_ERROR;
   }
 
-  g_IoBatchBufferPool =
-      DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_BATCH_POOL_SIZE);
-  g_IoEventBufferPool =
-      DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_EVENT_POOL_SIZE);
-  g_EventResultPool =
-      DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_EVENT_POOL_SIZE);
-  g_16KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
-  g_32KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
-  g_64KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
-  g_128KEventResultPool = DokanVector_AllocWithCapacity(
-      sizeof(PVOID), DOKAN_IO_EXTRA_EVENT_POOL_SIZE);
+  g_PoolFlsIndex = FlsAlloc(FlushPoolThreadCache);
+  if (g_PoolFlsIndex == FLS_OUT_OF_INDEXES) {
+    DokanDbgPrint("Dokan Warning: Failed to allocate pool FLS index, "
+                  "per-thread object caches are disabled.\n");
+  }
+  DokanObjectCache_Initialize(&g_ObjectCaches[DOKAN_OBJECT_CACHE_IO_BATCH],
+                              DOKAN_IO_BATCH_SIZE(BATCH_EVENT_CONTEXT_SIZE),
+                              DOKAN_IO_BATCH_MAGAZINE_SIZE,
+                              DOKAN_IO_BATCH_POOL_SIZE, &g_PoolBudget);
+  DokanObjectCache_Initialize(&g_ObjectCaches[DOKAN_OBJECT_CACHE_IO_EVENT],
+                              sizeof(DOKAN_IO_EVENT),
+                              DOKAN_IO_EVENT_MAGAZINE_SIZE,
+                              DOKAN_IO_EVENT_POOL_SIZE, &g_PoolBudget);
+  for (ULONG i = 0; i < DOKAN_EVENT_RESULT_CLASS_COUNT; ++i) {
+    DokanObjectCache_Initialize(
+        &g_ObjectCaches[DOKAN_OBJECT_CACHE_EVENT_RESULT + i],
+        FIELD_OFFSET(EVENT_INFORMATION, Buffer) +
+            g_EventResultClasses[i].BufferSize,
+        g_EventResultClasses[i].MagazineSize, g_EventResultClasses[i].PoolSize,
+        &g_PoolBudget);
+  }
   g_FileInfoPool =
       DokanVector_AllocWithCapacity(sizeof(PVOID), DOKAN_IO_EVENT_POOL_SIZE);
   g_DirectoryListPool = DokanVector_AllocWithCapacity(
@@ -128,105 +338,35 @@ VOID CleanupPool() {
     CloseThreadpool(g_ThreadPool);
     g_ThreadPool = NULL;
   }
-  //////////////////// IO batch buffer object pool ////////////////////
-  {
-    EnterCriticalSection(&g_IoBatchBufferCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_IoBatchBufferPool); ++i) {
-        FreeIoBatchBuffer(
-            *(PDOKAN_IO_BATCH *)DokanVector_GetItem(g_IoBatchBufferPool, i));
-      }
-      DokanVector_Free(g_IoBatchBufferPool);
-      g_IoBatchBufferPool = NULL;
-    }
-    LeaveCriticalSection(&g_IoBatchBufferCriticalSection);
-    DeleteCriticalSection(&g_IoBatchBufferCriticalSection);
+  if (g_PoolTrimTimer) {
+    SetThreadpoolTimer(g_PoolTrimTimer, NULL, 0, 0);
+    WaitForThreadpoolTimerCallbacks(g_PoolTrimTimer, TRUE);
+    CloseThreadpoolTimer(g_PoolTrimTimer);
+    g_PoolTrimTimer = NULL;
   }
-
-  //////////////////// IO event buffer object pool ////////////////////
+  g_PoolTrimIntervalMs = 0;
+  g_PoolBudget.MemoryBudget = 0;
+  DeleteCriticalSection(&g_PoolConfigCriticalSection);
+  //////////////////// Per-thread object caches ////////////////////
   {
-    EnterCriticalSection(&g_IoEventBufferCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_IoEventBufferPool); ++i) {
-        FreeIoEventBuffer(
-            *(PDOKAN_IO_EVENT *)DokanVector_GetItem(g_IoEventBufferPool, i));
-      }
-      DokanVector_Free(g_IoEventBufferPool);
-      g_IoEventBufferPool = NULL;
+    // Hands back the magazines of every thread still holding some.
+    if (g_PoolFlsIndex != FLS_OUT_OF_INDEXES) {
+      FlsFree(g_PoolFlsIndex);
+      g_PoolFlsIndex = FLS_OUT_OF_INDEXES;
     }
-    LeaveCriticalSection(&g_IoEventBufferCriticalSection);
-    DeleteCriticalSection(&g_IoEventBufferCriticalSection);
-  }
-
-  //////////////////// Event result object pool ////////////////////
-  {
-    EnterCriticalSection(&g_EventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_EventResultPool); ++i) {
-        FreeEventResult(
-            *(PEVENT_INFORMATION *)DokanVector_GetItem(g_EventResultPool, i));
-      }
-      DokanVector_Free(g_EventResultPool);
-      g_EventResultPool = NULL;
-    }
-    LeaveCriticalSection(&g_EventResultCriticalSection);
-    DeleteCriticalSection(&g_EventResultCriticalSection);
-  }
-
-  {
-    EnterCriticalSection(&g_16KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_16KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_16KEventResultPool, i));
-      }
-      DokanVector_Free(g_16KEventResultPool);
-      g_16KEventResultPool = NULL;
+    for (ULONG i = 0; i < DOKAN_EVENT_RESULT_CLASS_COUNT; ++i) {
+      DOKAN_EVENT_RESULT_CLASS_OCCUPANCY occupancy;
+      GetEventResultClassOccupancy(i, &occupancy);
+      DbgPrint("Dokan Information: Event result class %lu bytes: %lu heap "
+               "allocations, %ld resident and %ld cached objects.\n",
+               occupancy.BufferSize, (ULONG)occupancy.HeapAllocations,
+               occupancy.ResidentObjects, occupancy.DepotObjects);
     }
-    LeaveCriticalSection(&g_16KEventResultCriticalSection);
-    DeleteCriticalSection(&g_16KEventResultCriticalSection);
-  }
-
-  {
-    EnterCriticalSection(&g_32KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_32KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_32KEventResultPool, i));
-      }
-      DokanVector_Free(g_32KEventResultPool);
-      g_32KEventResultPool = NULL;
-    }
-    LeaveCriticalSection(&g_32KEventResultCriticalSection);
-    DeleteCriticalSection(&g_32KEventResultCriticalSection);
-  }
-
-  {
-    EnterCriticalSection(&g_64KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_64KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_64KEventResultPool, i));
-      }
-      DokanVector_Free(g_64KEventResultPool);
-      g_64KEventResultPool = NULL;
-    }
-    LeaveCriticalSection(&g_64KEventResultCriticalSection);
-    DeleteCriticalSection(&g_64KEventResultCriticalSection);
-  }
-
-  {
-    EnterCriticalSection(&g_128KEventResultCriticalSection);
-    {
-      for (size_t i = 0; i < DokanVector_GetCount(g_128KEventResultPool); ++i) {
-        FreeEventResult(*(PEVENT_INFORMATION *)DokanVector_GetItem(
-            g_128KEventResultPool, i));
-      }
-      DokanVector_Free(g_128KEventResultPool);
-      g_128KEventResultPool = NULL;
+    for (int i = 0; i < DOKAN_OBJECT_CACHE_COUNT; ++i) {
+      DokanObjectCache_Cleanup(&g_ObjectCaches[i]);
     }
-    LeaveCriticalSection(&g_128KEventResultCriticalSection);
-    DeleteCriticalSection(&g_128KEventResultCriticalSection);
+    g_PoolBudget.DepotBytes = 0;
+    DeleteCriticalSection(&g_PoolThreadCachesCriticalSection);
   }
 
   //////////////////// File info object pool ////////////////////
@@ -249,8 +389,8 @@ VOID CleanupPool() {
     EnterCriticalSection(&g_DirectoryListCriticalSection);
     {
       for (size_t i = 0; i < DokanVector_GetCount(g_DirectoryListPool); ++i) {
-        DokanVector_Free(
-            *(PDOKAN_VECTOR *)DokanVector_GetItem(g_DirectoryListPool, i));
+        DokanDirectoryList_Free(*(PDOKAN_DIRECTORY_LIST *)DokanVector_GetItem(
+            g_DirectoryListPool, i));
       }
       DokanVector_Free(g_DirectoryListPool);
       g_DirectoryListPool = NULL;
@@ -262,23 +402,81 @@ VOID CleanupPool() {
   //////////////////// Object pool cleanup finished ////////////////////
 }
 
+static VOID GetObjectCacheStatistics(DOKAN_OBJECT_CACHE_ID Id,
+                                     PDOKAN_POOL_STATISTICS Statistics) {
+  PDOKAN_OBJECT_CACHE cache = &g_ObjectCaches[Id];
+  Statistics->ObjectSize = cache->ObjectSize;
+  Statistics->Requests = cache->Requests;
+  EnterCriticalSection(&g_PoolThreadCachesCriticalSection);
+  for (PLIST_ENTRY entry = g_PoolThreadCaches.Flink;
+       entry != &g_PoolThreadCaches; entry = entry->Flink) {
+    PDOKAN_THREAD_CACHE threadCache =
+        CONTAINING_RECORD(entry, DOKAN_THREAD_CACHE, ListEntry);
+    Statistics->Requests += ReadNoFence64(&threadCache->Magazines[Id].Requests);
+  }
+  LeaveCriticalSection(&g_PoolThreadCachesCriticalSection);
+  Statistics->Misses = cache->HeapAllocations;
+  Statistics->ResidentObjects = cache->ResidentObjects;
+  Statistics->CachedObjects = cache->DepotObjects;
+}
+
+VOID GetPoolStatistics(PDOKAN_RUNTIME_STATISTICS Statistics) {
+  GetObjectCacheStatistics(DOKAN_OBJECT_CACHE_IO_BATCH,
+                           &Statistics->IoBatchPool);
+  GetObjectCacheStatistics(DOKAN_OBJECT_CACHE_IO_EVENT,
+                           &Statistics->IoEventPool);
+  for (ULONG i = 0; i < DOKAN_EVENT_RESULT_CLASS_COUNT; ++i) {
+    GetObjectCacheStatistics(DOKAN_OBJECT_CACHE_EVENT_RESULT + i,
+                             &Statistics->EventResultPools[i]);
+  }
+}
+
 /////////////////// DOKAN_IO_BATCH ///////////////////
-PDOKAN_IO_BATCH PopIoBatchBuffer() {
-  PDOKAN_IO_BATCH ioBatch = NULL;
-  EnterCriticalSection(&g_IoBatchBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoBatchBufferPool) > 0) {
-      ioBatch =
-          *(PDOKAN_IO_BATCH *)DokanVector_GetLastItem(g_IoBatchBufferPool);
-      DokanVector_PopBack(g_IoBatchBufferPool);
-    }
+VOID InitializeIoBatchPool(PDOKAN_IO_BATCH_POOL IoBatchPool,
+                           ULONG BufferLength) {
+  InitializeSListHead(&IoBatchPool->FreeBatches);
+  IoBatchPool->FreeCount = 0;
+  IoBatchPool->BufferLength = BufferLength;
+  // Keep at most the memory the shared cache would, enough for the pullers.
+  LONG64 maxFreeCount = (LONG64)DOKAN_IO_BATCH_POOL_SIZE *
+                        BATCH_EVENT_CONTEXT_SIZE / BufferLength;
+  IoBatchPool->MaxFreeCount =
+      (LONG)min(max(maxFreeCount, DOKAN_MAIN_PULL_THREAD_COUNT_MAX),
+                DOKAN_IO_BATCH_POOL_SIZE);
+}
+
+VOID CleanupIoBatchPool(PDOKAN_IO_BATCH_POOL IoBatchPool) {
+  PSLIST_ENTRY entry = InterlockedFlushSList(&IoBatchPool->FreeBatches);
+  while (entry) {
+    PSLIST_ENTRY next = entry->Next;
+    InterlockedAdd64(&g_PoolBudget.DepotBytes,
+                     -(LONG64)DOKAN_IO_BATCH_SIZE(IoBatchPool->BufferLength));
+    free(entry);
+    entry = next;
   }
-  LeaveCriticalSection(&g_IoBatchBufferCriticalSection);
-  if (!ioBatch) {
-    ioBatch = (PDOKAN_IO_BATCH)malloc(DOKAN_IO_BATCH_SIZE);
+  IoBatchPool->FreeCount = 0;
+}
+
+PDOKAN_IO_BATCH PopIoBatchBuffer(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_IO_BATCH_POOL ioBatchPool = &DokanInstance->IoBatchPool;
+  PDOKAN_IO_BATCH ioBatch;
+  if (IsSharedIoBatchPool(ioBatchPool)) {
+    ioBatch = (PDOKAN_IO_BATCH)PopCachedObject(DOKAN_OBJECT_CACHE_IO_BATCH);
+  } else {
+    ioBatch =
+        (PDOKAN_IO_BATCH)InterlockedPopEntrySList(&ioBatchPool->FreeBatches);
+    if (ioBatch) {
+      InterlockedDecrement(&ioBatchPool->FreeCount);
+      InterlockedAdd64(&g_PoolBudget.DepotBytes,
+                       -(LONG64)DOKAN_IO_BATCH_SIZE(ioBatchPool->BufferLength));
+    } else {
+      ioBatch = (PDOKAN_IO_BATCH)malloc(
+          DOKAN_IO_BATCH_SIZE(ioBatchPool->BufferLength));
+    }
   }
   if (ioBatch) {
     RtlZeroMemory(ioBatch, FIELD_OFFSET(DOKAN_IO_BATCH, EventContext));
+    ioBatch->DokanInstance = DokanInstance;
     ioBatch->PoolAllocated = TRUE;
   }
   return ioBatch;
@@ -301,34 +499,18 @@ VOID PushIoBatchBuffer(PDOKAN_IO_BATCH IoBatch) {
     FreeIoBatchBuffer(IoBatch);
     return;
   }
-  EnterCriticalSection(&g_IoBatchBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoBatchBufferPool) < DOKAN_IO_BATCH_POOL_SIZE) {
-      DokanVector_PushBack(g_IoBatchBufferPool, &IoBatch);
-      IoBatch = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_IoBatchBufferCriticalSection);
-  if (IoBatch) {
+  PDOKAN_IO_BATCH_POOL ioBatchPool = &IoBatch->DokanInstance->IoBatchPool;
+  if (IsSharedIoBatchPool(ioBatchPool)) {
+    PushCachedObject(DOKAN_OBJECT_CACHE_IO_BATCH, IoBatch);
+  } else if (!PushInstanceIoBatch(ioBatchPool, IoBatch)) {
     FreeIoBatchBuffer(IoBatch);
   }
 }
 
 /////////////////// DOKAN_IO_EVENT ///////////////////
 PDOKAN_IO_EVENT PopIoEventBuffer() {
-  PDOKAN_IO_EVENT ioEvent = NULL;
-  EnterCriticalSection(&g_IoEventBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoEventBufferPool) > 0) {
-      ioEvent =
-          *(PDOKAN_IO_EVENT *)DokanVector_GetLastItem(g_IoEventBufferPool);
-      DokanVector_PopBack(g_IoEventBufferPool);
-    }
-  }
-  LeaveCriticalSection(&g_IoEventBufferCriticalSection);
-  if (!ioEvent) {
-    ioEvent = (PDOKAN_IO_EVENT)malloc(sizeof(DOKAN_IO_EVENT));
-  }
+  PDOKAN_IO_EVENT ioEvent =
+      (PDOKAN_IO_EVENT)PopCachedObject(DOKAN_OBJECT_CACHE_IO_EVENT);
   if (ioEvent) {
     RtlZeroMemory(ioEvent, sizeof(DOKAN_IO_EVENT));
   }
@@ -337,38 +519,26 @@ PDOKAN_IO_EVENT PopIoEventBuffer() {
 
 VOID PushIoEventBuffer(PDOKAN_IO_EVENT IoEvent) {
   assert(IoEvent);
-  EnterCriticalSection(&g_IoEventBufferCriticalSection);
-  {
-    if (DokanVector_GetCount(g_IoEventBufferPool) < DOKAN_IO_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_IoEventBufferPool, &IoEvent);
-      IoEvent = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_IoEventBufferCriticalSection);
-  if (IoEvent) {
-    FreeIoEventBuffer(IoEvent);
-  }
+  PushCachedObject(DOKAN_OBJECT_CACHE_IO_EVENT, IoEvent);
 }
 
 /////////////////// EVENT_INFORMATION ///////////////////
-PEVENT_INFORMATION PopEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_EventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_EventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_EventResultPool);
-      DokanVector_PopBack(g_EventResultPool);
+PEVENT_INFORMATION PopEventResult(ULONG BufferSize, PULONG EventResultSize) {
+  assert(EventResultSize);
+  for (ULONG i = 0; i < DOKAN_EVENT_RESULT_CLASS_COUNT; ++i) {
+    if (BufferSize > g_EventResultClasses[i].BufferSize) {
+      continue;
     }
+    PEVENT_INFORMATION eventResult = (PEVENT_INFORMATION)PopCachedObject(
+        DOKAN_OBJECT_CACHE_EVENT_RESULT + i);
+    if (eventResult) {
+      RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
+      *EventResultSize = (ULONG)FIELD_OFFSET(EVENT_INFORMATION, Buffer) +
+                         g_EventResultClasses[i].BufferSize;
+    }
+    return eventResult;
   }
-  LeaveCriticalSection(&g_EventResultCriticalSection);
-  if (!eventResult) {
-    eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_DEFAULT_SIZE);
-  }
-  if (eventResult) {
-    RtlZeroMemory(eventResult, DOKAN_EVENT_INFO_DEFAULT_SIZE);
-  }
-  return eventResult;
+  return NULL;
 }
 
 VOID FreeEventResult(PEVENT_INFORMATION EventResult) {
@@ -377,167 +547,37 @@ VOID FreeEventResult(PEVENT_INFORMATION EventResult) {
   }
 }
 
-VOID PushEventResult(PEVENT_INFORMATION EventResult) {
-  assert(EventResult);
-  EnterCriticalSection(&g_EventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_EventResultPool) < DOKAN_IO_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_EventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_EventResultCriticalSection);
-  if (EventResult) {
-    FreeEventResult(EventResult);
-  }
-}
-
-/////////////////// EVENT_INFORMATION 16K ///////////////////
-PEVENT_INFORMATION Pop16KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_16KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_16KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_16KEventResultPool);
-      DokanVector_PopBack(g_16KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_16KEventResultCriticalSection);
-  if (!eventResult) {
-    eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_16K_SIZE);
-  }
-  if (eventResult) {
-    RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
-  }
-  return eventResult;
-}
-
-VOID Push16KEventResult(PEVENT_INFORMATION EventResult) {
-  assert(EventResult);
-  EnterCriticalSection(&g_16KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_16KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_16KEventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_16KEventResultCriticalSection);
-  if (EventResult) {
-    FreeEventResult(EventResult);
-  }
-}
-
-/////////////////// EVENT_INFORMATION 32K ///////////////////
-PEVENT_INFORMATION Pop32KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_32KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_32KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_32KEventResultPool);
-      DokanVector_PopBack(g_32KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_32KEventResultCriticalSection);
-  if (!eventResult) {
-    eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_32K_SIZE);
-  }
-  if (eventResult) {
-    RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
-  }
-  return eventResult;
-}
-
-VOID Push32KEventResult(PEVENT_INFORMATION EventResult) {
+VOID PushEventResult(PEVENT_INFORMATION EventResult, ULONG EventResultSize) {
   assert(EventResult);
-  EnterCriticalSection(&g_32KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_32KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_32KEventResultPool, &EventResult);
-      EventResult = NULL;
+  ULONG bufferSize =
+      EventResultSize - (ULONG)FIELD_OFFSET(EVENT_INFORMATION, Buffer);
+  for (ULONG i = 0; i < DOKAN_EVENT_RESULT_CLASS_COUNT; ++i) {
+    if (bufferSize == g_EventResultClasses[i].BufferSize) {
+      PushCachedObject(DOKAN_OBJECT_CACHE_EVENT_RESULT + i, EventResult);
+      return;
     }
   }
-  LeaveCriticalSection(&g_32KEventResultCriticalSection);
-  if (EventResult) {
-    FreeEventResult(EventResult);
-  }
+  // PoolAllocated should only be set on results from a size class. Free the
+  // result rather than caching it under the wrong size.
+  DbgPrint("Dokan Warning: PushEventResult called with %lu bytes that match "
+           "no event result class, freeing it.\n",
+           EventResultSize);
+  FreeEventResult(EventResult);
 }
 
-/////////////////// EVENT_INFORMATION 64K ///////////////////
-PEVENT_INFORMATION Pop64KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_64KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_64KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_64KEventResultPool);
-      DokanVector_PopBack(g_64KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_64KEventResultCriticalSection);
-  if (!eventResult) {
-    eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_64K_SIZE);
-  }
-  if (eventResult) {
-    RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
-  }
-  return eventResult;
-}
-
-VOID Push64KEventResult(PEVENT_INFORMATION EventResult) {
-  assert(EventResult);
-  EnterCriticalSection(&g_64KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_64KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_64KEventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_64KEventResultCriticalSection);
-  if (EventResult) {
-    FreeEventResult(EventResult);
-  }
-}
-
-/////////////////// EVENT_INFORMATION 128K ///////////////////
-PEVENT_INFORMATION Pop128KEventResult() {
-  PEVENT_INFORMATION eventResult = NULL;
-  EnterCriticalSection(&g_128KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_128KEventResultPool) > 0) {
-      eventResult =
-          *(PEVENT_INFORMATION *)DokanVector_GetLastItem(g_128KEventResultPool);
-      DokanVector_PopBack(g_128KEventResultPool);
-    }
-  }
-  LeaveCriticalSection(&g_128KEventResultCriticalSection);
-  if (!eventResult) {
-    eventResult = (PEVENT_INFORMATION)malloc(DOKAN_EVENT_INFO_128K_SIZE);
-  }
-  if (eventResult) {
-    RtlZeroMemory(eventResult, FIELD_OFFSET(EVENT_INFORMATION, Buffer));
-  }
-  return eventResult;
-}
-
-VOID Push128KEventResult(PEVENT_INFORMATION EventResult) {
-  assert(EventResult);
-  EnterCriticalSection(&g_128KEventResultCriticalSection);
-  {
-    if (DokanVector_GetCount(g_128KEventResultPool) <
-        DOKAN_IO_EXTRA_EVENT_POOL_SIZE) {
-      DokanVector_PushBack(g_128KEventResultPool, &EventResult);
-      EventResult = NULL;
-    }
-  }
-  LeaveCriticalSection(&g_128KEventResultCriticalSection);
-  if (EventResult) {
-    FreeEventResult(EventResult);
-  }
+BOOL GetEventResultClassOccupancy(
+    ULONG ClassIndex, PDOKAN_EVENT_RESULT_CLASS_OCCUPANCY Occupancy) {
+  if (ClassIndex >= DOKAN_EVENT_RESULT_CLASS_COUNT || !Occupancy) {
+    return FALSE;
+  }
+  PDOKAN_OBJECT_CACHE cache =
+      &g_ObjectCaches[DOKAN_OBJECT_CACHE_EVENT_RESULT + ClassIndex];
+  Occupancy->BufferSize = g_EventResultClasses[ClassIndex].BufferSize;
+  Occupancy->PoolSize = g_EventResultClasses[ClassIndex].PoolSize;
+  Occupancy->ResidentObjects = cache->ResidentObjects;
+  Occupancy->DepotObjects = cache->DepotObjects;
+  Occupancy->HeapAllocations = cache->HeapAllocations;
+  return TRUE;
 }
 
 /////////////////// DOKAN_OPEN_INFO ///////////////////
@@ -564,7 +604,12 @@ PDOKAN_OPEN_INFO PopFileOpenInfo() {
     fileInfo->DokanInstance = NULL;
     fileInfo->DirList = NULL;
     fileInfo->DirListSearchPattern= NULL;
+    fileInfo->DirListCursor.Index = 0;
+    fileInfo->DirListCursor.Position = 0;
     fileInfo->UnimplementedFindFilesWithPattern = FALSE;
+    fileInfo->UnimplementedFindFilesStream = FALSE;
+    fileInfo->StreamIndex = 0;
+    fileInfo->StreamCookie = 0;
     fileInfo->UserContext = 0;
     fileInfo->EventId = 0;
     fileInfo->IsDirectory = FALSE;
@@ -572,13 +617,18 @@ PDOKAN_OPEN_INFO PopFileOpenInfo() {
     fileInfo->CloseFileName = NULL;
     fileInfo->CloseUserContext = 0;
     fileInfo->EventContext = NULL;
+    fileInfo->LaneBusy = FALSE;
+    fileInfo->LaneHead = NULL;
+    fileInfo->LaneTail = NULL;
+    fileInfo->ReadAhead = NULL;
+    fileInfo->WriteBehind = NULL;
   }
   return fileInfo;
 }
 
 VOID CleanupFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
   assert(FileInfo);
-  PDOKAN_VECTOR dirList = NULL;
+  PDOKAN_DIRECTORY_LIST dirList = NULL;
   EnterCriticalSection(&FileInfo->CriticalSection);
   {
     if (FileInfo->DirListSearchPattern) {
@@ -595,6 +645,8 @@ VOID CleanupFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
   if (dirList) {
     PushDirectoryList(dirList);
   }
+  DokanWriteBehind_Free(FileInfo);
+  DokanReadAhead_Free(FileInfo);
 }
 
 VOID FreeFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
@@ -622,40 +674,42 @@ VOID PushFileOpenInfo(PDOKAN_OPEN_INFO FileInfo) {
 }
 
 /////////////////// Directory list ///////////////////
-PDOKAN_VECTOR PopDirectoryList() {
-  PDOKAN_VECTOR directoryList = NULL;
+PDOKAN_DIRECTORY_LIST PopDirectoryList() {
+  PDOKAN_DIRECTORY_LIST directoryList = NULL;
   EnterCriticalSection(&g_DirectoryListCriticalSection);
   {
     if (DokanVector_GetCount(g_DirectoryListPool) > 0) {
-      directoryList =
-          *(PDOKAN_VECTOR *)DokanVector_GetLastItem(g_DirectoryListPool);
+      directoryList = *(PDOKAN_DIRECTORY_LIST *)DokanVector_GetLastItem(
+          g_DirectoryListPool);
       DokanVector_PopBack(g_DirectoryListPool);
     }
   }
   LeaveCriticalSection(&g_DirectoryListCriticalSection);
   if (!directoryList) {
-    directoryList = DokanVector_Alloc(sizeof(WIN32_FIND_DATAW));
+    directoryList = DokanDirectoryList_Alloc();
   }
   if (directoryList) {
-    DokanVector_Clear(directoryList);
+    DokanDirectoryList_Clear(directoryList);
   }
   return directoryList;
 }
 
-VOID PushDirectoryList(PDOKAN_VECTOR DirectoryList) {
+VOID PushDirectoryList(PDOKAN_DIRECTORY_LIST DirectoryList) {
   assert(DirectoryList);
-  assert(DokanVector_GetItemSize(DirectoryList) == sizeof(WIN32_FIND_DATAW));
+  // The memory of huge listings is given back rather than kept idle.
+  BOOL keep = DokanDirectoryList_GetAllocatedSize(DirectoryList) <=
+              DOKAN_DIRECTORY_LIST_POOL_MAX_KEPT_SIZE;
   EnterCriticalSection(&g_DirectoryListCriticalSection);
   {
-    if (DokanVector_GetCount(g_DirectoryListPool) <
-        DOKAN_DIRECTORY_LIST_POOL_SIZE) {
+    if (keep && DokanVector_GetCount(g_DirectoryListPool) <
+                    DOKAN_DIRECTORY_LIST_POOL_SIZE) {
       DokanVector_PushBack(g_DirectoryListPool, &DirectoryList);
       DirectoryList = NULL;
     }
   }
   LeaveCriticalSection(&g_DirectoryListCriticalSection);
   if (DirectoryList) {
-    DokanVector_Free(DirectoryList);
+    DokanDirectoryList_Free(DirectoryList);
   }
 }
 
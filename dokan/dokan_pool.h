@@ -28,50 +28,74 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define DOKAN_MAIN_PULL_THREAD_COUNT_MAX 16
 #define DOKAN_MAIN_PULL_THREAD_COUNT_MIN 2
 #define BATCH_EVENT_CONTEXT_SIZE (EVENT_CONTEXT_MAX_SIZE * 4)
-#define DOKAN_IO_BATCH_SIZE                                                    \
-  ((SIZE_T)(FIELD_OFFSET(DOKAN_IO_BATCH, EventContext)) +                      \
-   BATCH_EVENT_CONTEXT_SIZE)
-
-#define DOKAN_EVENT_INFO_16K_SIZE                                              \
-  (FIELD_OFFSET(EVENT_INFORMATION, Buffer) + (16 * 1024))
-#define DOKAN_EVENT_INFO_32K_SIZE                                              \
-  (FIELD_OFFSET(EVENT_INFORMATION, Buffer) + (32 * 1024))
-#define DOKAN_EVENT_INFO_64K_SIZE                                              \
-  (FIELD_OFFSET(EVENT_INFORMATION, Buffer) + (64 * 1024))
-#define DOKAN_EVENT_INFO_128K_SIZE                                             \
-  (FIELD_OFFSET(EVENT_INFORMATION, Buffer) + (128 * 1024))
+#define DOKAN_IO_BATCH_SIZE(BufferLength)                                      \
+  ((SIZE_T)(FIELD_OFFSET(DOKAN_IO_BATCH, EventContext)) + (BufferLength))
+
+// Number of size classes of the EVENT_INFORMATION slab allocator.
+#define DOKAN_EVENT_RESULT_CLASS_COUNT 8
+
+// Occupancy of an EVENT_INFORMATION size class.
+typedef struct _DOKAN_EVENT_RESULT_CLASS_OCCUPANCY {
+  // Size of the EVENT_INFORMATION Buffer held by the class objects.
+  ULONG BufferSize;
+  // Maximum number of objects kept in the global depot.
+  LONG PoolSize;
+  // Objects allocated by the class and not yet given back to the heap,
+  // whether they are in use or cached.
+  LONG ResidentObjects;
+  // Objects cached in the global depot. Objects cached in per-thread
+  // magazines are only accounted in ResidentObjects.
+  LONG DepotObjects;
+  // Number of requests the caches could not serve.
+  LONG64 HeapAllocations;
+} DOKAN_EVENT_RESULT_CLASS_OCCUPANCY, *PDOKAN_EVENT_RESULT_CLASS_OCCUPANCY;
 
 PTP_POOL GetThreadPool();
 int InitializePool();
 VOID CleanupPool();
-
-PDOKAN_IO_BATCH PopIoBatchBuffer();
+// Sets the memory budget of the pool depots and the interval of their idle
+// trimming. A zero budget only bounds the depots by their pool size, a zero
+// interval stops the trimming.
+VOID ConfigurePool(ULONG64 MemoryBudget, ULONG IdleTrimIntervalMs);
+// Sets the thread count limits of the thread pool shared by the instances.
+// Zero values keep the current settings.
+VOID ConfigureThreadPool(ULONG MinThreads, ULONG MaxThreads);
+// Allocates objects ahead of time for EventCount events and BatchCount
+// batches of DokanInstance.
+VOID PrewarmPool(PDOKAN_INSTANCE DokanInstance, ULONG EventCount,
+                 ULONG BatchCount);
+// Fills the pool counters of Statistics.
+VOID GetPoolStatistics(PDOKAN_RUNTIME_STATISTICS Statistics);
+
+// Sets the length of the pull buffers of an instance.
+VOID InitializeIoBatchPool(PDOKAN_IO_BATCH_POOL IoBatchPool,
+                           ULONG BufferLength);
+VOID CleanupIoBatchPool(PDOKAN_IO_BATCH_POOL IoBatchPool);
+// Returns a batch with a pull buffer of the length negotiated by
+// DokanInstance.
+PDOKAN_IO_BATCH PopIoBatchBuffer(PDOKAN_INSTANCE DokanInstance);
 VOID PushIoBatchBuffer(PDOKAN_IO_BATCH IoBatch);
 VOID FreeIoBatchBuffer(PDOKAN_IO_BATCH IoBatch);
 
 PDOKAN_IO_EVENT PopIoEventBuffer();
 VOID PushIoEventBuffer(PDOKAN_IO_EVENT IoEvent);
 
-// Default Event size.
-PEVENT_INFORMATION PopEventResult();
-VOID PushEventResult(PEVENT_INFORMATION EventResult);
+// EVENT_INFORMATION slab allocator. Returns an object from the smallest size
+// class holding BufferSize bytes of Buffer and sets EventResultSize to the
+// object size, or NULL when BufferSize exceeds the largest class.
+PEVENT_INFORMATION PopEventResult(ULONG BufferSize, PULONG EventResultSize);
+VOID PushEventResult(PEVENT_INFORMATION EventResult, ULONG EventResultSize);
 VOID FreeEventResult(PEVENT_INFORMATION EventResult);
-
-// Event with extra memory allocated for events holding additional data. 
-PEVENT_INFORMATION Pop16KEventResult();
-VOID Push16KEventResult(PEVENT_INFORMATION EventResult);
-PEVENT_INFORMATION Pop32KEventResult();
-VOID Push32KEventResult(PEVENT_INFORMATION EventResult);
-PEVENT_INFORMATION Pop64KEventResult();
-VOID Push64KEventResult(PEVENT_INFORMATION EventResult);
-PEVENT_INFORMATION Pop128KEventResult();
-VOID Push128KEventResult(PEVENT_INFORMATION EventResult);
+BOOL GetEventResultClassOccupancy(
+    ULONG ClassIndex, PDOKAN_EVENT_RESULT_CLASS_OCCUPANCY Occupancy);
 
 PDOKAN_OPEN_INFO PopFileOpenInfo();
 VOID PushFileOpenInfo(PDOKAN_OPEN_INFO FileInfo);
 VOID FreeFileOpenInfo(PDOKAN_OPEN_INFO FileInfo);
 
-PDOKAN_VECTOR PopDirectoryList();
-VOID PushDirectoryList(PDOKAN_VECTOR DirectoryList);
+PDOKAN_DIRECTORY_LIST PopDirectoryList();
+// Keeps a list for later use unless its memory is larger than
+// DOKAN_DIRECTORY_LIST_POOL_MAX_KEPT_SIZE.
+VOID PushDirectoryList(PDOKAN_DIRECTORY_LIST DirectoryList);
 
 #endif
@@ -0,0 +1,154 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+#include "dokan_queue.h"
+
+#include <assert.h>
+#include <malloc.h>
+
+PDOKAN_QUEUE DokanQueue_Alloc(ULONG Capacity) {
+  if (Capacity < 2 || (Capacity & (Capacity - 1)) != 0) {
+    DbgPrintW(L"DOKAN_QUEUE capacity must be a power of two.\n");
+    return NULL;
+  }
+  PDOKAN_QUEUE queue = (PDOKAN_QUEUE)_aligned_malloc(
+      sizeof(DOKAN_QUEUE), SYSTEM_CACHE_ALIGNMENT_SIZE);
+  if (!queue) {
+    DbgPrintW(L"DOKAN_QUEUE allocation failed.\n");
+    return NULL;
+  }
+  queue->Cells =
+      (PDOKAN_QUEUE_CELL)malloc(sizeof(DOKAN_QUEUE_CELL) * Capacity);
+  if (!queue->Cells) {
+    DbgPrintW(L"DOKAN_QUEUE Cells allocation failed.\n");
+    _aligned_free(queue);
+    return NULL;
+  }
+  for (ULONG i = 0; i < Capacity; ++i) {
+    queue->Cells[i].Sequence = i;
+    queue->Cells[i].Item = NULL;
+    queue->Cells[i].Waiters = 0;
+  }
+  queue->Mask = Capacity - 1;
+  queue->EnqueuePosition = 0;
+  queue->DequeuePosition = 0;
+  return queue;
+}
+
+VOID DokanQueue_Free(PDOKAN_QUEUE Queue) {
+  if (Queue) {
+    free(Queue->Cells);
+    _aligned_free(Queue);
+  }
+}
+
+BOOL DokanQueue_Push(PDOKAN_QUEUE Queue, PVOID Item, PLONG WaiterCount) {
+  PDOKAN_QUEUE_CELL cell;
+  LONG64 position = Queue->EnqueuePosition;
+  for (;;) {
+    cell = &Queue->Cells[position & Queue->Mask];
+    LONG64 difference = ReadAcquire64(&cell->Sequence) - position;
+    if (difference == 0) {
+      // The cell is free for this position, try to claim it.
+      LONG64 current = InterlockedCompareExchange64(&Queue->EnqueuePosition,
+                                                    position + 1, position);
+      if (current == position) {
+        break;
+      }
+      position = current;
+    } else if (difference < 0) {
+      // The cell still holds the item of the previous lap.
+      return FALSE;
+    } else {
+      position = Queue->EnqueuePosition;
+    }
+  }
+  cell->Item = Item;
+  WriteRelease64(&cell->Sequence, position + 1);
+  // Full barrier: a waiter registered before the item was published is
+  // counted, one registered after sees the item and takes back its count.
+  LONG waiterCount = InterlockedExchange(&cell->Waiters, 0);
+  if (WaiterCount) {
+    *WaiterCount = waiterCount;
+  }
+  return TRUE;
+}
+
+PVOID DokanQueue_Pop(PDOKAN_QUEUE Queue) {
+  PDOKAN_QUEUE_CELL cell;
+  LONG64 position = Queue->DequeuePosition;
+  for (;;) {
+    cell = &Queue->Cells[position & Queue->Mask];
+    LONG64 difference = ReadAcquire64(&cell->Sequence) - (position + 1);
+    if (difference == 0) {
+      // The cell holds the item of this position, try to claim it.
+      LONG64 current = InterlockedCompareExchange64(&Queue->DequeuePosition,
+                                                    position + 1, position);
+      if (current == position) {
+        break;
+      }
+      position = current;
+    } else if (difference < 0) {
+      return NULL;
+    } else {
+      position = Queue->DequeuePosition;
+    }
+  }
+  PVOID item = cell->Item;
+  // Make the cell available to the producers of the next lap.
+  WriteRelease64(&cell->Sequence, position + Queue->Mask + 1);
+  return item;
+}
+
+// Takes back a waiter registration unless a producer already counted it.
+static BOOL CancelWait(PDOKAN_QUEUE_CELL Cell) {
+  LONG waiters = Cell->Waiters;
+  while (waiters > 0) {
+    LONG current =
+        InterlockedCompareExchange(&Cell->Waiters, waiters - 1, waiters);
+    if (current == waiters) {
+      return TRUE;
+    }
+    waiters = current;
+  }
+  return FALSE;
+}
+
+PVOID DokanQueue_PopOrWait(PDOKAN_QUEUE Queue) {
+  for (;;) {
+    PVOID item = DokanQueue_Pop(Queue);
+    if (item) {
+      return item;
+    }
+    LONG64 position = Queue->DequeuePosition;
+    PDOKAN_QUEUE_CELL cell = &Queue->Cells[position & Queue->Mask];
+    InterlockedIncrement(&cell->Waiters);
+    // Until the item of this position is published, its producer will count
+    // the registration.
+    if (ReadAcquire64(&cell->Sequence) <= position) {
+      return NULL;
+    }
+    if (!CancelWait(cell)) {
+      // A producer counted it and retries for us.
+      return NULL;
+    }
+  }
+}
@@ -0,0 +1,68 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_QUEUE_H_
+#define DOKAN_QUEUE_H_
+
+typedef struct _DOKAN_QUEUE_CELL {
+  volatile LONG64 Sequence;
+  PVOID Item;
+  // Number of DokanQueue_PopOrWait calls waiting for the item pushed next in
+  // this cell.
+  volatile LONG Waiters;
+} DOKAN_QUEUE_CELL, *PDOKAN_QUEUE_CELL;
+
+// Bounded multi-producer multi-consumer FIFO queue of pointers.
+// Push and Pop are lock-free and never allocate. Each cell carries a sequence
+// number telling whether it is ready to be written or read for a given
+// position, so producers and consumers only contend on their own position.
+typedef struct _DOKAN_QUEUE {
+  PDOKAN_QUEUE_CELL Cells;
+  LONG64 Mask;
+  DECLSPEC_CACHEALIGN volatile LONG64 EnqueuePosition;
+  DECLSPEC_CACHEALIGN volatile LONG64 DequeuePosition;
+} DOKAN_QUEUE, *PDOKAN_QUEUE;
+
+// Creates a new queue holding up to Capacity items. Capacity must be a power
+// of two.
+PDOKAN_QUEUE DokanQueue_Alloc(ULONG Capacity);
+
+// Releases the memory associated with a DOKAN_QUEUE. Remaining items are not
+// released.
+VOID DokanQueue_Free(PDOKAN_QUEUE Queue);
+
+// Appends an item at the end of the queue. Returns FALSE if the queue is full.
+// On success, WaiterCount receives the number of DokanQueue_PopOrWait calls
+// that found no item ready and that the caller now has to retry on their
+// behalf. It can be NULL when DokanQueue_PopOrWait is not used.
+BOOL DokanQueue_Push(PDOKAN_QUEUE Queue, PVOID Item, PLONG WaiterCount);
+
+// Removes the item at the front of the queue. Returns NULL if the queue is
+// empty or if the front item is still being pushed.
+PVOID DokanQueue_Pop(PDOKAN_QUEUE Queue);
+
+// Same as DokanQueue_Pop, but when no item is ready the call is registered as
+// a waiter of the front item and the DokanQueue_Push of that item reports it
+// in its WaiterCount. Consumers started once per pushed item use it so that
+// a consumer missing an item still being pushed can return without retrying:
+// the producer starts another one once the item is there.
+PVOID DokanQueue_PopOrWait(PDOKAN_QUEUE Queue);
+
+#endif
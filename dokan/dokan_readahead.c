@@ -0,0 +1,285 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_readahead.h"
+
+// Index of the generation of a file name.
+static ULONG GetGenerationBucket(LPCWSTR FileName, ULONG FileNameLength) {
+  return HashFileName(FileName, FileNameLength) %
+         DOKAN_READ_AHEAD_GENERATION_COUNT;
+}
+
+static PDOKAN_READ_AHEAD GetReadAhead(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  if (!openInfo || !IoEvent->DokanInstance->DokanOptions->ReadAheadSize) {
+    return NULL;
+  }
+  EnterCriticalSection(&openInfo->CriticalSection);
+  if (!openInfo->ReadAhead) {
+    PDOKAN_READ_AHEAD readAhead = calloc(1, sizeof(DOKAN_READ_AHEAD));
+    if (readAhead) {
+      InitializeCriticalSection(&readAhead->CriticalSection);
+      InitializeConditionVariable(&readAhead->PrefetchDone);
+      readAhead->DokanInstance = IoEvent->DokanInstance;
+      openInfo->ReadAhead = readAhead;
+    }
+  }
+  LeaveCriticalSection(&openInfo->CriticalSection);
+  return openInfo->ReadAhead;
+}
+
+static BOOL IsWindowCurrent(PDOKAN_READ_AHEAD ReadAhead,
+                            PDOKAN_READ_AHEAD_WINDOW Window, ULONG Bucket) {
+  return Window->Bucket == Bucket &&
+         Window->Generation ==
+             ReadNoFence(&ReadAhead->DokanInstance->ReadAheadGenerations[Bucket]);
+}
+
+static PDOKAN_READ_AHEAD_WINDOW FindWindow(PDOKAN_READ_AHEAD ReadAhead,
+                                           LONGLONG Offset) {
+  for (ULONG i = 0; i < DOKAN_READ_AHEAD_WINDOW_COUNT; ++i) {
+    PDOKAN_READ_AHEAD_WINDOW window = &ReadAhead->Windows[i];
+    if ((window->Loading || window->Ready) && Offset >= window->Offset &&
+        (Offset < window->Offset + window->Length ||
+         (window->Ready && window->EndOfFile))) {
+      return window;
+    }
+  }
+  return NULL;
+}
+
+static VOID FreeWindows(PDOKAN_READ_AHEAD ReadAhead) {
+  for (ULONG i = 0; i < DOKAN_READ_AHEAD_WINDOW_COUNT; ++i) {
+    PDOKAN_READ_AHEAD_WINDOW window = &ReadAhead->Windows[i];
+    if (window->Buffer) {
+      free(window->Buffer);
+      window->Buffer = NULL;
+      InterlockedAdd64(
+          &ReadAhead->DokanInstance->ReadAheadMemory,
+          -(LONG64)ReadAhead->DokanInstance->DokanOptions->ReadAheadSize);
+    }
+    window->Loading = FALSE;
+    window->Ready = FALSE;
+  }
+}
+
+static VOID CALLBACK Prefetch(PTP_CALLBACK_INSTANCE Instance,
+                              PVOID Parameter) {
+  UNREFERENCED_PARAMETER(Instance);
+  PDOKAN_READ_AHEAD readAhead = (PDOKAN_READ_AHEAD)Parameter;
+  PDOKAN_READ_AHEAD_WINDOW window = readAhead->PrefetchWindow;
+  DWORD readLength = 0;
+  // The window and the ReadFile parameters do not change while it runs.
+  NTSTATUS status = CallReadFile(readAhead->DokanInstance, readAhead->FileName,
+                                 window->Buffer, window->Length, &readLength,
+                                 window->Offset, &readAhead->FileInfo);
+  EnterCriticalSection(&readAhead->CriticalSection);
+  window->Loading = FALSE;
+  if (!readAhead->Stopped &&
+      (status == STATUS_SUCCESS || status == STATUS_END_OF_FILE) &&
+      readLength <= window->Length) {
+    window->Ready = TRUE;
+    window->EndOfFile = readLength < window->Length;
+    window->Length = readLength;
+  } else if (status == STATUS_PENDING) {
+    DbgPrint("Dokan Error: ReadFile returned STATUS_PENDING for a "
+             "read-ahead, which requires reads to complete synchronously.\n");
+  }
+  readAhead->PrefetchWindow = NULL;
+  // Signaled with the lock held: cleanup can free the state once released.
+  WakeAllConditionVariable(&readAhead->PrefetchDone);
+  LeaveCriticalSection(&readAhead->CriticalSection);
+}
+
+// Starts reading the window at Offset, in another window than Current.
+// ReadAhead->CriticalSection must be held.
+static VOID StartPrefetch(PDOKAN_READ_AHEAD ReadAhead, PDOKAN_IO_EVENT IoEvent,
+                          PDOKAN_READ_AHEAD_WINDOW Current, LONGLONG Offset,
+                          ULONG Bucket) {
+  PDOKAN_INSTANCE dokanInstance = ReadAhead->DokanInstance;
+  ULONG windowSize = dokanInstance->DokanOptions->ReadAheadSize;
+  if (ReadAhead->Stopped || ReadAhead->PrefetchWindow) {
+    return;
+  }
+  PDOKAN_READ_AHEAD_WINDOW window = NULL;
+  for (ULONG i = 0; i < DOKAN_READ_AHEAD_WINDOW_COUNT; ++i) {
+    PDOKAN_READ_AHEAD_WINDOW candidate = &ReadAhead->Windows[i];
+    if (candidate->Ready && candidate->Offset == Offset &&
+        IsWindowCurrent(ReadAhead, candidate, Bucket)) {
+      // Already prefetched.
+      return;
+    }
+    if (candidate != Current &&
+        (!window || !candidate->Ready ||
+         (window->Ready && candidate->Offset < window->Offset))) {
+      window = candidate;
+    }
+  }
+  if (!window->Buffer) {
+    if (InterlockedAdd64(&dokanInstance->ReadAheadMemory, windowSize) >
+        DOKAN_READ_AHEAD_MAX_MEMORY) {
+      InterlockedAdd64(&dokanInstance->ReadAheadMemory, -(LONG64)windowSize);
+      return;
+    }
+    window->Buffer = malloc(windowSize);
+    if (!window->Buffer) {
+      InterlockedAdd64(&dokanInstance->ReadAheadMemory, -(LONG64)windowSize);
+      return;
+    }
+  }
+  LPCWSTR fileName = IoEvent->EventContext->Operation.Read.FileName;
+  if (!ReadAhead->FileName || wcscmp(ReadAhead->FileName, fileName) != 0) {
+    free(ReadAhead->FileName);
+    ReadAhead->FileName = _wcsdup(fileName);
+    if (!ReadAhead->FileName) {
+      return;
+    }
+  }
+  ReadAhead->FileInfo = IoEvent->DokanFileInfo;
+  // The prefetch cannot be completed with DokanEndDispatchRead.
+  ReadAhead->FileInfo.DokanContext = 0;
+  window->Ready = FALSE;
+  window->Loading = TRUE;
+  window->Offset = Offset;
+  window->Length = windowSize;
+  window->Bucket = Bucket;
+  // Read before the data so that a write completing meanwhile makes it stale.
+  window->Generation =
+      ReadNoFence(&dokanInstance->ReadAheadGenerations[Bucket]);
+  ReadAhead->PrefetchWindow = window;
+  if (!TrySubmitThreadpoolCallback(
+          Prefetch, ReadAhead, &dokanInstance->ThreadInfo.CallbackEnvironment)) {
+    window->Loading = FALSE;
+    ReadAhead->PrefetchWindow = NULL;
+  }
+}
+
+// Updates the sequential read detection with a read of ReadLength bytes at
+// Offset. Returns whether the open reads sequentially.
+static BOOL RecordRead(PDOKAN_READ_AHEAD ReadAhead, LONGLONG Offset,
+                       ULONG ReadLength) {
+  if (Offset == ReadAhead->NextOffset) {
+    ++ReadAhead->SequentialReads;
+  } else {
+    ReadAhead->SequentialReads = 1;
+  }
+  ReadAhead->NextOffset = Offset + ReadLength;
+  return ReadAhead->SequentialReads >= DOKAN_READ_AHEAD_SEQUENTIAL_READS;
+}
+
+BOOL DokanReadAhead_Read(PDOKAN_IO_EVENT IoEvent, PVOID Buffer, ULONG Length,
+                         PULONG ReadLength) {
+  PDOKAN_READ_AHEAD readAhead = GetReadAhead(IoEvent);
+  if (!readAhead) {
+    return FALSE;
+  }
+  LPCWSTR fileName = IoEvent->EventContext->Operation.Read.FileName;
+  LONGLONG offset = IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart;
+  ULONG bucket = GetGenerationBucket(fileName, (ULONG)wcslen(fileName));
+  BOOL served = FALSE;
+  EnterCriticalSection(&readAhead->CriticalSection);
+  while (!readAhead->Stopped) {
+    PDOKAN_READ_AHEAD_WINDOW window = FindWindow(readAhead, offset);
+    if (!window) {
+      break;
+    }
+    if (window->Loading) {
+      SleepConditionVariableCS(&readAhead->PrefetchDone,
+                               &readAhead->CriticalSection, INFINITE);
+      continue;
+    }
+    if (!IsWindowCurrent(readAhead, window, bucket)) {
+      window->Ready = FALSE;
+      break;
+    }
+    LONGLONG windowEnd = window->Offset + window->Length;
+    if (offset + Length > windowEnd && !window->EndOfFile) {
+      // Only partly prefetched, the backend serves it whole.
+      break;
+    }
+    ULONG length = offset < windowEnd
+                       ? (ULONG)min((LONGLONG)Length, windowEnd - offset)
+                       : 0;
+    RtlCopyMemory(Buffer, window->Buffer + (offset - window->Offset), length);
+    *ReadLength = length;
+    served = TRUE;
+    // Keep the next window coming while the reader is in the second half.
+    if (RecordRead(readAhead, offset, length) && !window->EndOfFile &&
+        (offset + length - window->Offset) * 2 >= window->Length) {
+      StartPrefetch(readAhead, IoEvent, window, windowEnd, bucket);
+    }
+    break;
+  }
+  LeaveCriticalSection(&readAhead->CriticalSection);
+  return served;
+}
+
+VOID DokanReadAhead_OnRead(PDOKAN_IO_EVENT IoEvent, ULONG ReadLength) {
+  PDOKAN_READ_AHEAD readAhead =
+      IoEvent->DokanOpenInfo ? IoEvent->DokanOpenInfo->ReadAhead : NULL;
+  if (!readAhead) {
+    return;
+  }
+  LPCWSTR fileName = IoEvent->EventContext->Operation.Read.FileName;
+  LONGLONG offset = IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart;
+  EnterCriticalSection(&readAhead->CriticalSection);
+  if (RecordRead(readAhead, offset, ReadLength) && ReadLength) {
+    StartPrefetch(readAhead, IoEvent, NULL, offset + ReadLength,
+                  GetGenerationBucket(fileName, (ULONG)wcslen(fileName)));
+  }
+  LeaveCriticalSection(&readAhead->CriticalSection);
+}
+
+VOID DokanReadAhead_Invalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               ULONG FileNameLength) {
+  if (!DokanInstance->DokanOptions->ReadAheadSize) {
+    return;
+  }
+  InterlockedIncrement(
+      &DokanInstance->ReadAheadGenerations[GetGenerationBucket(
+          FileName, FileNameLength)]);
+}
+
+VOID DokanReadAhead_Stop(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_READ_AHEAD readAhead = OpenInfo->ReadAhead;
+  if (!readAhead) {
+    return;
+  }
+  EnterCriticalSection(&readAhead->CriticalSection);
+  readAhead->Stopped = TRUE;
+  while (readAhead->PrefetchWindow) {
+    SleepConditionVariableCS(&readAhead->PrefetchDone,
+                             &readAhead->CriticalSection, INFINITE);
+  }
+  FreeWindows(readAhead);
+  LeaveCriticalSection(&readAhead->CriticalSection);
+}
+
+VOID DokanReadAhead_Free(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_READ_AHEAD readAhead = OpenInfo->ReadAhead;
+  if (!readAhead) {
+    return;
+  }
+  DokanReadAhead_Stop(OpenInfo);
+  OpenInfo->ReadAhead = NULL;
+  free(readAhead->FileName);
+  DeleteCriticalSection(&readAhead->CriticalSection);
+  free(readAhead);
+}
@@ -0,0 +1,94 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_READAHEAD_H_
+#define DOKAN_READAHEAD_H_
+
+#include "dokani.h"
+
+// Number of reads following each other an open needs before it is prefetched.
+#define DOKAN_READ_AHEAD_SEQUENTIAL_READS 2
+// Memory an instance can use for the windows of all its opens.
+#define DOKAN_READ_AHEAD_MAX_MEMORY (64 * 1024 * 1024)
+// Windows of an open: the one being read and the one prefetched after it.
+#define DOKAN_READ_AHEAD_WINDOW_COUNT 2
+
+typedef struct _DOKAN_READ_AHEAD_WINDOW {
+  PCHAR Buffer;
+  LONGLONG Offset;
+  // Length read once Ready, length requested while Loading.
+  ULONG Length;
+  BOOL Loading;
+  BOOL Ready;
+  // Whether the read of the window stopped at the end of the file.
+  BOOL EndOfFile;
+  // Generation bucket of the file name and its value when the window was read.
+  ULONG Bucket;
+  LONG Generation;
+} DOKAN_READ_AHEAD_WINDOW, *PDOKAN_READ_AHEAD_WINDOW;
+
+// Sequential read detection and prefetched data of an open.
+//
+// Once an open reads sequentially, the window after its last read is read
+// from the backend by a thread pool callback and the next reads are served
+// from it. A single prefetch runs at a time and reads needing it wait for it.
+//
+// Writes, size changes and renames bump the generation of the file name in
+// the instance, which makes the windows read before stale for all the opens
+// of the file.
+typedef struct _DOKAN_READ_AHEAD {
+  CRITICAL_SECTION CriticalSection;
+  // Signaled when the running prefetch completes.
+  CONDITION_VARIABLE PrefetchDone;
+  PDOKAN_INSTANCE DokanInstance;
+  DOKAN_READ_AHEAD_WINDOW Windows[DOKAN_READ_AHEAD_WINDOW_COUNT];
+  // Offset following the last read and the number of reads ending there.
+  LONGLONG NextOffset;
+  ULONG SequentialReads;
+  // Set by cleanup, the open no longer reads ahead.
+  BOOL Stopped;
+  // Window of the running prefetch, NULL when there is none.
+  PDOKAN_READ_AHEAD_WINDOW PrefetchWindow;
+  // ReadFile parameters of the prefetch, only updated while none runs.
+  LPWSTR FileName;
+  DOKAN_FILE_INFO FileInfo;
+} DOKAN_READ_AHEAD, *PDOKAN_READ_AHEAD;
+
+// Serves the read of IoEvent from the prefetched data when it holds it and
+// sets ReadLength. Returns FALSE when the backend has to be called.
+BOOL DokanReadAhead_Read(PDOKAN_IO_EVENT IoEvent, PVOID Buffer, ULONG Length,
+                         PULONG ReadLength);
+
+// Records a read of IoEvent served by the backend and starts a prefetch after
+// it when the open reads sequentially.
+VOID DokanReadAhead_OnRead(PDOKAN_IO_EVENT IoEvent, ULONG ReadLength);
+
+// Makes the prefetched data of all the opens of FileName stale. FileName is
+// FileNameLength characters long.
+VOID DokanReadAhead_Invalidate(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                               ULONG FileNameLength);
+
+// Waits for the prefetch of an open being cleaned up and releases its data.
+VOID DokanReadAhead_Stop(PDOKAN_OPEN_INFO OpenInfo);
+
+// Releases the read-ahead state of an open.
+VOID DokanReadAhead_Free(PDOKAN_OPEN_INFO OpenInfo);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <windows.h>
+#include <malloc.h>
+
+#include "dokan_scheduler.h"
+
+PDOKAN_WORK_SCHEDULER DokanScheduler_Alloc(ULONG DequeCount,
+                                           ULONG DequeCapacity) {
+  if (!DequeCount || DequeCapacity < 2 ||
+      (DequeCapacity & (DequeCapacity - 1)) != 0) {
+    return NULL;
+  }
+  PDOKAN_WORK_SCHEDULER scheduler =
+      (PDOKAN_WORK_SCHEDULER)malloc(sizeof(DOKAN_WORK_SCHEDULER));
+  if (!scheduler) {
+    return NULL;
+  }
+  scheduler->DequeCount = DequeCount;
+  scheduler->Deques = (PDOKAN_WORK_DEQUE)_aligned_malloc(
+      sizeof(DOKAN_WORK_DEQUE) * DequeCount, SYSTEM_CACHE_ALIGNMENT_SIZE);
+  if (!scheduler->Deques) {
+    free(scheduler);
+    return NULL;
+  }
+  ZeroMemory(scheduler->Deques, sizeof(DOKAN_WORK_DEQUE) * DequeCount);
+  for (ULONG i = 0; i < DequeCount; ++i) {
+    PDOKAN_WORK_DEQUE deque = &scheduler->Deques[i];
+    deque->Items = (PVOID volatile *)malloc(sizeof(PVOID) * DequeCapacity);
+    if (!deque->Items) {
+      DokanScheduler_Free(scheduler);
+      return NULL;
+    }
+    deque->Mask = DequeCapacity - 1;
+  }
+  return scheduler;
+}
+
+VOID DokanScheduler_Free(PDOKAN_WORK_SCHEDULER Scheduler) {
+  if (!Scheduler) {
+    return;
+  }
+  for (ULONG i = 0; i < Scheduler->DequeCount; ++i) {
+    free((PVOID)Scheduler->Deques[i].Items);
+  }
+  _aligned_free(Scheduler->Deques);
+  free(Scheduler);
+}
+
+PDOKAN_WORK_DEQUE DokanScheduler_AcquireDeque(PDOKAN_WORK_SCHEDULER Scheduler,
+                                              ULONG Hint) {
+  for (ULONG i = 0; i < Scheduler->DequeCount; ++i) {
+    PDOKAN_WORK_DEQUE deque =
+        &Scheduler->Deques[(Hint + i) % Scheduler->DequeCount];
+    if (!deque->Owned && !InterlockedCompareExchange(&deque->Owned, 1, 0)) {
+      return deque;
+    }
+  }
+  return NULL;
+}
+
+VOID DokanScheduler_ReleaseDeque(PDOKAN_WORK_DEQUE Deque) {
+  if (Deque) {
+    InterlockedExchange(&Deque->Owned, 0);
+  }
+}
+
+BOOL DokanScheduler_Push(PDOKAN_WORK_DEQUE Deque, PVOID Item) {
+  LONG64 bottom = Deque->Bottom;
+  LONG64 top = ReadAcquire64(&Deque->Top);
+  if (bottom - top > Deque->Mask) {
+    return FALSE;
+  }
+  Deque->Items[bottom & Deque->Mask] = Item;
+  // Publish the item before thieves can see the new bottom.
+  WriteRelease64(&Deque->Bottom, bottom + 1);
+  return TRUE;
+}
+
+PVOID DokanScheduler_Pop(PDOKAN_WORK_DEQUE Deque) {
+  LONG64 bottom = Deque->Bottom - 1;
+  // Full barrier: thieves must see the reserved bottom before we read top.
+  InterlockedExchange64(&Deque->Bottom, bottom);
+  LONG64 top = Deque->Top;
+  if (top > bottom) {
+    Deque->Bottom = bottom + 1;
+    return NULL;
+  }
+  PVOID item = Deque->Items[bottom & Deque->Mask];
+  if (top == bottom) {
+    // Last item: thieves can race us for it.
+    if (InterlockedCompareExchange64(&Deque->Top, top + 1, top) != top) {
+      item = NULL;
+    }
+    Deque->Bottom = bottom + 1;
+  }
+  return item;
+}
+
+PVOID DokanScheduler_Steal(PDOKAN_WORK_SCHEDULER Scheduler, ULONG Hint) {
+  for (ULONG i = 0; i < Scheduler->DequeCount; ++i) {
+    PDOKAN_WORK_DEQUE deque =
+        &Scheduler->Deques[(Hint + i) % Scheduler->DequeCount];
+    for (;;) {
+      LONG64 top = ReadAcquire64(&deque->Top);
+      MemoryBarrier();
+      LONG64 bottom = ReadAcquire64(&deque->Bottom);
+      if (top >= bottom) {
+        break;
+      }
+      // The owner cannot reuse this slot until top moves past it.
+      PVOID item = deque->Items[top & deque->Mask];
+      if (InterlockedCompareExchange64(&deque->Top, top + 1, top) == top) {
+        return item;
+      }
+      // Lost the race against another thief or the owner, retry.
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,73 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_SCHEDULER_H_
+#define DOKAN_SCHEDULER_H_
+
+// Work stealing scheduler core. It only stores opaque items and does not
+// depend on the thread pool or the driver: the caller decides which threads
+// own a deque and when idle threads try to steal.
+
+// Double ended queue of items with a single owner.
+// The owner pushes and pops items at the bottom in LIFO order, so the most
+// recent and likely still cached item is processed first. Any other thread
+// can steal the oldest item at the top.
+typedef struct _DOKAN_WORK_DEQUE {
+  DECLSPEC_CACHEALIGN volatile LONG64 Top;
+  DECLSPEC_CACHEALIGN volatile LONG64 Bottom;
+  PVOID volatile *Items;
+  LONG64 Mask;
+  // Whether a thread currently owns the deque.
+  volatile LONG Owned;
+} DOKAN_WORK_DEQUE, *PDOKAN_WORK_DEQUE;
+
+typedef struct _DOKAN_WORK_SCHEDULER {
+  PDOKAN_WORK_DEQUE Deques;
+  ULONG DequeCount;
+} DOKAN_WORK_SCHEDULER, *PDOKAN_WORK_SCHEDULER;
+
+// Creates a scheduler with DequeCount deques holding up to DequeCapacity items
+// each. DequeCapacity must be a power of two.
+PDOKAN_WORK_SCHEDULER DokanScheduler_Alloc(ULONG DequeCount,
+                                           ULONG DequeCapacity);
+
+// Releases the memory associated with a DOKAN_WORK_SCHEDULER. Remaining items
+// are not released.
+VOID DokanScheduler_Free(PDOKAN_WORK_SCHEDULER Scheduler);
+
+// Takes ownership of a free deque, trying the one at index Hint first.
+// Returns NULL if all deques are owned.
+PDOKAN_WORK_DEQUE DokanScheduler_AcquireDeque(PDOKAN_WORK_SCHEDULER Scheduler,
+                                              ULONG Hint);
+
+// Gives up the ownership of a deque. Items left in it can still be stolen.
+VOID DokanScheduler_ReleaseDeque(PDOKAN_WORK_DEQUE Deque);
+
+// Pushes an item at the bottom of an owned deque. Returns FALSE if it is full.
+BOOL DokanScheduler_Push(PDOKAN_WORK_DEQUE Deque, PVOID Item);
+
+// Pops the most recent item of an owned deque. Returns NULL if it is empty.
+PVOID DokanScheduler_Pop(PDOKAN_WORK_DEQUE Deque);
+
+// Steals the oldest item of the first non empty deque, starting with the one
+// at index Hint. Returns NULL if all deques are empty.
+PVOID DokanScheduler_Steal(PDOKAN_WORK_SCHEDULER Scheduler, ULONG Hint);
+
+#endif
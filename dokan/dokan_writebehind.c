@@ -0,0 +1,426 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_writebehind.h"
+#include "dokan_readahead.h"
+
+static PDOKAN_WRITE_BEHIND GetWriteBehind(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  EnterCriticalSection(&openInfo->CriticalSection);
+  if (!openInfo->WriteBehind) {
+    PDOKAN_WRITE_BEHIND writeBehind = calloc(1, sizeof(DOKAN_WRITE_BEHIND));
+    PCHAR buffer =
+        malloc(IoEvent->DokanInstance->DokanOptions->WriteBehindSize);
+    if (writeBehind && buffer) {
+      InitializeCriticalSection(&writeBehind->CriticalSection);
+      writeBehind->References = 1;
+      writeBehind->DokanInstance = IoEvent->DokanInstance;
+      writeBehind->Buffer = buffer;
+      writeBehind->Error = STATUS_SUCCESS;
+      openInfo->WriteBehind = writeBehind;
+    } else {
+      free(writeBehind);
+      free(buffer);
+    }
+  }
+  LeaveCriticalSection(&openInfo->CriticalSection);
+  return openInfo->WriteBehind;
+}
+
+// Releases a reference on a buffer, the last one frees it.
+static VOID ReleaseWriteBehind(PDOKAN_WRITE_BEHIND WriteBehind) {
+  if (InterlockedDecrement(&WriteBehind->References) != 0) {
+    return;
+  }
+  free(WriteBehind->FileName);
+  free(WriteBehind->Buffer);
+  DeleteCriticalSection(&WriteBehind->CriticalSection);
+  free(WriteBehind);
+}
+
+// Removes a buffer from the dirty list, with the list lock held.
+static VOID UnlistWriteBehind(PDOKAN_WRITE_BEHIND_LIST List,
+                              PDOKAN_WRITE_BEHIND WriteBehind) {
+  RemoveEntryList(&WriteBehind->ListEntry);
+  WriteBehind->Listed = FALSE;
+  --List->Count;
+}
+
+// Sends the buffered data to the backend, with the buffer lock held. A
+// failure is kept in Error for the next event of the open.
+static VOID FlushLocked(PDOKAN_WRITE_BEHIND WriteBehind) {
+  if (!WriteBehind->Length) {
+    return;
+  }
+  PDOKAN_INSTANCE instance = WriteBehind->DokanInstance;
+  DWORD writtenLength = 0;
+  NTSTATUS status = CallWriteFile(
+      instance, WriteBehind->FileName, WriteBehind->Buffer,
+      WriteBehind->Length, &writtenLength, WriteBehind->Offset,
+      &WriteBehind->FileInfo);
+  if (status == STATUS_PENDING) {
+    DbgPrint("Dokan Error: WriteFile returned STATUS_PENDING for a "
+             "write-behind flush.\n");
+    status = STATUS_INTERNAL_ERROR;
+  } else if (status == STATUS_SUCCESS &&
+             writtenLength != WriteBehind->Length) {
+    status = STATUS_UNEXPECTED_IO_ERROR;
+  }
+  if (status != STATUS_SUCCESS && WriteBehind->Error == STATUS_SUCCESS) {
+    WriteBehind->Error = status;
+  }
+  // Data read ahead while the write was buffered is stale.
+  DokanReadAhead_Invalidate(instance, WriteBehind->FileName,
+                            (ULONG)wcslen(WriteBehind->FileName));
+  InvalidateFileInfoCache(instance, WriteBehind->FileName);
+  InvalidateDirectoryListCache(instance, WriteBehind->FileName);
+  RecordWriteBehindFlush(instance);
+  WriteBehind->Length = 0;
+}
+
+// Whether FileName is an entry of the directory DirectoryName.
+static BOOL IsInDirectory(LPCWSTR FileName, LPCWSTR DirectoryName) {
+  size_t directoryLength = wcslen(DirectoryName);
+  while (directoryLength && DirectoryName[directoryLength - 1] == L'\\') {
+    --directoryLength;
+  }
+  if (_wcsnicmp(FileName, DirectoryName, directoryLength) != 0 ||
+      FileName[directoryLength] != L'\\') {
+    return FALSE;
+  }
+  return FileName[directoryLength + 1] != L'\0' &&
+         wcschr(FileName + directoryLength + 1, L'\\') == NULL;
+}
+
+static BOOL IsWriteBehindMatching(PDOKAN_WRITE_BEHIND WriteBehind,
+                                  LPCWSTR FileName, LPCWSTR DirectoryName,
+                                  LONGLONG Offset, ULONG Length) {
+  if (FileName && _wcsicmp(WriteBehind->FileName, FileName) != 0) {
+    return FALSE;
+  }
+  if (DirectoryName && !IsInDirectory(WriteBehind->FileName, DirectoryName)) {
+    return FALSE;
+  }
+  return !Length || (WriteBehind->Offset < Offset + Length &&
+                     Offset < WriteBehind->Offset + WriteBehind->Length);
+}
+
+// Flushes the listed buffers of FileName, or of the entries of DirectoryName,
+// or all of them when both are NULL, overlapping the Length bytes at Offset,
+// or the whole file when Length is 0.
+// Exclude is the buffer of the caller, which must not be flushed here.
+// The list lock is never held while waiting for a buffer lock or writing the
+// backend: such a buffer is handled with a reference once the list lock is
+// released, and the walk resumes after it.
+static VOID FlushMatching(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                          LPCWSTR DirectoryName, LONGLONG Offset, ULONG Length,
+                          PDOKAN_WRITE_BEHIND Exclude) {
+  PDOKAN_WRITE_BEHIND_LIST list = &DokanInstance->WriteBehind;
+  if (!ReadNoFence(&list->Count)) {
+    return;
+  }
+  ULONG nameHash = FileName ? HashFileName(FileName, (ULONG)wcslen(FileName))
+                            : 0;
+  EnterCriticalSection(&list->CriticalSection);
+  PLIST_ENTRY entry = list->DirtyList.Flink;
+  while (entry != &list->DirtyList) {
+    PDOKAN_WRITE_BEHIND writeBehind =
+        CONTAINING_RECORD(entry, DOKAN_WRITE_BEHIND, ListEntry);
+    entry = entry->Flink;
+    if (writeBehind == Exclude ||
+        (FileName && ReadNoFence((volatile LONG *)&writeBehind->NameHash) !=
+                         (LONG)nameHash)) {
+      continue;
+    }
+    BOOL locked = TryEnterCriticalSection(&writeBehind->CriticalSection);
+    if (locked) {
+      if (!writeBehind->Length) {
+        // Buffers flushed by their open stay listed until found empty here.
+        UnlistWriteBehind(list, writeBehind);
+        LeaveCriticalSection(&writeBehind->CriticalSection);
+        continue;
+      }
+      if (!IsWriteBehindMatching(writeBehind, FileName, DirectoryName, Offset,
+                                 Length)) {
+        LeaveCriticalSection(&writeBehind->CriticalSection);
+        continue;
+      }
+    }
+    // The reference keeps the buffer alive if its open is closed meanwhile.
+    InterlockedIncrement(&writeBehind->References);
+    LeaveCriticalSection(&list->CriticalSection);
+    if (!locked) {
+      EnterCriticalSection(&writeBehind->CriticalSection);
+    }
+    if (writeBehind->Length &&
+        IsWriteBehindMatching(writeBehind, FileName, DirectoryName, Offset,
+                              Length)) {
+      FlushLocked(writeBehind);
+    }
+    LeaveCriticalSection(&writeBehind->CriticalSection);
+    EnterCriticalSection(&list->CriticalSection);
+    if (writeBehind->Listed) {
+      entry = writeBehind->ListEntry.Flink;
+      if (TryEnterCriticalSection(&writeBehind->CriticalSection)) {
+        if (!writeBehind->Length) {
+          UnlistWriteBehind(list, writeBehind);
+        }
+        LeaveCriticalSection(&writeBehind->CriticalSection);
+      }
+    } else {
+      // Unlisted meanwhile, the entry after it may be gone too.
+      entry = list->DirtyList.Flink;
+    }
+    ReleaseWriteBehind(writeBehind);
+  }
+  LeaveCriticalSection(&list->CriticalSection);
+}
+
+static VOID SetFlushTimer(PDOKAN_WRITE_BEHIND_LIST List) {
+  // Negative due time is relative, in 100 nanoseconds units.
+  ULARGE_INTEGER dueTime;
+  dueTime.QuadPart =
+      (ULONGLONG)(-(LONGLONG)DOKAN_WRITE_BEHIND_DELAY_MS * 10000);
+  FILETIME fileDueTime;
+  fileDueTime.dwHighDateTime = dueTime.HighPart;
+  fileDueTime.dwLowDateTime = dueTime.LowPart;
+  SetThreadpoolTimer(List->Timer, &fileDueTime, 0, 0);
+}
+
+static VOID InsertDirtyWriteBehind(PDOKAN_WRITE_BEHIND WriteBehind) {
+  PDOKAN_WRITE_BEHIND_LIST list = &WriteBehind->DokanInstance->WriteBehind;
+  EnterCriticalSection(&list->CriticalSection);
+  if (!WriteBehind->Listed) {
+    WriteBehind->Listed = TRUE;
+    // The timer is armed by the first buffer and kept armed while the list
+    // is not empty.
+    if (IsListEmpty(&list->DirtyList)) {
+      SetFlushTimer(list);
+    }
+    InsertTailList(&list->DirtyList, &WriteBehind->ListEntry);
+    ++list->Count;
+  }
+  LeaveCriticalSection(&list->CriticalSection);
+}
+
+static VOID CALLBACK FlushTimerCallback(PTP_CALLBACK_INSTANCE Instance,
+                                        PVOID Context, PTP_TIMER Timer) {
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Timer);
+  PDOKAN_INSTANCE dokanInstance = (PDOKAN_INSTANCE)Context;
+  PDOKAN_WRITE_BEHIND_LIST list = &dokanInstance->WriteBehind;
+  FlushMatching(dokanInstance, NULL, NULL, 0, 0, NULL);
+  // Buffers listed during the flush did not arm the timer.
+  EnterCriticalSection(&list->CriticalSection);
+  if (!IsListEmpty(&list->DirtyList)) {
+    SetFlushTimer(list);
+  }
+  LeaveCriticalSection(&list->CriticalSection);
+}
+
+BOOL DokanWriteBehind_Start(PDOKAN_INSTANCE DokanInstance) {
+  DokanInstance->WriteBehind.Timer =
+      CreateThreadpoolTimer(FlushTimerCallback, DokanInstance,
+                            &DokanInstance->ThreadInfo.CallbackEnvironment);
+  return DokanInstance->WriteBehind.Timer != NULL;
+}
+
+VOID DokanWriteBehind_Stop(PDOKAN_INSTANCE DokanInstance) {
+  PTP_TIMER timer = DokanInstance->WriteBehind.Timer;
+  if (!timer) {
+    return;
+  }
+  SetThreadpoolTimer(timer, NULL, 0, 0);
+  WaitForThreadpoolTimerCallbacks(timer, TRUE);
+  FlushMatching(DokanInstance, NULL, NULL, 0, 0, NULL);
+}
+
+BOOL DokanWriteBehind_Write(PDOKAN_IO_EVENT IoEvent,
+                            PEVENT_CONTEXT WriteEventContext,
+                            NTSTATUS *Status, PULONG WrittenLength) {
+  PDOKAN_INSTANCE instance = IoEvent->DokanInstance;
+  ULONG size = instance->DokanOptions->WriteBehindSize;
+  if (!size || !instance->WriteBehind.Timer) {
+    return FALSE;
+  }
+  PDOKAN_OPEN_INFO openInfo = IoEvent->DokanOpenInfo;
+  LPCWSTR fileName = WriteEventContext->Operation.Write.FileName;
+  LONGLONG offset = WriteEventContext->Operation.Write.ByteOffset.QuadPart;
+  ULONG length = WriteEventContext->Operation.Write.BufferLength;
+  PDOKAN_WRITE_BEHIND writeBehind = openInfo ? openInfo->WriteBehind : NULL;
+
+  // Data buffered by the other opens of the file was written before.
+  FlushMatching(instance, fileName, NULL, 0, 0, writeBehind);
+
+  // Paging writes come from the cache manager flushing its own data, they
+  // are already large and must reach the backend.
+  BOOL bufferable = openInfo && !IoEvent->DokanFileInfo.PagingIo &&
+                    !IoEvent->DokanFileInfo.WriteToEndOfFile && offset >= 0 &&
+                    length && length < size;
+  if (!writeBehind) {
+    if (!bufferable) {
+      return FALSE;
+    }
+    writeBehind = GetWriteBehind(IoEvent);
+    if (!writeBehind) {
+      return FALSE;
+    }
+  }
+
+  EnterCriticalSection(&writeBehind->CriticalSection);
+  if (writeBehind->Length &&
+      (!bufferable || writeBehind->Stopped ||
+       offset != writeBehind->Offset + writeBehind->Length ||
+       writeBehind->Length + length > size ||
+       _wcsicmp(writeBehind->FileName, fileName) != 0)) {
+    FlushLocked(writeBehind);
+  }
+  if (writeBehind->Error != STATUS_SUCCESS) {
+    *Status = writeBehind->Error;
+    *WrittenLength = 0;
+    writeBehind->Error = STATUS_SUCCESS;
+    LeaveCriticalSection(&writeBehind->CriticalSection);
+    return TRUE;
+  }
+  if (!bufferable || writeBehind->Stopped) {
+    LeaveCriticalSection(&writeBehind->CriticalSection);
+    return FALSE;
+  }
+  if (!writeBehind->Length) {
+    if (!writeBehind->FileName ||
+        _wcsicmp(writeBehind->FileName, fileName) != 0) {
+      LPWSTR newFileName = _wcsdup(fileName);
+      if (!newFileName) {
+        LeaveCriticalSection(&writeBehind->CriticalSection);
+        return FALSE;
+      }
+      free(writeBehind->FileName);
+      writeBehind->FileName = newFileName;
+      writeBehind->NameHash =
+          HashFileName(newFileName, (ULONG)wcslen(newFileName));
+    }
+    writeBehind->Offset = offset;
+  }
+  // The flush runs outside of the event, it cannot be completed
+  // asynchronously.
+  writeBehind->FileInfo = IoEvent->DokanFileInfo;
+  writeBehind->FileInfo.DokanContext = 0;
+  RtlCopyMemory(writeBehind->Buffer + writeBehind->Length,
+                (PCHAR)WriteEventContext +
+                    WriteEventContext->Operation.Write.BufferOffset,
+                length);
+  writeBehind->Length += length;
+  RecordBufferedWrite(instance);
+  if (writeBehind->Length == size) {
+    FlushLocked(writeBehind);
+  }
+  BOOL insert = writeBehind->Length && !writeBehind->Listed;
+  LeaveCriticalSection(&writeBehind->CriticalSection);
+  if (insert) {
+    InsertDirtyWriteBehind(writeBehind);
+  }
+  *Status = STATUS_SUCCESS;
+  *WrittenLength = length;
+  return TRUE;
+}
+
+VOID DokanWriteBehind_FlushRange(PDOKAN_INSTANCE DokanInstance,
+                                 LPCWSTR FileName, LONGLONG Offset,
+                                 ULONG Length) {
+  if (Length) {
+    FlushMatching(DokanInstance, FileName, NULL, Offset, Length, NULL);
+  }
+}
+
+VOID DokanWriteBehind_FlushFile(PDOKAN_INSTANCE DokanInstance,
+                                LPCWSTR FileName) {
+  FlushMatching(DokanInstance, FileName, NULL, 0, 0, NULL);
+}
+
+VOID DokanWriteBehind_FlushAll(PDOKAN_INSTANCE DokanInstance) {
+  FlushMatching(DokanInstance, NULL, NULL, 0, 0, NULL);
+}
+
+VOID DokanWriteBehind_FlushDirectory(PDOKAN_INSTANCE DokanInstance,
+                                     LPCWSTR DirectoryName) {
+  FlushMatching(DokanInstance, NULL, DirectoryName, 0, 0, NULL);
+}
+
+NTSTATUS DokanWriteBehind_TakeError(PDOKAN_IO_EVENT IoEvent) {
+  PDOKAN_WRITE_BEHIND writeBehind =
+      IoEvent->DokanOpenInfo ? IoEvent->DokanOpenInfo->WriteBehind : NULL;
+  if (!writeBehind) {
+    return STATUS_SUCCESS;
+  }
+  EnterCriticalSection(&writeBehind->CriticalSection);
+  NTSTATUS status = writeBehind->Error;
+  writeBehind->Error = STATUS_SUCCESS;
+  LeaveCriticalSection(&writeBehind->CriticalSection);
+  return status;
+}
+
+// Flushes a buffer with its lock held and logs the error nobody is left to
+// receive.
+static VOID FlushLockedForClose(PDOKAN_WRITE_BEHIND WriteBehind) {
+  FlushLocked(WriteBehind);
+  if (WriteBehind->Error != STATUS_SUCCESS) {
+    DbgPrintW(L"Dokan Warning: Write-behind flush of %s failed with 0x%x\n",
+              WriteBehind->FileName, WriteBehind->Error);
+    WriteBehind->Error = STATUS_SUCCESS;
+  }
+}
+
+NTSTATUS DokanWriteBehind_Cleanup(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_WRITE_BEHIND writeBehind = OpenInfo->WriteBehind;
+  if (!writeBehind) {
+    return STATUS_SUCCESS;
+  }
+  EnterCriticalSection(&writeBehind->CriticalSection);
+  writeBehind->Stopped = TRUE;
+  FlushLocked(writeBehind);
+  NTSTATUS status = writeBehind->Error;
+  writeBehind->Error = STATUS_SUCCESS;
+  LeaveCriticalSection(&writeBehind->CriticalSection);
+  if (status != STATUS_SUCCESS) {
+    DbgPrintW(L"Dokan Warning: Write-behind flush of %s failed with 0x%x\n",
+              writeBehind->FileName, status);
+  }
+  return status;
+}
+
+VOID DokanWriteBehind_Free(PDOKAN_OPEN_INFO OpenInfo) {
+  PDOKAN_WRITE_BEHIND writeBehind = OpenInfo->WriteBehind;
+  if (!writeBehind) {
+    return;
+  }
+  PDOKAN_WRITE_BEHIND_LIST list = &writeBehind->DokanInstance->WriteBehind;
+  EnterCriticalSection(&list->CriticalSection);
+  if (writeBehind->Listed) {
+    UnlistWriteBehind(list, writeBehind);
+  }
+  LeaveCriticalSection(&list->CriticalSection);
+  // Waits for a flusher writing it. Flushers holding a reference find it
+  // empty and free it when they release the last one.
+  EnterCriticalSection(&writeBehind->CriticalSection);
+  FlushLockedForClose(writeBehind);
+  LeaveCriticalSection(&writeBehind->CriticalSection);
+  OpenInfo->WriteBehind = NULL;
+  ReleaseWriteBehind(writeBehind);
+}
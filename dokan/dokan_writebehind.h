@@ -0,0 +1,104 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DOKAN_WRITEBEHIND_H_
+#define DOKAN_WRITEBEHIND_H_
+
+#include "dokani.h"
+
+// Longest time written data stays in a write-behind buffer.
+#define DOKAN_WRITE_BEHIND_DELAY_MS 1000
+
+// Buffer of an open merging its contiguous small writes into one backend
+// write.
+//
+// Buffers holding data are linked in the instance DOKAN_WRITE_BEHIND_LIST so
+// that the events of other opens can flush them first: the ones of the same
+// file or, for directory listings and renames, all of them. The list lock is
+// taken before the lock of a buffer, never while holding one, and flushers
+// holding it only try the lock of a buffer.
+typedef struct _DOKAN_WRITE_BEHIND {
+  CRITICAL_SECTION CriticalSection;
+  // Held by the open and by the flushers waiting for the buffer lock.
+  volatile LONG References;
+  PDOKAN_INSTANCE DokanInstance;
+  // Entry in DOKAN_WRITE_BEHIND_LIST.DirtyList, protected by its lock.
+  LIST_ENTRY ListEntry;
+  volatile BOOL Listed;
+  PCHAR Buffer;
+  // File offset and length of the buffered data.
+  LONGLONG Offset;
+  ULONG Length;
+  // Error of a failed flush, returned by the next read, write or flush of
+  // the open.
+  NTSTATUS Error;
+  // Set by cleanup, the open no longer buffers writes.
+  BOOL Stopped;
+  // WriteFile parameters of the buffered data. FileName only changes while
+  // the buffer is empty.
+  LPWSTR FileName;
+  // HashFileName of FileName, read without the buffer lock to skip the
+  // buffers of other files.
+  volatile ULONG NameHash;
+  DOKAN_FILE_INFO FileInfo;
+} DOKAN_WRITE_BEHIND, *PDOKAN_WRITE_BEHIND;
+
+// Creates the timer flushing the buffers of an instance.
+BOOL DokanWriteBehind_Start(PDOKAN_INSTANCE DokanInstance);
+
+// Stops the timer and flushes the buffers left, before the instance is
+// deleted.
+VOID DokanWriteBehind_Stop(PDOKAN_INSTANCE DokanInstance);
+
+// Buffers the write of IoEvent when possible, and flushes what has to be
+// written before it. Returns FALSE when the write has to be sent to the
+// backend, otherwise sets Status and WrittenLength.
+BOOL DokanWriteBehind_Write(PDOKAN_IO_EVENT IoEvent,
+                            PEVENT_CONTEXT WriteEventContext,
+                            NTSTATUS *Status, PULONG WrittenLength);
+
+// Flushes the buffers of FileName overlapping the Length bytes at Offset.
+VOID DokanWriteBehind_FlushRange(PDOKAN_INSTANCE DokanInstance,
+                                 LPCWSTR FileName, LONGLONG Offset,
+                                 ULONG Length);
+
+// Flushes the buffers of FileName.
+VOID DokanWriteBehind_FlushFile(PDOKAN_INSTANCE DokanInstance,
+                                LPCWSTR FileName);
+
+// Flushes all the buffers of the instance.
+VOID DokanWriteBehind_FlushAll(PDOKAN_INSTANCE DokanInstance);
+
+// Flushes the buffers of the entries of DirectoryName.
+VOID DokanWriteBehind_FlushDirectory(PDOKAN_INSTANCE DokanInstance,
+                                     LPCWSTR DirectoryName);
+
+// Returns and clears the error of a failed flush of the open of IoEvent.
+NTSTATUS DokanWriteBehind_TakeError(PDOKAN_IO_EVENT IoEvent);
+
+// Flushes the buffer of an open being cleaned up and stops buffering.
+// Returns the error of a failed flush not returned to an event of the open
+// yet.
+NTSTATUS DokanWriteBehind_Cleanup(PDOKAN_OPEN_INFO OpenInfo);
+
+// Flushes and releases the buffer of an open.
+VOID DokanWriteBehind_Free(PDOKAN_OPEN_INFO OpenInfo);
+
+#endif
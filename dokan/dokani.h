@@ -32,6 +32,10 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "dokanc.h"
 #include "list.h"
 #include "dokan_vector.h"
+#include "dokan_dirlist.h"
+#include "dokan_namecache.h"
+#include "dokan_queue.h"
+#include "dokan_scheduler.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,7 +45,173 @@ typedef struct _DOKAN_INSTANCE_THREADINFO {
   PTP_POOL ThreadPool;
   PTP_CLEANUP_GROUP CleanupGroup;
   TP_CALLBACK_ENVIRON CallbackEnvironment;
-} DOKAN_INSTANCE_THREADINFO;
+  /** Work object submitted once for each event pushed to DispatchQueue */
+  PTP_WORK DispatchWork;
+  /** Events waiting to be processed by a DispatchWork callback */
+  PDOKAN_QUEUE DispatchQueue;
+  /** Deques where pullers schedule the events of their batches */
+  PDOKAN_WORK_SCHEDULER Scheduler;
+  /** Work object waking up an idle thread to steal a scheduled event */
+  PTP_WORK StealWork;
+} DOKAN_INSTANCE_THREADINFO, *PDOKAN_INSTANCE_THREADINFO;
+
+// Number of per processor counter slots of an instance.
+#define DOKAN_STATISTICS_CPU_SLOT_COUNT 64
+
+/**
+ * \struct DOKAN_CPU_STATISTICS
+ * \brief Event counters of a Dokan instance updated by a single processor
+ *
+ * Each slot lives on its own cache line so that counters can be updated
+ * without contention. They are summed by DokanGetRuntimeStatistics.
+ */
+typedef struct DECLSPEC_CACHEALIGN _DOKAN_CPU_STATISTICS {
+  LONG64 PulledBatches;
+  LONG64 PulledEvents;
+  LONG64 PulledBatchSizes[DOKAN_STATISTICS_BATCH_SIZE_BUCKET_COUNT];
+  LONG64 QueuedEvents;
+  LONG64 MajorFunctionEvents[DOKAN_STATISTICS_MAJOR_FUNCTION_COUNT];
+  LONG64 DeferredEvents[DOKAN_STATISTICS_DISPATCH_CLASS_COUNT];
+  LONG64 DispatchLatencies[DOKAN_STATISTICS_DISPATCH_CLASS_COUNT]
+                          [DOKAN_STATISTICS_LATENCY_BUCKET_COUNT];
+  LONG64 BufferedWrites;
+  LONG64 WriteBehindFlushes;
+  LONG64 FileInfoCacheHits;
+  LONG64 FileInfoCacheMisses;
+  LONG64 NegativeLookupCacheHits;
+  LONG64 DirectoryListCacheHits;
+  LONG64 DirectoryListCacheMisses;
+} DOKAN_CPU_STATISTICS, *PDOKAN_CPU_STATISTICS;
+
+/**
+ * \struct DOKAN_DISPATCH_CLASS
+ * \brief Concurrency limit of a class of events
+ *
+ * See DOKAN_OPTIONS.MaxMetadataDispatchCount and MaxBulkDispatchCount.
+ */
+typedef struct _DOKAN_DISPATCH_CLASS {
+  CRITICAL_SECTION CriticalSection;
+  /** Maximum number of events of the class dispatched at the same time, 0 if unlimited */
+  ULONG MaxRunning;
+  /** Number of events of the class being dispatched */
+  ULONG Running;
+  /** First and last events waiting for a running event to complete */
+  struct _DOKAN_IO_EVENT *DeferredHead;
+  struct _DOKAN_IO_EVENT *DeferredTail;
+} DOKAN_DISPATCH_CLASS, *PDOKAN_DISPATCH_CLASS;
+
+/**
+ * \struct DOKAN_PULLER_CONTROL
+ * \brief Adjusts the number of threads waiting for events from the driver
+ *
+ * A timer compares the activity since its previous tick and moves
+ * TargetPullerCount between MinPullerCount and MaxPullerCount. Missing pullers
+ * are started by the timer, extra pullers retire by themselves.
+ */
+typedef struct _DOKAN_PULLER_CONTROL {
+  PTP_TIMER Timer;
+  /** Number of threads waiting indefinitely for events */
+  volatile LONG PullerCount;
+  volatile LONG TargetPullerCount;
+  LONG MinPullerCount;
+  LONG MaxPullerCount;
+  /** Counters at the previous tick */
+  ULONG64 PulledBatches;
+  ULONG64 PulledEvents;
+  ULONG64 DispatchedEvents;
+  ULONG64 SlowEvents;
+} DOKAN_PULLER_CONTROL, *PDOKAN_PULLER_CONTROL;
+
+/**
+ * \struct DOKAN_REPLY_BATCH
+ * \brief Event results waiting to be sent to the driver in a single ioctl
+ *
+ * Results are sent with the next pull of any thread, or by the Timer if no
+ * pull happened in time.
+ */
+typedef struct _DOKAN_REPLY_BATCH {
+  CRITICAL_SECTION CriticalSection;
+  PTP_TIMER Timer;
+  /** Events holding the results, linked by NextWaitingEvent */
+  struct _DOKAN_IO_EVENT *Head;
+  ULONG EventCount;
+  /** Size of the results once serialized */
+  ULONG Size;
+} DOKAN_REPLY_BATCH, *PDOKAN_REPLY_BATCH;
+
+/**
+ * \struct DOKAN_IO_BATCH_POOL
+ * \brief Free DOKAN_IO_BATCH of an instance
+ *
+ * Batches hold the pull buffer length negotiated with the driver. Instances
+ * pulling with the default BATCH_EVENT_CONTEXT_SIZE share the per-thread
+ * object caches instead of using the list.
+ */
+typedef struct _DOKAN_IO_BATCH_POOL {
+  /** Free batches, linked through their first bytes */
+  SLIST_HEADER FreeBatches;
+  volatile LONG FreeCount;
+  /** Maximum number of free batches kept in the list */
+  LONG MaxFreeCount;
+  /** Size of the EventContext buffer of the batches */
+  ULONG BufferLength;
+} DOKAN_IO_BATCH_POOL, *PDOKAN_IO_BATCH_POOL;
+
+/** Number of read-ahead generations of an instance */
+#define DOKAN_READ_AHEAD_GENERATION_COUNT 256
+
+/** Allocation unit of DOKAN_READ_BUFFER */
+#define DOKAN_READ_BUFFER_CHUNK_SIZE (1024 * 16)
+/** Marks the chunks of a DOKAN_READ_BUFFER range after the first one */
+#define DOKAN_READ_BUFFER_CHUNK_USED MAXULONG
+
+/**
+ * \struct DOKAN_READ_BUFFER
+ * \brief Memory registered with the driver that reads are completed from
+ *
+ * Large reads get a range of chunks the read data is written to. The driver
+ * copies it to the request buffer when the result is sent and the range is
+ * released with the result.
+ */
+typedef struct _DOKAN_READ_BUFFER {
+  CRITICAL_SECTION CriticalSection;
+  /** Registered memory, NULL when the buffer is not used */
+  PUCHAR Base;
+  ULONG ChunkCount;
+  /**
+   * Chunk count of the range starting at each chunk, or
+   * DOKAN_READ_BUFFER_CHUNK_USED for the other chunks of a range.
+   * Free chunks are 0.
+   */
+  PULONG Ranges;
+  /** Chunk the search of the next free range starts from */
+  ULONG NextChunk;
+} DOKAN_READ_BUFFER, *PDOKAN_READ_BUFFER;
+
+/** Number of entries of the file info cache */
+#define DOKAN_FILE_INFO_CACHE_SIZE 4096
+/** Number of entries of the negative lookup cache */
+#define DOKAN_NEGATIVE_LOOKUP_CACHE_SIZE 4096
+/** Number of entries of the directory list cache */
+#define DOKAN_DIRECTORY_LIST_CACHE_SIZE 256
+/** Default of DOKAN_OPTIONS.DirectoryListCacheMaxMemory */
+#define DOKAN_DIRECTORY_LIST_CACHE_DEFAULT_MAX_MEMORY (64 * 1024 * 1024)
+
+/**
+ * \struct DOKAN_WRITE_BEHIND_LIST
+ * \brief Write-behind buffers of an instance holding data
+ *
+ * See DOKAN_WRITE_BEHIND. The timer flushes the listed buffers when data has
+ * stayed buffered for DOKAN_WRITE_BEHIND_DELAY_MS.
+ */
+typedef struct _DOKAN_WRITE_BEHIND_LIST {
+  CRITICAL_SECTION CriticalSection;
+  LIST_ENTRY DirtyList;
+  /** Number of entries of DirtyList, read without the lock by the flushers */
+  volatile LONG Count;
+  /** NULL when write-behind is disabled */
+  PTP_TIMER Timer;
+} DOKAN_WRITE_BEHIND_LIST, *PDOKAN_WRITE_BEHIND_LIST;
 
 /**
  * \struct DOKAN_INSTANCE
@@ -72,6 +242,14 @@ typedef struct _DOKAN_INSTANCE {
   PDOKAN_OPTIONS DokanOptions;
   /** DOKAN_OPERATIONS linked to the mount */
   PDOKAN_OPERATIONS DokanOperations;
+  /**
+   * Copy of the options of an application older than
+   * DOKAN_EXTENDED_API_VERSION, with the members it does not know about left
+   * zero. DokanOptions then points to it.
+   */
+  DOKAN_OPTIONS LegacyOptions;
+  /** Same as LegacyOptions for the operations */
+  DOKAN_OPERATIONS LegacyOperations;
   /** Current list entry informations */
   LIST_ENTRY ListEntry;
   /** Global Dokan Kernel device handle */
@@ -93,6 +271,43 @@ typedef struct _DOKAN_INSTANCE {
    * Only the first incrementer thread will call it.
    */
   LONG UnmountedCalled;
+  /** Per processor event counters, DOKAN_STATISTICS_CPU_SLOT_COUNT slots */
+  PDOKAN_CPU_STATISTICS Statistics;
+  /** Concurrency limits indexed by DOKAN_DISPATCH_CLASS_METADATA and DOKAN_DISPATCH_CLASS_BULK */
+  DOKAN_DISPATCH_CLASS DispatchClasses[DOKAN_STATISTICS_DISPATCH_CLASS_COUNT];
+  /** Pull threads count controller */
+  DOKAN_PULLER_CONTROL PullerControl;
+  /** Results waiting to be sent together */
+  DOKAN_REPLY_BATCH ReplyBatch;
+  /** Buffers the events are pulled with */
+  DOKAN_IO_BATCH_POOL IoBatchPool;
+  /** Buffer registered with the driver for the read data */
+  DOKAN_READ_BUFFER ReadBuffer;
+  /** Memory used by the read-ahead windows of the opens */
+  volatile LONG64 ReadAheadMemory;
+  /**
+   * Incremented when the data of a file changes, indexed by a hash of its
+   * name. Read-ahead windows read with an older value are stale.
+   */
+  volatile LONG ReadAheadGenerations[DOKAN_READ_AHEAD_GENERATION_COUNT];
+  /** Write-behind buffers of the opens holding data */
+  DOKAN_WRITE_BEHIND_LIST WriteBehind;
+  /**
+   * BY_HANDLE_FILE_INFORMATION results of GetFileInformation, cached for
+   * DOKAN_OPTIONS.FileInfoCacheTtlMs
+   */
+  DOKAN_NAME_CACHE FileInfoCache;
+  /**
+   * Names not found by ZwCreateFile, without payload, cached for
+   * DOKAN_OPTIONS.NegativeLookupCacheTtlMs
+   */
+  DOKAN_NAME_CACHE NegativeLookupCache;
+  /**
+   * PDOKAN_DIRECTORY_LIST listings shared by the opens, cached for
+   * DOKAN_OPTIONS.DirectoryListCacheTtlMs within
+   * DOKAN_OPTIONS.DirectoryListCacheMaxMemory
+   */
+  DOKAN_NAME_CACHE DirectoryListCache;
 } DOKAN_INSTANCE, *PDOKAN_INSTANCE;
 
 /**
@@ -105,10 +320,18 @@ typedef struct _DOKAN_OPEN_INFO {
   CRITICAL_SECTION CriticalSection;
   /** Dokan instance linked to the open */
   PDOKAN_INSTANCE DokanInstance;
-  PDOKAN_VECTOR DirList;
+  PDOKAN_DIRECTORY_LIST DirList;
   PWCHAR DirListSearchPattern;
+  /** Position reached in DirList by the last query */
+  DOKAN_DIRECTORY_CURSOR DirListCursor;
   /** Whether the FindFilesWithPattern has returned STATUS_NOT_IMPLEMENTED */
   BOOLEAN UnimplementedFindFilesWithPattern;
+  /** Whether the FindFilesStream has returned STATUS_NOT_IMPLEMENTED */
+  BOOLEAN UnimplementedFindFilesStream;
+  /** Index of the next entry of the enumeration done with FindFilesStream */
+  ULONG StreamIndex;
+  /** Cookie resuming the FindFilesStream enumeration at StreamIndex */
+  ULONG64 StreamCookie;
   /** User Context see DOKAN_FILE_INFO.Context */
   LONG64 UserContext;
   /** Event Id */
@@ -122,6 +345,18 @@ typedef struct _DOKAN_OPEN_INFO {
   LONG64 CloseUserContext;
   /** Event context */
   PEVENT_CONTEXT EventContext;
+  /**
+   * Whether an event of the open is being dispatched.
+   * Only used with DOKAN_OPTION_ORDERED_FILE_DISPATCH.
+   */
+  BOOL LaneBusy;
+  /** First and last events waiting for the lane to be free, in pull order */
+  struct _DOKAN_IO_EVENT *LaneHead;
+  struct _DOKAN_IO_EVENT *LaneTail;
+  /** Read-ahead state, allocated on the first read */
+  struct _DOKAN_READ_AHEAD *ReadAhead;
+  /** Write-behind buffer, allocated on the first buffered write */
+  struct _DOKAN_WRITE_BEHIND *WriteBehind;
 } DOKAN_OPEN_INFO, *PDOKAN_OPEN_INFO;
 
 /**
@@ -142,6 +377,8 @@ typedef struct _DOKAN_IO_BATCH {
   DWORD NumberOfBytesTransferred;
   /** Whether it is used by the Main pull thread that wait indefinitely in kernel compared to volatile pool threads */
   BOOL MainPullThread;
+  /** Performance counter value when the events were pulled from the kernel */
+  LARGE_INTEGER PullTime;
   /**
    * Whether this object was allocated from the memory pool.
    * Large Write events will allocate a specific buffer that will not come from the memory pool.
@@ -194,8 +431,34 @@ typedef struct _DOKAN_IO_EVENT {
    * When it is free, the EventContext of this IoEvent is no longer safe to access.
    */
   PDOKAN_IO_BATCH IoBatch;
+  /** Callback processing the event once it has been queued by QueueIoEvent */
+  PTP_WORK_CALLBACK QueuedCallback;
+  /** Open whose dispatch lane is held by the event */
+  PDOKAN_OPEN_INFO LaneOpenInfo;
+  /** Dispatch class whose concurrency slot is held by the event */
+  PDOKAN_DISPATCH_CLASS DispatchClass;
+  /**
+   * Next event waiting on the same lane or dispatch class, or whose result
+   * waits in the same reply batch.
+   */
+  struct _DOKAN_IO_EVENT *NextWaitingEvent;
+  /**
+   * Io batch holding the data of a write. It differs from IoBatch when the
+   * driver had to send the write buffer separately.
+   */
+  PDOKAN_IO_BATCH WriteIoBatch;
+  /** DOKAN_IO_EVENT_ASYNC_* state of an operation returning STATUS_PENDING */
+  volatile LONG AsyncState;
 } DOKAN_IO_EVENT, *PDOKAN_IO_EVENT;
 
+/** The operation callback has not returned yet. */
+#define DOKAN_IO_EVENT_ASYNC_DISPATCHING 0
+/** The operation callback returned STATUS_PENDING and the event is owned by
+ * its completion. */
+#define DOKAN_IO_EVENT_ASYNC_PENDING 1
+/** The result was filled before the operation callback returned. */
+#define DOKAN_IO_EVENT_ASYNC_COMPLETED 2
+
 #define IOEVENT_RESULT_BUFFER_SIZE(ioEvent)                                    \
   ((ioEvent)->EventResultSize >= offsetof(EVENT_INFORMATION, Buffer)           \
        ? (ioEvent)->EventResultSize - offsetof(EVENT_INFORMATION, Buffer)      \
@@ -221,23 +484,103 @@ BOOL IsMountPointDriveLetter(LPCWSTR mountPoint);
 
 VOID EventCompletion(PDOKAN_IO_EVENT EventInfo);
 
+BOOL SetIoEventPending(PDOKAN_IO_EVENT IoEvent);
+
+VOID CompleteIoEvent(PDOKAN_IO_EVENT IoEvent);
+
 VOID CreateDispatchCommon(PDOKAN_IO_EVENT IoEvent, ULONG SizeOfEventInfo,
-                          BOOL UseExtraMemoryPool, BOOL ClearNonPoolBuffer);
+                          BOOL ClearBuffer);
+
+/** Gives a result created by CreateDispatchCommon back to its allocator */
+VOID FreeIoEventResult(PDOKAN_INSTANCE DokanInstance,
+                       PEVENT_INFORMATION EventResult, ULONG EventResultSize,
+                       BOOL PoolAllocated);
+
+/**
+ * Hash of the FileNameLength characters of FileName. Names differing by case
+ * have the same hash.
+ */
+ULONG HashFileName(LPCWSTR FileName, ULONG FileNameLength);
+
+/** Number of DOKAN_IO_SEGMENT dispatchers keep on their stack */
+#define DOKAN_IO_SEGMENT_STACK_COUNT 16
+
+/**
+ * Splits the Length bytes of Buffer read or written at Offset in segments
+ * ending at offsets multiple of SegmentSize. The SegmentCapacity entries of
+ * Segments are returned when they are enough, otherwise the returned array is
+ * allocated and has to be freed. Returns NULL when the allocation fails.
+ */
+PDOKAN_IO_SEGMENT SplitIoSegments(PDOKAN_IO_SEGMENT Segments,
+                                  ULONG SegmentCapacity, PVOID Buffer,
+                                  DWORD Length, LONGLONG Offset,
+                                  ULONG SegmentSize, PDWORD SegmentCount);
 
 VOID DispatchDirectoryInformation(PDOKAN_IO_EVENT IoEvent);
 
+VOID InitializeDirectoryListCache(PDOKAN_INSTANCE DokanInstance);
+
+VOID FreeDirectoryListCache(PDOKAN_INSTANCE DokanInstance);
+
+/**
+ * Drops the cached listings of FileName and of its parent directory, once
+ * FileName was created, deleted or changed
+ */
+VOID InvalidateDirectoryListCache(PDOKAN_INSTANCE DokanInstance,
+                                  LPCWSTR FileName);
+
+/** Drops all the cached listings, when directories can have changed names */
+VOID ClearDirectoryListCache(PDOKAN_INSTANCE DokanInstance);
+
 VOID DispatchQueryInformation(PDOKAN_IO_EVENT IoEvent);
 
+VOID InitializeFileInfoCache(PDOKAN_INSTANCE DokanInstance);
+
+VOID FreeFileInfoCache(PDOKAN_INSTANCE DokanInstance);
+
+/** Drops the cached information of FileName, once the file has changed */
+VOID InvalidateFileInfoCache(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName);
+
+/** Drops all the cached information, when files can have changed names */
+VOID ClearFileInfoCache(PDOKAN_INSTANCE DokanInstance);
+
 VOID DispatchQueryVolumeInformation(PDOKAN_IO_EVENT IoEvent);
 
 VOID DispatchSetInformation(PDOKAN_IO_EVENT IoEvent);
 
-VOID DispatchRead(PDOKAN_IO_EVENT IoEvent);
+BOOL DispatchRead(PDOKAN_IO_EVENT IoEvent);
 
-VOID DispatchWrite(PDOKAN_IO_EVENT IoEvent);
+NTSTATUS CallReadFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                      PVOID Buffer, DWORD BufferLength, LPDWORD ReadLength,
+                      LONGLONG Offset, PDOKAN_FILE_INFO DokanFileInfo);
+
+VOID RegisterReadBuffer(PDOKAN_INSTANCE DokanInstance, ULONG Length);
+
+VOID ReleaseReadBufferRange(PDOKAN_INSTANCE DokanInstance,
+                            PEVENT_INFORMATION EventResult);
+
+VOID FreeReadBuffer(PDOKAN_INSTANCE DokanInstance);
+
+BOOL DispatchWrite(PDOKAN_IO_EVENT IoEvent);
+
+NTSTATUS CallWriteFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                       PVOID Buffer, DWORD NumberOfBytesToWrite,
+                       LPDWORD NumberOfBytesWritten, LONGLONG Offset,
+                       PDOKAN_FILE_INFO DokanFileInfo);
 
 VOID DispatchCreate(PDOKAN_IO_EVENT IoEvent);
 
+VOID InitializeNegativeLookupCache(PDOKAN_INSTANCE DokanInstance);
+
+VOID FreeNegativeLookupCache(PDOKAN_INSTANCE DokanInstance);
+
+/** Drops FileName from the not found names, once it can exist */
+VOID InvalidateNegativeLookupCache(PDOKAN_INSTANCE DokanInstance,
+                                   LPCWSTR FileName);
+
+/** Drops all the not found names, when files can have changed names */
+VOID ClearNegativeLookupCache(PDOKAN_INSTANCE DokanInstance);
+
 VOID DispatchClose(PDOKAN_IO_EVENT IoEvent);
 
 VOID DispatchCleanup(PDOKAN_IO_EVENT IoEvent);
@@ -258,6 +601,35 @@ VOID CheckFileName(LPWSTR FileName);
 
 VOID ReleaseDokanOpenInfo(PDOKAN_IO_EVENT IoEvent);
 
+PDOKAN_CPU_STATISTICS AllocateInstanceStatistics();
+
+VOID FreeInstanceStatistics(PDOKAN_CPU_STATISTICS Statistics);
+
+VOID RecordPulledBatch(PDOKAN_INSTANCE DokanInstance, ULONG EventCount);
+
+VOID RecordQueuedEvent(PDOKAN_INSTANCE DokanInstance);
+
+VOID RecordDispatchedEvent(PDOKAN_INSTANCE DokanInstance, ULONG MajorFunction);
+
+VOID RecordDeferredEvent(PDOKAN_INSTANCE DokanInstance, ULONG DispatchClass);
+
+VOID RecordDispatchLatency(PDOKAN_INSTANCE DokanInstance, ULONG DispatchClass,
+                           PLARGE_INTEGER PullTime);
+
+VOID RecordBufferedWrite(PDOKAN_INSTANCE DokanInstance);
+
+VOID RecordWriteBehindFlush(PDOKAN_INSTANCE DokanInstance);
+
+VOID RecordFileInfoCacheHit(PDOKAN_INSTANCE DokanInstance);
+
+VOID RecordFileInfoCacheMiss(PDOKAN_INSTANCE DokanInstance);
+
+VOID RecordNegativeLookupCacheHit(PDOKAN_INSTANCE DokanInstance);
+
+VOID RecordDirectoryListCacheHit(PDOKAN_INSTANCE DokanInstance);
+
+VOID RecordDirectoryListCacheMiss(PDOKAN_INSTANCE DokanInstance);
+
 VOID DokanNotifyUnmounted(PDOKAN_INSTANCE DokanInstance);
 
 #ifdef __cplusplus
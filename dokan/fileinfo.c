@@ -22,6 +22,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 #include "fileinfo.h"
+#include "dokan_writebehind.h"
 
 #include <ntstatus.h>
 #include <stdio.h>
@@ -462,6 +463,59 @@ VOID DOKANAPI DokanEndDispatchFindStreams(PDOKAN_IO_EVENT IoEvent,
   EventCompletion(IoEvent);
 }
 
+VOID InitializeFileInfoCache(PDOKAN_INSTANCE DokanInstance) {
+  if (!DokanNameCache_Initialize(
+          &DokanInstance->FileInfoCache, DOKAN_FILE_INFO_CACHE_SIZE,
+          sizeof(BY_HANDLE_FILE_INFORMATION),
+          DokanInstance->DokanOptions->FileInfoCacheTtlMs, /*MaxMemory=*/0,
+          DokanInstance->DokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE,
+          /*CopyPayload=*/NULL, /*FreePayload=*/NULL)) {
+    DbgPrintW(L"Dokan Warning: Failed to allocate the file info cache.\n");
+  }
+}
+
+VOID FreeFileInfoCache(PDOKAN_INSTANCE DokanInstance) {
+  DokanNameCache_Free(&DokanInstance->FileInfoCache);
+}
+
+// Copies the information of FileName to FileInfo when it is cached and has
+// not expired. Otherwise Generation receives the generation of its entry to
+// give to InsertFileInfoCache.
+static BOOL LookupFileInfoCache(PDOKAN_INSTANCE DokanInstance,
+                                LPCWSTR FileName,
+                                PBY_HANDLE_FILE_INFORMATION FileInfo,
+                                PLONG64 Generation) {
+  BOOL found = DokanNameCache_Lookup(&DokanInstance->FileInfoCache, FileName,
+                                     (ULONG)wcslen(FileName), FileInfo,
+                                     Generation);
+  if (found) {
+    RecordFileInfoCacheHit(DokanInstance);
+  } else {
+    RecordFileInfoCacheMiss(DokanInstance);
+  }
+  return found;
+}
+
+// Caches the information of FileName read by the backend, unless its entry
+// was invalidated since Generation was read before calling it.
+static VOID InsertFileInfoCache(PDOKAN_INSTANCE DokanInstance,
+                                LPCWSTR FileName,
+                                PBY_HANDLE_FILE_INFORMATION FileInfo,
+                                LONG64 Generation) {
+  DokanNameCache_Insert(&DokanInstance->FileInfoCache, FileName,
+                        (ULONG)wcslen(FileName), FileInfo, /*Memory=*/0,
+                        Generation);
+}
+
+VOID InvalidateFileInfoCache(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName) {
+  DokanNameCache_Invalidate(&DokanInstance->FileInfoCache, FileName,
+                            (ULONG)wcslen(FileName));
+}
+
+VOID ClearFileInfoCache(PDOKAN_INSTANCE DokanInstance) {
+  DokanNameCache_Clear(&DokanInstance->FileInfoCache);
+}
+
 VOID DispatchQueryInformation(PDOKAN_IO_EVENT IoEvent) {
   BY_HANDLE_FILE_INFORMATION byHandleFileInfo;
   NTSTATUS status = STATUS_INVALID_PARAMETER;
@@ -476,8 +530,11 @@ VOID DispatchQueryInformation(PDOKAN_IO_EVENT IoEvent) {
 
   CreateDispatchCommon(IoEvent,
                        IoEvent->EventContext->Operation.File.BufferLength,
-                       /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+                       /*ClearBuffer=*/TRUE);
+
+  // The size and times returned have to include the buffered writes.
+  DokanWriteBehind_FlushFile(IoEvent->DokanInstance,
+                             IoEvent->EventContext->Operation.File.FileName);
 
   if (IoEvent->EventContext->Operation.File.FileInformationClass ==
       FileStreamInformation) {
@@ -497,11 +554,23 @@ VOID DispatchQueryInformation(PDOKAN_IO_EVENT IoEvent) {
       status = STATUS_NOT_IMPLEMENTED;
     }
   } else if (IoEvent->DokanInstance->DokanOperations->GetFileInformation) {
+    PDOKAN_INSTANCE instance = IoEvent->DokanInstance;
+    LPCWSTR fileName = IoEvent->EventContext->Operation.File.FileName;
+    BOOL useCache = instance->FileInfoCache.Entries != NULL;
+    LONG64 generation = 0;
+    if (useCache && LookupFileInfoCache(instance, fileName, &byHandleFileInfo,
+                                        &generation)) {
+      DokanEndDispatchGetFileInformation(IoEvent, &byHandleFileInfo,
+                                         STATUS_SUCCESS);
+      return;
+    }
 
     ZeroMemory(&byHandleFileInfo, sizeof(BY_HANDLE_FILE_INFORMATION));
-    status = IoEvent->DokanInstance->DokanOperations->GetFileInformation(
-        IoEvent->EventContext->Operation.File.FileName, &byHandleFileInfo,
-        &IoEvent->DokanFileInfo);
+    status = instance->DokanOperations->GetFileInformation(
+        fileName, &byHandleFileInfo, &IoEvent->DokanFileInfo);
+    if (useCache && status == STATUS_SUCCESS) {
+      InsertFileInfoCache(instance, fileName, &byHandleFileInfo, generation);
+    }
     DokanEndDispatchGetFileInformation(IoEvent, &byHandleFileInfo, status);
   } else {
 
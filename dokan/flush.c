@@ -21,14 +21,14 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokani.h"
+#include "dokan_writebehind.h"
 
 VOID DispatchFlush(PDOKAN_IO_EVENT IoEvent) {
   NTSTATUS status;
 
   CheckFileName(IoEvent->EventContext->Operation.Flush.FileName);
 
-  CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+  CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/TRUE);
 
   DbgPrint("###Flush file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
            IoEvent->DokanOpenInfo,
@@ -36,6 +36,10 @@ VOID DispatchFlush(PDOKAN_IO_EVENT IoEvent) {
                                           : -1,
            IoEvent);
 
+  DokanWriteBehind_FlushFile(IoEvent->DokanInstance,
+                             IoEvent->EventContext->Operation.Flush.FileName);
+  NTSTATUS writeBehindError = DokanWriteBehind_TakeError(IoEvent);
+
   if (IoEvent->DokanInstance->DokanOperations->FlushFileBuffers) {
     status = IoEvent->DokanInstance->DokanOperations->FlushFileBuffers(
         IoEvent->EventContext->Operation.Flush.FileName, &IoEvent->DokanFileInfo);
@@ -49,6 +53,9 @@ VOID DispatchFlush(PDOKAN_IO_EVENT IoEvent) {
     IoEvent->EventResult->Status =
         status != STATUS_SUCCESS ? STATUS_NOT_SUPPORTED : STATUS_SUCCESS;
   }
+  if (writeBehindError != STATUS_SUCCESS) {
+    IoEvent->EventResult->Status = writeBehindError;
+  }
 
   EventCompletion(IoEvent);
 }
@@ -22,14 +22,18 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 #include "fileinfo.h"
+#include "dokan_writebehind.h"
 
 VOID DispatchLock(PDOKAN_IO_EVENT IoEvent) {
   NTSTATUS status;
 
   CheckFileName(IoEvent->EventContext->Operation.Lock.FileName);
 
-  CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+  CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/TRUE);
+
+  // Writes buffered before the lock must not be written after it.
+  DokanWriteBehind_FlushFile(IoEvent->DokanInstance,
+                             IoEvent->EventContext->Operation.Lock.FileName);
 
   DbgPrint("###Lock file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
            IoEvent->DokanOpenInfo,
@@ -21,17 +21,248 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokani.h"
+#include "dokan_readahead.h"
+#include "dokan_writebehind.h"
 
-VOID DispatchRead(PDOKAN_IO_EVENT IoEvent) {
+VOID RegisterReadBuffer(PDOKAN_INSTANCE DokanInstance, ULONG Length) {
+  PDOKAN_READ_BUFFER readBuffer = &DokanInstance->ReadBuffer;
+  Length = min(Length, DOKAN_READ_BUFFER_MAX_LENGTH);
+  ULONG chunkCount = Length / DOKAN_READ_BUFFER_CHUNK_SIZE;
+  if (!chunkCount) {
+    return;
+  }
+  Length = chunkCount * DOKAN_READ_BUFFER_CHUNK_SIZE;
+  PUCHAR base = VirtualAlloc(NULL, Length, MEM_COMMIT | MEM_RESERVE,
+                             PAGE_READWRITE);
+  PULONG ranges = calloc(chunkCount, sizeof(ULONG));
+  if (!base || !ranges) {
+    DokanDbgPrintW(L"Dokan Error: Failed to allocate the read buffer.\n");
+    if (base) {
+      VirtualFree(base, 0, MEM_RELEASE);
+    }
+    free(ranges);
+    return;
+  }
+  EVENT_READ_BUFFER registration;
+  registration.Address = (ULONG64)(ULONG_PTR)base;
+  registration.Length = Length;
+  DWORD returnedLength = 0;
+  if (!DeviceIoControl(DokanInstance->Device, FSCTL_EVENT_REGISTER_READ_BUFFER,
+                       &registration, sizeof(registration), NULL, 0,
+                       &returnedLength, NULL)) {
+    // Reads still work by copying their data with the result.
+    DokanDbgPrintW(L"Dokan Warning: Failed to register the read buffer with "
+                   L"code %d.\n",
+                   GetLastError());
+    VirtualFree(base, 0, MEM_RELEASE);
+    free(ranges);
+    return;
+  }
+  InitializeCriticalSection(&readBuffer->CriticalSection);
+  readBuffer->ChunkCount = chunkCount;
+  readBuffer->Ranges = ranges;
+  readBuffer->NextChunk = 0;
+  readBuffer->Base = base;
+  DbgPrintW(L"Dokan: Registered a read buffer of %lu bytes\n", Length);
+}
+
+// Frees the registered memory, once the device is closed so that the driver
+// no longer uses it.
+VOID FreeReadBuffer(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_READ_BUFFER readBuffer = &DokanInstance->ReadBuffer;
+  if (!readBuffer->Base) {
+    return;
+  }
+  VirtualFree(readBuffer->Base, 0, MEM_RELEASE);
+  readBuffer->Base = NULL;
+  free(readBuffer->Ranges);
+  readBuffer->Ranges = NULL;
+  DeleteCriticalSection(&readBuffer->CriticalSection);
+}
+
+// Finds ChunkCount free chunks in a row from the chunk From.
+static BOOL FindFreeReadBufferRange(PDOKAN_READ_BUFFER ReadBuffer, ULONG From,
+                                    ULONG ChunkCount, PULONG Start) {
+  ULONG freeCount = 0;
+  for (ULONG chunk = From; chunk < ReadBuffer->ChunkCount; ++chunk) {
+    if (ReadBuffer->Ranges[chunk]) {
+      freeCount = 0;
+    } else if (++freeCount == ChunkCount) {
+      *Start = chunk + 1 - ChunkCount;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Reserves a range of Length bytes of the registered memory. Returns FALSE
+// when the buffer is not used or has no free range large enough.
+static BOOL AllocateReadBufferRange(PDOKAN_INSTANCE DokanInstance, ULONG Length,
+                                    PULONG Offset) {
+  PDOKAN_READ_BUFFER readBuffer = &DokanInstance->ReadBuffer;
+  if (!readBuffer->Base) {
+    return FALSE;
+  }
+  ULONG chunkCount =
+      (Length + DOKAN_READ_BUFFER_CHUNK_SIZE - 1) / DOKAN_READ_BUFFER_CHUNK_SIZE;
+  if (chunkCount > readBuffer->ChunkCount) {
+    return FALSE;
+  }
+  ULONG start = 0;
+  EnterCriticalSection(&readBuffer->CriticalSection);
+  // Next fit: the search starts after the last reserved range then wraps.
+  BOOL found = FindFreeReadBufferRange(readBuffer, readBuffer->NextChunk,
+                                       chunkCount, &start) ||
+               FindFreeReadBufferRange(readBuffer, 0, chunkCount, &start);
+  if (found) {
+    readBuffer->Ranges[start] = chunkCount;
+    for (ULONG i = 1; i < chunkCount; ++i) {
+      readBuffer->Ranges[start + i] = DOKAN_READ_BUFFER_CHUNK_USED;
+    }
+    readBuffer->NextChunk = (start + chunkCount) % readBuffer->ChunkCount;
+    *Offset = start * DOKAN_READ_BUFFER_CHUNK_SIZE;
+  }
+  LeaveCriticalSection(&readBuffer->CriticalSection);
+  return found;
+}
+
+// Gives the range used by a read result back, once the driver has copied it.
+VOID ReleaseReadBufferRange(PDOKAN_INSTANCE DokanInstance,
+                            PEVENT_INFORMATION EventResult) {
+  if (!(EventResult->Flags & DOKAN_EVENT_INFO_READ_BUFFER)) {
+    return;
+  }
+  PDOKAN_READ_BUFFER readBuffer = &DokanInstance->ReadBuffer;
+  ULONG start = EventResult->Operation.Read.BufferOffset /
+                DOKAN_READ_BUFFER_CHUNK_SIZE;
+  EnterCriticalSection(&readBuffer->CriticalSection);
+  ULONG chunkCount = readBuffer->Ranges[start];
+  for (ULONG i = 0; i < chunkCount; ++i) {
+    readBuffer->Ranges[start + i] = 0;
+  }
+  LeaveCriticalSection(&readBuffer->CriticalSection);
+}
+
+NTSTATUS CallReadFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                      PVOID Buffer, DWORD BufferLength, LPDWORD ReadLength,
+                      LONGLONG Offset, PDOKAN_FILE_INFO DokanFileInfo) {
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  if (DokanInstance->DokanOperations->ReadFileScatter) {
+    DOKAN_IO_SEGMENT stackSegments[DOKAN_IO_SEGMENT_STACK_COUNT];
+    DWORD segmentCount = 0;
+    PDOKAN_IO_SEGMENT segments = SplitIoSegments(
+        stackSegments, DOKAN_IO_SEGMENT_STACK_COUNT, Buffer, BufferLength,
+        Offset, DokanInstance->DokanOptions->IoSegmentSize, &segmentCount);
+    if (segments) {
+      status = DokanInstance->DokanOperations->ReadFileScatter(
+          FileName, segments, segmentCount, ReadLength, DokanFileInfo);
+      if (segments != stackSegments) {
+        free(segments);
+      }
+    } else {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+  } else if (DokanInstance->DokanOperations->ReadFile) {
+    status = DokanInstance->DokanOperations->ReadFile(
+        FileName, Buffer, BufferLength, ReadLength, Offset, DokanFileInfo);
+  }
+  return status;
+}
+
+static VOID FillReadResult(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status,
+                           ULONG ReadLength) {
+  IoEvent->EventResult->BufferLength = 0;
+  IoEvent->EventResult->Status = Status;
+
+  if (Status == STATUS_SUCCESS) {
+    if (ReadLength == 0) {
+      IoEvent->EventResult->Status = STATUS_END_OF_FILE;
+    } else {
+      IoEvent->EventResult->BufferLength = ReadLength;
+      IoEvent->EventResult->Operation.Read.CurrentByteOffset.QuadPart =
+          IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart +
+          ReadLength;
+    }
+  }
+}
+
+VOID DOKANAPI DokanEndDispatchRead(PDOKAN_FILE_INFO DokanFileInfo,
+                                   NTSTATUS Status, DWORD ReadLength) {
+  PDOKAN_IO_EVENT ioEvent =
+      (PDOKAN_IO_EVENT)(UINT_PTR)DokanFileInfo->DokanContext;
+
+  // STATUS_PENDING should not be passed to this function
+  if (Status == STATUS_PENDING) {
+    DbgPrint("Dokan Error: DokanEndDispatchRead() failed because "
+             "STATUS_PENDING was supplied for Status.\n");
+    Status = STATUS_INTERNAL_ERROR;
+  }
+  if (ReadLength > ioEvent->EventContext->Operation.Read.BufferLength) {
+    DbgPrint("Dokan Error: DokanEndDispatchRead() failed because ReadLength "
+             "exceeds the read buffer.\n");
+    Status = STATUS_INTERNAL_ERROR;
+    ReadLength = 0;
+  }
+
+  FillReadResult(ioEvent, Status, ReadLength);
+  DbgPrint("\tDokanEndDispatchRead result =  0x%x\n", Status);
+  CompleteIoEvent(ioEvent);
+}
+
+// Creates the result of a read. Returns TRUE when the data goes to a range of
+// the registered read buffer reserved at ReadBufferOffset, the result then
+// has no room for it.
+static BOOL CreateReadResult(PDOKAN_IO_EVENT IoEvent, ULONG BufferLength,
+                             PULONG ReadBufferOffset) {
+  // Small reads are cheaper to copy with the result than to allocate a range.
+  if (BufferLength > DOKAN_EVENT_INFO_DEFAULT_BUFFER_SIZE &&
+      IoEvent->DokanInstance->ReadBuffer.Base) {
+    CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/FALSE);
+    if (!IoEvent->EventResult) {
+      return FALSE;
+    }
+    // The range is only reserved once the result exists, so that the result
+    // always gives it back.
+    if (AllocateReadBufferRange(IoEvent->DokanInstance, BufferLength,
+                                ReadBufferOffset)) {
+      return TRUE;
+    }
+    FreeIoEventResult(IoEvent->DokanInstance, IoEvent->EventResult,
+                      IoEvent->EventResultSize, IoEvent->PoolAllocated);
+    IoEvent->EventResult = NULL;
+    IoEvent->EventResultSize = 0;
+    IoEvent->PoolAllocated = FALSE;
+  }
+  CreateDispatchCommon(IoEvent, BufferLength, /*ClearBuffer=*/FALSE);
+  return FALSE;
+}
+
+BOOL DispatchRead(PDOKAN_IO_EVENT IoEvent) {
   ULONG readLength = 0;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  ULONG bufferLength = IoEvent->EventContext->Operation.Read.BufferLength;
+  ULONG readBufferOffset = 0;
 
   CheckFileName(IoEvent->EventContext->Operation.Read.FileName);
 
-  CreateDispatchCommon(IoEvent,
-                       IoEvent->EventContext->Operation.Read.BufferLength,
-                       /*UseExtraMemoryPool=*/TRUE,
-                       /*ClearNonPoolBuffer=*/FALSE);
+  BOOL useReadBuffer =
+      CreateReadResult(IoEvent, bufferLength, &readBufferOffset);
+  if (!IoEvent->EventResult) {
+    // No memory for the data, the read fails with an empty result.
+    DbgPrint("Dokan Error: Failed to allocate the result of a read.\n");
+    CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/FALSE);
+    FillReadResult(IoEvent, STATUS_NO_MEMORY, 0);
+    EventCompletion(IoEvent);
+    return TRUE;
+  }
+  PVOID buffer = IoEvent->EventResult->Buffer;
+  if (useReadBuffer) {
+    // The driver takes the data from the registered buffer at this offset.
+    IoEvent->EventResult->Flags |=
+        DOKAN_EVENT_INFO_FIXED_SIZE | DOKAN_EVENT_INFO_READ_BUFFER;
+    IoEvent->EventResult->Operation.Read.BufferOffset = readBufferOffset;
+    buffer = IoEvent->DokanInstance->ReadBuffer.Base + readBufferOffset;
+  }
 
   DbgPrint("###Read file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
            IoEvent->DokanOpenInfo,
@@ -39,28 +270,33 @@ VOID DispatchRead(PDOKAN_IO_EVENT IoEvent) {
                                           : -1,
            IoEvent);
 
-  if (IoEvent->DokanInstance->DokanOperations->ReadFile) {
-    status = IoEvent->DokanInstance->DokanOperations->ReadFile(
-        IoEvent->EventContext->Operation.Read.FileName,
-        IoEvent->EventResult->Buffer,
-        IoEvent->EventContext->Operation.Read.BufferLength, &readLength,
+  // Written data still buffered has to reach the backend first.
+  DokanWriteBehind_FlushRange(
+      IoEvent->DokanInstance, IoEvent->EventContext->Operation.Read.FileName,
+      IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart, bufferLength);
+  NTSTATUS writeBehindError = DokanWriteBehind_TakeError(IoEvent);
+  if (writeBehindError != STATUS_SUCCESS) {
+    status = writeBehindError;
+  } else if (DokanReadAhead_Read(IoEvent, buffer, bufferLength,
+                                 &readLength)) {
+    status = STATUS_SUCCESS;
+  } else {
+    status = CallReadFile(
+        IoEvent->DokanInstance, IoEvent->EventContext->Operation.Read.FileName,
+        buffer, bufferLength, &readLength,
         IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart,
         &IoEvent->DokanFileInfo);
+    if (status == STATUS_SUCCESS) {
+      DokanReadAhead_OnRead(IoEvent, readLength);
+    }
   }
 
-  IoEvent->EventResult->BufferLength = 0;
-  IoEvent->EventResult->Status = status;
-
-  if (status == STATUS_SUCCESS) {
-    if (readLength == 0) {
-      IoEvent->EventResult->Status = STATUS_END_OF_FILE;
-    } else {
-      IoEvent->EventResult->BufferLength = readLength;
-      IoEvent->EventResult->Operation.Read.CurrentByteOffset.QuadPart =
-          IoEvent->EventContext->Operation.Read.ByteOffset.QuadPart +
-          readLength;
-    }
+  if (status == STATUS_PENDING) {
+    // Completed by DokanEndDispatchRead, possibly already.
+    return SetIoEventPending(IoEvent);
   }
 
+  FillReadResult(IoEvent, status, readLength);
   EventCompletion(IoEvent);
+  return TRUE;
 }
@@ -135,8 +135,7 @@ VOID DispatchQuerySecurity(PDOKAN_IO_EVENT IoEvent) {
 
   CreateDispatchCommon(IoEvent,
                        IoEvent->EventContext->Operation.Security.BufferLength,
-                       /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+                       /*ClearBuffer=*/TRUE);
 
   DbgPrint("###GetFileSecurity file handle = 0x%p, eventID = %04d, event Info "
            "= 0x%p\n",
@@ -186,8 +185,7 @@ VOID DispatchSetSecurity(PDOKAN_IO_EVENT IoEvent) {
 
   CheckFileName(IoEvent->EventContext->Operation.SetSecurity.FileName);
 
-  CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+  CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/TRUE);
 
   DbgPrint(
       "###SetSecurity file handle = 0x%p, eventID = %04d, event Info = 0x%p\n",
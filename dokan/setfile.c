@@ -23,6 +23,8 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdlib.h>
 #include "dokani.h"
+#include "dokan_readahead.h"
+#include "dokan_writebehind.h"
 #include "fileinfo.h"
 
 NTSTATUS
@@ -211,15 +213,24 @@ VOID DispatchSetInformation(PDOKAN_IO_EVENT IoEvent) {
                                     IoEvent->EventContext->Operation.SetFile
                                         .BufferOffset);
     CreateDispatchCommon(IoEvent, renameInfo->FileNameLength,
-                         /*UseExtraMemoryPool=*/FALSE,
-                         /*ClearNonPoolBuffer=*/TRUE);
+                         /*ClearBuffer=*/TRUE);
   } else {
-    CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
-                         /*ClearNonPoolBuffer=*/TRUE);
+    CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/TRUE);
   }
 
   CheckFileName(IoEvent->EventContext->Operation.SetFile.FileName);
 
+  // Buffered writes have to reach the file before it changes. A renamed
+  // directory moves the files under it.
+  if (fileInformationClass == FileRenameInformation ||
+      fileInformationClass == FileRenameInformationEx) {
+    DokanWriteBehind_FlushAll(IoEvent->DokanInstance);
+  } else {
+    DokanWriteBehind_FlushFile(
+        IoEvent->DokanInstance,
+        IoEvent->EventContext->Operation.SetFile.FileName);
+  }
+
   DbgPrint(
       "###SetFileInfo file handle = 0x%p, eventID = %04d, FileInformationClass "
       "= %d, event Info = 0x%p\n",
@@ -278,6 +289,41 @@ VOID DispatchSetInformation(PDOKAN_IO_EVENT IoEvent) {
   IoEvent->EventResult->BufferLength = 0;
   IoEvent->EventResult->Status = status;
 
+  // Even a failed change can have been partly applied.
+  if (fileInformationClass == FileRenameInformation ||
+      fileInformationClass == FileRenameInformationEx) {
+    ClearFileInfoCache(IoEvent->DokanInstance);
+    ClearNegativeLookupCache(IoEvent->DokanInstance);
+    ClearDirectoryListCache(IoEvent->DokanInstance);
+  } else {
+    InvalidateFileInfoCache(IoEvent->DokanInstance,
+                            IoEvent->EventContext->Operation.SetFile.FileName);
+    InvalidateDirectoryListCache(
+        IoEvent->DokanInstance,
+        IoEvent->EventContext->Operation.SetFile.FileName);
+  }
+
+  if (fileInformationClass == FileAllocationInformation ||
+      fileInformationClass == FileEndOfFileInformation ||
+      fileInformationClass == FileValidDataLengthInformation ||
+      fileInformationClass == FileRenameInformation ||
+      fileInformationClass == FileRenameInformationEx) {
+    // The prefetched data of the file, or of the file replaced by the rename,
+    // might no longer be right.
+    LPCWSTR fileName = IoEvent->EventContext->Operation.SetFile.FileName;
+    DokanReadAhead_Invalidate(IoEvent->DokanInstance, fileName,
+                              (ULONG)wcslen(fileName));
+    if (fileInformationClass == FileRenameInformation ||
+        fileInformationClass == FileRenameInformationEx) {
+      PDOKAN_RENAME_INFORMATION renameInfo =
+          (PDOKAN_RENAME_INFORMATION)((PCHAR)IoEvent->EventContext +
+                                      IoEvent->EventContext->Operation.SetFile
+                                          .BufferOffset);
+      DokanReadAhead_Invalidate(IoEvent->DokanInstance, renameInfo->FileName,
+                                renameInfo->FileNameLength / sizeof(WCHAR));
+    }
+  }
+
   if (status == STATUS_SUCCESS) {
     if (fileInformationClass == FileDispositionInformation ||
         fileInformationClass == FileDispositionInformationEx) {
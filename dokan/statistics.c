@@ -0,0 +1,203 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+#include "dokan_pool.h"
+
+#include <malloc.h>
+
+// Performance counter ticks per second, constant since system boot.
+static LARGE_INTEGER g_PerformanceFrequency;
+
+PDOKAN_CPU_STATISTICS AllocateInstanceStatistics() {
+  if (!g_PerformanceFrequency.QuadPart) {
+    QueryPerformanceFrequency(&g_PerformanceFrequency);
+  }
+  PDOKAN_CPU_STATISTICS statistics = (PDOKAN_CPU_STATISTICS)_aligned_malloc(
+      sizeof(DOKAN_CPU_STATISTICS) * DOKAN_STATISTICS_CPU_SLOT_COUNT,
+      SYSTEM_CACHE_ALIGNMENT_SIZE);
+  if (statistics) {
+    ZeroMemory(statistics,
+               sizeof(DOKAN_CPU_STATISTICS) * DOKAN_STATISTICS_CPU_SLOT_COUNT);
+  }
+  return statistics;
+}
+
+VOID FreeInstanceStatistics(PDOKAN_CPU_STATISTICS Statistics) {
+  if (Statistics) {
+    _aligned_free(Statistics);
+  }
+}
+
+// Returns the counters slot of the current processor. The thread can be
+// moved to another processor at any time so slots are still updated with
+// interlocked operations, they just rarely contend.
+static PDOKAN_CPU_STATISTICS GetCpuStatistics(PDOKAN_INSTANCE DokanInstance) {
+  if (!DokanInstance->Statistics) {
+    return NULL;
+  }
+  return &DokanInstance->Statistics[GetCurrentProcessorNumber() %
+                                    DOKAN_STATISTICS_CPU_SLOT_COUNT];
+}
+
+VOID RecordPulledBatch(PDOKAN_INSTANCE DokanInstance, ULONG EventCount) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (!statistics || !EventCount) {
+    return;
+  }
+  ULONG bucket = 0;
+  while (bucket + 1 < DOKAN_STATISTICS_BATCH_SIZE_BUCKET_COUNT &&
+         (EventCount >> (bucket + 1))) {
+    ++bucket;
+  }
+  InterlockedIncrementNoFence64(&statistics->PulledBatches);
+  InterlockedAddNoFence64(&statistics->PulledEvents, EventCount);
+  InterlockedIncrementNoFence64(&statistics->PulledBatchSizes[bucket]);
+}
+
+VOID RecordQueuedEvent(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->QueuedEvents);
+  }
+}
+
+VOID RecordDispatchedEvent(PDOKAN_INSTANCE DokanInstance, ULONG MajorFunction) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics && MajorFunction < DOKAN_STATISTICS_MAJOR_FUNCTION_COUNT) {
+    InterlockedIncrementNoFence64(
+        &statistics->MajorFunctionEvents[MajorFunction]);
+  }
+}
+
+VOID RecordDeferredEvent(PDOKAN_INSTANCE DokanInstance, ULONG DispatchClass) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics && DispatchClass < DOKAN_STATISTICS_DISPATCH_CLASS_COUNT) {
+    InterlockedIncrementNoFence64(&statistics->DeferredEvents[DispatchClass]);
+  }
+}
+
+VOID RecordDispatchLatency(PDOKAN_INSTANCE DokanInstance, ULONG DispatchClass,
+                           PLARGE_INTEGER PullTime) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (!statistics || DispatchClass >= DOKAN_STATISTICS_DISPATCH_CLASS_COUNT ||
+      !PullTime->QuadPart || !g_PerformanceFrequency.QuadPart) {
+    return;
+  }
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  ULONG64 microseconds = (ULONG64)(now.QuadPart - PullTime->QuadPart) *
+                         1000000 / g_PerformanceFrequency.QuadPart;
+  ULONG bucket = 0;
+  while (bucket + 1 < DOKAN_STATISTICS_LATENCY_BUCKET_COUNT &&
+         (microseconds >> (bucket + 1))) {
+    ++bucket;
+  }
+  InterlockedIncrementNoFence64(
+      &statistics->DispatchLatencies[DispatchClass][bucket]);
+}
+
+VOID RecordBufferedWrite(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->BufferedWrites);
+  }
+}
+
+VOID RecordWriteBehindFlush(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->WriteBehindFlushes);
+  }
+}
+
+VOID RecordFileInfoCacheHit(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->FileInfoCacheHits);
+  }
+}
+
+VOID RecordFileInfoCacheMiss(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->FileInfoCacheMisses);
+  }
+}
+
+VOID RecordNegativeLookupCacheHit(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->NegativeLookupCacheHits);
+  }
+}
+
+VOID RecordDirectoryListCacheHit(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->DirectoryListCacheHits);
+  }
+}
+
+VOID RecordDirectoryListCacheMiss(PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_CPU_STATISTICS statistics = GetCpuStatistics(DokanInstance);
+  if (statistics) {
+    InterlockedIncrementNoFence64(&statistics->DirectoryListCacheMisses);
+  }
+}
+
+BOOL DOKANAPI DokanGetRuntimeStatistics(
+    _In_ DOKAN_HANDLE DokanInstance,
+    _Out_ PDOKAN_RUNTIME_STATISTICS Statistics) {
+  PDOKAN_INSTANCE instance = (PDOKAN_INSTANCE)DokanInstance;
+  if (!instance || !Statistics) {
+    return FALSE;
+  }
+  ZeroMemory(Statistics, sizeof(DOKAN_RUNTIME_STATISTICS));
+  if (instance->Statistics) {
+    for (ULONG i = 0; i < DOKAN_STATISTICS_CPU_SLOT_COUNT; ++i) {
+      PDOKAN_CPU_STATISTICS slot = &instance->Statistics[i];
+      Statistics->PulledBatches += slot->PulledBatches;
+      Statistics->PulledEvents += slot->PulledEvents;
+      for (ULONG j = 0; j < DOKAN_STATISTICS_BATCH_SIZE_BUCKET_COUNT; ++j) {
+        Statistics->PulledBatchSizes[j] += slot->PulledBatchSizes[j];
+      }
+      Statistics->QueuedEvents += slot->QueuedEvents;
+      for (ULONG j = 0; j < DOKAN_STATISTICS_MAJOR_FUNCTION_COUNT; ++j) {
+        Statistics->MajorFunctionEvents[j] += slot->MajorFunctionEvents[j];
+      }
+      for (ULONG j = 0; j < DOKAN_STATISTICS_DISPATCH_CLASS_COUNT; ++j) {
+        Statistics->DeferredEvents[j] += slot->DeferredEvents[j];
+        for (ULONG k = 0; k < DOKAN_STATISTICS_LATENCY_BUCKET_COUNT; ++k) {
+          Statistics->DispatchLatencies[j][k] += slot->DispatchLatencies[j][k];
+        }
+      }
+      Statistics->BufferedWrites += slot->BufferedWrites;
+      Statistics->WriteBehindFlushes += slot->WriteBehindFlushes;
+      Statistics->FileInfoCacheHits += slot->FileInfoCacheHits;
+      Statistics->FileInfoCacheMisses += slot->FileInfoCacheMisses;
+      Statistics->NegativeLookupCacheHits += slot->NegativeLookupCacheHits;
+      Statistics->DirectoryListCacheHits += slot->DirectoryListCacheHits;
+      Statistics->DirectoryListCacheMisses += slot->DirectoryListCacheMisses;
+    }
+  }
+  GetPoolStatistics(Statistics);
+  return TRUE;
+}
@@ -306,8 +306,7 @@ DokanFsFullSizeInformation(PEVENT_INFORMATION EventInfo,
 VOID DispatchQueryVolumeInformation(PDOKAN_IO_EVENT IoEvent) {
   CreateDispatchCommon(IoEvent,
                        IoEvent->EventContext->Operation.Volume.BufferLength,
-                       /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+                       /*ClearBuffer=*/TRUE);
 
   DbgPrint("###QueryVolumeInfo file handle = 0x%p, eventID = %04d, event Info "
            "= 0x%p\n",
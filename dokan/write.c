@@ -22,6 +22,8 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 #include "dokan_pool.h"
+#include "dokan_readahead.h"
+#include "dokan_writebehind.h"
 
 #include <assert.h>
 
@@ -29,15 +31,17 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 DWORD SendWriteRequest(PDOKAN_IO_EVENT IoEvent, ULONG WriteEventContextLength,
                        PDOKAN_IO_BATCH *WriteIoBatch) {
   DWORD WrittenLength = 0;
-  if (WriteEventContextLength <= BATCH_EVENT_CONTEXT_SIZE) {
-    *WriteIoBatch = PopIoBatchBuffer();
+  if (WriteEventContextLength <=
+      IoEvent->DokanInstance->IoBatchPool.BufferLength) {
+    *WriteIoBatch = PopIoBatchBuffer(IoEvent->DokanInstance);
   } else {
-    *WriteIoBatch = malloc((SIZE_T)FIELD_OFFSET(DOKAN_IO_BATCH, EventContext) +
-                           WriteEventContextLength);
+    *WriteIoBatch = malloc(DOKAN_IO_BATCH_SIZE(WriteEventContextLength));
     if (!*WriteIoBatch) {
       DokanDbgPrintW(L"Dokan Error: Failed to allocate IO event buffer.\n");
       return ERROR_NO_SYSTEM_RESOURCES;
     }
+    RtlZeroMemory(*WriteIoBatch, FIELD_OFFSET(DOKAN_IO_BATCH, EventContext));
+    (*WriteIoBatch)->DokanInstance = IoEvent->DokanInstance;
     (*WriteIoBatch)->PoolAllocated = FALSE;
   }
 
@@ -56,13 +60,89 @@ DWORD SendWriteRequest(PDOKAN_IO_EVENT IoEvent, ULONG WriteEventContextLength,
   return 0;
 }
 
-VOID DispatchWrite(PDOKAN_IO_EVENT IoEvent) {
+NTSTATUS CallWriteFile(PDOKAN_INSTANCE DokanInstance, LPCWSTR FileName,
+                       PVOID Buffer, DWORD NumberOfBytesToWrite,
+                       LPDWORD NumberOfBytesWritten, LONGLONG Offset,
+                       PDOKAN_FILE_INFO DokanFileInfo) {
+  NTSTATUS status = STATUS_NOT_IMPLEMENTED;
+  if (DokanInstance->DokanOperations->WriteFileGather) {
+    DOKAN_IO_SEGMENT stackSegments[DOKAN_IO_SEGMENT_STACK_COUNT];
+    DWORD segmentCount = 0;
+    PDOKAN_IO_SEGMENT segments = SplitIoSegments(
+        stackSegments, DOKAN_IO_SEGMENT_STACK_COUNT, Buffer,
+        NumberOfBytesToWrite, Offset,
+        DokanInstance->DokanOptions->IoSegmentSize, &segmentCount);
+    if (segments) {
+      status = DokanInstance->DokanOperations->WriteFileGather(
+          FileName, segments, segmentCount, NumberOfBytesWritten,
+          DokanFileInfo);
+      if (segments != stackSegments) {
+        free(segments);
+      }
+    } else {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+  } else if (DokanInstance->DokanOperations->WriteFile) {
+    status = DokanInstance->DokanOperations->WriteFile(
+        FileName, Buffer, NumberOfBytesToWrite, NumberOfBytesWritten, Offset,
+        DokanFileInfo);
+  }
+  return status;
+}
+
+static VOID FillWriteResult(PDOKAN_IO_EVENT IoEvent, NTSTATUS Status,
+                            ULONG WrittenLength) {
+  PDOKAN_IO_BATCH writeIoBatch = IoEvent->WriteIoBatch;
+
+  IoEvent->EventResult->Status = Status;
+  IoEvent->EventResult->BufferLength = 0;
+
+  if (Status == STATUS_SUCCESS) {
+    IoEvent->EventResult->BufferLength = WrittenLength;
+    IoEvent->EventResult->Operation.Write.CurrentByteOffset.QuadPart =
+        IoEvent->EventContext->Operation.Write.ByteOffset.QuadPart +
+        WrittenLength;
+  }
+
+  // Even a failed write can have changed part of the data.
+  DokanReadAhead_Invalidate(
+      IoEvent->DokanInstance, IoEvent->EventContext->Operation.Write.FileName,
+      (ULONG)wcslen(IoEvent->EventContext->Operation.Write.FileName));
+  InvalidateFileInfoCache(IoEvent->DokanInstance,
+                          IoEvent->EventContext->Operation.Write.FileName);
+  InvalidateDirectoryListCache(IoEvent->DokanInstance,
+                               IoEvent->EventContext->Operation.Write.FileName);
+
+  if (writeIoBatch != IoEvent->IoBatch) {
+    PushIoBatchBuffer(writeIoBatch);
+  }
+  IoEvent->WriteIoBatch = NULL;
+}
+
+VOID DOKANAPI DokanEndDispatchWrite(PDOKAN_FILE_INFO DokanFileInfo,
+                                    NTSTATUS Status,
+                                    DWORD NumberOfBytesWritten) {
+  PDOKAN_IO_EVENT ioEvent =
+      (PDOKAN_IO_EVENT)(UINT_PTR)DokanFileInfo->DokanContext;
+
+  // STATUS_PENDING should not be passed to this function
+  if (Status == STATUS_PENDING) {
+    DbgPrint("Dokan Error: DokanEndDispatchWrite() failed because "
+             "STATUS_PENDING was supplied for Status.\n");
+    Status = STATUS_INTERNAL_ERROR;
+  }
+
+  FillWriteResult(ioEvent, Status, NumberOfBytesWritten);
+  DbgPrint("\tDokanEndDispatchWrite result =  0x%x\n", Status);
+  CompleteIoEvent(ioEvent);
+}
+
+BOOL DispatchWrite(PDOKAN_IO_EVENT IoEvent) {
   PDOKAN_IO_BATCH writeIoBatch = IoEvent->IoBatch;
   ULONG writtenLength = 0;
   NTSTATUS status;
 
-  CreateDispatchCommon(IoEvent, 0, /*UseExtraMemoryPool=*/FALSE,
-                       /*ClearNonPoolBuffer=*/TRUE);
+  CreateDispatchCommon(IoEvent, 0, /*ClearBuffer=*/TRUE);
 
   CheckFileName(IoEvent->EventContext->Operation.Write.FileName);
   DbgPrint(
@@ -94,37 +174,35 @@ VOID DispatchWrite(PDOKAN_IO_EVENT IoEvent) {
                  error, IoEvent->EventResult->Status);
       }
       EventCompletion(IoEvent);
-      return;
+      return TRUE;
     }
   }
+  // Kept until the result is filled, which can happen asynchronously.
+  IoEvent->WriteIoBatch = writeIoBatch;
+  // The data was pulled with the event, which is not necessarily the first
+  // of its batch, unless it had to be requested separately.
+  PEVENT_CONTEXT writeEventContext = writeIoBatch == IoEvent->IoBatch
+                                         ? IoEvent->EventContext
+                                         : writeIoBatch->EventContext;
 
   // for the case SendWriteRequest success
-  if (IoEvent->DokanInstance->DokanOperations->WriteFile) {
-    status = IoEvent->DokanInstance->DokanOperations->WriteFile(
-        writeIoBatch->EventContext->Operation.Write.FileName,
-        (PCHAR)writeIoBatch->EventContext +
-            writeIoBatch->EventContext->Operation.Write.BufferOffset,
-        writeIoBatch->EventContext->Operation.Write.BufferLength,
-        &writtenLength,
-        writeIoBatch->EventContext->Operation.Write.ByteOffset.QuadPart,
+  if (!DokanWriteBehind_Write(IoEvent, writeEventContext, &status,
+                              &writtenLength)) {
+    status = CallWriteFile(
+        IoEvent->DokanInstance, writeEventContext->Operation.Write.FileName,
+        (PCHAR)writeEventContext +
+            writeEventContext->Operation.Write.BufferOffset,
+        writeEventContext->Operation.Write.BufferLength, &writtenLength,
+        writeEventContext->Operation.Write.ByteOffset.QuadPart,
         &IoEvent->DokanFileInfo);
-  } else {
-    status = STATUS_NOT_IMPLEMENTED;
   }
 
-  IoEvent->EventResult->Status = status;
-  IoEvent->EventResult->BufferLength = 0;
-
-  if (status == STATUS_SUCCESS) {
-    IoEvent->EventResult->BufferLength = writtenLength;
-    IoEvent->EventResult->Operation.Write.CurrentByteOffset.QuadPart =
-        writeIoBatch->EventContext->Operation.Write.ByteOffset.QuadPart +
-        writtenLength;
-  }
-
-  if (writeIoBatch != IoEvent->IoBatch) {
-    PushIoBatchBuffer(writeIoBatch);
+  if (status == STATUS_PENDING) {
+    // Completed by DokanEndDispatchWrite, possibly already.
+    return SetIoEventPending(IoEvent);
   }
 
+  FillWriteResult(IoEvent, status, writtenLength);
   EventCompletion(IoEvent);
+  return TRUE;
 }
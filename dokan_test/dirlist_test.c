@@ -0,0 +1,263 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_test.h"
+#include "dokan_dirlist.h"
+
+// Enough entries to grow both the arena and the offsets past their initial
+// capacities.
+#define TEST_ENTRY_COUNT 5000
+
+static VOID SetFindData(PWIN32_FIND_DATAW FindData, ULONG Index) {
+  ZeroMemory(FindData, sizeof(WIN32_FIND_DATAW));
+  FindData->dwFileAttributes =
+      Index % 2 ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+  FindData->ftCreationTime.dwLowDateTime = Index;
+  FindData->ftLastAccessTime.dwLowDateTime = Index + 1;
+  FindData->ftLastWriteTime.dwHighDateTime = Index + 2;
+  FindData->nFileSizeHigh = Index;
+  FindData->nFileSizeLow = Index * 3;
+  // Names of different lengths to move the entries off a fixed stride.
+  swprintf_s(FindData->cFileName, MAX_PATH, L"file%lu%.*ls", Index,
+             (int)(Index % 7), L"_______");
+}
+
+static BOOL IsEntryOf(PDOKAN_DIRECTORY_ENTRY Entry,
+                      PWIN32_FIND_DATAW FindData) {
+  return Entry->FileAttributes == FindData->dwFileAttributes &&
+         Entry->CreationTime.dwLowDateTime ==
+             FindData->ftCreationTime.dwLowDateTime &&
+         Entry->LastAccessTime.dwLowDateTime ==
+             FindData->ftLastAccessTime.dwLowDateTime &&
+         Entry->LastWriteTime.dwHighDateTime ==
+             FindData->ftLastWriteTime.dwHighDateTime &&
+         Entry->FileSize == (((ULONG64)FindData->nFileSizeHigh << 32) |
+                             FindData->nFileSizeLow) &&
+         Entry->FileNameLength == wcslen(FindData->cFileName) &&
+         wcscmp(Entry->FileName, FindData->cFileName) == 0;
+}
+
+// Returns whether the entries of List are the ones set by SetFindData for
+// the indexes First to First + Count - 1.
+static BOOL HasEntries(PDOKAN_DIRECTORY_LIST List, ULONG First, ULONG Count) {
+  WIN32_FIND_DATAW findData;
+  if (DokanDirectoryList_GetCount(List) != Count) {
+    return FALSE;
+  }
+  for (ULONG i = 0; i < Count; ++i) {
+    PDOKAN_DIRECTORY_ENTRY entry = DokanDirectoryList_GetEntry(List, i);
+    SetFindData(&findData, First + i);
+    if (((ULONG_PTR)entry & 7) != 0 || !IsEntryOf(entry, &findData)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static VOID TestEntryBuffer() {
+  WIN32_FIND_DATAW findData;
+  DOKAN_DIRECTORY_ENTRY_BUFFER buffer;
+  SetFindData(&findData, 12);
+  DokanDirectoryEntry_Initialize(&buffer.Entry, &findData,
+                                 (ULONG)wcslen(findData.cFileName));
+  CHECK(IsEntryOf(&buffer.Entry, &findData));
+
+  // The longest name a WIN32_FIND_DATAW can hold.
+  for (ULONG i = 0; i < MAX_PATH - 1; ++i) {
+    findData.cFileName[i] = L'a';
+  }
+  findData.cFileName[MAX_PATH - 1] = L'\0';
+  DokanDirectoryEntry_Initialize(&buffer.Entry, &findData, MAX_PATH - 1);
+  CHECK(IsEntryOf(&buffer.Entry, &findData));
+}
+
+static VOID TestPush() {
+  WIN32_FIND_DATAW findData;
+  PDOKAN_DIRECTORY_LIST list = DokanDirectoryList_Alloc();
+  CHECK(list != NULL);
+  if (!list) {
+    return;
+  }
+  CHECK(DokanDirectoryList_GetCount(list) == 0);
+
+  for (ULONG i = 2; i < TEST_ENTRY_COUNT; ++i) {
+    SetFindData(&findData, i);
+    CHECK(DokanDirectoryList_PushBack(list, &findData));
+  }
+  CHECK(HasEntries(list, 2, TEST_ENTRY_COUNT - 2));
+
+  // Entries pushed in front come first, like "." and ".." ahead of the
+  // listing of the file system.
+  SetFindData(&findData, 1);
+  CHECK(DokanDirectoryList_PushFront(list, &findData));
+  SetFindData(&findData, 0);
+  CHECK(DokanDirectoryList_PushFront(list, &findData));
+  CHECK(HasEntries(list, 0, TEST_ENTRY_COUNT));
+
+  // Clearing keeps the memory for the next listing.
+  SIZE_T allocatedSize = DokanDirectoryList_GetAllocatedSize(list);
+  DokanDirectoryList_Clear(list);
+  CHECK(DokanDirectoryList_GetCount(list) == 0);
+  CHECK(DokanDirectoryList_GetAllocatedSize(list) == allocatedSize);
+  SetFindData(&findData, 7);
+  CHECK(DokanDirectoryList_PushFront(list, &findData));
+  SetFindData(&findData, 8);
+  CHECK(DokanDirectoryList_PushBack(list, &findData));
+  CHECK(HasEntries(list, 7, 2));
+  CHECK(DokanDirectoryList_GetAllocatedSize(list) == allocatedSize);
+  DokanDirectoryList_Free(list);
+}
+
+static VOID TestCopy() {
+  WIN32_FIND_DATAW findData;
+  PDOKAN_DIRECTORY_LIST source = DokanDirectoryList_Alloc();
+  PDOKAN_DIRECTORY_LIST destination = DokanDirectoryList_Alloc();
+  CHECK(source != NULL && destination != NULL);
+  if (!source || !destination) {
+    DokanDirectoryList_Free(source);
+    DokanDirectoryList_Free(destination);
+    return;
+  }
+
+  // Copying an empty list into an empty one.
+  CHECK(DokanDirectoryList_Copy(destination, source));
+  CHECK(DokanDirectoryList_GetCount(destination) == 0);
+
+  // Copying into a smaller list grows it.
+  for (ULONG i = 0; i < TEST_ENTRY_COUNT; ++i) {
+    SetFindData(&findData, i);
+    CHECK(DokanDirectoryList_PushBack(source, &findData));
+  }
+  SetFindData(&findData, 0);
+  CHECK(DokanDirectoryList_PushBack(destination, &findData));
+  CHECK(DokanDirectoryList_Copy(destination, source));
+  CHECK(HasEntries(destination, 0, TEST_ENTRY_COUNT));
+
+  // The copy does not share memory with the source.
+  DokanDirectoryList_Clear(source);
+  for (ULONG i = 0; i < 3; ++i) {
+    SetFindData(&findData, 100 + i);
+    CHECK(DokanDirectoryList_PushBack(source, &findData));
+  }
+  CHECK(HasEntries(destination, 0, TEST_ENTRY_COUNT));
+
+  // Copying into a larger list replaces all its entries.
+  CHECK(DokanDirectoryList_Copy(destination, source));
+  CHECK(HasEntries(destination, 100, 3));
+  DokanDirectoryList_Clear(source);
+  CHECK(DokanDirectoryList_Copy(destination, source));
+  CHECK(DokanDirectoryList_GetCount(destination) == 0);
+
+  DokanDirectoryList_Free(source);
+  DokanDirectoryList_Free(destination);
+}
+
+VOID TestDirectoryList() {
+  TestEntryBuffer();
+  TestPush();
+  TestCopy();
+}
+
+// Listing in an array of WIN32_FIND_DATAW doubled when full, how the
+// listings were held before the arena.
+typedef struct _BENCHMARK_FIND_DATA_ARRAY {
+  PWIN32_FIND_DATAW Items;
+  ULONG Count;
+  ULONG Capacity;
+} BENCHMARK_FIND_DATA_ARRAY, *PBENCHMARK_FIND_DATA_ARRAY;
+
+static BOOL PushFindData(PBENCHMARK_FIND_DATA_ARRAY Array,
+                         PWIN32_FIND_DATAW FindData) {
+  if (Array->Count == Array->Capacity) {
+    ULONG capacity = Array->Capacity ? Array->Capacity * 2 : 128;
+    PWIN32_FIND_DATAW items =
+        realloc(Array->Items, capacity * sizeof(WIN32_FIND_DATAW));
+    if (!items) {
+      return FALSE;
+    }
+    Array->Items = items;
+    Array->Capacity = capacity;
+  }
+  Array->Items[Array->Count++] = *FindData;
+  return TRUE;
+}
+
+static VOID PrintListing(LPCSTR Name, ULONG Count, SIZE_T Memory,
+                         double FillMs, double ReadMs) {
+  printf("%s, %lu entries: %.1f MB, %.0f bytes/entry, fill %.1f ms, "
+         "read %.1f ms\n",
+         Name, Count, Memory / (1024.0 * 1024.0), (double)Memory / Count,
+         FillMs, ReadMs);
+}
+
+// Memory and time to fill and read the names of listings of 10K, 100K and 1M
+// entries, in a DOKAN_DIRECTORY_LIST and in a WIN32_FIND_DATAW array.
+VOID BenchmarkDirectoryList() {
+  static const ULONG counts[] = {10000, 100000, 1000000};
+  WIN32_FIND_DATAW findData;
+  for (ULONG c = 0; c < ARRAYSIZE(counts); ++c) {
+    ULONG count = counts[c];
+    SIZE_T nameLength = 0;
+
+    PDOKAN_DIRECTORY_LIST list = DokanDirectoryList_Alloc();
+    LONGLONG start = BenchmarkStart();
+    for (ULONG i = 0; i < count; ++i) {
+      SetFindData(&findData, i);
+      if (!list || !DokanDirectoryList_PushBack(list, &findData)) {
+        fprintf(stderr, "Directory list benchmark setup failed.\n");
+        DokanDirectoryList_Free(list);
+        return;
+      }
+    }
+    double fillMs = BenchmarkElapsedMs(start);
+    start = BenchmarkStart();
+    for (ULONG i = 0; i < count; ++i) {
+      nameLength += DokanDirectoryList_GetEntry(list, i)->FileNameLength;
+    }
+    PrintListing("Directory list", count,
+                 DokanDirectoryList_GetAllocatedSize(list), fillMs,
+                 BenchmarkElapsedMs(start));
+    DokanDirectoryList_Free(list);
+
+    BENCHMARK_FIND_DATA_ARRAY array = {NULL, 0, 0};
+    start = BenchmarkStart();
+    for (ULONG i = 0; i < count; ++i) {
+      SetFindData(&findData, i);
+      if (!PushFindData(&array, &findData)) {
+        fprintf(stderr, "Directory list benchmark setup failed.\n");
+        free(array.Items);
+        return;
+      }
+    }
+    fillMs = BenchmarkElapsedMs(start);
+    start = BenchmarkStart();
+    for (ULONG i = 0; i < count; ++i) {
+      nameLength -= wcslen(array.Items[i].cFileName);
+    }
+    PrintListing("WIN32_FIND_DATAW array", count,
+                 array.Capacity * sizeof(WIN32_FIND_DATAW), fillMs,
+                 BenchmarkElapsedMs(start));
+    free(array.Items);
+    if (nameLength) {
+      fprintf(stderr, "Directory list benchmark names differ.\n");
+    }
+  }
+}
@@ -0,0 +1,85 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_test.h"
+
+#include <string.h>
+
+// Debug output switches of dokanc.h, defined by dokan.c in the library.
+BOOL g_DebugMode = FALSE;
+BOOL g_UseStdErr = FALSE;
+
+ULONG g_FailureCount = 0;
+
+typedef struct _DOKAN_TEST {
+  LPCSTR Name;
+  VOID (*Run)();
+} DOKAN_TEST;
+
+static const DOKAN_TEST g_Tests[] = {
+    {"Scheduler", TestScheduler},
+    {"DirectoryList", TestDirectoryList},
+    {"Pattern", TestPattern},
+    {"Magazine", TestMagazine},
+    {"Queue", TestQueue},
+    {"NameCache", TestNameCache},
+};
+
+static const DOKAN_TEST g_Benchmarks[] = {
+    {"Queue", BenchmarkQueue},
+    {"DirectoryList", BenchmarkDirectoryList},
+    {"Pattern", BenchmarkPattern},
+};
+
+LONGLONG BenchmarkStart() {
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart;
+}
+
+double BenchmarkElapsedMs(LONGLONG Start) {
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (double)(counter.QuadPart - Start) * 1000 / frequency.QuadPart;
+}
+
+static VOID RunBenchmarks() {
+  for (ULONG i = 0; i < ARRAYSIZE(g_Benchmarks); ++i) {
+    printf("== %s\n", g_Benchmarks[i].Name);
+    g_Benchmarks[i].Run();
+  }
+}
+
+int __cdecl main(int argc, char *argv[]) {
+  if (argc > 1 && _stricmp(argv[1], "/b") == 0) {
+    RunBenchmarks();
+    return EXIT_SUCCESS;
+  }
+  for (ULONG i = 0; i < ARRAYSIZE(g_Tests); ++i) {
+    ULONG failureCount = g_FailureCount;
+    g_Tests[i].Run();
+    fprintf(stderr, "%s: %s\n", g_Tests[i].Name,
+            g_FailureCount == failureCount ? "passed" : "FAILED");
+  }
+  return g_FailureCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
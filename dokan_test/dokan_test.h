@@ -0,0 +1,82 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DOKAN_TEST_H_
+#define DOKAN_TEST_H_
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Unit tests of the parts of the library that do not need the driver. Failed
+// checks are reported on stderr and make the process exit with a failure.
+
+extern ULONG g_FailureCount;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      ++g_FailureCount;                                                        \
+    }                                                                          \
+  } while (0)
+
+// Work stealing deque of dokan_scheduler.c.
+VOID TestScheduler();
+
+// Directory listings of dokan_dirlist.c.
+VOID TestDirectoryList();
+
+// Compiled search patterns of dokan_pattern.c.
+VOID TestPattern();
+
+// Object caches of dokan_magazine.c.
+VOID TestMagazine();
+
+// Dispatch queue of dokan_queue.c.
+VOID TestQueue();
+
+// Keyed caches of dokan_namecache.c.
+VOID TestNameCache();
+
+// Benchmarks, only run when the first argument is /b. They print their
+// results on stdout.
+
+// Returns the current time for BenchmarkElapsedMs.
+LONGLONG BenchmarkStart();
+
+// Milliseconds elapsed since Start.
+double BenchmarkElapsedMs(LONGLONG Start);
+
+// Dispatch rate of the queue and reused work object against a work object
+// per event.
+VOID BenchmarkQueue();
+
+// Memory and time of directory listings in the arena of dokan_dirlist.c
+// against an array of WIN32_FIND_DATAW.
+VOID BenchmarkDirectoryList();
+
+// Matching rate of the compiled patterns of dokan_pattern.c against
+// DokanIsNameInExpression.
+VOID BenchmarkPattern();
+
+#endif // DOKAN_TEST_H_
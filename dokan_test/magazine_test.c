@@ -0,0 +1,319 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_test.h"
+#include "dokan_magazine.h"
+#include "list.h"
+
+#define TEST_MAGAZINE_SIZE 4
+#define TEST_POOL_SIZE 64
+#define TEST_OBJECT_MAGIC 0x4D41475A
+#define TEST_THREAD_COUNT 4
+#define TEST_ROUND_COUNT 20000
+#define TEST_HELD_OBJECT_COUNT 24
+
+// Objects handed out by the caches record their owner so that an object given
+// to two threads at once is detected.
+typedef struct _TEST_OBJECT {
+  volatile LONG Owner;
+  LONG Magic;
+} TEST_OBJECT, *PTEST_OBJECT;
+
+static VOID InitializeCache(PDOKAN_OBJECT_CACHE Cache,
+                            PDOKAN_MAGAZINE_BUDGET Budget) {
+  Budget->DepotBytes = 0;
+  Budget->MemoryBudget = 0;
+  DokanObjectCache_Initialize(Cache, sizeof(TEST_OBJECT), TEST_MAGAZINE_SIZE,
+                              TEST_POOL_SIZE, Budget);
+}
+
+static VOID TestPrewarmAndTrim() {
+  DOKAN_MAGAZINE_BUDGET budget;
+  DOKAN_OBJECT_CACHE cache;
+  InitializeCache(&cache, &budget);
+
+  // The depot stops at the pool size.
+  DokanObjectCache_Prewarm(&cache, TEST_POOL_SIZE * 2);
+  CHECK(cache.DepotObjects == TEST_POOL_SIZE);
+  CHECK(cache.ResidentObjects == TEST_POOL_SIZE);
+  CHECK(budget.DepotBytes == TEST_POOL_SIZE * sizeof(TEST_OBJECT));
+
+  // An idle depot releases half of its magazines on each trim.
+  CHECK(DokanObjectCache_TrimIdle(&cache) == TEST_POOL_SIZE / 2);
+  CHECK(cache.DepotObjects == TEST_POOL_SIZE / 2);
+  CHECK(cache.ResidentObjects == TEST_POOL_SIZE / 2);
+
+  // A depot that handed out a magazine since the previous trim is kept.
+  PVOID object = DokanObjectCache_Pop(&cache, NULL, 0);
+  CHECK(object != NULL);
+  CHECK(cache.DepotObjects == TEST_POOL_SIZE / 2 - 1);
+  PDOKAN_THREAD_CACHE threadCache = DokanThreadCache_Alloc(1);
+  CHECK(threadCache != NULL);
+  PVOID threadObject = DokanObjectCache_Pop(&cache, threadCache, 0);
+  CHECK(threadObject != NULL);
+  CHECK(DokanObjectCache_TrimIdle(&cache) == 0);
+  DokanObjectCache_Push(&cache, threadCache, 0, threadObject);
+  DokanObjectCache_Push(&cache, NULL, 0, object);
+  DokanThreadCache_Free(threadCache, &cache);
+  CHECK(cache.Requests == 2);
+
+  DokanObjectCache_Cleanup(&cache);
+  CHECK(cache.ResidentObjects == 0);
+  CHECK(cache.DepotObjects == 0);
+}
+
+static VOID TestMemoryBudget() {
+  DOKAN_MAGAZINE_BUDGET budget;
+  DOKAN_OBJECT_CACHE first;
+  DOKAN_OBJECT_CACHE second;
+  InitializeCache(&first, &budget);
+  DokanObjectCache_Initialize(&second, sizeof(TEST_OBJECT), TEST_MAGAZINE_SIZE,
+                              TEST_POOL_SIZE, &budget);
+  budget.MemoryBudget = 3 * TEST_MAGAZINE_SIZE * sizeof(TEST_OBJECT);
+
+  // The budget is shared by the depots of both caches.
+  DokanObjectCache_Prewarm(&first, 2 * TEST_MAGAZINE_SIZE);
+  DokanObjectCache_Prewarm(&second, TEST_POOL_SIZE);
+  CHECK(first.DepotObjects == 2 * TEST_MAGAZINE_SIZE);
+  CHECK(second.DepotObjects == TEST_MAGAZINE_SIZE);
+  CHECK(second.ResidentObjects == TEST_MAGAZINE_SIZE);
+  CHECK(budget.DepotBytes == budget.MemoryBudget);
+
+  // A magazine that does not fit in the budget goes back to the heap.
+  PVOID object = DokanObjectCache_Pop(&second, NULL, 0);
+  PVOID other = DokanObjectCache_Pop(&second, NULL, 0);
+  CHECK(object && other);
+  CHECK(second.DepotObjects == TEST_MAGAZINE_SIZE - 2);
+  DokanObjectCache_Prewarm(&first, TEST_MAGAZINE_SIZE);
+  CHECK(first.DepotObjects == 2 * TEST_MAGAZINE_SIZE);
+  DokanObjectCache_Prewarm(&first, 2);
+  CHECK(first.DepotObjects == 2 * TEST_MAGAZINE_SIZE + 2);
+  CHECK(first.ResidentObjects == first.DepotObjects);
+  CHECK(first.HeapAllocations == 3 * TEST_MAGAZINE_SIZE + 2);
+  DokanObjectCache_Push(&second, NULL, 0, object);
+  DokanObjectCache_Push(&second, NULL, 0, other);
+  CHECK(second.DepotObjects == TEST_MAGAZINE_SIZE - 2);
+  CHECK(second.ResidentObjects == TEST_MAGAZINE_SIZE - 2);
+  CHECK(budget.DepotBytes == budget.MemoryBudget);
+
+  DokanObjectCache_Cleanup(&first);
+  DokanObjectCache_Cleanup(&second);
+  CHECK(first.ResidentObjects == 0);
+  CHECK(second.ResidentObjects == 0);
+}
+
+static VOID TestReclaimIdle() {
+  DOKAN_MAGAZINE_BUDGET budget;
+  DOKAN_OBJECT_CACHE cache;
+  InitializeCache(&cache, &budget);
+  LIST_ENTRY threadCaches;
+  InitializeListHead(&threadCaches);
+  PDOKAN_THREAD_CACHE threadCache = DokanThreadCache_Alloc(1);
+  CHECK(threadCache != NULL);
+  if (!threadCache) {
+    return;
+  }
+  InsertTailList(&threadCaches, &threadCache->ListEntry);
+
+  PVOID objects[TEST_MAGAZINE_SIZE];
+  for (ULONG i = 0; i < TEST_MAGAZINE_SIZE; ++i) {
+    objects[i] = DokanObjectCache_Pop(&cache, threadCache, 0);
+    CHECK(objects[i] != NULL);
+  }
+  for (ULONG i = 0; i < TEST_MAGAZINE_SIZE; ++i) {
+    DokanObjectCache_Push(&cache, threadCache, 0, objects[i]);
+  }
+  CHECK(cache.DepotObjects == 0);
+
+  // The thread cache was used since the previous reclaim and is kept.
+  CHECK(DokanThreadCache_ReclaimIdle(&threadCaches, &cache) == 0);
+  CHECK(threadCache->Magazines[0].Loaded != NULL);
+  // Idle since then, its magazines go back to the depot.
+  CHECK(DokanThreadCache_ReclaimIdle(&threadCaches, &cache) == 1);
+  CHECK(threadCache->Magazines[0].Loaded == NULL);
+  CHECK(threadCache->Magazines[0].Previous == NULL);
+  CHECK(cache.DepotObjects == TEST_MAGAZINE_SIZE);
+  CHECK(cache.ResidentObjects == TEST_MAGAZINE_SIZE);
+  CHECK(!threadCache->Reclaiming);
+
+  // The owner gets its objects back from the depot.
+  PVOID object = DokanObjectCache_Pop(&cache, threadCache, 0);
+  CHECK(object != NULL);
+  CHECK(cache.DepotObjects == 0);
+  CHECK(cache.HeapAllocations == TEST_MAGAZINE_SIZE);
+
+  // An owner racing with a reclaim bypasses its magazines.
+  threadCache->Reclaiming = TRUE;
+  DokanObjectCache_Push(&cache, threadCache, 0, object);
+  CHECK(cache.DepotObjects == 1);
+  CHECK(DokanObjectCache_Pop(&cache, threadCache, 0) == object);
+  CHECK(cache.Requests == 1);
+  threadCache->Reclaiming = FALSE;
+  DokanObjectCache_Push(&cache, threadCache, 0, object);
+
+  RemoveEntryList(&threadCache->ListEntry);
+  DokanThreadCache_Free(threadCache, &cache);
+  CHECK(cache.Requests == TEST_MAGAZINE_SIZE + 2);
+  CHECK(cache.ResidentObjects == cache.DepotObjects);
+  DokanObjectCache_Cleanup(&cache);
+  CHECK(cache.ResidentObjects == 0);
+}
+
+typedef struct _TEST_RECLAIM_CONTEXT {
+  DOKAN_MAGAZINE_BUDGET Budget;
+  DOKAN_OBJECT_CACHE Cache;
+  LIST_ENTRY ThreadCaches;
+  PDOKAN_THREAD_CACHE ThreadCacheList[TEST_THREAD_COUNT];
+  volatile LONG RunningThreads;
+  volatile LONG DoubleHandOuts;
+  volatile LONG ReclaimedCount;
+} TEST_RECLAIM_CONTEXT, *PTEST_RECLAIM_CONTEXT;
+
+typedef struct _TEST_RECLAIM_THREAD {
+  PTEST_RECLAIM_CONTEXT Context;
+  LONG Id;
+} TEST_RECLAIM_THREAD, *PTEST_RECLAIM_THREAD;
+
+static PTEST_OBJECT PopTestObject(PTEST_RECLAIM_CONTEXT Context,
+                                  PDOKAN_THREAD_CACHE ThreadCache, LONG Id) {
+  PTEST_OBJECT object =
+      (PTEST_OBJECT)DokanObjectCache_Pop(&Context->Cache, ThreadCache, 0);
+  if (!object) {
+    return NULL;
+  }
+  if (object->Magic != TEST_OBJECT_MAGIC) {
+    object->Magic = TEST_OBJECT_MAGIC;
+    object->Owner = Id;
+  } else if (InterlockedCompareExchange(&object->Owner, Id, 0) != 0) {
+    InterlockedIncrement(&Context->DoubleHandOuts);
+  }
+  return object;
+}
+
+static VOID PushTestObject(PTEST_RECLAIM_CONTEXT Context,
+                           PDOKAN_THREAD_CACHE ThreadCache, LONG Id,
+                           PTEST_OBJECT Object) {
+  if (InterlockedExchange(&Object->Owner, 0) != Id) {
+    InterlockedIncrement(&Context->DoubleHandOuts);
+  }
+  DokanObjectCache_Push(&Context->Cache, ThreadCache, 0, Object);
+}
+
+static DWORD WINAPI ReclaimOwnerThread(LPVOID Parameter) {
+  PTEST_RECLAIM_THREAD thread = (PTEST_RECLAIM_THREAD)Parameter;
+  PTEST_RECLAIM_CONTEXT context = thread->Context;
+  PDOKAN_THREAD_CACHE threadCache = context->ThreadCacheList[thread->Id - 1];
+  PTEST_OBJECT objects[TEST_HELD_OBJECT_COUNT];
+  for (ULONG round = 0; round < TEST_ROUND_COUNT; ++round) {
+    // Hold a varying number of objects to move magazines through the depot.
+    ULONG count = 1 + round % TEST_HELD_OBJECT_COUNT;
+    for (ULONG i = 0; i < count; ++i) {
+      objects[i] = PopTestObject(context, threadCache, thread->Id);
+    }
+    for (ULONG i = 0; i < count; ++i) {
+      if (objects[i]) {
+        PushTestObject(context, threadCache, thread->Id, objects[i]);
+      }
+    }
+    if (round % 64 == 0) {
+      // Leave the thread cache idle long enough to be reclaimed.
+      Sleep(1);
+    }
+  }
+  InterlockedDecrement(&context->RunningThreads);
+  return 0;
+}
+
+static DWORD WINAPI ReclaimThread(LPVOID Parameter) {
+  PTEST_RECLAIM_CONTEXT context = (PTEST_RECLAIM_CONTEXT)Parameter;
+  while (ReadAcquire(&context->RunningThreads) > 0) {
+    context->ReclaimedCount +=
+        DokanThreadCache_ReclaimIdle(&context->ThreadCaches, &context->Cache);
+    DokanObjectCache_TrimIdle(&context->Cache);
+    YieldProcessor();
+  }
+  return 0;
+}
+
+// Owners use their thread caches while another thread keeps reclaiming the
+// idle ones: no object may be handed out twice or lost.
+static VOID TestConcurrentReclaim() {
+  PTEST_RECLAIM_CONTEXT context =
+      (PTEST_RECLAIM_CONTEXT)calloc(1, sizeof(TEST_RECLAIM_CONTEXT));
+  CHECK(context != NULL);
+  if (!context) {
+    return;
+  }
+  InitializeCache(&context->Cache, &context->Budget);
+  InitializeListHead(&context->ThreadCaches);
+  for (ULONG i = 0; i < TEST_THREAD_COUNT; ++i) {
+    context->ThreadCacheList[i] = DokanThreadCache_Alloc(1);
+    CHECK(context->ThreadCacheList[i] != NULL);
+    if (!context->ThreadCacheList[i]) {
+      return;
+    }
+    InsertTailList(&context->ThreadCaches,
+                   &context->ThreadCacheList[i]->ListEntry);
+  }
+  context->RunningThreads = TEST_THREAD_COUNT;
+
+  TEST_RECLAIM_THREAD threads[TEST_THREAD_COUNT];
+  HANDLE handles[TEST_THREAD_COUNT + 1];
+  for (ULONG i = 0; i < TEST_THREAD_COUNT; ++i) {
+    threads[i].Context = context;
+    threads[i].Id = (LONG)i + 1;
+    handles[i] =
+        CreateThread(NULL, 0, ReclaimOwnerThread, &threads[i], 0, NULL);
+    CHECK(handles[i] != NULL);
+  }
+  handles[TEST_THREAD_COUNT] =
+      CreateThread(NULL, 0, ReclaimThread, context, 0, NULL);
+  CHECK(handles[TEST_THREAD_COUNT] != NULL);
+  WaitForMultipleObjects(TEST_THREAD_COUNT + 1, handles, TRUE, INFINITE);
+  for (ULONG i = 0; i < TEST_THREAD_COUNT + 1; ++i) {
+    CloseHandle(handles[i]);
+  }
+
+  CHECK(context->DoubleHandOuts == 0);
+  CHECK(context->ReclaimedCount > 0);
+  LONG64 requests = 0;
+  for (ULONG i = 0; i < TEST_THREAD_COUNT; ++i) {
+    requests += context->ThreadCacheList[i]->Magazines[0].Requests;
+    RemoveEntryList(&context->ThreadCacheList[i]->ListEntry);
+    DokanThreadCache_Free(context->ThreadCacheList[i], &context->Cache);
+  }
+  CHECK(context->Cache.Requests >= requests);
+  // Every object is back in the depot or in the heap.
+  CHECK(context->Cache.ResidentObjects == context->Cache.DepotObjects);
+  CHECK(context->Cache.DepotObjects <= TEST_POOL_SIZE);
+  CHECK(context->Budget.DepotBytes ==
+        context->Cache.DepotObjects * (LONG64)sizeof(TEST_OBJECT));
+  DokanObjectCache_Cleanup(&context->Cache);
+  CHECK(context->Cache.ResidentObjects == 0);
+  free(context);
+}
+
+VOID TestMagazine() {
+  TestPrewarmAndTrim();
+  TestMemoryBudget();
+  TestReclaimIdle();
+  TestConcurrentReclaim();
+}
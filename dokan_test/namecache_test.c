@@ -0,0 +1,205 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokan_test.h"
+#include "dokan_namecache.h"
+
+#define TEST_TTL_MS 60000
+
+typedef struct _TEST_PAYLOAD {
+  ULONG Value;
+  ULONG Padding[3];
+} TEST_PAYLOAD, *PTEST_PAYLOAD;
+
+// Owned payloads of the memory tests, a pointer to a heap allocated value.
+static LONG g_FreedPayloads;
+static BOOL g_FailCopies;
+
+static BOOL CopyOwnedPayload(PVOID Destination, const VOID *Payload) {
+  if (g_FailCopies) {
+    return FALSE;
+  }
+  *(PULONG)Destination = **(PULONG const *)Payload;
+  return TRUE;
+}
+
+static VOID FreeOwnedPayload(PVOID Payload) {
+  free(*(PULONG *)Payload);
+  ++g_FreedPayloads;
+}
+
+static BOOL InsertOwned(PDOKAN_NAME_CACHE Cache, LPCWSTR Name, ULONG Value,
+                        SIZE_T Memory) {
+  LONG64 generation;
+  ULONG found;
+  DokanNameCache_Lookup(Cache, Name, (ULONG)wcslen(Name), &found, &generation);
+  PULONG payload = malloc(sizeof(ULONG));
+  *payload = Value;
+  if (!DokanNameCache_Insert(Cache, Name, (ULONG)wcslen(Name), &payload,
+                             Memory, generation)) {
+    free(payload);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static BOOL LookupOwned(PDOKAN_NAME_CACHE Cache, LPCWSTR Name,
+                        PULONG Value) {
+  LONG64 generation;
+  return DokanNameCache_Lookup(Cache, Name, (ULONG)wcslen(Name), Value,
+                               &generation);
+}
+
+static VOID TestLookupInsert() {
+  DOKAN_NAME_CACHE cache;
+  CHECK(DokanNameCache_Initialize(&cache, 64, sizeof(TEST_PAYLOAD),
+                                  TEST_TTL_MS, 0, FALSE, NULL, NULL));
+  TEST_PAYLOAD payload = {42, {0}};
+  TEST_PAYLOAD found = {0, {0}};
+  LONG64 generation;
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, &found, &generation));
+  CHECK(DokanNameCache_Insert(&cache, L"\\a", 2, &payload, 0, generation));
+  CHECK(DokanNameCache_Lookup(&cache, L"\\a", 2, &found, &generation));
+  CHECK(found.Value == 42);
+
+  // Names differing by case share the entry of a case insensitive cache.
+  found.Value = 0;
+  CHECK(DokanNameCache_Lookup(&cache, L"\\A", 2, &found, &generation));
+  CHECK(found.Value == 42);
+
+  // Only the NameLength characters are the name.
+  CHECK(DokanNameCache_Lookup(&cache, L"\\a\\b", 2, &found, &generation));
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a\\b", 4, &found, &generation));
+  DokanNameCache_Free(&cache);
+  CHECK(cache.Entries == NULL);
+
+  // A disabled cache misses and refuses payloads.
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, &found, &generation));
+  CHECK(!DokanNameCache_Insert(&cache, L"\\a", 2, &payload, 0, generation));
+  DokanNameCache_Invalidate(&cache, L"\\a", 2);
+  DokanNameCache_Clear(&cache);
+
+  CHECK(DokanNameCache_Initialize(&cache, 64, sizeof(TEST_PAYLOAD),
+                                  TEST_TTL_MS, 0, TRUE, NULL, NULL));
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, &found, &generation));
+  CHECK(DokanNameCache_Insert(&cache, L"\\a", 2, &payload, 0, generation));
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\A", 2, &found, &generation));
+  DokanNameCache_Free(&cache);
+
+  // Payloads expire after the time to live.
+  CHECK(DokanNameCache_Initialize(&cache, 64, sizeof(TEST_PAYLOAD), 0, 0,
+                                  FALSE, NULL, NULL));
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, &found, &generation));
+  CHECK(DokanNameCache_Insert(&cache, L"\\a", 2, &payload, 0, generation));
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, &found, &generation));
+  DokanNameCache_Free(&cache);
+}
+
+static VOID TestInvalidate() {
+  DOKAN_NAME_CACHE cache;
+  CHECK(DokanNameCache_Initialize(&cache, 64, 0, TEST_TTL_MS, 0, FALSE, NULL,
+                                  NULL));
+  LONG64 generation;
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, NULL, &generation));
+  CHECK(DokanNameCache_Insert(&cache, L"\\a", 2, NULL, 0, generation));
+  CHECK(DokanNameCache_Lookup(&cache, L"\\a", 2, NULL, &generation));
+  DokanNameCache_Invalidate(&cache, L"\\A", 2);
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, NULL, &generation));
+
+  // A result read while the name was invalidated is not cached.
+  DokanNameCache_Invalidate(&cache, L"\\a", 2);
+  CHECK(!DokanNameCache_Insert(&cache, L"\\a", 2, NULL, 0, generation));
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, NULL, &generation));
+
+  // Neither is one read while the cache was cleared.
+  CHECK(DokanNameCache_Insert(&cache, L"\\a", 2, NULL, 0, generation));
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\b", 2, NULL, &generation));
+  DokanNameCache_Clear(&cache);
+  CHECK(!DokanNameCache_Lookup(&cache, L"\\a", 2, NULL, &generation));
+  CHECK(DokanNameCache_Insert(&cache, L"\\a", 2, NULL, 0, generation));
+  DokanNameCache_Free(&cache);
+}
+
+static VOID TestOwnedPayloads() {
+  DOKAN_NAME_CACHE cache;
+  g_FreedPayloads = 0;
+  g_FailCopies = FALSE;
+  // A single entry: every name evicts the previous one.
+  CHECK(DokanNameCache_Initialize(&cache, 1, sizeof(PULONG), TEST_TTL_MS, 0,
+                                  FALSE, CopyOwnedPayload, FreeOwnedPayload));
+  ULONG value = 0;
+  CHECK(InsertOwned(&cache, L"\\a", 1, 0));
+  CHECK(LookupOwned(&cache, L"\\a", &value));
+  CHECK(value == 1);
+  CHECK(InsertOwned(&cache, L"\\b", 2, 0));
+  CHECK(g_FreedPayloads == 1);
+  CHECK(!LookupOwned(&cache, L"\\a", &value));
+  CHECK(LookupOwned(&cache, L"\\b", &value));
+  CHECK(value == 2);
+
+  // A failed copy is a miss.
+  g_FailCopies = TRUE;
+  CHECK(!LookupOwned(&cache, L"\\b", &value));
+  g_FailCopies = FALSE;
+
+  DokanNameCache_Invalidate(&cache, L"\\b", 2);
+  CHECK(g_FreedPayloads == 2);
+  CHECK(InsertOwned(&cache, L"\\b", 3, 0));
+  DokanNameCache_Free(&cache);
+  CHECK(g_FreedPayloads == 3);
+}
+
+static VOID TestMemoryLimit() {
+  DOKAN_NAME_CACHE cache;
+  g_FreedPayloads = 0;
+  CHECK(DokanNameCache_Initialize(&cache, 256, sizeof(PULONG), TEST_TTL_MS,
+                                  100, FALSE, CopyOwnedPayload,
+                                  FreeOwnedPayload));
+  // Larger than the whole cache.
+  CHECK(!InsertOwned(&cache, L"\\large", 1, 101));
+  CHECK(cache.Memory == 0);
+
+  WCHAR name[16];
+  ULONG inserted = 0;
+  for (ULONG i = 0; i < 8; ++i) {
+    swprintf_s(name, ARRAYSIZE(name), L"\\%lu", i);
+    inserted += InsertOwned(&cache, name, i, 40);
+    CHECK(cache.Memory <= 100);
+  }
+  // Other payloads are evicted to make room.
+  CHECK(inserted == 8);
+  CHECK(cache.Memory == 80);
+  CHECK(g_FreedPayloads == 6);
+  ULONG value = 0;
+  CHECK(LookupOwned(&cache, L"\\7", &value));
+  CHECK(value == 7);
+
+  DokanNameCache_Clear(&cache);
+  CHECK(cache.Memory == 0);
+  CHECK(g_FreedPayloads == 8);
+  DokanNameCache_Free(&cache);
+}
+
+VOID TestNameCache() {
+  TestLookupInsert();
+  TestInvalidate();
+  TestOwnedPayloads();
+  TestMemoryLimit();
+}
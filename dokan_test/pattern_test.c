@@ -0,0 +1,171 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_test.h"
+#include "dokan_pattern.h"
+
+// Names are padded with null characters because DokanIsNameInExpression
+// reads past the end of a name shorter than the '?' of an expression.
+static const WCHAR g_Names[][16] = {
+    L"",           L"a",           L"ab",           L"abc",
+    L"ABC",        L"abcd",        L"xabc",         L"file",
+    L"file.txt",   L"FILE.TXT",    L"file.txt.bak", L"file.",
+    L".txt",       L"txt",         L"a.b.c",        L"\x00E9t\x00E9",
+    L"\x00C9T\x00C9",
+};
+
+static const LPCWSTR g_Expressions[] = {
+    L"",         L"*",         L"abc",      L"ABC",      L"ab*",
+    L"AB*",      L"*.txt",     L"*.TXT",    L"*txt",     L"*abc",
+    L"abc*",     L"file.txt",  L"a*c",      L"*.*",      L"a?c",
+    L"?",        L"<.txt",     L"file.>>>", L"file\"*", L"\x00E9*",
+    L"*\x00C9", L"**",        L"*?",       L"?*",
+};
+
+typedef struct _TEST_PATTERN_KIND {
+  LPCWSTR Expression;
+  DOKAN_PATTERN_KIND Kind;
+  LPCWSTR Literal;
+} TEST_PATTERN_KIND;
+
+static const TEST_PATTERN_KIND g_Kinds[] = {
+    {L"", DOKAN_PATTERN_LITERAL, L""},
+    {L"*", DOKAN_PATTERN_ALL, NULL},
+    {L"abc", DOKAN_PATTERN_LITERAL, L"abc"},
+    {L"ab*", DOKAN_PATTERN_PREFIX, L"ab"},
+    {L"*.txt", DOKAN_PATTERN_SUFFIX, L".txt"},
+    {L"a*c", DOKAN_PATTERN_EXPRESSION, NULL},
+    {L"*.*", DOKAN_PATTERN_EXPRESSION, NULL},
+    {L"**", DOKAN_PATTERN_EXPRESSION, NULL},
+    {L"a?c", DOKAN_PATTERN_EXPRESSION, NULL},
+    {L"<.txt", DOKAN_PATTERN_EXPRESSION, NULL},
+    {L"file\"*", DOKAN_PATTERN_EXPRESSION, NULL},
+};
+
+static VOID TestCompile() {
+  for (ULONG i = 0; i < ARRAYSIZE(g_Kinds); ++i) {
+    DOKAN_PATTERN pattern;
+    DokanPattern_Compile(&pattern, g_Kinds[i].Expression, TRUE);
+    CHECK(pattern.Kind == g_Kinds[i].Kind);
+    CHECK(pattern.IgnoreCase);
+    CHECK(pattern.Expression == g_Kinds[i].Expression);
+    if (g_Kinds[i].Literal) {
+      CHECK(pattern.LiteralLength == wcslen(g_Kinds[i].Literal));
+      CHECK(wcsncmp(pattern.Literal, g_Kinds[i].Literal,
+                    pattern.LiteralLength) == 0);
+    }
+  }
+}
+
+// Every compiled pattern has to give the same result as
+// DokanIsNameInExpression, with and without case.
+static VOID TestMatchLikeExpression() {
+  for (ULONG e = 0; e < ARRAYSIZE(g_Expressions); ++e) {
+    for (ULONG ignoreCase = 0; ignoreCase < 2; ++ignoreCase) {
+      DOKAN_PATTERN pattern;
+      DokanPattern_Compile(&pattern, g_Expressions[e], ignoreCase);
+      for (ULONG n = 0; n < ARRAYSIZE(g_Names); ++n) {
+        BOOL expected =
+            DokanIsNameInExpression(g_Expressions[e], g_Names[n], ignoreCase);
+        BOOL matched = DokanPattern_Match(&pattern, g_Names[n],
+                                          (ULONG)wcslen(g_Names[n]));
+        if (!matched != !expected) {
+          fprintf(stderr, "\"%ls\" on \"%ls\" ignoring case %lu: %d\n",
+                  g_Expressions[e], g_Names[n], ignoreCase, matched);
+        }
+        CHECK(!matched == !expected);
+      }
+    }
+  }
+}
+
+VOID TestPattern() {
+  TestCompile();
+  TestMatchLikeExpression();
+}
+
+#define BENCHMARK_NAME_COUNT 100000
+#define BENCHMARK_NAME_SIZE 32
+#define BENCHMARK_ROUNDS 10
+
+// Expressions of each pattern kind, as given by directory queries.
+static const LPCWSTR g_BenchmarkExpressions[] = {
+    L"*", L"file12345.txt", L"file1*", L"*.txt", L"f*1.t*",
+};
+
+static ULONG CountMatches(PDOKAN_PATTERN Pattern, LPCWSTR Expression,
+                          WCHAR (*Names)[BENCHMARK_NAME_SIZE],
+                          PULONG NameLengths, double *ElapsedMs) {
+  ULONG matchCount = 0;
+  LONGLONG start = BenchmarkStart();
+  for (ULONG r = 0; r < BENCHMARK_ROUNDS; ++r) {
+    for (ULONG i = 0; i < BENCHMARK_NAME_COUNT; ++i) {
+      matchCount += Pattern
+                        ? DokanPattern_Match(Pattern, Names[i], NameLengths[i])
+                        : DokanIsNameInExpression(Expression, Names[i], TRUE);
+    }
+  }
+  *ElapsedMs = BenchmarkElapsedMs(start);
+  return matchCount;
+}
+
+// Names matched per second by a compiled pattern and by
+// DokanIsNameInExpression, ignoring case like the queries of a case
+// insensitive mount.
+VOID BenchmarkPattern() {
+  WCHAR(*names)[BENCHMARK_NAME_SIZE] =
+      calloc(BENCHMARK_NAME_COUNT, sizeof(*names));
+  PULONG nameLengths = calloc(BENCHMARK_NAME_COUNT, sizeof(ULONG));
+  if (!names || !nameLengths) {
+    fprintf(stderr, "Pattern benchmark setup failed.\n");
+    free(names);
+    free(nameLengths);
+    return;
+  }
+  static const LPCWSTR extensions[] = {L"txt", L"TXT", L"dat", L"log"};
+  for (ULONG i = 0; i < BENCHMARK_NAME_COUNT; ++i) {
+    swprintf_s(names[i], BENCHMARK_NAME_SIZE, L"file%lu.%ls", i,
+               extensions[i % ARRAYSIZE(extensions)]);
+    nameLengths[i] = (ULONG)wcslen(names[i]);
+  }
+  ULONG matchedNames = BENCHMARK_NAME_COUNT * BENCHMARK_ROUNDS;
+  for (ULONG e = 0; e < ARRAYSIZE(g_BenchmarkExpressions); ++e) {
+    DOKAN_PATTERN pattern;
+    DokanPattern_Compile(&pattern, g_BenchmarkExpressions[e], TRUE);
+    double compiledMs;
+    double expressionMs;
+    ULONG compiledCount = CountMatches(&pattern, g_BenchmarkExpressions[e],
+                                       names, nameLengths, &compiledMs);
+    ULONG expressionCount = CountMatches(NULL, g_BenchmarkExpressions[e],
+                                         names, nameLengths, &expressionMs);
+    printf("\"%ls\": compiled %.0f names/s, DokanIsNameInExpression %.0f "
+           "names/s, %lu matches\n",
+           g_BenchmarkExpressions[e], matchedNames / (compiledMs / 1000),
+           matchedNames / (expressionMs / 1000),
+           compiledCount / BENCHMARK_ROUNDS);
+    if (compiledCount != expressionCount) {
+      fprintf(stderr, "\"%ls\": %lu compiled matches, %lu expected.\n",
+              g_BenchmarkExpressions[e], compiledCount, expressionCount);
+    }
+  }
+  free(names);
+  free(nameLengths);
+}
@@ -0,0 +1,301 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_test.h"
+#include "dokan_queue.h"
+
+#define TEST_QUEUE_CAPACITY 64
+#define TEST_PRODUCER_COUNT 3
+#define TEST_CONSUMER_COUNT 3
+#define TEST_ITEM_PER_PRODUCER 20000
+#define TEST_ITEM_COUNT (TEST_PRODUCER_COUNT * TEST_ITEM_PER_PRODUCER)
+
+static PVOID ToItem(ULONG Index) { return (PVOID)((ULONG_PTR)Index + 1); }
+
+static ULONG FromItem(PVOID Item) { return (ULONG)((ULONG_PTR)Item - 1); }
+
+static VOID TestAlloc() {
+  CHECK(DokanQueue_Alloc(0) == NULL);
+  CHECK(DokanQueue_Alloc(1) == NULL);
+  CHECK(DokanQueue_Alloc(48) == NULL);
+  PDOKAN_QUEUE queue = DokanQueue_Alloc(2);
+  CHECK(queue != NULL);
+  DokanQueue_Free(queue);
+}
+
+static VOID TestFullEmpty() {
+  PDOKAN_QUEUE queue = DokanQueue_Alloc(4);
+  CHECK(queue != NULL);
+  if (!queue) {
+    return;
+  }
+  CHECK(DokanQueue_Pop(queue) == NULL);
+  for (ULONG i = 0; i < 4; ++i) {
+    CHECK(DokanQueue_Push(queue, ToItem(i), NULL));
+  }
+  CHECK(!DokanQueue_Push(queue, ToItem(4), NULL));
+  for (ULONG i = 0; i < 4; ++i) {
+    CHECK(DokanQueue_Pop(queue) == ToItem(i));
+  }
+  CHECK(DokanQueue_Pop(queue) == NULL);
+  DokanQueue_Free(queue);
+}
+
+// Positions keep growing past the capacity while cells are reused.
+static VOID TestWrapAround() {
+  PDOKAN_QUEUE queue = DokanQueue_Alloc(4);
+  CHECK(queue != NULL);
+  if (!queue) {
+    return;
+  }
+  ULONG pushed = 0;
+  ULONG popped = 0;
+  for (ULONG lap = 0; lap < 10; ++lap) {
+    for (ULONG i = 0; i < 3; ++i) {
+      CHECK(DokanQueue_Push(queue, ToItem(pushed++), NULL));
+    }
+    for (ULONG i = 0; i < 3; ++i) {
+      CHECK(DokanQueue_Pop(queue) == ToItem(popped++));
+    }
+  }
+  CHECK(queue->EnqueuePosition == 30);
+  CHECK(queue->DequeuePosition == 30);
+  CHECK(DokanQueue_Pop(queue) == NULL);
+  DokanQueue_Free(queue);
+}
+
+static VOID TestPopOrWait() {
+  PDOKAN_QUEUE queue = DokanQueue_Alloc(4);
+  CHECK(queue != NULL);
+  if (!queue) {
+    return;
+  }
+  LONG waiterCount = -1;
+  CHECK(DokanQueue_Push(queue, ToItem(0), &waiterCount));
+  CHECK(waiterCount == 0);
+  CHECK(DokanQueue_PopOrWait(queue) == ToItem(0));
+
+  // Misses are reported to the push of the next item.
+  CHECK(DokanQueue_PopOrWait(queue) == NULL);
+  CHECK(DokanQueue_PopOrWait(queue) == NULL);
+  CHECK(DokanQueue_Push(queue, ToItem(1), &waiterCount));
+  CHECK(waiterCount == 2);
+  CHECK(DokanQueue_Push(queue, ToItem(2), &waiterCount));
+  CHECK(waiterCount == 0);
+  CHECK(DokanQueue_PopOrWait(queue) == ToItem(1));
+  CHECK(DokanQueue_PopOrWait(queue) == ToItem(2));
+  DokanQueue_Free(queue);
+}
+
+// Producers push items and hand out one token per item plus one per waiter,
+// like QueueIoEvent submits the dispatch work. Consumers use each token for
+// one DokanQueue_PopOrWait, like DispatchQueuedIoEvent.
+typedef struct _TEST_QUEUE_CONTEXT {
+  PDOKAN_QUEUE Queue;
+  volatile LONG Tokens;
+  volatile LONG RunningProducers;
+  volatile LONG ConsumedCount;
+  volatile LONG Consumed[TEST_ITEM_COUNT];
+  volatile LONG ProducerIndex;
+} TEST_QUEUE_CONTEXT, *PTEST_QUEUE_CONTEXT;
+
+static DWORD WINAPI ProducerThread(LPVOID Parameter) {
+  PTEST_QUEUE_CONTEXT context = (PTEST_QUEUE_CONTEXT)Parameter;
+  ULONG first = (ULONG)(InterlockedIncrement(&context->ProducerIndex) - 1) *
+                TEST_ITEM_PER_PRODUCER;
+  for (ULONG i = first; i < first + TEST_ITEM_PER_PRODUCER; ++i) {
+    LONG waiterCount;
+    while (!DokanQueue_Push(context->Queue, ToItem(i), &waiterCount)) {
+      SwitchToThread();
+    }
+    InterlockedAdd(&context->Tokens, 1 + waiterCount);
+  }
+  InterlockedDecrement(&context->RunningProducers);
+  return 0;
+}
+
+static BOOL TakeToken(PTEST_QUEUE_CONTEXT Context) {
+  LONG tokens = Context->Tokens;
+  while (tokens > 0) {
+    LONG current =
+        InterlockedCompareExchange(&Context->Tokens, tokens - 1, tokens);
+    if (current == tokens) {
+      return TRUE;
+    }
+    tokens = current;
+  }
+  return FALSE;
+}
+
+static DWORD WINAPI ConsumerThread(LPVOID Parameter) {
+  PTEST_QUEUE_CONTEXT context = (PTEST_QUEUE_CONTEXT)Parameter;
+  for (;;) {
+    if (TakeToken(context)) {
+      PVOID item = DokanQueue_PopOrWait(context->Queue);
+      if (item) {
+        InterlockedIncrement(&context->Consumed[FromItem(item)]);
+        InterlockedIncrement(&context->ConsumedCount);
+      }
+      continue;
+    }
+    // Without tokens left once the producers are done, an item that was not
+    // consumed is lost.
+    if (ReadAcquire(&context->RunningProducers) == 0 &&
+        ReadAcquire(&context->Tokens) == 0) {
+      break;
+    }
+    SwitchToThread();
+  }
+  return 0;
+}
+
+static VOID TestConcurrentPushPop() {
+  PTEST_QUEUE_CONTEXT context =
+      (PTEST_QUEUE_CONTEXT)calloc(1, sizeof(TEST_QUEUE_CONTEXT));
+  CHECK(context != NULL);
+  if (!context) {
+    return;
+  }
+  context->Queue = DokanQueue_Alloc(TEST_QUEUE_CAPACITY);
+  CHECK(context->Queue != NULL);
+  if (!context->Queue) {
+    free(context);
+    return;
+  }
+  context->RunningProducers = TEST_PRODUCER_COUNT;
+  HANDLE threads[TEST_PRODUCER_COUNT + TEST_CONSUMER_COUNT];
+  for (ULONG i = 0; i < TEST_CONSUMER_COUNT; ++i) {
+    threads[i] = CreateThread(NULL, 0, ConsumerThread, context, 0, NULL);
+    CHECK(threads[i] != NULL);
+  }
+  for (ULONG i = 0; i < TEST_PRODUCER_COUNT; ++i) {
+    threads[TEST_CONSUMER_COUNT + i] =
+        CreateThread(NULL, 0, ProducerThread, context, 0, NULL);
+    CHECK(threads[TEST_CONSUMER_COUNT + i] != NULL);
+  }
+  WaitForMultipleObjects(ARRAYSIZE(threads), threads, TRUE, INFINITE);
+  for (ULONG i = 0; i < ARRAYSIZE(threads); ++i) {
+    CloseHandle(threads[i]);
+  }
+  CHECK(context->ConsumedCount == TEST_ITEM_COUNT);
+  ULONG wrongCount = 0;
+  for (ULONG i = 0; i < TEST_ITEM_COUNT; ++i) {
+    if (context->Consumed[i] != 1) {
+      ++wrongCount;
+    }
+  }
+  CHECK(wrongCount == 0);
+  CHECK(DokanQueue_Pop(context->Queue) == NULL);
+  DokanQueue_Free(context->Queue);
+  free(context);
+}
+
+VOID TestQueue() {
+  TestAlloc();
+  TestFullEmpty();
+  TestWrapAround();
+  TestPopOrWait();
+  TestConcurrentPushPop();
+}
+
+#define BENCHMARK_QUEUE_CAPACITY 4096
+#define BENCHMARK_EVENT_COUNT 1000000
+
+typedef struct _BENCHMARK_QUEUE_CONTEXT {
+  PDOKAN_QUEUE Queue;
+  volatile LONG DispatchedCount;
+} BENCHMARK_QUEUE_CONTEXT, *PBENCHMARK_QUEUE_CONTEXT;
+
+static VOID CALLBACK DispatchQueuedEvent(PTP_CALLBACK_INSTANCE Instance,
+                                         PVOID Parameter, PTP_WORK Work) {
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Work);
+  PBENCHMARK_QUEUE_CONTEXT context = (PBENCHMARK_QUEUE_CONTEXT)Parameter;
+  if (DokanQueue_PopOrWait(context->Queue)) {
+    InterlockedIncrement(&context->DispatchedCount);
+  }
+}
+
+static VOID CALLBACK DispatchEvent(PTP_CALLBACK_INSTANCE Instance,
+                                   PVOID Parameter, PTP_WORK Work) {
+  UNREFERENCED_PARAMETER(Instance);
+  UNREFERENCED_PARAMETER(Work);
+  PBENCHMARK_QUEUE_CONTEXT context = (PBENCHMARK_QUEUE_CONTEXT)Parameter;
+  InterlockedIncrement(&context->DispatchedCount);
+}
+
+static VOID PrintEventRate(LPCSTR Name, LONG DispatchedCount,
+                           LONGLONG Start) {
+  double elapsedMs = BenchmarkElapsedMs(Start);
+  printf("%s: %ld events in %.0f ms, %.0f events/s\n", Name, DispatchedCount,
+         elapsedMs, DispatchedCount / (elapsedMs / 1000));
+}
+
+// Events dispatched through one work object and the queue, like
+// QueueIoEvent, or through one work object created per event in a cleanup
+// group, like the library did before.
+VOID BenchmarkQueue() {
+  BENCHMARK_QUEUE_CONTEXT context;
+  context.Queue = DokanQueue_Alloc(BENCHMARK_QUEUE_CAPACITY);
+  context.DispatchedCount = 0;
+  PTP_WORK work = CreateThreadpoolWork(DispatchQueuedEvent, &context, NULL);
+  if (!context.Queue || !work) {
+    fprintf(stderr, "Queue benchmark setup failed.\n");
+    return;
+  }
+  LONGLONG start = BenchmarkStart();
+  for (ULONG i = 0; i < BENCHMARK_EVENT_COUNT; ++i) {
+    LONG waiterCount;
+    while (!DokanQueue_Push(context.Queue, ToItem(i), &waiterCount)) {
+      SwitchToThread();
+    }
+    for (LONG j = 0; j <= waiterCount; ++j) {
+      SubmitThreadpoolWork(work);
+    }
+  }
+  WaitForThreadpoolWorkCallbacks(work, FALSE);
+  PrintEventRate("Reused work object", context.DispatchedCount, start);
+  CloseThreadpoolWork(work);
+  DokanQueue_Free(context.Queue);
+
+  TP_CALLBACK_ENVIRON callbackEnvironment;
+  InitializeThreadpoolEnvironment(&callbackEnvironment);
+  PTP_CLEANUP_GROUP cleanupGroup = CreateThreadpoolCleanupGroup();
+  if (!cleanupGroup) {
+    fprintf(stderr, "Queue benchmark setup failed.\n");
+    return;
+  }
+  SetThreadpoolCallbackCleanupGroup(&callbackEnvironment, cleanupGroup, NULL);
+  context.DispatchedCount = 0;
+  start = BenchmarkStart();
+  for (ULONG i = 0; i < BENCHMARK_EVENT_COUNT; ++i) {
+    work = CreateThreadpoolWork(DispatchEvent, &context, &callbackEnvironment);
+    if (!work) {
+      fprintf(stderr, "CreateThreadpoolWork failed after %lu events.\n", i);
+      break;
+    }
+    SubmitThreadpoolWork(work);
+  }
+  CloseThreadpoolCleanupGroupMembers(cleanupGroup, FALSE, NULL);
+  PrintEventRate("Work object per event", context.DispatchedCount, start);
+  CloseThreadpoolCleanupGroup(cleanupGroup);
+  DestroyThreadpoolEnvironment(&callbackEnvironment);
+}
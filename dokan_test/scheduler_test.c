@@ -0,0 +1,189 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2022 - 2025 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "dokan_test.h"
+#include "dokan_scheduler.h"
+
+#define TEST_DEQUE_CAPACITY 64
+#define TEST_ITEM_COUNT 100000
+#define TEST_THIEF_COUNT 3
+
+static PVOID ToItem(ULONG Index) { return (PVOID)((ULONG_PTR)Index + 1); }
+
+static ULONG FromItem(PVOID Item) { return (ULONG)((ULONG_PTR)Item - 1); }
+
+static VOID TestAlloc() {
+  CHECK(DokanScheduler_Alloc(0, TEST_DEQUE_CAPACITY) == NULL);
+  CHECK(DokanScheduler_Alloc(1, 1) == NULL);
+  CHECK(DokanScheduler_Alloc(1, 48) == NULL);
+  PDOKAN_WORK_SCHEDULER scheduler = DokanScheduler_Alloc(2, 2);
+  CHECK(scheduler != NULL);
+  DokanScheduler_Free(scheduler);
+}
+
+static VOID TestAcquireDeque() {
+  PDOKAN_WORK_SCHEDULER scheduler =
+      DokanScheduler_Alloc(2, TEST_DEQUE_CAPACITY);
+  CHECK(scheduler != NULL);
+  if (!scheduler) {
+    return;
+  }
+  PDOKAN_WORK_DEQUE first = DokanScheduler_AcquireDeque(scheduler, 1);
+  CHECK(first == &scheduler->Deques[1]);
+  PDOKAN_WORK_DEQUE second = DokanScheduler_AcquireDeque(scheduler, 1);
+  CHECK(second == &scheduler->Deques[0]);
+  CHECK(DokanScheduler_AcquireDeque(scheduler, 0) == NULL);
+  DokanScheduler_ReleaseDeque(first);
+  CHECK(DokanScheduler_AcquireDeque(scheduler, 0) == first);
+  DokanScheduler_ReleaseDeque(first);
+  DokanScheduler_ReleaseDeque(second);
+  DokanScheduler_Free(scheduler);
+}
+
+static VOID TestPushPopSteal() {
+  PDOKAN_WORK_SCHEDULER scheduler = DokanScheduler_Alloc(2, 4);
+  CHECK(scheduler != NULL);
+  if (!scheduler) {
+    return;
+  }
+  PDOKAN_WORK_DEQUE deque = DokanScheduler_AcquireDeque(scheduler, 0);
+  CHECK(DokanScheduler_Pop(deque) == NULL);
+  CHECK(DokanScheduler_Steal(scheduler, 0) == NULL);
+
+  // The owner pops the most recent item, thieves steal the oldest one.
+  for (ULONG i = 0; i < 4; ++i) {
+    CHECK(DokanScheduler_Push(deque, ToItem(i)));
+  }
+  CHECK(!DokanScheduler_Push(deque, ToItem(4)));
+  CHECK(DokanScheduler_Pop(deque) == ToItem(3));
+  CHECK(DokanScheduler_Steal(scheduler, 1) == ToItem(0));
+  CHECK(DokanScheduler_Steal(scheduler, 0) == ToItem(1));
+  CHECK(DokanScheduler_Pop(deque) == ToItem(2));
+  CHECK(DokanScheduler_Pop(deque) == NULL);
+  CHECK(DokanScheduler_Steal(scheduler, 0) == NULL);
+
+  // Freed slots are reused once the items wrapped around the ring.
+  for (ULONG i = 0; i < 4; ++i) {
+    CHECK(DokanScheduler_Push(deque, ToItem(i)));
+  }
+  for (ULONG i = 0; i < 4; ++i) {
+    CHECK(DokanScheduler_Steal(scheduler, 0) == ToItem(i));
+  }
+
+  // Items of a released deque can still be stolen.
+  CHECK(DokanScheduler_Push(deque, ToItem(5)));
+  DokanScheduler_ReleaseDeque(deque);
+  CHECK(DokanScheduler_Steal(scheduler, 1) == ToItem(5));
+  DokanScheduler_Free(scheduler);
+}
+
+typedef struct _TEST_STEAL_CONTEXT {
+  PDOKAN_WORK_SCHEDULER Scheduler;
+  volatile LONG Done;
+  volatile LONG Consumed[TEST_ITEM_COUNT];
+} TEST_STEAL_CONTEXT, *PTEST_STEAL_CONTEXT;
+
+static VOID Consume(PTEST_STEAL_CONTEXT Context, PVOID Item) {
+  InterlockedIncrement(&Context->Consumed[FromItem(Item)]);
+}
+
+static DWORD WINAPI ThiefThread(LPVOID Parameter) {
+  PTEST_STEAL_CONTEXT context = (PTEST_STEAL_CONTEXT)Parameter;
+  for (;;) {
+    BOOL done = ReadAcquire(&context->Done);
+    PVOID item = DokanScheduler_Steal(context->Scheduler, 0);
+    if (item) {
+      Consume(context, item);
+    } else if (done) {
+      return 0;
+    } else {
+      YieldProcessor();
+    }
+  }
+}
+
+// The owner pushes and pops while thieves steal: every item has to be
+// consumed exactly once.
+static VOID TestConcurrentSteal() {
+  PTEST_STEAL_CONTEXT context =
+      (PTEST_STEAL_CONTEXT)calloc(1, sizeof(TEST_STEAL_CONTEXT));
+  CHECK(context != NULL);
+  if (!context) {
+    return;
+  }
+  context->Scheduler = DokanScheduler_Alloc(1, TEST_DEQUE_CAPACITY);
+  CHECK(context->Scheduler != NULL);
+  if (!context->Scheduler) {
+    free(context);
+    return;
+  }
+  PDOKAN_WORK_DEQUE deque =
+      DokanScheduler_AcquireDeque(context->Scheduler, 0);
+  HANDLE threads[TEST_THIEF_COUNT];
+  ULONG threadCount = 0;
+  for (ULONG i = 0; i < TEST_THIEF_COUNT; ++i) {
+    threads[threadCount] = CreateThread(NULL, 0, ThiefThread, context, 0, NULL);
+    CHECK(threads[threadCount] != NULL);
+    if (threads[threadCount]) {
+      ++threadCount;
+    }
+  }
+  for (ULONG i = 0; i < TEST_ITEM_COUNT; ++i) {
+    while (!DokanScheduler_Push(deque, ToItem(i))) {
+      PVOID item = DokanScheduler_Pop(deque);
+      if (item) {
+        Consume(context, item);
+      }
+    }
+    if (i % 3 == 0) {
+      PVOID item = DokanScheduler_Pop(deque);
+      if (item) {
+        Consume(context, item);
+      }
+    }
+  }
+  PVOID item;
+  while ((item = DokanScheduler_Pop(deque)) != NULL) {
+    Consume(context, item);
+  }
+  WriteRelease(&context->Done, TRUE);
+  WaitForMultipleObjects(threadCount, threads, TRUE, INFINITE);
+  for (ULONG i = 0; i < threadCount; ++i) {
+    CloseHandle(threads[i]);
+  }
+  ULONG wrongCount = 0;
+  for (ULONG i = 0; i < TEST_ITEM_COUNT; ++i) {
+    if (context->Consumed[i] != 1) {
+      ++wrongCount;
+    }
+  }
+  CHECK(wrongCount == 0);
+  DokanScheduler_ReleaseDeque(deque);
+  DokanScheduler_Free(context->Scheduler);
+  free(context);
+}
+
+VOID TestScheduler() {
+  TestAlloc();
+  TestAcquireDeque();
+  TestPushPopSteal();
+  TestConcurrentSteal();
+}
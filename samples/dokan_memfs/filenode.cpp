@@ -29,6 +29,8 @@ THE SOFTWARE.
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+
 namespace memfs {
 filenode::filenode(const std::wstring& filename, bool is_directory,
                    DWORD file_attr,
@@ -43,14 +45,61 @@ filenode::filenode(const std::wstring& filename, bool is_directory,
   }
 }
 
+DWORD filenode::read_locked(LPVOID buffer, DWORD bufferlength,
+                            LONGLONG offset) {
+  if (offset >= _size) return 0;
+  if (offset + bufferlength > _size)
+    bufferlength = static_cast<DWORD>(_size - offset);
+  auto out = static_cast<uint8_t*>(buffer);
+  for (DWORD remaining = bufferlength; remaining;) {
+    auto block = static_cast<size_t>(offset / block_size);
+    auto block_offset = static_cast<DWORD>(offset % block_size);
+    DWORD length = (std::min)(remaining, block_size - block_offset);
+    if (_blocks[block])
+      memcpy(out, &_blocks[block][block_offset], length);
+    else
+      memset(out, 0, length);
+    out += length;
+    offset += length;
+    remaining -= length;
+  }
+  return bufferlength;
+}
+
+void filenode::write_locked(LPCVOID buffer, DWORD number_of_bytes_to_write,
+                            LONGLONG offset) {
+  if (offset + number_of_bytes_to_write > _size)
+    resize_locked(offset + number_of_bytes_to_write);
+  auto in = static_cast<const uint8_t*>(buffer);
+  for (DWORD remaining = number_of_bytes_to_write; remaining;) {
+    auto block = static_cast<size_t>(offset / block_size);
+    auto block_offset = static_cast<DWORD>(offset % block_size);
+    DWORD length = (std::min)(remaining, block_size - block_offset);
+    // Value initialized, so zero filled.
+    if (!_blocks[block])
+      _blocks[block] = std::make_unique<uint8_t[]>(block_size);
+    memcpy(&_blocks[block][block_offset], in, length);
+    in += length;
+    offset += length;
+    remaining -= length;
+  }
+}
+
+void filenode::resize_locked(LONGLONG size) {
+  if (size < _size) {
+    // Data past the end has to read as zeros if the file is extended again.
+    auto block = static_cast<size_t>(size / block_size);
+    auto block_offset = static_cast<DWORD>(size % block_size);
+    if (block_offset && _blocks[block])
+      memset(&_blocks[block][block_offset], 0, block_size - block_offset);
+  }
+  _blocks.resize(static_cast<size_t>((size + block_size - 1) / block_size));
+  _size = size;
+}
+
 DWORD filenode::read(LPVOID buffer, DWORD bufferlength, LONGLONG offset) {
   std::shared_lock lock(_data_mutex);
-  if (static_cast<size_t>(offset + bufferlength) > _data.size())
-    bufferlength = (_data.size() > static_cast<size_t>(offset))
-                       ? static_cast<DWORD>(_data.size() - offset)
-                       : 0;
-  if (bufferlength)
-    memcpy(buffer, &_data[static_cast<size_t>(offset)], bufferlength);
+  bufferlength = read_locked(buffer, bufferlength, offset);
   spdlog::info(L"Read {} : BufferLength {} Offset {}", get_filename(),
                bufferlength, offset);
   return bufferlength;
@@ -61,23 +110,47 @@ DWORD filenode::write(LPCVOID buffer, DWORD number_of_bytes_to_write,
   if (!number_of_bytes_to_write) return 0;
 
   std::unique_lock lock(_data_mutex);
-  if (static_cast<size_t>(offset + number_of_bytes_to_write) > _data.size())
-    _data.resize(static_cast<size_t>(offset + number_of_bytes_to_write));
-
   spdlog::info(L"Write {} : NumberOfBytesToWrite {} Offset {}", get_filename(),
                number_of_bytes_to_write, offset);
-  memcpy(&_data[static_cast<size_t>(offset)], buffer, number_of_bytes_to_write);
+  write_locked(buffer, number_of_bytes_to_write, offset);
   return number_of_bytes_to_write;
 }
 
+DWORD filenode::read(const DOKAN_IO_SEGMENT* segments, DWORD segment_count) {
+  std::shared_lock lock(_data_mutex);
+  DWORD readlength = 0;
+  for (DWORD i = 0; i < segment_count; ++i) {
+    DWORD length =
+        read_locked(segments[i].Buffer, segments[i].Length, segments[i].Offset);
+    readlength += length;
+    // The end of file was reached.
+    if (length < segments[i].Length) break;
+  }
+  spdlog::info(L"Read {} : SegmentCount {} ReadLength {}", get_filename(),
+               segment_count, readlength);
+  return readlength;
+}
+
+DWORD filenode::write(const DOKAN_IO_SEGMENT* segments, DWORD segment_count) {
+  std::unique_lock lock(_data_mutex);
+  DWORD written = 0;
+  for (DWORD i = 0; i < segment_count; ++i) {
+    write_locked(segments[i].Buffer, segments[i].Length, segments[i].Offset);
+    written += segments[i].Length;
+  }
+  spdlog::info(L"Write {} : SegmentCount {} NumberOfBytesWritten {}",
+               get_filename(), segment_count, written);
+  return written;
+}
+
 const LONGLONG filenode::get_filesize() {
   std::shared_lock lock(_data_mutex);
-  return static_cast<LONGLONG>(_data.size());
+  return _size;
 }
 
 void filenode::set_endoffile(const LONGLONG& byte_offset) {
   std::unique_lock lock(_data_mutex);
-  _data.resize(static_cast<size_t>(byte_offset));
+  resize_locked(byte_offset);
 }
 
 const std::wstring filenode::get_filename() {
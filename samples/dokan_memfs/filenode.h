@@ -94,8 +94,16 @@ class filenode {
 
   filenode(const filenode& f) = delete;
 
+  // Size of the blocks the file data is stored in. It is also the
+  // IoSegmentSize of the mount so that each segment maps to a single block.
+  static constexpr DWORD block_size = 64 * 1024;
+
   DWORD read(LPVOID buffer, DWORD bufferlength, LONGLONG offset);
   DWORD write(LPCVOID buffer, DWORD number_of_bytes_to_write, LONGLONG offset);
+  // Same as a read or write of the segments one after the other, under a
+  // single lock. Write segments need a resolved offset.
+  DWORD read(const DOKAN_IO_SEGMENT* segments, DWORD segment_count);
+  DWORD write(const DOKAN_IO_SEGMENT* segments, DWORD segment_count);
 
   const LONGLONG get_filesize();
   void set_endoffile(const LONGLONG& byte_offset);
@@ -121,9 +129,17 @@ class filenode {
  private:
   filenode() = default;
 
+  // _data_mutex need to be aquired
+  DWORD read_locked(LPVOID buffer, DWORD bufferlength, LONGLONG offset);
+  void write_locked(LPCVOID buffer, DWORD number_of_bytes_to_write,
+                    LONGLONG offset);
+  void resize_locked(LONGLONG size);
+
   std::shared_mutex _data_mutex;
   // _data_mutex need to be aquired
-  std::vector<uint8_t> _data;
+  // Blocks of block_size bytes, a null block is only zeros.
+  std::vector<std::unique_ptr<uint8_t[]>> _blocks;
+  LONGLONG _size = 0;
   std::unordered_map<std::wstring, std::shared_ptr<filenode> > _streams;
 
   std::shared_mutex _fileName_mutex;
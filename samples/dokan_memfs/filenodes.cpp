@@ -86,7 +86,7 @@ fs_filenodes::fs_filenodes() {
   LocalFree(security_descriptor);
 
   _filenodes[L"\\"] = fileNode;
-  _directoryPaths.emplace(L"\\", std::set<std::shared_ptr<filenode>>());
+  _directoryPaths.emplace(L"\\", filenode_set());
 }
 
 NTSTATUS fs_filenodes::add(const std::shared_ptr<filenode> &f,
@@ -124,7 +124,7 @@ NTSTATUS fs_filenodes::add(const std::shared_ptr<filenode> &f,
 
   // If we have a folder, we add it to our directoryPaths
   if (f->is_directory && !_directoryPaths.count(filename))
-    _directoryPaths.emplace(filename, std::set<std::shared_ptr<filenode>>());
+    _directoryPaths.emplace(filename, filenode_set());
 
   // Add our file to the fileNodes and directoryPaths
   auto previous_f = _filenodes[filename];
@@ -143,13 +143,24 @@ std::shared_ptr<filenode> fs_filenodes::find(const std::wstring& filename) {
   return (fileNode != _filenodes.end()) ? fileNode->second : nullptr;
 }
 
-std::set<std::shared_ptr<filenode>> fs_filenodes::list_folder(
-    const std::wstring& fileName) {
+filenode_set fs_filenodes::list_folder(const std::wstring& fileName) {
   std::scoped_lock lock(_filesnodes_mutex);
 
   auto it = _directoryPaths.find(fileName);
-  return (it != _directoryPaths.end()) ? it->second
-                                       : std::set<std::shared_ptr<filenode>>();
+  return (it != _directoryPaths.end()) ? it->second : filenode_set();
+}
+
+void fs_filenodes::list_folder_from(
+    const std::wstring& fileName, LONGLONG from_fileindex,
+    const std::function<bool(const std::shared_ptr<filenode>&)>& callback) {
+  std::scoped_lock lock(_filesnodes_mutex);
+
+  auto it = _directoryPaths.find(fileName);
+  if (it == _directoryPaths.end()) return;
+  for (auto f = it->second.lower_bound(from_fileindex); f != it->second.end();
+       ++f) {
+    if (!callback(*f)) break;
+  }
 }
 
 void fs_filenodes::remove(const std::wstring& filename) {
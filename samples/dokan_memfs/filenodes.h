@@ -30,6 +30,7 @@ THE SOFTWARE.
 
 #include "filenode.h"
 
+#include <functional>
 #include <memory>
 #include <mutex>
 
@@ -39,6 +40,26 @@ THE SOFTWARE.
 #include <unordered_map>
 
 namespace memfs {
+// Orders the filenodes of a folder by fileindex, which never changes once the
+// node is added, so that a listing can resume from an index. Alternate
+// streams share the index of their main stream and are ordered by address.
+struct filenode_index_less {
+  using is_transparent = void;
+  bool operator()(const std::shared_ptr<filenode>& a,
+                  const std::shared_ptr<filenode>& b) const {
+    if (a->fileindex != b->fileindex) return a->fileindex < b->fileindex;
+    return a < b;
+  }
+  bool operator()(const std::shared_ptr<filenode>& a, LONGLONG b) const {
+    return a->fileindex < b;
+  }
+  bool operator()(LONGLONG a, const std::shared_ptr<filenode>& b) const {
+    return a < b->fileindex;
+  }
+};
+
+using filenode_set = std::set<std::shared_ptr<filenode>, filenode_index_less>;
+
 // Memfs filenode storage
 // There is only one instance of fs_filenodes per dokan mount
 // as fs_filenodes describre the whole filesystem hierarchy context.
@@ -57,7 +78,14 @@ class fs_filenodes {
   std::shared_ptr<filenode> find(const std::wstring& filename);
 
   // Return all filenode of the directory scope give in param.
-  std::set<std::shared_ptr<filenode>> list_folder(const std::wstring& filename);
+  filenode_set list_folder(const std::wstring& filename);
+
+  // Call callback, with the lock held, for the filenodes of the directory
+  // from the first with a fileindex not lower than from_fileindex, in
+  // fileindex order, until it returns false.
+  void list_folder_from(
+      const std::wstring& filename, LONGLONG from_fileindex,
+      const std::function<bool(const std::shared_ptr<filenode>&)>& callback);
 
   // Remove filenode from the filesystem hierarchy.
   // If the filenode has alternated streams attached, they will also be removed.
@@ -90,8 +118,7 @@ class fs_filenodes {
   // Directory map of directoryname / sub filenodes in the scope.
   // A directory \foo with 2 files bar and coco will have one entry:
   // first: foo - second: set filenode { bar, coco }
-  std::unordered_map<std::wstring, std::set<std::shared_ptr<filenode>>>
-      _directoryPaths;
+  std::unordered_map<std::wstring, filenode_set> _directoryPaths;
 };
 }  // namespace memfs
 
@@ -39,8 +39,19 @@ void show_usage() {
                 "  /n (use network drive)\t\t\t Show device as network device.\n"
                 "  /u (UNC provider name ex. \\localhost\\myfs)\t UNC name used for network volume.\n"
                 "  /t Single thread\t\t\t\t Only use a single thread to process events.\n\t\t\t\t\t\t This is highly not recommended as can easily create a bottleneck.\n"
+                "  /o Ordered file dispatch\t\t\t Process the events of a file handle in the order they were received.\n"
+                "  /f FindFilesStream\t\t\t\t List directories a part at a time with FindFilesStream.\n"
+                "  /s IPC batching\t\t\t\t Pull and dispatch the events of the driver in batches.\n"
                 "  /d (enable debug output)\t\t\t Enable debug output to an attached debugger.\n"
                 "  /i (Timeout in Milliseconds ex. /i 30000)\t Timeout until a running operation is aborted and the device is unmounted.\n"
+                "  /b (Read buffer size in bytes ex. /b 4194304)\t Buffer registered with the driver that large reads are written to.\n"
+                "  /r (Read ahead size in bytes ex. /r 1048576)\t Data read ahead of opens reading sequentially.\n"
+                "  /w (Write behind size in bytes ex. /w 65536)\t Buffer per open merging small contiguous writes.\n"
+                "  /a (File info cache time in Milliseconds ex. /a 1000)\t Time GetFileInformation results are reused.\n"
+                "  /g (Negative lookup cache time in Milliseconds ex. /g 1000)\t Time missing names are answered without calling ZwCreateFile.\n"
+                "  /q (Max bulk dispatch count ex. /q 4)\t Reads, writes and flushes processed at the same time with /s.\n"
+                "  /p (Pull buffer size in bytes ex. /p 1048576)\t Buffer the events are pulled from the driver with.\n"
+                "  /k (Directory list cache time in Milliseconds ex. /k 1000)\t Time directory listings are shared by the opens.\n"
                 "  /x (network unmount)\t\t\t\t Allows unmounting network drive from file explorer\n"
                 "  /e Enable Driver Logs\t\t\t\t Forward Kernel logs to userland.\n\n"
                 "Examples:\n"
@@ -90,6 +101,12 @@ int __cdecl wmain(ULONG argc, PWCHAR argv[]) {
         dokan_memfs->dispatch_driver_logs = true;
       } else if (arg == L"/t") {
         dokan_memfs->single_thread = true;
+      } else if (arg == L"/o") {
+        dokan_memfs->ordered_file_dispatch = true;
+      } else if (arg == L"/f") {
+        dokan_memfs->find_files_stream = true;
+      } else if (arg == L"/s") {
+        dokan_memfs->ipc_batching = true;
       } else {
         if (i + 1 >= argc) {
           show_usage();
@@ -98,6 +115,22 @@ int __cdecl wmain(ULONG argc, PWCHAR argv[]) {
         std::wstring extra_arg = argv[++i];
         if (arg == L"/i") {
           dokan_memfs->timeout = std::stoul(extra_arg);
+        } else if (arg == L"/k") {
+          dokan_memfs->directory_list_cache_ttl_ms = std::stoul(extra_arg);
+        } else if (arg == L"/g") {
+          dokan_memfs->negative_lookup_cache_ttl_ms = std::stoul(extra_arg);
+        } else if (arg == L"/a") {
+          dokan_memfs->file_info_cache_ttl_ms = std::stoul(extra_arg);
+        } else if (arg == L"/w") {
+          dokan_memfs->write_behind_size = std::stoul(extra_arg);
+        } else if (arg == L"/r") {
+          dokan_memfs->read_ahead_size = std::stoul(extra_arg);
+        } else if (arg == L"/b") {
+          dokan_memfs->read_buffer_size = std::stoul(extra_arg);
+        } else if (arg == L"/q") {
+          dokan_memfs->max_bulk_dispatch_count = std::stoul(extra_arg);
+        } else if (arg == L"/p") {
+          dokan_memfs->pull_buffer_size = std::stoul(extra_arg);
         } else if (arg == L"/l") {
           wcscpy_s(dokan_memfs->mount_point,
                    sizeof(dokan_memfs->mount_point) / sizeof(WCHAR),
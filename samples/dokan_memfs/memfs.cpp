@@ -40,6 +40,12 @@ void memfs::start() {
                           DOKAN_OPTION_CASE_SENSITIVE;
   dokan_options.MountPoint = mount_point;
   dokan_options.SingleThread = single_thread;
+  if (ordered_file_dispatch) {
+    dokan_options.Options |= DOKAN_OPTION_ORDERED_FILE_DISPATCH;
+  }
+  if (ipc_batching) {
+    dokan_options.Options |= DOKAN_OPTION_ALLOW_IPC_BATCHING;
+  }
   if (debug_log) {
     dokan_options.Options |= DOKAN_OPTION_STDERR | DOKAN_OPTION_DEBUG;
     if (dispatch_driver_logs) {
@@ -68,9 +74,26 @@ void memfs::start() {
   
   dokan_options.Timeout = timeout;
   dokan_options.GlobalContext = reinterpret_cast<ULONG64>(this);
+  // Read and write segments match the blocks of the file nodes.
+  dokan_options.IoSegmentSize = filenode::block_size;
+  // Optional features, all disabled by default.
+  dokan_options.DirectoryListCacheTtlMs = directory_list_cache_ttl_ms;
+  dokan_options.NegativeLookupCacheTtlMs = negative_lookup_cache_ttl_ms;
+  dokan_options.FileInfoCacheTtlMs = file_info_cache_ttl_ms;
+  dokan_options.WriteBehindSize = write_behind_size;
+  dokan_options.ReadAheadSize = read_ahead_size;
+  dokan_options.ReadBufferSize = read_buffer_size;
+  dokan_options.MaxBulkDispatchCount = max_bulk_dispatch_count;
+  dokan_options.PullBufferSize = pull_buffer_size;
+
+  operations = memfs_operations;
+  if (!find_files_stream) {
+    // Directories are listed at once with FindFiles.
+    operations.FindFilesStream = nullptr;
+  }
 
   NTSTATUS status =
-      DokanCreateFileSystem(&dokan_options, &memfs_operations, &instance);
+      DokanCreateFileSystem(&dokan_options, &operations, &instance);
   switch (status) {
     case DOKAN_SUCCESS:
       break;
@@ -47,6 +47,8 @@ class memfs {
   void stop();
 
   DOKAN_HANDLE instance = nullptr;
+  // Operations of the mount, referenced by the library until it is closed.
+  DOKAN_OPERATIONS operations;
 
   // FileSystem mount options
   WCHAR mount_point[MAX_PATH] = L"M:\\";
@@ -58,7 +60,18 @@ class memfs {
   bool debug_log = false;
   bool enable_network_unmount = false;
   bool dispatch_driver_logs = false;
+  bool ordered_file_dispatch = false;
+  bool find_files_stream = false;
+  bool ipc_batching = false;
   ULONG timeout = 0;
+  ULONG directory_list_cache_ttl_ms = 0;
+  ULONG negative_lookup_cache_ttl_ms = 0;
+  ULONG file_info_cache_ttl_ms = 0;
+  ULONG write_behind_size = 0;
+  ULONG read_ahead_size = 0;
+  ULONG read_buffer_size = 0;
+  ULONG max_bulk_dispatch_count = 0;
+  ULONG pull_buffer_size = 0;
 
   // Memory FileSystem runtime context.
   std::unique_ptr<fs_filenodes> fs_filenodes;
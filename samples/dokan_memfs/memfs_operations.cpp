@@ -30,10 +30,12 @@ THE SOFTWARE.
 
 #include <sddl.h>
 #include <spdlog/spdlog.h>
+#include <algorithm>
 #include <iostream>
 #include <mutex>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace memfs {
 static const DWORD g_volumserial = 0x19831116;
@@ -373,6 +375,58 @@ static NTSTATUS DOKAN_CALLBACK memfs_writefile(LPCWSTR filename, LPCVOID buffer,
   return STATUS_SUCCESS;
 }
 
+static NTSTATUS DOKAN_CALLBACK memfs_readfilescatter(
+    LPCWSTR filename, PDOKAN_IO_SEGMENT segments, DWORD segment_count,
+    LPDWORD readlength, PDOKAN_FILE_INFO dokanfileinfo) {
+  auto filenodes = GET_FS_INSTANCE;
+  auto filename_str = std::wstring(filename);
+  spdlog::info(L"ReadFileScatter: {}", filename_str);
+  auto f = filenodes->find(filename_str);
+  if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
+
+  *readlength = f->read(segments, segment_count);
+  spdlog::info(L"\tSegmentCount: {} offset: {} readlength: {}", segment_count,
+               segments[0].Offset, *readlength);
+  return STATUS_SUCCESS;
+}
+
+static NTSTATUS DOKAN_CALLBACK memfs_writefilegather(
+    LPCWSTR filename, PDOKAN_IO_SEGMENT segments, DWORD segment_count,
+    LPDWORD number_of_bytes_written, PDOKAN_FILE_INFO dokanfileinfo) {
+  auto filenodes = GET_FS_INSTANCE;
+  auto filename_str = std::wstring(filename);
+  spdlog::info(L"WriteFileGather: {}", filename_str);
+  auto f = filenodes->find(filename_str);
+  if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
+
+  auto file_size = f->get_filesize();
+
+  // Same rules as memfs_writefile. A write at the end of the file comes as a
+  // single segment with an offset of -1.
+  if (segments[0].Offset == -1) segments[0].Offset = file_size;
+
+  if (dokanfileinfo->PagingIo) {
+    // Only write the segments, or the part of them, before the file size.
+    for (DWORD i = 0; i < segment_count; ++i) {
+      if (segments[i].Offset >= file_size) {
+        segment_count = i;
+        break;
+      }
+      if (segments[i].Offset + segments[i].Length > file_size) {
+        segments[i].Length =
+            static_cast<DWORD>(file_size - segments[i].Offset);
+      }
+    }
+    spdlog::info(L"\tPagingIo segment_count: {}", segment_count);
+  }
+
+  *number_of_bytes_written = f->write(segments, segment_count);
+
+  spdlog::info(L"\tSegmentCount {} offset: {} number_of_bytes_written: {}",
+               segment_count, segments[0].Offset, *number_of_bytes_written);
+  return STATUS_SUCCESS;
+}
+
 static NTSTATUS DOKAN_CALLBACK
 memfs_flushfilebuffers(LPCWSTR filename, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
@@ -419,6 +473,22 @@ memfs_getfileInformation(LPCWSTR filename, LPBY_HANDLE_FILE_INFORMATION buffer,
   return STATUS_SUCCESS;
 }
 
+// Fills findData with the information of the file node f listed as name.
+static void fill_find_data(const std::shared_ptr<filenode>& f,
+                           const std::wstring& name,
+                           WIN32_FIND_DATAW& findData) {
+  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
+  std::copy(name.begin(), name.end(), std::begin(findData.cFileName));
+  findData.cFileName[name.length()] = '\0';
+  findData.dwFileAttributes = f->attributes;
+  memfs_helper::LlongToFileTime(f->times.creation, findData.ftCreationTime);
+  memfs_helper::LlongToFileTime(f->times.lastaccess,
+                                findData.ftLastAccessTime);
+  memfs_helper::LlongToFileTime(f->times.lastwrite, findData.ftLastWriteTime);
+  memfs_helper::LlongToDwLowHigh(f->get_filesize(), findData.nFileSizeLow,
+                                 findData.nFileSizeHigh);
+}
+
 static NTSTATUS DOKAN_CALLBACK memfs_findfiles(LPCWSTR filename,
                                                PFillFindData fill_finddata,
                                                PDOKAN_FILE_INFO dokanfileinfo) {
@@ -427,28 +497,18 @@ static NTSTATUS DOKAN_CALLBACK memfs_findfiles(LPCWSTR filename,
   auto files = filenodes->list_folder(filename_str);
   WIN32_FIND_DATAW findData;
   spdlog::info(L"FindFiles: {}", filename_str);
-  ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
   for (const auto& f : files) {
     if (f->main_stream) continue; // Do not list File Streams
     const auto fileNodeName = memfs_helper::GetFileName(f->get_filename());
     if (fileNodeName.size() > MAX_PATH)
       continue;
-    std::copy(fileNodeName.begin(), fileNodeName.end(),
-              std::begin(findData.cFileName));
-    findData.cFileName[fileNodeName.length()] = '\0';
-    findData.dwFileAttributes = f->attributes;
-    memfs_helper::LlongToFileTime(f->times.creation, findData.ftCreationTime);
-    memfs_helper::LlongToFileTime(f->times.lastaccess,
-                                  findData.ftLastAccessTime);
-    memfs_helper::LlongToFileTime(f->times.lastwrite, findData.ftLastWriteTime);
-    auto file_size = f->get_filesize();
-    memfs_helper::LlongToDwLowHigh(file_size, findData.nFileSizeLow,
-                                   findData.nFileSizeHigh);
+    fill_find_data(f, fileNodeName, findData);
     spdlog::info(
         L"FindFiles: {} fileNode: {} Attributes: {} Times: Creation {} "
         L"LastAccess {} LastWrite {} FileSize {}",
         filename_str, fileNodeName, findData.dwFileAttributes,
-        f->times.creation, f->times.lastaccess, f->times.lastwrite, file_size);
+        f->times.creation, f->times.lastaccess, f->times.lastwrite,
+        f->get_filesize());
     fill_finddata(&findData, dokanfileinfo);
   }
   return STATUS_SUCCESS;
@@ -796,6 +856,32 @@ memfs_findstreams(LPCWSTR filename, PFillFindStreamData fill_findstreamdata,
   return STATUS_SUCCESS;
 }
 
+static NTSTATUS DOKAN_CALLBACK memfs_findfilesstream(
+    LPCWSTR pathname, LPCWSTR searchpattern, ULONG64 cookie,
+    PFillFindDataWithCookie fill_finddata, PDOKAN_FILE_INFO dokanfileinfo) {
+  UNREFERENCED_PARAMETER(searchpattern);
+  auto filenodes = GET_FS_INSTANCE;
+  auto pathname_str = std::wstring(pathname);
+  spdlog::info(L"FindFilesStream: {} Cookie: {}", pathname_str, cookie);
+  // The cookie is the fileindex following the last listed entry. The folder
+  // is ordered by fileindex, so that each query resumes with a lookup rather
+  // than by walking the entries already listed. Entries added during the
+  // listing have a higher fileindex and are listed at the end.
+  WIN32_FIND_DATAW findData;
+  filenodes->list_folder_from(
+      pathname_str, static_cast<LONGLONG>(cookie),
+      [&](const std::shared_ptr<filenode>& f) {
+        if (f->main_stream) return true;  // Do not list File Streams
+        auto fileNodeName = memfs_helper::GetFileName(f->get_filename());
+        if (fileNodeName.size() > MAX_PATH) return true;
+        fill_find_data(f, fileNodeName, findData);
+        // When the query buffer is full, the next query resumes from this
+        // entry.
+        return !fill_finddata(&findData, f->fileindex + 1, dokanfileinfo);
+      });
+  return STATUS_SUCCESS;
+}
+
 DOKAN_OPERATIONS memfs_operations = {memfs_createfile,
                                      memfs_cleanup,
                                      memfs_closeFile,
@@ -820,5 +906,8 @@ DOKAN_OPERATIONS memfs_operations = {memfs_createfile,
                                      memfs_unmounted,
                                      memfs_getfilesecurity,
                                      memfs_setfilesecurity,
-                                     memfs_findstreams};
+                                     memfs_findstreams,
+                                     memfs_readfilescatter,
+                                     memfs_writefilegather,
+                                     memfs_findfilesstream};
 }  // namespace memfs
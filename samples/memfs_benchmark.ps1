@@ -0,0 +1,197 @@
+param(
+    [Parameter(Mandatory=$false)][string] $Memfs = "..\x64\Release\memfs.exe",
+    [Parameter(Mandatory=$false)][string] $DokanDriverLetter = "M",
+    [Parameter(Mandatory=$false)][Array] $Benchmarks = @()
+)
+# Runs the memfs benchmarks, or only the ones named in $Benchmarks, and prints
+# their results. Each benchmark mounts memfs with the configurations it
+# compares. The numbers are only comparable between runs on the same machine.
+
+$destination = "$($DokanDriverLetter):"
+
+add-type -AssemblyName System.Windows.Forms
+
+function Start-Memfs {
+  param(
+	[Parameter(Position=0,Mandatory=1)][string] $arguments
+  )
+  $app = Start-Process -passthru $Memfs -ArgumentList "/l $DokanDriverLetter $arguments"
+  # When memfs finished mounting, Test-Path will return success.
+  $count = 20;
+  while (!(Test-Path "$($destination)\") -and ($count -ne 0)) { Start-Sleep -m 250; $count -= 1 }
+  if ($count -eq 0) {
+	throw ("Impossible to mount for arguments $arguments")
+  }
+  return $app
+}
+
+function Stop-Memfs {
+  param(
+	[Parameter(Position=0,Mandatory=1)] $app
+  )
+  [System.Windows.Forms.SendKeys]::SendWait("^{c}")
+  $app.WaitForExit()
+}
+
+# Runs $script with $arguments on $count runspaces at the same time.
+function Start-Parallel {
+  param(
+	[Parameter(Position=0,Mandatory=1)][int] $count,
+	[Parameter(Position=1,Mandatory=1)][scriptblock] $script,
+	[Parameter(Position=2,Mandatory=0)][Array] $arguments = @()
+  )
+  $jobs = @()
+  for ($i = 0; $i -lt $count; $i++) {
+	$ps = [PowerShell]::Create().AddScript($script)
+	foreach ($argument in $arguments) { $ps = $ps.AddArgument($argument) }
+	$ps = $ps.AddArgument($i)
+	$jobs += @{ "PowerShell" = $ps; "Handle" = $ps.BeginInvoke() }
+  }
+  return $jobs
+}
+
+# Waits for the jobs of Start-Parallel and returns their output.
+function Wait-Parallel {
+  param(
+	[Parameter(Position=0,Mandatory=1)][Array] $jobs
+  )
+  $output = @()
+  foreach ($job in $jobs) {
+	$output += $job.PowerShell.EndInvoke($job.Handle)
+	$job.PowerShell.Dispose()
+  }
+  return $output
+}
+
+# Formats the p50, p99, p99.9 and max of Stopwatch tick samples in us.
+function Format-Latencies {
+  param(
+	[Parameter(Position=0,Mandatory=1)][Array] $samples
+  )
+  $sorted = $samples | Sort-Object
+  $toUs = 1000000.0 / [System.Diagnostics.Stopwatch]::Frequency
+  $at = { param($q) [math]::Round($sorted[[math]::Min($sorted.Count - 1, [int]($sorted.Count * $q))] * $toUs, 1) }
+  return ("{0} ops p50 {1}us p99 {2}us p99.9 {3}us max {4}us" -f $sorted.Count,
+	(& $at 0.5), (& $at 0.99), (& $at 0.999), [math]::Round($sorted[-1] * $toUs, 1))
+}
+
+# Latency of metadata operations while reads saturate the mount. Without
+# MaxBulkDispatchCount the reads take every pool thread and a GetFileAttributes
+# waits behind them.
+function Benchmark-ReadFloodLatency {
+  $readers = 16
+  $durationSeconds = 10
+  $configs = @(
+	@{ "Name" = "unlimited"; "MemFSArguments" = "/s" },
+	@{ "Name" = "maxBulk4"; "MemFSArguments" = "/s /q 4" }
+  )
+  foreach ($config in $configs) {
+	$app = Start-Memfs $config.MemFSArguments
+	$file = "$($destination)\flood.bin"
+	$fs = [System.IO.File]::Create($file)
+	$buffer = New-Object byte[] 1MB
+	for ($i = 0; $i -lt 64; $i++) { $fs.Write($buffer, 0, $buffer.Length) }
+	$fs.Dispose()
+	Set-Content "$($destination)\small.txt" "small"
+
+	$until = [DateTime]::UtcNow.AddSeconds($durationSeconds)
+	$jobs = Start-Parallel $readers {
+	  param($file, $until)
+	  $buffer = New-Object byte[] 1MB
+	  while ([DateTime]::UtcNow -lt $until) {
+		# FILE_FLAG_NO_BUFFERING, so that every read reaches memfs.
+		$fs = New-Object System.IO.FileStream($file, "Open", "Read", "ReadWrite", 1, [System.IO.FileOptions]0x20000000)
+		while ($fs.Read($buffer, 0, $buffer.Length) -gt 0) { }
+		$fs.Dispose()
+	  }
+	} @($file, $until)
+
+	# Let the readers fill the pool before measuring.
+	Start-Sleep -s 1
+	$samples = New-Object System.Collections.Generic.List[long]
+	$stopwatch = New-Object System.Diagnostics.Stopwatch
+	while ([DateTime]::UtcNow -lt $until.AddSeconds(-1)) {
+	  $stopwatch.Restart()
+	  [System.IO.File]::GetAttributes("$($destination)\small.txt") | Out-Null
+	  $samples.Add($stopwatch.ElapsedTicks)
+	}
+	Wait-Parallel $jobs | Out-Null
+	Stop-Memfs $app
+	Write-Host ("{0}: GetFileAttributes under {1} readers, {2}" -f $config.Name, $readers, (Format-Latencies $samples.ToArray()))
+  }
+}
+
+# Events per second for pull buffer sizes from the smallest the driver accepts
+# to the largest. Each GetFileAttributes is a create, a query, a cleanup and a
+# close event.
+function Benchmark-PullBufferSize {
+  $workers = 16
+  $durationSeconds = 5
+  foreach ($size in @(32768, 131072, 1048576, 8388608)) {
+	$app = Start-Memfs "/s /p $size"
+	for ($i = 0; $i -lt 100; $i++) { Set-Content "$($destination)\file$i.txt" "file" }
+
+	$until = [DateTime]::UtcNow.AddSeconds($durationSeconds)
+	$jobs = Start-Parallel $workers {
+	  param($destination, $until, $worker)
+	  $count = 0
+	  while ([DateTime]::UtcNow -lt $until) {
+		[System.IO.File]::GetAttributes("$($destination)\file$(($worker + $count) % 100).txt") | Out-Null
+		$count++
+	  }
+	  return $count
+	} @($destination, $until)
+	$operations = (Wait-Parallel $jobs | Measure-Object -Sum).Sum
+	Stop-Memfs $app
+	Write-Host ("pull buffer {0} bytes: {1} events/s with {2} threads" -f $size,
+	  [math]::Round($operations * 4 / $durationSeconds), $workers)
+  }
+}
+
+# Throughput of 4KB appends, each reaching memfs, with and without a
+# write-behind buffer merging them. Every writer appends to its own file so
+# that the flushes of the other opens are looked up on each write.
+function Benchmark-WriteBehindAppend {
+  $writers = 4
+  $fileSize = 32MB
+  $configs = @(
+	@{ "Name" = "direct"; "MemFSArguments" = "" },
+	@{ "Name" = "writeBehind64K"; "MemFSArguments" = "/w 65536" }
+  )
+  foreach ($config in $configs) {
+	$app = Start-Memfs $config.MemFSArguments
+	$stopwatch = [System.Diagnostics.Stopwatch]::StartNew()
+	$jobs = Start-Parallel $writers {
+	  param($destination, $fileSize, $worker)
+	  $buffer = New-Object byte[] 4KB
+	  # FILE_FLAG_WRITE_THROUGH and FILE_FLAG_NO_BUFFERING, so that every
+	  # append reaches memfs instead of the cache manager.
+	  $fs = New-Object System.IO.FileStream("$($destination)\append$worker.bin", "Create", "Write", "None", 1,
+		([System.IO.FileOptions]::WriteThrough -bor [System.IO.FileOptions]0x20000000))
+	  for ($written = 0; $written -lt $fileSize; $written += $buffer.Length) {
+		$fs.Write($buffer, 0, $buffer.Length)
+	  }
+	  $fs.Dispose()
+	} @($destination, $fileSize)
+	Wait-Parallel $jobs | Out-Null
+	$stopwatch.Stop()
+	Stop-Memfs $app
+	$appends = $writers * $fileSize / 4KB
+	Write-Host ("{0}: {1} appends of 4KB by {2} writers, {3} MB/s, {4} appends/s" -f $config.Name,
+	  $appends, $writers,
+	  [math]::Round($writers * $fileSize / 1MB / $stopwatch.Elapsed.TotalSeconds, 1),
+	  [math]::Round($appends / $stopwatch.Elapsed.TotalSeconds))
+  }
+}
+
+$AllBenchmarks = [ordered]@{
+	"ReadFloodLatency" = ${function:Benchmark-ReadFloodLatency};
+	"PullBufferSize" = ${function:Benchmark-PullBufferSize};
+	"WriteBehindAppend" = ${function:Benchmark-WriteBehindAppend};
+}
+
+foreach ($name in $AllBenchmarks.Keys) {
+	if ($Benchmarks.Count -ne 0 -and !($Benchmarks -contains $name)) { continue }
+	Write-Host "== $name" -ForegroundColor Green
+	& $AllBenchmarks[$name]
+}
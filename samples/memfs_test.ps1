@@ -27,6 +27,46 @@ $Configs = @(
 		"MemFSArguments" = "/l $DokanDriverLetter";
 		"Destination" = "$($DokanDriverLetter):";
 		"Name" = "drive";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /o";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveOrderedDispatch";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /b 4194304";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveReadBuffer";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /r 1048576";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveReadAhead";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /w 65536";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveWriteBehind";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /a 1000";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveFileInfoCache";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /g 1000";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveNegativeLookupCache";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /k 1000";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveDirectoryListCache";
+	},
+	@{
+		"MemFSArguments" = "/l $DokanDriverLetter /f";
+		"Destination" = "$($DokanDriverLetter):";
+		"Name" = "driveFindFilesStream";
 	}
 )
 
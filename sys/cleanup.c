@@ -54,6 +54,15 @@ Return Value:
   fileObject = RequestContext->IrpSp->FileObject;
   DOKAN_LOG_FINE_IRP(RequestContext, "FileObject=%p", fileObject);
 
+  if (fileObject != NULL && RequestContext->Dcb != NULL &&
+      ReadPointerNoFence((PVOID *)&RequestContext->Dcb->ReadBufferFileObject) ==
+          fileObject) {
+    // The DLL registers its read buffer through the disk device or, for
+    // network mounts, through the volume device. Only the cleanup of the
+    // registering handle releases it.
+    DokanReleaseReadBuffer(RequestContext->Dcb, fileObject);
+  }
+
   // Cleanup must be success in any case
   if (fileObject == NULL || RequestContext->Vcb == NULL ||
       !DokanCheckCCB(RequestContext, fileObject->FsContext2)) {
@@ -290,6 +290,22 @@ typedef struct _DokanDiskControlBlock {
   // strictly one for each DeviceIoControl that the DLL issues to fetch a
   // request.
   BOOLEAN AllowIpcBatching;
+  // Length of the largest event, except writes, sent to the DLL, negotiated
+  // in EVENT_START. Requests with a larger event fail.
+  ULONG EventContextMaxLength;
+  // Length of the buffers the DLL pulls events with, at least
+  // EventContextMaxLength. Larger writes are requested by the DLL with
+  // FSCTL_EVENT_WRITE.
+  ULONG MaxPulledEventLength;
+
+  // EVENT_READ_BUFFER registered by the DLL, mapped in system space.
+  PMDL ReadBufferMdl;
+  PUCHAR ReadBuffer;
+  ULONG ReadBufferLength;
+  // Handle of the DLL that registered the read buffer. The buffer is released
+  // on its cleanup, once the copies protected by ReadBufferRundown are done.
+  PFILE_OBJECT ReadBufferFileObject;
+  EX_RUNDOWN_REF ReadBufferRundown;
 
   // How often to garbage-collect FCBs. If this is 0, we use the historical
   // default behavior of freeing them on the spot and in the current context
@@ -1024,6 +1040,14 @@ VOID DokanCompleteDirectoryControl(__in PREQUEST_CONTEXT RequestContext,
 VOID DokanCompleteRead(__in PREQUEST_CONTEXT RequestContext,
                        __in PEVENT_INFORMATION EventInfo);
 
+NTSTATUS
+DokanRegisterReadBuffer(__in PREQUEST_CONTEXT RequestContext);
+
+// Unlocks the read buffer registered by FileObject, or by any handle when
+// FileObject is NULL. Another handle can register a buffer afterwards.
+VOID DokanReleaseReadBuffer(__in PDokanDCB Dcb,
+                            __in_opt PFILE_OBJECT FileObject);
+
 VOID DokanCompleteWrite(__in PREQUEST_CONTEXT RequestContext,
                         __in PEVENT_INFORMATION EventInfo);
 
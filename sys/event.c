@@ -292,7 +292,7 @@ DokanRegisterPendingIrp(__in PREQUEST_CONTEXT RequestContext,
   // large buffer that will request userland to allocate a specific buffer size
   // that match it.
   if (RequestContext->IrpSp->MajorFunction != IRP_MJ_WRITE &&
-      EventContext->Length > EVENT_CONTEXT_MAX_SIZE) {
+      EventContext->Length > RequestContext->Dcb->EventContextMaxLength) {
     InterlockedIncrement64((LONG64*)&RequestContext->Vcb->VolumeMetrics
                                .LargeIRPRegistrationCanceled);
     status = DokanLogError(&logger, STATUS_INVALID_PARAMETER,
@@ -413,6 +413,11 @@ GetEventInfoSize(__in ULONG MajorFunction, __in PEVENT_INFORMATION EventInfo) {
     // is the "bytes written" value as opposed to the reply size.
     return sizeof(EVENT_INFORMATION);
   }
+  if (MajorFunction == IRP_MJ_READ &&
+      (EventInfo->Flags & DOKAN_EVENT_INFO_READ_BUFFER)) {
+    // The data is in the read buffer, BufferLength is the read length.
+    return sizeof(EVENT_INFORMATION);
+  }
   if (EventInfo->Status == STATUS_BUFFER_OVERFLOW) {
     // For buffer overflow replies, the BufferLength is the needed length and
     // not the used length. The caller needs to take precautions in case the
@@ -424,6 +429,16 @@ GetEventInfoSize(__in ULONG MajorFunction, __in PEVENT_INFORMATION EventInfo) {
                  (ULONG)EventInfo->BufferLength);
 }
 
+// Size of a reply in a batch whose IRP is no longer pending.
+ULONG GetUnmatchedEventInfoSize(__in PEVENT_INFORMATION EventInfo) {
+  if (EventInfo->Flags & DOKAN_EVENT_INFO_FIXED_SIZE) {
+    return sizeof(EVENT_INFORMATION);
+  }
+  return max((ULONG)sizeof(EVENT_INFORMATION),
+             FIELD_OFFSET(EVENT_INFORMATION, Buffer[0]) +
+                 (ULONG)EventInfo->BufferLength);
+}
+
 // When user-mode file system application returns EventInformation,
 // search corresponding pending IRP and complete it
 NTSTATUS
@@ -478,6 +493,23 @@ DokanCompleteIrp(__in PREQUEST_CONTEXT RequestContext) {
       break;
     }
     lastSerialNumber = eventInfo->SerialNumber;
+    if (irpEntry->SerialNumber > eventInfo->SerialNumber &&
+        RequestContext->Dcb->AllowIpcBatching) {
+      // Pending IRPs are sorted by serial number so the IRP of this reply was
+      // canceled or timed out. Skip the reply and match the next one against
+      // the same IRP.
+      offset += GetUnmatchedEventInfoSize(eventInfo);
+      if (offset >= bufferLength) {
+        break;
+      }
+      if (offset + sizeof(EVENT_INFORMATION) > bufferLength) {
+        DokanLogInfo(&logger, L"Wrong input buffer length.");
+        badUsageByCaller = TRUE;
+        break;
+      }
+      nextEntry = thisEntry;
+      continue;
+    }
     if (irpEntry->SerialNumber != eventInfo->SerialNumber) {
       continue;
     }
@@ -555,6 +587,12 @@ DokanCompleteIrp(__in PREQUEST_CONTEXT RequestContext) {
       return STATUS_NO_SUCH_DEVICE;
     }
     irpEntry = CONTAINING_RECORD(listHead, IRP_ENTRY, ListEntry);
+    // Skip the replies of the IRPs that were canceled before being completed.
+    while (offset + sizeof(EVENT_INFORMATION) <= bufferLength &&
+           ((PEVENT_INFORMATION)(buffer + offset))->SerialNumber <
+               irpEntry->SerialNumber) {
+      offset += GetUnmatchedEventInfoSize((PEVENT_INFORMATION)(buffer + offset));
+    }
     if (offset >= bufferLength) {
       DokanLogInfo(&logger, L"Unexpected end of event info list.");
       irpEntry->RequestContext.Irp->IoStatus.Information = 0;
@@ -945,6 +983,17 @@ DokanEventStart(__in PREQUEST_CONTEXT RequestContext) {
       (eventStart->Flags & DOKAN_EVENT_DISPATCH_DRIVER_LOGS) != 0;
   dcb->AllowIpcBatching =
       (eventStart->Flags & DOKAN_EVENT_ALLOW_IPC_BATCHING) != 0;
+  // Negotiate the event sizes. The DLL must be able to pull the largest event
+  // it accepts.
+  dcb->EventContextMaxLength = eventStart->EventContextMaxLength
+                                   ? eventStart->EventContextMaxLength
+                                   : EVENT_CONTEXT_MAX_SIZE;
+  dcb->EventContextMaxLength =
+      min(max(dcb->EventContextMaxLength, EVENT_CONTEXT_MIN_SIZE),
+          EVENT_CONTEXT_MAX_SIZE_LIMIT);
+  dcb->MaxPulledEventLength =
+      min(max(eventStart->PullBufferLength, dcb->EventContextMaxLength),
+          DOKAN_PULL_BUFFER_MAX_LENGTH);
   isMountPointDriveLetter = IsMountPointDriveLetter(dcb->MountPoint);
 
   if (dcb->DispatchDriverLogs) {
@@ -1005,6 +1054,8 @@ DokanEventStart(__in PREQUEST_CONTEXT RequestContext) {
   driverInfo->MountId = RequestContext->DokanGlobal->MountId;
   driverInfo->Status = DOKAN_MOUNTED;
   driverInfo->DriverVersion = DOKAN_DRIVER_VERSION;
+  driverInfo->EventContextMaxLength = dcb->EventContextMaxLength;
+  driverInfo->PullBufferLength = dcb->MaxPulledEventLength;
 
   // SymbolicName is
   // \\DosDevices\\Global\\Volume{D6CC17C5-1734-4085-BCE7-964F1E9F5DE9}
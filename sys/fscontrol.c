@@ -577,6 +577,8 @@ DokanDiskUserFsRequest(__in PREQUEST_CONTEXT RequestContext) {
       return DokanEventRelease(&requestContext, requestContext.Vcb->DeviceObject);
     case FSCTL_EVENT_WRITE:
       return DokanEventWrite(&requestContext);
+    case FSCTL_EVENT_REGISTER_READ_BUFFER:
+      return DokanRegisterReadBuffer(&requestContext);
     case FSCTL_GET_VOLUME_METRICS:
       return DokanGetVolumeMetrics(&requestContext);
     case FSCTL_RESET_TIMEOUT:
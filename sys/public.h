@@ -28,9 +28,16 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <minwindef.h>
 #endif
 
-#define DOKAN_DRIVER_VERSION 0x0000190
+#define DOKAN_DRIVER_VERSION 0x0000193
 
+// Default size of the largest event, except writes, sent to the DLL. A mount
+// can negotiate another one in EVENT_START within the bounds below.
 #define EVENT_CONTEXT_MAX_SIZE (1024 * 32)
+#define EVENT_CONTEXT_MIN_SIZE (1024 * 4)
+#define EVENT_CONTEXT_MAX_SIZE_LIMIT (1024 * 1024)
+// Largest pull buffer a mount can negotiate. Pulls are buffered ioctls, each
+// of them allocates a system buffer of that size.
+#define DOKAN_PULL_BUFFER_MAX_LENGTH (1024 * 1024 * 8)
 // This is arbitrary. There isn't really an absolute max, but we marshal it in
 // a fixed-size buffer.
 #define VOLUME_SECURITY_DESCRIPTOR_MAX_SIZE (1024 * 16)
@@ -79,6 +86,10 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define FSCTL_EVENT_PROCESS_N_PULL                                                     \
   CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x812, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+// DeviceIoControl code to register the EVENT_READ_BUFFER of a mount.
+#define FSCTL_EVENT_REGISTER_READ_BUFFER                                       \
+  CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x813, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
 #define DRIVER_FUNC_INSTALL 0x01
 #define DRIVER_FUNC_REMOVE 0x02
 
@@ -371,6 +382,9 @@ typedef struct _EVENT_INFORMATION {
     } Create;
     struct {
       LARGE_INTEGER CurrentByteOffset;
+      // Offset of the data in the read buffer of the mount when the reply has
+      // DOKAN_EVENT_INFO_READ_BUFFER.
+      ULONG BufferOffset;
     } Read;
     struct {
       LARGE_INTEGER CurrentByteOffset;
@@ -391,6 +405,25 @@ typedef struct _EVENT_INFORMATION {
   UCHAR Buffer[DOKAN_EVENT_INFO_MIN_BUFFER_SIZE];
 } EVENT_INFORMATION, *PEVENT_INFORMATION;
 
+// EVENT_INFORMATION Flags
+// The reply has the size of EVENT_INFORMATION whatever its BufferLength, like
+// write replies. Lets the driver skip the reply of an IRP canceled while the
+// reply was in a batch.
+#define DOKAN_EVENT_INFO_FIXED_SIZE 1
+// The data of a read reply is in the read buffer of the mount instead of
+// Buffer. The reply also has DOKAN_EVENT_INFO_FIXED_SIZE.
+#define DOKAN_EVENT_INFO_READ_BUFFER 2
+
+// Memory of the DLL, locked by the driver until the handle that registered it
+// is closed, that read data can be written to directly. The driver copies
+// replies with DOKAN_EVENT_INFO_READ_BUFFER from it to the request buffer.
+typedef struct _EVENT_READ_BUFFER {
+  ULONG64 Address;
+  ULONG Length;
+} EVENT_READ_BUFFER, *PEVENT_READ_BUFFER;
+
+#define DOKAN_READ_BUFFER_MAX_LENGTH (1024 * 1024 * 64)
+
 // By default we pool EVENT_INFORMATION objects with a 4k buffer (1 page) as most read/writes are this size
 // or smaller
 #define DOKAN_EVENT_INFO_DEFAULT_SIZE                                          \
@@ -459,6 +492,10 @@ typedef struct _EVENT_DRIVER_INFO {
   ULONG MountId;
   WCHAR DeviceName[64];
   WCHAR ActualDriveLetter;
+  // Values of EVENT_START.EventContextMaxLength and PullBufferLength accepted
+  // by the driver. The DLL must pull events with buffers of PullBufferLength.
+  ULONG EventContextMaxLength;
+  ULONG PullBufferLength;
 } EVENT_DRIVER_INFO, *PEVENT_DRIVER_INFO;
 
 typedef struct _EVENT_START {
@@ -469,6 +506,13 @@ typedef struct _EVENT_START {
   WCHAR UNCName[64];
   ULONG IrpTimeout;
   ULONG FcbGarbageCollectionIntervalMs;
+  // Length of the buffers the DLL pulls events with. Writes whose event fits
+  // in it are pulled with their data instead of being requested separately
+  // with FSCTL_EVENT_WRITE. The driver raises it to EventContextMaxLength.
+  ULONG PullBufferLength;
+  // Length of the largest event, except writes, the DLL accepts. Requests
+  // with a larger event fail. 0 for EVENT_CONTEXT_MAX_SIZE.
+  ULONG EventContextMaxLength;
   ULONG VolumeSecurityDescriptorLength;
   CHAR VolumeSecurityDescriptor[VOLUME_SECURITY_DESCRIPTOR_MAX_SIZE];
 } EVENT_START, *PEVENT_START;
@@ -21,6 +21,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "dokan.h"
+#include "util/irp_buffer_helper.h"
 
 NTSTATUS
 DokanDispatchRead(__in PREQUEST_CONTEXT RequestContext)
@@ -250,6 +251,8 @@ VOID DokanCompleteRead(__in PREQUEST_CONTEXT RequestContext,
                        __in PEVENT_INFORMATION EventInfo) {
   ULONG bufferLen = 0;
   PVOID buffer = NULL;
+  PUCHAR readData = EventInfo->Buffer;
+  BOOLEAN readBufferAcquired = FALSE;
   PDokanCCB ccb;
   PFILE_OBJECT fileObject;
 
@@ -277,15 +280,35 @@ VOID DokanCompleteRead(__in PREQUEST_CONTEXT RequestContext,
   DOKAN_LOG_FINE_IRP(RequestContext, "BufferLen %lu, Event.BufferLen %lu", bufferLen,
                 EventInfo->BufferLength);
 
+  if (EventInfo->Flags & DOKAN_EVENT_INFO_READ_BUFFER) {
+    // The DLL wrote the data directly in its read buffer.
+    PDokanDCB dcb = RequestContext->Dcb;
+    readBufferAcquired = ExAcquireRundownProtection(&dcb->ReadBufferRundown);
+    PUCHAR readBuffer =
+        readBufferAcquired ? ReadPointerAcquire((PVOID *)&dcb->ReadBuffer)
+                           : NULL;
+    if (readBuffer == NULL ||
+        EventInfo->Operation.Read.BufferOffset > dcb->ReadBufferLength ||
+        EventInfo->BufferLength >
+            dcb->ReadBufferLength - EventInfo->Operation.Read.BufferOffset) {
+      DOKAN_LOG_FINE_IRP(RequestContext, "Invalid read buffer reply");
+      readData = NULL;
+    } else {
+      readData = readBuffer + EventInfo->Operation.Read.BufferOffset;
+    }
+  }
+
   // buffer is not specified or short of length
-  if (bufferLen == 0 || buffer == NULL || bufferLen < EventInfo->BufferLength) {
+  if (bufferLen == 0 || buffer == NULL || readData == NULL ||
+      bufferLen < EventInfo->BufferLength) {
 
     RequestContext->Irp->IoStatus.Information = 0;
     RequestContext->Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
 
   } else {
-    RtlZeroMemory(buffer, bufferLen);
-    RtlCopyMemory(buffer, EventInfo->Buffer, EventInfo->BufferLength);
+    RtlCopyMemory(buffer, readData, EventInfo->BufferLength);
+    RtlZeroMemory((PUCHAR)buffer + EventInfo->BufferLength,
+                  bufferLen - EventInfo->BufferLength);
 
     // read length which is actually read
     RequestContext->Irp->IoStatus.Information = EventInfo->BufferLength;
@@ -303,8 +326,105 @@ VOID DokanCompleteRead(__in PREQUEST_CONTEXT RequestContext,
     }
   }
 
+  if (readBufferAcquired) {
+    ExReleaseRundownProtection(&RequestContext->Dcb->ReadBufferRundown);
+  }
+
   if (RequestContext->Flags & DOKAN_MDL_ALLOCATED) {
     DokanFreeMdl(RequestContext->Irp);
     RequestContext->Flags &= ~DOKAN_MDL_ALLOCATED;
   }
 }
+
+NTSTATUS
+DokanRegisterReadBuffer(__in PREQUEST_CONTEXT RequestContext) {
+  PDokanDCB dcb = RequestContext->Dcb;
+  PFILE_OBJECT fileObject = RequestContext->IrpSp->FileObject;
+  PEVENT_READ_BUFFER readBuffer = NULL;
+  PMDL mdl = NULL;
+  PUCHAR systemAddress = NULL;
+  NTSTATUS status = STATUS_SUCCESS;
+  DOKAN_INIT_LOGGER(logger, RequestContext->DeviceObject->DriverObject, 0);
+
+  GET_IRP_BUFFER_OR_RETURN(RequestContext->Irp, readBuffer);
+  if (fileObject == NULL || readBuffer->Length == 0 ||
+      readBuffer->Length > DOKAN_READ_BUFFER_MAX_LENGTH ||
+      readBuffer->Address != (ULONG_PTR)readBuffer->Address) {
+    return DokanLogError(&logger, STATUS_INVALID_PARAMETER,
+                         L"Invalid read buffer registration.");
+  }
+  // A mount has a single read buffer, owned by the handle registering it.
+  if (InterlockedCompareExchangePointer(
+          (PVOID *)&dcb->ReadBufferFileObject, fileObject, NULL) != NULL) {
+    return DokanLogError(&logger, STATUS_INVALID_DEVICE_STATE,
+                         L"A read buffer is already registered.");
+  }
+
+  __try {
+    mdl = IoAllocateMdl((PVOID)(ULONG_PTR)readBuffer->Address,
+                        readBuffer->Length, FALSE, FALSE, NULL);
+    if (mdl == NULL) {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+      __leave;
+    }
+    __try {
+      MmProbeAndLockPages(mdl, RequestContext->Irp->RequestorMode,
+                          IoReadAccess);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+      status = GetExceptionCode();
+      IoFreeMdl(mdl);
+      mdl = NULL;
+      __leave;
+    }
+    systemAddress = MmGetSystemAddressForMdlSafe(
+        mdl, NormalPagePriority | MdlMappingNoExecute);
+    if (systemAddress == NULL) {
+      status = STATUS_INSUFFICIENT_RESOURCES;
+      MmUnlockPages(mdl);
+      IoFreeMdl(mdl);
+      mdl = NULL;
+      __leave;
+    }
+    dcb->ReadBufferMdl = mdl;
+    dcb->ReadBufferLength = readBuffer->Length;
+    InterlockedExchangePointer((PVOID *)&dcb->ReadBuffer, systemAddress);
+  } __finally {
+    if (!NT_SUCCESS(status)) {
+      InterlockedExchangePointer((PVOID *)&dcb->ReadBufferFileObject, NULL);
+    }
+  }
+  if (!NT_SUCCESS(status)) {
+    return DokanLogError(&logger, status, L"Failed to lock the read buffer.");
+  }
+  DOKAN_LOG_FINE_IRP(RequestContext, "Registered read buffer of %lu bytes",
+                     readBuffer->Length);
+  return STATUS_SUCCESS;
+}
+
+VOID DokanReleaseReadBuffer(__in PDokanDCB Dcb,
+                            __in_opt PFILE_OBJECT FileObject) {
+  PFILE_OBJECT owner;
+  PMDL mdl;
+  owner = ReadPointerAcquire((PVOID *)&Dcb->ReadBufferFileObject);
+  if (owner == NULL || (FileObject != NULL && owner != FileObject)) {
+    return;
+  }
+  // The cleanup of the handle and the unmount can both release the buffer,
+  // the one taking the MDL does.
+  mdl = InterlockedExchangePointer((PVOID *)&Dcb->ReadBufferMdl, NULL);
+  if (mdl == NULL) {
+    return;
+  }
+  // Waits for the copies in progress, later replies fail to acquire it. The
+  // pages must be unlocked before the DLL process address space goes away.
+  ExWaitForRundownProtectionRelease(&Dcb->ReadBufferRundown);
+  InterlockedExchangePointer((PVOID *)&Dcb->ReadBuffer, NULL);
+  // Also unmaps the system address.
+  MmUnlockPages(mdl);
+  IoFreeMdl(mdl);
+  Dcb->ReadBufferLength = 0;
+  // Another handle can now register a buffer, its replies acquire the
+  // rundown again.
+  ExReInitializeRundownProtection(&Dcb->ReadBufferRundown);
+  InterlockedExchangePointer((PVOID *)&Dcb->ReadBufferFileObject, NULL);
+}
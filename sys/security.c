@@ -219,10 +219,10 @@ DokanDispatchSetSecurity(__in PREQUEST_CONTEXT RequestContext) {
   eventLength =
       sizeof(EVENT_CONTEXT) + securityDescLength + fcb->FileName.Length + 3;
 
-  if (EVENT_CONTEXT_MAX_SIZE < eventLength) {
+  if (RequestContext->Dcb->EventContextMaxLength < eventLength) {
     // TODO: Handle this case like DispatchWrite.
     DOKAN_LOG_FINE_IRP(RequestContext, "SecurityDescriptor is too big: %d (limit %d)",
-                       eventLength, EVENT_CONTEXT_MAX_SIZE);
+                       eventLength, RequestContext->Dcb->EventContextMaxLength);
     return STATUS_INSUFFICIENT_RESOURCES;
   }
 
@@ -220,9 +220,9 @@ DokanDispatchWrite(__in PREQUEST_CONTEXT RequestContext) {
     RtlCopyMemory(eventContext->Operation.Write.FileName, fcb->FileName.Buffer,
                   fcb->FileName.Length);
 
-    // When eventlength is less than event notification buffer,
+    // When eventlength fits in the buffers the DLL pulls events with,
     // returns it to user-mode using pending event.
-    if (eventLength <= EVENT_CONTEXT_MAX_SIZE) {
+    if (eventLength <= RequestContext->Dcb->MaxPulledEventLength) {
 
       // EventContext is no longer needed, clear it
       RequestContext->Irp->Tail.Overlay.DriverContext[DRIVER_CONTEXT_EVENT] = 0;